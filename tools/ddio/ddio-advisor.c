@@ -0,0 +1,191 @@
+/*
+ * Does the I/O working set fit in the DDIO ways? Footprint and advice
+ *
+ * Copyright (c) 2020, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+// Compile command: gcc -O2 ddio-advisor.c ddio.c -o ddio-advisor
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+
+#include "ddio.h"
+
+static void
+usage(const char *prog)
+{
+	printf("Usage: %s [options]\n", prog);
+	printf("\nOptions:\n");
+	printf("  -d desc     : RX descriptors per queue, the NDESC of FromDPDKDevice (default: 4096)\n");
+	printf("  -q queues   : RX queues per port (NCORE) (default: 1)\n");
+	printf("  -p ports    : Ports on the socket (default: 1)\n");
+	printf("  -s size     : Packet size (default: 1500)\n");
+	printf("  -e bytes    : Bytes written back per descriptor (default: 16)\n");
+	printf("  -w ways     : DDIO ways (IOWAY), instead of the mask of the register\n");
+	printf("  -m mask     : Mask of the register (0xC8B), instead of reading it\n");
+	printf("  -f percent  : Share of the DDIO ways the footprint may take (default: 100)\n");
+	printf("  -c core     : A core of the NIC's socket (default: 0)\n");
+	printf("  -r root     : sysfs CPU tree to read instead of CPUID (default: %s)\n",
+	       DDIO_SYSFS_CPU);
+	printf("  -v          : Explain the results on stderr\n");
+	printf("  -o file     : Write results to file instead of stdout\n");
+	printf("\nExample:\n");
+	printf("  sudo %s -d 4096 -q 4 -s 1500\n", prog);
+	printf("  %s -d $NDESC -q $NCORE -s $GEN_PKT_SIZE -w $IOWAY\n", prog);
+}
+
+static void
+print_size(FILE *f, uint64_t x)
+{
+	if (x >= 10 << 20)
+		fprintf(f, "%.1f MB", x / 1048576.0);
+	else
+		fprintf(f, "%.0f KB", x / 1024.0);
+}
+
+int main(int argc, char *argv[])
+{
+	struct ddio_io io = { 4096, 1, 1, 1500, 16 };
+	struct ddio_io best;
+	struct ddio_llc llc;
+	const char *outfile = NULL, *root = NULL;
+	uint64_t mask = 0, way, capacity, footprint, per_queue;
+	unsigned int ways = 0, need, max_queues;
+	double fill = 100, ratio;
+	int opt, cpu = 0, verbose = 0, have_mask = 0;
+	FILE *out = stdout;
+
+	while ((opt = getopt(argc, argv, "d:q:p:s:e:w:m:f:c:r:vo:h")) != -1) {
+		switch (opt) {
+		case 'd':
+			io.ndesc = strtoul(optarg, NULL, 0);
+			break;
+		case 'q':
+			io.queues = strtoul(optarg, NULL, 0);
+			break;
+		case 'p':
+			io.ports = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			io.pkt_size = strtoul(optarg, NULL, 0);
+			break;
+		case 'e':
+			io.desc_size = strtoul(optarg, NULL, 0);
+			break;
+		case 'w':
+			ways = strtoul(optarg, NULL, 0);
+			break;
+		case 'm':
+			mask = strtoull(optarg, NULL, 0);
+			have_mask = 1;
+			break;
+		case 'f':
+			fill = atof(optarg);
+			break;
+		case 'c':
+			cpu = atoi(optarg);
+			break;
+		case 'r':
+			root = optarg;
+			break;
+		case 'v':
+			verbose = 1;
+			break;
+		case 'o':
+			outfile = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+	if (!io.ndesc || !io.queues || !io.ports || !io.pkt_size || fill <= 0) {
+		printf("Bad ring configuration!\n");
+		return 1;
+	}
+	if (ddio_llc_read(&llc, root, cpu)) {
+		printf("Cannot find the LLC of core %d!\n", cpu);
+		return 1;
+	}
+	if (ways) {
+		mask = ddio_mask_of_ways(ways, llc.ways);
+	} else if (!have_mask && ddio_mask_read(cpu, &mask)) {
+		/* The default of Skylake-SP and Haswell/Broadwell: the two top ways */
+		mask = ddio_mask_of_ways(2, llc.ways);
+		fprintf(stderr, "Assuming the default of 2 DDIO ways (0x%" PRIx64 ")\n", mask);
+	}
+	mask &= ddio_mask_of_ways(llc.ways, llc.ways);
+	if (!mask) {
+		printf("DDIO has no ways!\n");
+		return 1;
+	}
+
+	way = llc.size / llc.ways;
+	capacity = way * ddio_mask_ways(mask) * fill / 100;
+	footprint = ddio_io_footprint(&io);
+	/* Ways whose -f share holds the footprint, rounded up */
+	ratio = footprint * 100.0 / (way * fill);
+	need = ratio;
+	need += need < ratio;
+	/* The largest power of 2 of descriptors per queue that fits, 0 if not even 1 */
+	best = io;
+	for (best.ndesc = 1u << 16; best.ndesc && ddio_io_footprint(&best) > capacity; best.ndesc >>= 1)
+		;
+	/* Queues of the other ports count too */
+	per_queue = footprint / io.queues;
+	max_queues = capacity / per_queue;
+
+	if (outfile) {
+		out = fopen(outfile, "w");
+		if (!out) {
+			perror(outfile);
+			return 1;
+		}
+	}
+	fprintf(out, "RESULT-LLC-SIZE %" PRIu64 "\n", llc.size);
+	fprintf(out, "RESULT-LLC-WAYS %u\n", llc.ways);
+	fprintf(out, "RESULT-DDIO-MASK %" PRIu64 "\n", mask);
+	fprintf(out, "RESULT-DDIO-WAYS %u\n", ddio_mask_ways(mask));
+	fprintf(out, "RESULT-DDIO-CAPACITY %" PRIu64 "\n", capacity);
+	fprintf(out, "RESULT-IO-FOOTPRINT %" PRIu64 "\n", footprint);
+	fprintf(out, "RESULT-IO-FIT %f\n", (double)footprint / capacity);
+	fprintf(out, "RESULT-MAX-NDESC %u\n", best.ndesc);
+	fprintf(out, "RESULT-MIN-IOWAYS %u\n", need);
+	fprintf(out, "RESULT-MAX-QUEUES %u\n", max_queues);
+	if (out != stdout)
+		fclose(out);
+
+	if (!verbose)
+		return 0;
+	fprintf(stderr, "LLC (%s): ", llc.source);
+	print_size(stderr, llc.size);
+	fprintf(stderr, ", %u ways of ", llc.ways);
+	print_size(stderr, way);
+	fprintf(stderr, "\nDDIO: mask 0x%" PRIx64 ", %u ways, ", mask, ddio_mask_ways(mask));
+	print_size(stderr, capacity);
+	fprintf(stderr, fill < 100 ? " (%.0f%% of them)\n" : "\n", fill);
+	fprintf(stderr, "I/O: %u port(s) x %u queue(s) x %u descriptors x %u-byte packets = ",
+	        io.ports, io.queues, io.ndesc, io.pkt_size);
+	print_size(stderr, footprint);
+	fprintf(stderr, " (%.0f%% of DDIO)\n", 100.0 * footprint / capacity);
+	if (footprint <= capacity) {
+		fprintf(stderr, "Fits: DMA writes should find their lines in the DDIO ways.\n");
+		return 0;
+	}
+	fprintf(stderr, "Leaky DMA: packets will be evicted before the cores read them. Either\n");
+	if (best.ndesc)
+		fprintf(stderr, "  - use at most %u descriptors per queue,\n", best.ndesc);
+	if (need <= llc.ways)
+		fprintf(stderr, "  - give DDIO %u ways (IOWAY=%u, mask 0x%" PRIx64 "),\n", need, need,
+		        ddio_mask_of_ways(need, llc.ways));
+	else
+		fprintf(stderr, "  - (the footprint exceeds the whole LLC, no way count helps)\n");
+	if (max_queues)
+		fprintf(stderr, "  - or use at most %u queue(s) per port.\n", max_queues);
+	else
+		fprintf(stderr, "  - (even one queue per port does not fit)\n");
+	return 0;
+}
@@ -0,0 +1,470 @@
+/*
+ * Auto-tuning of IOWAY, NDESC, NCORE, bursts, ... by Bayesian optimization
+ *
+ * Copyright (c) 2020, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+// Compile command: gcc -O2 ddio-autotune.c gp.c -o ddio-autotune -lm
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "gp.h"
+
+#define MAX_VALUES	64
+#define MAX_CANDIDATES	20000
+#define VALUE_LEN	32
+
+struct param {
+	char name[VALUE_LEN];
+	char value[MAX_VALUES][VALUE_LEN];
+	unsigned int n;
+};
+
+struct obs {
+	unsigned long idx;		/* in the grid */
+	double y, c;			/* objective and constraint, NAN if missing */
+	double acq;			/* of the proposal, NAN for the initial ones */
+};
+
+static struct param params[GP_MAX_DIMS];
+static unsigned int nparams;
+
+static void
+usage(const char *prog)
+{
+	printf("Usage: %s [options] -x command\n", prog);
+	printf("\nOptions:\n");
+	printf("  -x command  : Experiment; gets the parameters as environment variables and\n");
+	printf("                prints RESULT-<name> <value> lines\n");
+	printf("  -P param    : NAME=v1,v2,... or NAME=lo-hi[:step], up to %d of them\n", GP_MAX_DIMS);
+	printf("  -y name     : Result to maximize (default: THROUGHPUT)\n");
+	printf("  -M          : Minimize it instead\n");
+	printf("  -l slo      : Constraint on a result, NAME<=value or NAME>=value, e.g., LAT99<=50\n");
+	printf("  -n runs     : Most configurations to run (default: 30)\n");
+	printf("  -i runs     : Random configurations before the model proposes any (default: 5)\n");
+	printf("  -r runs     : Runs of every configuration, averaged (default: 1)\n");
+	printf("  -e percent  : Negligible expected improvement, of the best, or of the\n");
+	printf("                deviation of the results when the best is 0 (default: 1)\n");
+	printf("  -p count    : Stop after that many negligible proposals in a row (default: 3)\n");
+	printf("  -S seed     : Of the random configurations (default: 1)\n");
+	printf("  -T file     : Write every run as CSV\n");
+	printf("  -o file     : Write results to file instead of stdout\n");
+	printf("\nExample:\n");
+	printf("  %s -P NCORE=1,2,4,8 -P NINBURST=8,16,32,64 -P NDESC=512,1024,2048,4096 \\\n", prog);
+	printf("      -l 'LAT99<=1000' -x '../emu/ddio-vnic -q $NCORE -b $NINBURST -d $NDESC -s 1500 -t 5'\n");
+	printf("  %s -P IOWAY=2-11 -P NCORE=1-8 -l 'LAT99<=50' -r 3 -x ./experiment.sh\n", prog);
+}
+
+/* "IOWAY=2,4,6" or "IOWAY=2-11" or "NDESC=256-4096:256" */
+static int
+parse_param(const char *arg, struct param *p)
+{
+	char copy[256], *eq, *tok, *save;
+	long lo, hi, step;
+
+	snprintf(copy, sizeof(copy), "%s", arg);
+	eq = strchr(copy, '=');
+	if (!eq || eq == copy || eq - copy >= VALUE_LEN)
+		return -1;
+	*eq = '\0';
+	memcpy(p->name, copy, eq - copy + 1);
+	p->n = 0;
+	if (sscanf(eq + 1, "%ld-%ld", &lo, &hi) == 2 && !strchr(eq + 1, ',')) {
+		const char *colon = strchr(eq + 1, ':');
+
+		step = colon ? atol(colon + 1) : 1;
+		if (step <= 0 || hi < lo)
+			return -1;
+		for (; lo <= hi; lo += step) {
+			if (p->n == MAX_VALUES)
+				return -1;
+			snprintf(p->value[p->n++], VALUE_LEN, "%ld", lo);
+		}
+		return 0;
+	}
+	for (tok = strtok_r(eq + 1, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+		if (p->n == MAX_VALUES || strlen(tok) >= VALUE_LEN)
+			return -1;
+		snprintf(p->value[p->n++], VALUE_LEN, "%s", tok);
+	}
+	return p->n ? 0 : -1;
+}
+
+/* Every parameter in [0,1], by the rank of its value */
+static void
+coords(unsigned long idx, double *x)
+{
+	unsigned int i;
+
+	for (i = 0; i < nparams; i++) {
+		unsigned int v = idx % params[i].n;
+
+		x[i] = params[i].n > 1 ? (double)v / (params[i].n - 1) : 0;
+		idx /= params[i].n;
+	}
+}
+
+static const char *
+value_of(unsigned long idx, unsigned int i)
+{
+	unsigned int k;
+
+	for (k = 0; k < i; k++)
+		idx /= params[k].n;
+	return params[i].value[idx % params[i].n];
+}
+
+static void
+print_config(FILE *f, unsigned long idx, const char *sep)
+{
+	unsigned int i;
+
+	for (i = 0; i < nparams; i++)
+		fprintf(f, "%s%s=%s", i ? sep : "", params[i].name, value_of(idx, i));
+}
+
+/* "RESULT-<name> <value>" anywhere in the output */
+static int
+parse_result(const char *line, const char *name, double *x)
+{
+	size_t len = strlen(name);
+	const char *p = strstr(line, "RESULT-");
+
+	if (!p || strncmp(p + 7, name, len) || (p[7 + len] != ' ' && p[7 + len] != '\t'))
+		return -1;
+	*x = atof(p + 7 + len);
+	return 0;
+}
+
+/* The averages of reps runs of the experiment; y or c NAN if one lacks it */
+static void
+run(const char *cmd, unsigned long idx, unsigned int reps, const char *yname, const char *cname,
+    double *y, double *c)
+{
+	char line[1024];
+	unsigned int i, r, ny = 0, nc = 0;
+	double sy = 0, sc = 0, x;
+
+	for (i = 0; i < nparams; i++)
+		setenv(params[i].name, value_of(idx, i), 1);
+	for (r = 0; r < reps; r++) {
+		FILE *p = popen(cmd, "r");
+		int gy = 0, gc = 0;
+
+		if (!p) {
+			perror("popen");
+			break;
+		}
+		while (fgets(line, sizeof(line), p)) {
+			if (!gy && !parse_result(line, yname, &x)) {
+				sy += x;
+				gy = 1;
+			}
+			if (cname && !gc && !parse_result(line, cname, &x)) {
+				sc += x;
+				gc = 1;
+			}
+		}
+		if (pclose(p))
+			fprintf(stderr, "The experiment failed\n");
+		ny += gy;
+		nc += gc;
+	}
+	*y = ny == reps ? sy / reps : NAN;
+	*c = cname && nc == reps ? sc / reps : NAN;
+}
+
+static int
+feasible(const struct obs *o, const char *cname, int le, double slo)
+{
+	if (isnan(o->y))
+		return 0;
+	if (!cname)
+		return 1;
+	return !isnan(o->c) && (le ? o->c <= slo : o->c >= slo);
+}
+
+/*
+ * The k-th of n initial configurations: every parameter goes through its
+ * values in a random order of n strata (a Latin hypercube), so that the
+ * first runs already cover the range of every parameter.
+ */
+static unsigned long
+initial(unsigned int k, unsigned int n, unsigned int (*perm)[GP_MAX_OBS])
+{
+	unsigned long idx = 0, scale = 1;
+	unsigned int i;
+
+	for (i = 0; i < nparams; i++) {
+		unsigned int lo = perm[i][k] * params[i].n / n, hi = (perm[i][k] + 1) * params[i].n / n;
+		unsigned int v = lo + (hi > lo ? rand() % (hi - lo) : 0);
+
+		idx += scale * (v < params[i].n ? v : params[i].n - 1);
+		scale *= params[i].n;
+	}
+	return idx;
+}
+
+static int
+evaluated(const struct obs *o, unsigned int n, unsigned long idx)
+{
+	unsigned int i;
+
+	for (i = 0; i < n; i++)
+		if (o[i].idx == idx)
+			return 1;
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	static struct obs obs[GP_MAX_OBS];
+	static double x[GP_MAX_OBS][GP_MAX_DIMS];
+	static unsigned int perm[GP_MAX_DIMS][GP_MAX_OBS];
+	double y[GP_MAX_OBS], c[GP_MAX_OBS], slo = 0, eps = 1, sign = 1;
+	const char *cmd = NULL, *yname = "THROUGHPUT", *outfile = NULL, *tracefile = NULL;
+	char cname[VALUE_LEN] = "";
+	unsigned int max_runs = 30, ninit = 5, reps = 1, patience = 3, quiet = 0;
+	unsigned int n = 0, i, best = GP_MAX_OBS;
+	unsigned long grid = 1;
+	unsigned int seed = 1;
+	int opt, le = 1;
+	FILE *out = stdout, *trace = NULL;
+	struct gp gy, gc;
+
+	while ((opt = getopt(argc, argv, "x:P:y:Ml:n:i:r:e:p:S:T:o:h")) != -1) {
+		switch (opt) {
+		case 'x':
+			cmd = optarg;
+			break;
+		case 'P':
+			if (nparams == GP_MAX_DIMS || parse_param(optarg, &params[nparams])) {
+				printf("Bad parameter %s!\n", optarg);
+				return 1;
+			}
+			nparams++;
+			break;
+		case 'y':
+			yname = optarg;
+			break;
+		case 'M':
+			sign = -1;
+			break;
+		case 'l': {
+			const char *op = strstr(optarg, "<=");
+
+			le = op != NULL;
+			if (!op)
+				op = strstr(optarg, ">=");
+			if (!op || op == optarg || op - optarg >= VALUE_LEN) {
+				printf("Bad constraint %s!\n", optarg);
+				return 1;
+			}
+			snprintf(cname, op - optarg + 1, "%s", optarg);
+			slo = atof(op + 2);
+			break;
+		}
+		case 'n':
+			max_runs = strtoul(optarg, NULL, 0);
+			break;
+		case 'i':
+			ninit = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			reps = strtoul(optarg, NULL, 0);
+			break;
+		case 'e':
+			eps = atof(optarg);
+			break;
+		case 'p':
+			patience = strtoul(optarg, NULL, 0);
+			break;
+		case 'S':
+			seed = strtoul(optarg, NULL, 0);
+			break;
+		case 'T':
+			tracefile = optarg;
+			break;
+		case 'o':
+			outfile = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+	if (!cmd || !nparams) {
+		usage(argv[0]);
+		return 1;
+	}
+	if (!reps || !max_runs) {
+		printf("Bad number of runs!\n");
+		return 1;
+	}
+	for (i = 0; i < nparams; i++)
+		grid *= params[i].n;
+	if (max_runs > grid)
+		max_runs = grid;
+	if (max_runs > GP_MAX_OBS)
+		max_runs = GP_MAX_OBS;
+	if (ninit < 2)
+		ninit = 2;
+	if (ninit > max_runs)
+		ninit = max_runs;
+	if (tracefile) {
+		trace = fopen(tracefile, "w");
+		if (!trace) {
+			perror(tracefile);
+			return 1;
+		}
+		fprintf(trace, "run");
+		for (i = 0; i < nparams; i++)
+			fprintf(trace, ",%s", params[i].name);
+		fprintf(trace, ",%s,%s,feasible,acquisition\n", yname, cname[0] ? cname : "constraint");
+	}
+	memset(&gy, 0, sizeof(gy));
+	memset(&gc, 0, sizeof(gc));
+	srand(seed);
+	for (i = 0; i < nparams; i++) {
+		unsigned int k, j, t;
+
+		for (k = 0; k < ninit; k++)
+			perm[i][k] = k;
+		for (k = ninit; k-- > 1;) {
+			j = rand() % (k + 1);
+			t = perm[i][k];
+			perm[i][k] = perm[i][j];
+			perm[i][j] = t;
+		}
+	}
+	fprintf(stderr, "%lu configurations, at most %u runs\n", grid, max_runs);
+
+	while (n < max_runs) {
+		struct obs *o = &obs[n];
+		unsigned long idx, k, ncand;
+		double acq = NAN, incumbent = 0;
+		unsigned int m = 0;
+
+		/* The model needs a few points, at least one of them feasible */
+		if (n >= ninit) {
+			for (i = 0; i < n; i++) {
+				if (isnan(obs[i].y) || (cname[0] && isnan(obs[i].c)))
+					continue;
+				coords(obs[i].idx, x[m]);
+				y[m] = sign * obs[i].y;
+				c[m] = obs[i].c;
+				m++;
+			}
+			if (m < 2 || gp_fit(&gy, (const double (*)[GP_MAX_DIMS])x, y, m, nparams) ||
+			    (cname[0] && gp_fit(&gc, (const double (*)[GP_MAX_DIMS])x, c, m, nparams)))
+				m = 0;
+		}
+		if (best < GP_MAX_OBS)
+			incumbent = sign * obs[best].y;
+
+		if (!m) {
+			idx = n < ninit ? initial(n, ninit, perm) : grid;
+			while (idx == grid || evaluated(obs, n, idx))
+				idx = ((unsigned long)rand() * RAND_MAX + rand()) % grid;
+		} else {
+			/*
+			 * Expected improvement over the best feasible configuration,
+			 * weighted by the probability of meeting the constraint;
+			 * only that probability while none meets it.
+			 */
+			ncand = grid <= MAX_CANDIDATES ? grid : MAX_CANDIDATES;
+			idx = grid;
+			for (k = 0; k < ncand; k++) {
+				unsigned long cand = grid <= MAX_CANDIDATES ? k :
+				                     ((unsigned long)rand() * RAND_MAX + rand()) % grid;
+				double xc[GP_MAX_DIMS], mu, sd, a, pf = 1;
+
+				if (evaluated(obs, n, cand))
+					continue;
+				coords(cand, xc);
+				if (cname[0]) {
+					gp_predict(&gc, xc, &mu, &sd);
+					pf = gp_cdf(le ? (slo - mu) / sd : (mu - slo) / sd);
+				}
+				if (best < GP_MAX_OBS) {
+					gp_predict(&gy, xc, &mu, &sd);
+					a = gp_ei(mu, sd, incumbent) * pf;
+				} else {
+					a = pf;
+				}
+				if (idx == grid || a > acq) {
+					acq = a;
+					idx = cand;
+				}
+			}
+			if (idx == grid)
+				break;
+			/* Of the spread of the outputs when the best is 0 */
+			if (best < GP_MAX_OBS &&
+			    acq < eps / 100 * (incumbent ? fabs(incumbent) : gy.sd)) {
+				if (++quiet >= patience) {
+					fprintf(stderr, "Negligible expected improvement (%g), stopping\n", acq);
+					break;
+				}
+			} else {
+				quiet = 0;
+			}
+		}
+
+		o->idx = idx;
+		o->acq = acq;
+		fprintf(stderr, "[%u/%u] ", n + 1, max_runs);
+		print_config(stderr, idx, " ");
+		run(cmd, idx, reps, yname, cname[0] ? cname : NULL, &o->y, &o->c);
+		fprintf(stderr, ": %s %g", yname, o->y);
+		if (cname[0])
+			fprintf(stderr, ", %s %g", cname, o->c);
+		if (!isnan(acq))
+			fprintf(stderr, " (acquisition %g)", acq);
+		fprintf(stderr, "\n");
+		if (feasible(o, cname[0] ? cname : NULL, le, slo) &&
+		    (best == GP_MAX_OBS || sign * o->y > sign * obs[best].y))
+			best = n;
+		if (trace) {
+			fprintf(trace, "%u", n + 1);
+			for (i = 0; i < nparams; i++)
+				fprintf(trace, ",%s", value_of(idx, i));
+			fprintf(trace, ",%f,%f,%d,%g\n", o->y, o->c,
+			        feasible(o, cname[0] ? cname : NULL, le, slo), acq);
+		}
+		n++;
+	}
+	gp_free(&gy);
+	gp_free(&gc);
+	if (trace)
+		fclose(trace);
+
+	if (outfile) {
+		out = fopen(outfile, "w");
+		if (!out) {
+			perror(outfile);
+			return 1;
+		}
+	}
+	fprintf(out, "RESULT-TUNE-GRID %lu\n", grid);
+	fprintf(out, "RESULT-TUNE-RUNS %u\n", n);
+	if (best < GP_MAX_OBS) {
+		fprintf(out, "RESULT-TUNE-BEST %f\n", obs[best].y);
+		if (cname[0])
+			fprintf(out, "RESULT-TUNE-BEST-%s %f\n", cname, obs[best].c);
+		for (i = 0; i < nparams; i++)
+			fprintf(out, "RESULT-TUNE-%s %s\n", params[i].name, value_of(obs[best].idx, i));
+		fprintf(stderr, "Best after %u runs: ", n);
+		print_config(stderr, obs[best].idx, " ");
+		fprintf(stderr, ", %s %g\n", yname, obs[best].y);
+	} else {
+		fprintf(stderr, "No configuration met the constraint\n");
+	}
+	if (out != stdout)
+		fclose(out);
+	return best < GP_MAX_OBS ? 0 : 1;
+}
@@ -0,0 +1,455 @@
+/*
+ * Adapting the DDIO ways to the load, and the CAT ways of the cores around them
+ *
+ * Copyright (c) 2020, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+// Compile command: gcc -O2 ddio-ctl.c ddio.c ../pmu/pmu.c ../resctrl/resctrl.c -o ddio-ctl -lm
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ddio.h"
+#include "../pmu/pmu.h"
+#include "../pmu/iio.h"
+#include "../resctrl/resctrl.h"
+
+#define MAX_GROUPS	16
+#define MAX_BACKOFF	32
+
+static volatile sig_atomic_t stop;
+
+static void
+on_signal(int sig)
+{
+	(void)sig;
+	stop = 1;
+}
+
+enum action {
+	KEEP,
+	GROW,
+	SHRINK,
+	REVERT,			/* a shrink that made the misses go above the high mark */
+	IDLE,			/* too little I/O to tell */
+};
+
+static const char *action_names[] = { "keep", "grow", "shrink", "revert", "idle" };
+
+struct ctl {
+	/* Configuration */
+	int cpu, socket;
+	int dry;			/* only measure */
+	int no_msr;			/* the register is not accessed (mock) */
+	unsigned int llc_ways, min_ways, max_ways;
+	double hi, lo;			/* ItoM miss rate (%) that grows or shrinks DDIO */
+	double idle_bps;		/* inbound writes below which nothing changes */
+	double alpha;			/* of the moving averages */
+	uint64_t hold_ns;		/* after a change, before the next one */
+
+	/* CAT of the cores */
+	struct resctrl rc;
+	int ngroups;
+	const char *group[MAX_GROUPS];
+	struct resctrl_schema orig[MAX_GROUPS];
+
+	/* State */
+	uint64_t orig_mask;
+	unsigned int ways;
+	double miss, bps;		/* moving averages */
+	uint64_t t_change;
+	unsigned int backoff;		/* the hold of shrinks is multiplied by this */
+	int probing;			/* the last change was a shrink, not yet confirmed */
+};
+
+/* The CAT mask of a group, without the DDIO ways but never empty */
+static uint64_t
+cores_mask(const struct ctl *c, uint64_t orig, uint64_t ddio)
+{
+	uint64_t m = orig & ~ddio;
+
+	if (m)
+		return m;
+	/* The way right below DDIO, or the group's own ways when DDIO has them all */
+	return c->ways < c->llc_ways ? 1ull << (c->llc_ways - c->ways - 1) : orig;
+}
+
+static int
+set_cat(struct ctl *c, uint64_t ddio)
+{
+	int g, d;
+
+	if (c->dry)
+		return 0;
+	for (g = 0; g < c->ngroups; g++) {
+		struct resctrl_schema want;
+
+		resctrl_schema_init(&want);
+		for (d = 0; d < c->orig[g].nl3; d++)
+			if (c->orig[g].l3_id[d] == c->socket)
+				resctrl_schema_set_l3(&want, c->socket,
+				                      cores_mask(c, c->orig[g].l3[d], ddio));
+		if (resctrl_schema_apply(&c->rc, c->group[g], &want, NULL) < 0)
+			return -1;
+	}
+	return 0;
+}
+
+/*
+ * When DDIO grows, the cores leave the ways first; when it shrinks, DDIO
+ * leaves them first. So the two never share a way, even for a moment.
+ */
+static int
+set_ways(struct ctl *c, unsigned int ways)
+{
+	uint64_t mask = ddio_mask_of_ways(ways, c->llc_ways);
+	int grow = ways > c->ways;
+
+	c->ways = ways;
+	if (grow && set_cat(c, mask))
+		return -1;
+	if (!c->dry && !c->no_msr && ddio_mask_write(c->cpu, mask))
+		return -1;
+	if (!grow && set_cat(c, mask))
+		return -1;
+	return 0;
+}
+
+static enum action
+decide(struct ctl *c, uint64_t now)
+{
+	uint64_t hold = c->hold_ns;
+
+	if (c->bps < c->idle_bps)
+		return IDLE;
+	/* A shrink that pushed the misses up is undone at once, and tried less often */
+	if (c->probing && c->miss > c->hi && c->ways < c->max_ways) {
+		c->probing = 0;
+		if (c->backoff < MAX_BACKOFF)
+			c->backoff *= 2;
+		return REVERT;
+	}
+	if (now - c->t_change < hold)
+		return KEEP;
+	if (c->probing) {
+		c->probing = 0;
+		c->backoff = 1;
+	}
+	if (c->miss > c->hi && c->ways < c->max_ways)
+		return GROW;
+	if (c->miss < c->lo && c->ways > c->min_ways && now - c->t_change >= hold * c->backoff)
+		return SHRINK;
+	return KEEP;
+}
+
+static double
+delta(struct pmu_sched *s, int i, uint64_t *last)
+{
+	uint64_t d = s->ev[i].count - *last;
+
+	*last = s->ev[i].count;
+	return d * s->ev[i].scale;
+}
+
+static void
+usage(const char *prog)
+{
+	printf("Usage: %s [options]\n", prog);
+	printf("\nOptions:\n");
+	printf("  -s socket   : CPU socket of the NIC (default: 0)\n");
+	printf("  -c core     : A core of that socket, to access the register (default: 0)\n");
+	printf("  -w min-max  : Range of DDIO ways (default: 1-<LLC ways - 1>, all of them with -n or -G)\n");
+	printf("  -u percent  : ItoM miss rate above which DDIO grows by a way (default: 20)\n");
+	printf("  -l percent  : ItoM miss rate below which DDIO shrinks by a way (default: 5)\n");
+	printf("  -b gbps     : Inbound writes below which the ways are left alone (default: 1)\n");
+	printf("  -i ms       : Sampling interval in milliseconds (default: 10)\n");
+	printf("  -H ms       : Time after a change before the next one (default: 100)\n");
+	printf("  -a alpha    : Weight of the last sample in the moving averages (default: 0.5)\n");
+	printf("  -g group    : resctrl group of the cores, kept off the DDIO ways (repeatable,\n");
+	printf("                default: the default group)\n");
+	printf("  -G          : Leave CAT alone\n");
+	printf("  -R path     : resctrl root (default: %s)\n", RESCTRL_ROOT);
+	printf("  -r path     : sysfs event_source directory (default: %s)\n", PMU_SYSFS_ROOT);
+	printf("  -t seconds  : Duration (default: until SIGINT/SIGTERM)\n");
+	printf("  -K          : Keep the last ways at exit, instead of restoring the initial ones\n");
+	printf("  -n          : Only measure, never change the ways or CAT (e.g., a static baseline)\n");
+	printf("  -m          : Use the mock PMU backend and leave the register alone (and CAT,\n");
+	printf("                unless -R is given)\n");
+	printf("  -T file     : Write the decisions as CSV (time, ways, miss rate, Gbps, action)\n");
+	printf("  -o file     : Write results to file instead of stdout\n");
+	printf("\nExample:\n");
+	printf("  sudo %s -s 0 -c 0 -w 2-8 -T ctl.csv -o ctl.log\n", prog);
+	printf("  %s -m -t 5 -R /tmp/resctrl -T /dev/stderr\n", prog);
+}
+
+int main(int argc, char *argv[])
+{
+	struct ctl c = {
+		.hi = 20, .lo = 5, .idle_bps = 1e9 / 8, .alpha = 0.5,
+		.hold_ns = 100000000, .backoff = 1,
+	};
+	struct pmu_sched sched;
+	struct pmu_backend *be;
+	struct ddio_llc llc;
+	struct timespec next;
+	const char *pmu_root = NULL, *rc_root = NULL, *outfile = NULL, *tracefile = NULL;
+	unsigned int interval_ms = 10, min = 1, max = 0, top, changes[5] = { 0 };
+	uint64_t last[3] = { 0 }, t0, t_last, now;
+	double duration = 0, hit_sum = 0, miss_sum = 0, bytes_sum = 0, way_ns = 0;
+	unsigned int ways_min, ways_max;
+	int opt, i, mock = 0, no_cat = 0, keep = 0, ret = 0, ev[3];
+	FILE *out = stdout, *trace = NULL;
+
+	while ((opt = getopt(argc, argv, "s:c:w:u:l:b:i:H:a:g:GR:r:t:KnmT:o:h")) != -1) {
+		switch (opt) {
+		case 's':
+			c.socket = atoi(optarg);
+			break;
+		case 'c':
+			c.cpu = atoi(optarg);
+			break;
+		case 'w':
+			if (sscanf(optarg, "%u-%u", &min, &max) != 2) {
+				printf("Bad range of ways %s!\n", optarg);
+				return 1;
+			}
+			break;
+		case 'u':
+			c.hi = atof(optarg);
+			break;
+		case 'l':
+			c.lo = atof(optarg);
+			break;
+		case 'b':
+			c.idle_bps = atof(optarg) * 1e9 / 8;
+			break;
+		case 'i':
+			interval_ms = strtoul(optarg, NULL, 0);
+			break;
+		case 'H':
+			c.hold_ns = atof(optarg) * 1e6;
+			break;
+		case 'a':
+			c.alpha = atof(optarg);
+			break;
+		case 'g':
+			if (c.ngroups == MAX_GROUPS) {
+				printf("Too many groups!\n");
+				return 1;
+			}
+			c.group[c.ngroups++] = optarg;
+			break;
+		case 'G':
+			no_cat = 1;
+			break;
+		case 'R':
+			rc_root = optarg;
+			break;
+		case 'r':
+			pmu_root = optarg;
+			break;
+		case 't':
+			duration = atof(optarg);
+			break;
+		case 'K':
+			keep = 1;
+			break;
+		case 'n':
+			c.dry = 1;
+			break;
+		case 'm':
+			mock = c.no_msr = 1;
+			break;
+		case 'T':
+			tracefile = optarg;
+			break;
+		case 'o':
+			outfile = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+	if (c.lo >= c.hi || c.alpha <= 0 || c.alpha > 1 || !interval_ms) {
+		printf("Bad controller configuration!\n");
+		return 1;
+	}
+
+	if (ddio_llc_read(&llc, NULL, c.cpu)) {
+		printf("Cannot find the LLC of core %d!\n", c.cpu);
+		return 1;
+	}
+	c.llc_ways = llc.ways;
+	if (no_cat || (mock && !rc_root)) {
+		c.ngroups = 0;
+	} else {
+		if (!c.ngroups)
+			c.group[c.ngroups++] = NULL;
+		if (!rc_root && access(RESCTRL_ROOT "/schemata", F_OK) && resctrl_mount(RESCTRL_ROOT))
+			return 1;
+		if (resctrl_open(&c.rc, rc_root))
+			return 1;
+		for (i = 0; i < c.ngroups; i++) {
+			if (resctrl_schema_read(&c.rc, c.group[i], &c.orig[i])) {
+				printf("Cannot read the schemata of group %s!\n",
+				       c.group[i] ? c.group[i] : "(default)");
+				return 1;
+			}
+		}
+	}
+
+	/* All the ways only when no CAT group needs one below DDIO (cores_mask) */
+	top = c.dry || !c.ngroups ? llc.ways : llc.ways - 1;
+	c.min_ways = min ? min : 1;
+	c.max_ways = max && max <= top ? max : top;
+	if (c.min_ways > c.max_ways) {
+		printf("Bad range of ways %u-%u!\n", c.min_ways, c.max_ways);
+		return 1;
+	}
+	if (c.no_msr)
+		c.orig_mask = ddio_mask_of_ways(2, llc.ways);
+	else if (ddio_mask_read(c.cpu, &c.orig_mask))
+		return 1;
+	c.ways = ddio_mask_ways(c.orig_mask);
+	if (c.ways < c.min_ways || c.ways > c.max_ways)
+		c.ways = c.ways < c.min_ways ? c.min_ways : c.max_ways;
+
+	be = mock ? pmu_mock_backend(getpid()) : pmu_perf_backend(pmu_root);
+	if (!be) {
+		printf("Could not create the %s backend!\n", mock ? "mock" : "perf");
+		return 1;
+	}
+	pmu_sched_init(&sched, be, c.socket, 4, interval_ms);
+	ev[0] = pmu_sched_add_preset(&sched, "ItoM-HIT");
+	ev[1] = pmu_sched_add_preset(&sched, "ItoM-MISS");
+	ev[2] = pmu_sched_add(&sched, "IB-WR", "uncore_iio", IIO_IB_WRITE ",ch_mask=0xf",
+	                      IIO_BYTES_PER_COUNT);
+	if (ev[0] < 0 || ev[1] < 0 || ev[2] < 0)
+		return 1;
+	if (pmu_sched_build(&sched) != 1) {
+		printf("The events do not fit in the counters at once!\n");
+		return 1;
+	}
+
+	if (outfile) {
+		out = fopen(outfile, "w");
+		if (!out) {
+			perror(outfile);
+			return 1;
+		}
+	}
+	if (tracefile) {
+		trace = fopen(tracefile, "w");
+		if (!trace) {
+			perror(tracefile);
+			return 1;
+		}
+		fprintf(trace, "time,ways,miss_rate,gbps,action\n");
+	}
+
+	/* Start from a consistent state: the DDIO ways, and the cores off them */
+	if (set_ways(&c, c.ways)) {
+		printf("Could not set the ways!\n");
+		return 1;
+	}
+	fprintf(stderr, "DDIO: %u of %u ways (0x%" PRIx64 "), between %u and %u; %d CAT group(s)%s\n",
+	        c.ways, c.llc_ways, ddio_mask_of_ways(c.ways, c.llc_ways), c.min_ways,
+	        c.max_ways, c.ngroups, c.dry ? " (measuring only)" : c.no_msr ? " (register untouched)" : "");
+
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+	if (pmu_sched_start(&sched)) {
+		printf("Could not start the counters!\n");
+		return 1;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	t0 = t_last = c.t_change = pmu_now_ns();
+	ways_min = ways_max = c.ways;
+	while (!stop) {
+		double hit, miss, bytes, dt, rate;
+		enum action a;
+
+		next.tv_nsec += interval_ms * 1000000L;
+		while (next.tv_nsec >= 1000000000L) {
+			next.tv_nsec -= 1000000000L;
+			next.tv_sec++;
+		}
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+		if (pmu_sched_rotate(&sched))
+			break;
+		now = pmu_now_ns();
+		dt = (now - t_last) / 1e9;
+		way_ns += (double)c.ways * (now - t_last);
+		t_last = now;
+
+		hit = delta(&sched, ev[0], &last[0]);
+		miss = delta(&sched, ev[1], &last[1]);
+		bytes = delta(&sched, ev[2], &last[2]);
+		hit_sum += hit;
+		miss_sum += miss;
+		bytes_sum += bytes;
+		rate = hit + miss > 0 ? 100 * miss / (hit + miss) : 0;
+		if (now - t0 <= interval_ms * 1000000ull) {
+			c.miss = rate;
+			c.bps = bytes / dt;
+		} else {
+			c.miss += c.alpha * (rate - c.miss);
+			c.bps += c.alpha * (bytes / dt - c.bps);
+		}
+
+		a = c.dry ? KEEP : decide(&c, now);
+		if (a == GROW || a == REVERT || a == SHRINK) {
+			if (set_ways(&c, a == SHRINK ? c.ways - 1 : c.ways + 1)) {
+				ret = 1;
+				break;
+			}
+			c.t_change = now;
+			c.probing = a == SHRINK;
+			if (c.ways < ways_min)
+				ways_min = c.ways;
+			if (c.ways > ways_max)
+				ways_max = c.ways;
+		}
+		changes[a]++;
+		if (trace)
+			fprintf(trace, "%.3f,%u,%.2f,%.3f,%s\n", (now - t0) / 1e9, c.ways, c.miss,
+			        c.bps * 8 / 1e9, action_names[a]);
+		if (duration && now - t0 >= duration * 1e9)
+			break;
+	}
+	pmu_sched_stop(&sched);
+	now = pmu_now_ns();
+	way_ns += (double)c.ways * (now - t_last);
+
+	if (!keep && set_ways(&c, ddio_mask_ways(c.orig_mask)))
+		ret = 1;
+	for (i = 0; !keep && !c.dry && i < c.ngroups; i++)
+		if (resctrl_schema_apply(&c.rc, c.group[i], &c.orig[i], NULL) < 0)
+			ret = 1;
+
+	fprintf(out, "RESULT-CTL-IOWAY-AVG %f\n", now > t0 ? way_ns / (now - t0) : c.ways);
+	fprintf(out, "RESULT-CTL-IOWAY-MIN %u\n", ways_min);
+	fprintf(out, "RESULT-CTL-IOWAY-MAX %u\n", ways_max);
+	fprintf(out, "RESULT-CTL-CHANGES %u\n", changes[GROW] + changes[SHRINK] + changes[REVERT]);
+	fprintf(out, "RESULT-CTL-GROWS %u\n", changes[GROW]);
+	fprintf(out, "RESULT-CTL-SHRINKS %u\n", changes[SHRINK]);
+	fprintf(out, "RESULT-CTL-REVERTS %u\n", changes[REVERT]);
+	fprintf(out, "RESULT-CTL-ItoM-MISS-RATE %f\n",
+	        hit_sum + miss_sum > 0 ? 100 * miss_sum / (hit_sum + miss_sum) : 0);
+	fprintf(out, "RESULT-CTL-IB-WR-BW %f\n", now > t0 ? bytes_sum / ((now - t0) / 1e9) : 0);
+
+	if (trace)
+		fclose(trace);
+	if (out != stdout)
+		fclose(out);
+	pmu_sched_close(&sched);
+	be->destroy(be);
+	return ret;
+}
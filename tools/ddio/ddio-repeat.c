@@ -0,0 +1,342 @@
+/*
+ * Repeats an experiment until the confidence intervals of its results are narrow
+ *
+ * Copyright (c) 2020, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+// Compile command: gcc -O2 ddio-repeat.c -o ddio-repeat -lm
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+#define MAX_METRICS	64
+#define MAX_RUNS	1000
+#define NAME_LEN	64
+
+struct metric {
+	char name[NAME_LEN];
+	double x[MAX_RUNS];		/* NAN if a run lacks it */
+	double mean, ci;		/* ci: half-width */
+	unsigned int n;			/* runs in mean and ci */
+	unsigned int outliers;
+};
+
+static struct metric metrics[MAX_METRICS];
+static unsigned int nmetrics;
+static int fixed;			/* metrics of -y only */
+
+/* Two-sided quantiles of Student's t for 1 to 30 degrees of freedom */
+static const double t90[30] = {
+	6.314, 2.920, 2.353, 2.132, 2.015, 1.943, 1.895, 1.860, 1.833, 1.812,
+	1.796, 1.782, 1.771, 1.761, 1.753, 1.746, 1.740, 1.734, 1.729, 1.725,
+	1.721, 1.717, 1.714, 1.711, 1.708, 1.706, 1.703, 1.701, 1.699, 1.697,
+};
+static const double t95[30] = {
+	12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+	2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+	2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042,
+};
+static const double t99[30] = {
+	63.657, 9.925, 5.841, 4.604, 4.032, 3.707, 3.499, 3.355, 3.250, 3.169,
+	3.106, 3.055, 3.012, 2.977, 2.947, 2.921, 2.898, 2.878, 2.861, 2.845,
+	2.831, 2.819, 2.807, 2.797, 2.787, 2.779, 2.771, 2.763, 2.756, 2.750,
+};
+
+static void
+usage(const char *prog)
+{
+	printf("Usage: %s [options] -x command\n", prog);
+	printf("\nOptions:\n");
+	printf("  -x command  : Experiment; prints RESULT-<name> <value> lines\n");
+	printf("  -y name     : Result whose interval decides, repeatable (default: all of them)\n");
+	printf("  -w percent  : Target width of the confidence intervals, of the mean (default: 5)\n");
+	printf("  -c level    : Confidence level: 90, 95, or 99 (default: 95)\n");
+	printf("  -m runs     : Fewest runs (default: 3)\n");
+	printf("  -n runs     : Most runs, the n_runs of the testies (default: 10)\n");
+	printf("  -z score    : Modified z-score of an outlier (default: 3.5)\n");
+	printf("  -X          : Leave the outliers out of the means and intervals\n");
+	printf("  -T file     : Write every run as CSV\n");
+	printf("  -o file     : Write results to file instead of stdout\n");
+	printf("\nExample:\n");
+	printf("  %s -y THROUGHPUT -y LAT99 -w 2 -n 30 -x '../emu/ddio-vnic -q 4 -s 1500 -t 5'\n", prog);
+}
+
+static struct metric *
+find(const char *name, int add)
+{
+	unsigned int i;
+
+	for (i = 0; i < nmetrics; i++)
+		if (!strcmp(metrics[i].name, name))
+			return &metrics[i];
+	if (!add || nmetrics == MAX_METRICS || strlen(name) >= NAME_LEN)
+		return NULL;
+	snprintf(metrics[nmetrics].name, NAME_LEN, "%s", name);
+	for (i = 0; i < MAX_RUNS; i++)
+		metrics[nmetrics].x[i] = NAN;
+	return &metrics[nmetrics++];
+}
+
+/* The RESULT- lines of run r; -1 if the command cannot run */
+static int
+run(const char *cmd, unsigned int r)
+{
+	char line[1024], name[NAME_LEN];
+	double x;
+	FILE *p = popen(cmd, "r");
+
+	if (!p) {
+		perror("popen");
+		return -1;
+	}
+	while (fgets(line, sizeof(line), p)) {
+		const char *s = strstr(line, "RESULT-");
+		struct metric *m;
+
+		if (!s || sscanf(s + 7, "%63s %lf", name, &x) != 2)
+			continue;
+		/* Every metric of the first run, unless -y chose them */
+		m = find(name, !fixed && r == 0);
+		if (m && isnan(m->x[r]))
+			m->x[r] = x;
+	}
+	if (pclose(p))
+		fprintf(stderr, "Run %u failed\n", r + 1);
+	return 0;
+}
+
+static int
+cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static double
+median(double *x, unsigned int n)
+{
+	qsort(x, n, sizeof(*x), cmp_double);
+	return n % 2 ? x[n / 2] : (x[n / 2 - 1] + x[n / 2]) / 2;
+}
+
+/*
+ * Outliers by the modified z-score of Iglewicz and Hoaglin, from the
+ * median and the median absolute deviation, which outliers hardly move;
+ * from the mean absolute deviation when most runs have the same value.
+ */
+static void
+flag(const struct metric *m, unsigned int runs, double zmax, char *out)
+{
+	double v[MAX_RUNS], med, mad, scale = 0;
+	unsigned int r, n = 0;
+
+	for (r = 0; r < runs; r++)
+		if (!isnan(m->x[r]))
+			v[n++] = m->x[r];
+	memset(out, 0, runs);
+	if (n < 3)
+		return;
+	med = median(v, n);
+	for (r = 0; r < n; r++)
+		v[r] = fabs(v[r] - med);
+	for (r = 0; r < n; r++)
+		scale += v[r] / n;
+	mad = median(v, n);
+	scale = mad > 0 ? mad / 0.6745 : 1.253314 * scale;
+	if (scale <= 0)
+		return;
+	for (r = 0; r < runs; r++)
+		if (!isnan(m->x[r]) && fabs(m->x[r] - med) / scale > zmax)
+			out[r] = 1;
+}
+
+static void
+stats(struct metric *m, unsigned int runs, const double *t, double zmax, int exclude)
+{
+	char outlier[MAX_RUNS];
+	double sum = 0, var = 0;
+	unsigned int r;
+
+	flag(m, runs, zmax, outlier);
+	m->n = m->outliers = 0;
+	for (r = 0; r < runs; r++) {
+		if (isnan(m->x[r]))
+			continue;
+		m->outliers += outlier[r];
+		if (exclude && outlier[r])
+			continue;
+		sum += m->x[r];
+		m->n++;
+	}
+	m->mean = m->n ? sum / m->n : NAN;
+	for (r = 0; r < runs; r++)
+		if (!isnan(m->x[r]) && !(exclude && outlier[r]))
+			var += (m->x[r] - m->mean) * (m->x[r] - m->mean);
+	if (m->n < 2) {
+		m->ci = INFINITY;
+		return;
+	}
+	var /= m->n - 1;
+	m->ci = (m->n - 1 <= 30 ? t[m->n - 2] : t == t90 ? 1.645 : t == t95 ? 1.960 : 2.576) *
+	        sqrt(var / m->n);
+}
+
+/* The interval is narrow enough, relative to the mean */
+static int
+converged(const struct metric *m, double width)
+{
+	if (m->n < 2)
+		return 0;
+	if (m->mean == 0)
+		return m->ci == 0;
+	return 2 * m->ci <= width / 100 * fabs(m->mean);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *cmd = NULL, *outfile = NULL, *tracefile = NULL;
+	unsigned int min_runs = 3, max_runs = 10, runs = 0, i, r;
+	double width = 5, zmax = 3.5;
+	const double *t = t95;
+	int opt, exclude = 0, done = 0;
+	FILE *out = stdout;
+
+	while ((opt = getopt(argc, argv, "x:y:w:c:m:n:z:XT:o:h")) != -1) {
+		switch (opt) {
+		case 'x':
+			cmd = optarg;
+			break;
+		case 'y':
+			if (!find(optarg, 1)) {
+				printf("Bad result %s!\n", optarg);
+				return 1;
+			}
+			fixed = 1;
+			break;
+		case 'w':
+			width = atof(optarg);
+			break;
+		case 'c':
+			if (atoi(optarg) == 90) {
+				t = t90;
+			} else if (atoi(optarg) == 95) {
+				t = t95;
+			} else if (atoi(optarg) == 99) {
+				t = t99;
+			} else {
+				printf("Unsupported confidence level %s!\n", optarg);
+				return 1;
+			}
+			break;
+		case 'm':
+			min_runs = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			max_runs = strtoul(optarg, NULL, 0);
+			break;
+		case 'z':
+			zmax = atof(optarg);
+			break;
+		case 'X':
+			exclude = 1;
+			break;
+		case 'T':
+			tracefile = optarg;
+			break;
+		case 'o':
+			outfile = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+	if (!cmd) {
+		usage(argv[0]);
+		return 1;
+	}
+	if (max_runs > MAX_RUNS)
+		max_runs = MAX_RUNS;
+	if (min_runs < 2)
+		min_runs = 2;
+	if (!max_runs || min_runs > max_runs) {
+		printf("Bad number of runs!\n");
+		return 1;
+	}
+
+	while (runs < max_runs && !done) {
+		if (run(cmd, runs))
+			return 1;
+		runs++;
+		if (!nmetrics) {
+			printf("The experiment printed no results!\n");
+			return 1;
+		}
+		done = runs >= min_runs;
+		for (i = 0; i < nmetrics; i++) {
+			stats(&metrics[i], runs, t, zmax, exclude);
+			done &= converged(&metrics[i], width);
+		}
+		fprintf(stderr, "[%u/%u]", runs, max_runs);
+		for (i = 0; i < nmetrics && i < 4; i++)
+			fprintf(stderr, " %s %g +- %g", metrics[i].name, metrics[i].mean, metrics[i].ci);
+		fprintf(stderr, "%s\n", nmetrics > 4 ? " ..." : "");
+	}
+
+	for (i = 0; i < nmetrics; i++) {
+		char outlier[MAX_RUNS];
+
+		flag(&metrics[i], runs, zmax, outlier);
+		for (r = 0; r < runs; r++)
+			if (outlier[r])
+				fprintf(stderr, "Run %u is an outlier of %s: %g\n", r + 1, metrics[i].name,
+				        metrics[i].x[r]);
+		if (!converged(&metrics[i], width))
+			fprintf(stderr, "%s did not converge: %g +- %g after %u runs\n", metrics[i].name,
+			        metrics[i].mean, metrics[i].ci, runs);
+	}
+	if (tracefile) {
+		FILE *f = fopen(tracefile, "w");
+
+		if (!f) {
+			perror(tracefile);
+			return 1;
+		}
+		fprintf(f, "run");
+		for (i = 0; i < nmetrics; i++)
+			fprintf(f, ",%s", metrics[i].name);
+		fprintf(f, "\n");
+		for (r = 0; r < runs; r++) {
+			fprintf(f, "%u", r + 1);
+			for (i = 0; i < nmetrics; i++)
+				fprintf(f, ",%f", metrics[i].x[r]);
+			fprintf(f, "\n");
+		}
+		fclose(f);
+	}
+
+	if (outfile) {
+		out = fopen(outfile, "w");
+		if (!out) {
+			perror(outfile);
+			return 1;
+		}
+	}
+	fprintf(out, "RESULT-RUNS %u\n", runs);
+	fprintf(out, "RESULT-CONVERGED %d\n", done);
+	for (i = 0; i < nmetrics; i++) {
+		const struct metric *m = &metrics[i];
+
+		fprintf(out, "RESULT-%s %f\n", m->name, m->mean);
+		fprintf(out, "RESULT-%s-CI %f\n", m->name, m->ci);
+		fprintf(out, "RESULT-%s-RUNS %u\n", m->name, m->n);
+		fprintf(out, "RESULT-%s-OUTLIERS %u\n", m->name, m->outliers);
+	}
+	if (out != stdout)
+		fclose(out);
+	return 0;
+}
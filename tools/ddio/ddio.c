@@ -0,0 +1,183 @@
+/*
+ * LLC geometry and the DDIO ways (IIO LLC WAYS register)
+ *
+ * Copyright (c) 2020, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <cpuid.h>
+
+#include "ddio.h"
+
+int
+ddio_llc_cpuid(struct ddio_llc *llc)
+{
+	unsigned int eax, ebx, ecx, edx, i;
+
+	if (__get_cpuid_max(0, NULL) < 4)
+		return -1;
+	for (i = 0; i < 16; i++) {
+		__cpuid_count(4, i, eax, ebx, ecx, edx);
+		if (!(eax & 0x1f))
+			break;
+		/* Unified (3) cache of level 3 */
+		if ((eax & 0x1f) != 3 || ((eax >> 5) & 0x7) != 3)
+			continue;
+		llc->ways = (ebx >> 22) + 1;
+		llc->partitions = ((ebx >> 12) & 0x3ff) + 1;
+		llc->line = (ebx & 0xfff) + 1;
+		llc->sets = ecx + 1;
+		llc->size = (uint64_t)llc->ways * llc->partitions * llc->line * llc->sets;
+		llc->source = "cpuid";
+		(void)edx;
+		return 0;
+	}
+	return -1;
+}
+
+static int
+read_sysfs(const char *dir, const char *file, char *buf, size_t len)
+{
+	char path[512];
+	FILE *f;
+	int ok;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, file);
+	f = fopen(path, "r");
+	if (!f)
+		return -1;
+	ok = fgets(buf, len, f) != NULL;
+	fclose(f);
+	buf[strcspn(buf, "\n")] = '\0';
+	return ok ? 0 : -1;
+}
+
+int
+ddio_llc_sysfs(struct ddio_llc *llc, const char *root, int cpu)
+{
+	char dir[512], buf[64];
+	unsigned int i;
+
+	for (i = 0; i < 16; i++) {
+		uint64_t size;
+		char unit = 0;
+
+		snprintf(dir, sizeof(dir), "%s/cpu%d/cache/index%u", root ? root : DDIO_SYSFS_CPU,
+		         cpu, i);
+		if (read_sysfs(dir, "level", buf, sizeof(buf)))
+			break;
+		if (atoi(buf) != 3)
+			continue;
+		if (read_sysfs(dir, "size", buf, sizeof(buf)) ||
+		    sscanf(buf, "%" SCNu64 "%c", &size, &unit) < 1)
+			return -1;
+		llc->size = size << (unit == 'K' ? 10 : unit == 'M' ? 20 : 0);
+		if (read_sysfs(dir, "ways_of_associativity", buf, sizeof(buf)))
+			return -1;
+		llc->ways = atoi(buf);
+		llc->line = read_sysfs(dir, "coherency_line_size", buf, sizeof(buf)) ?
+		            DDIO_LINE : (unsigned int)atoi(buf);
+		llc->sets = read_sysfs(dir, "number_of_sets", buf, sizeof(buf)) ?
+		            0 : (unsigned int)atoi(buf);
+		llc->partitions = 1;
+		llc->source = "sysfs";
+		return llc->ways && llc->size ? 0 : -1;
+	}
+	return -1;
+}
+
+int
+ddio_llc_read(struct ddio_llc *llc, const char *root, int cpu)
+{
+	cpu_set_t old, set;
+	int ret = -1;
+
+	memset(llc, 0, sizeof(*llc));
+	/* CPUID describes the core it runs on, and the file tree may be a copy */
+	if (!root && !sched_getaffinity(0, sizeof(old), &old)) {
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		if (!sched_setaffinity(0, sizeof(set), &set)) {
+			ret = ddio_llc_cpuid(llc);
+			sched_setaffinity(0, sizeof(old), &old);
+		}
+	}
+	if (ret)
+		ret = ddio_llc_sysfs(llc, root, cpu);
+	return ret;
+}
+
+static int
+msr_open(int cpu, int flags)
+{
+	char path[64];
+	int fd;
+
+	snprintf(path, sizeof(path), "/dev/cpu/%d/msr", cpu);
+	fd = open(path, flags);
+	if (fd < 0)
+		fprintf(stderr, "Cannot open %s: %s%s\n", path, strerror(errno),
+		        errno == ENOENT ? " (modprobe msr)" : "");
+	return fd;
+}
+
+int
+ddio_mask_read(int cpu, uint64_t *mask)
+{
+	int fd = msr_open(cpu, O_RDONLY);
+	ssize_t n;
+
+	if (fd < 0)
+		return -1;
+	n = pread(fd, mask, sizeof(*mask), DDIO_MSR_IIO_LLC_WAYS);
+	close(fd);
+	if (n != sizeof(*mask)) {
+		fprintf(stderr, "Cannot read MSR 0x%x\n", DDIO_MSR_IIO_LLC_WAYS);
+		return -1;
+	}
+	return 0;
+}
+
+int
+ddio_mask_write(int cpu, uint64_t mask)
+{
+	int fd = msr_open(cpu, O_WRONLY);
+	ssize_t n;
+
+	if (fd < 0)
+		return -1;
+	n = pwrite(fd, &mask, sizeof(mask), DDIO_MSR_IIO_LLC_WAYS);
+	close(fd);
+	if (n != sizeof(mask)) {
+		fprintf(stderr, "Cannot write MSR 0x%x\n", DDIO_MSR_IIO_LLC_WAYS);
+		return -1;
+	}
+	return 0;
+}
+
+uint64_t
+ddio_mask_of_ways(unsigned int n, unsigned int ways)
+{
+	if (n > ways)
+		n = ways;
+	if (!n)
+		return 0;
+	return (n >= 64 ? ~0ull : (1ull << n) - 1) << (ways - n);
+}
+
+uint64_t
+ddio_io_footprint(const struct ddio_io *io)
+{
+	uint64_t pkt = (io->pkt_size + DDIO_LINE - 1) / DDIO_LINE * DDIO_LINE;
+	uint64_t ring = ((uint64_t)io->ndesc * io->desc_size + DDIO_LINE - 1) / DDIO_LINE * DDIO_LINE;
+
+	return (uint64_t)io->ports * io->queues * (io->ndesc * pkt + ring);
+}
@@ -0,0 +1,61 @@
+/*
+ * LLC geometry and the DDIO ways (IIO LLC WAYS register)
+ *
+ * Copyright (c) 2020, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#ifndef DDIO_DDIO_H
+#define DDIO_DDIO_H
+
+#include <stdint.h>
+
+#define DDIO_MSR_IIO_LLC_WAYS	0xC8B
+#define DDIO_SYSFS_CPU		"/sys/devices/system/cpu"
+#define DDIO_LINE		64
+
+struct ddio_llc {
+	uint64_t size;			/* bytes, of one socket */
+	unsigned int ways, sets, line, partitions;
+	const char *source;		/* "cpuid" or "sysfs" */
+};
+
+/* CPUID leaf 4 on the calling core; -1 if it does not describe an L3 */
+int  ddio_llc_cpuid(struct ddio_llc *llc);
+
+/* <root>/cpu<cpu>/cache/index*, root NULL for DDIO_SYSFS_CPU */
+int  ddio_llc_sysfs(struct ddio_llc *llc, const char *root, int cpu);
+
+/* CPUID on cpu, or sysfs when CPUID has no L3 (e.g., in some VMs) */
+int  ddio_llc_read(struct ddio_llc *llc, const char *root, int cpu);
+
+/* Through /dev/cpu/<cpu>/msr: needs root and the msr module */
+int  ddio_mask_read(int cpu, uint64_t *mask);
+int  ddio_mask_write(int cpu, uint64_t mask);
+
+/* n ways at the top of the LLC, where the default ones (e.g., 0x600 of 11) are */
+uint64_t ddio_mask_of_ways(unsigned int n, unsigned int ways);
+
+static inline unsigned int
+ddio_mask_ways(uint64_t mask)
+{
+	return __builtin_popcountll(mask);
+}
+
+/* RX rings of the ports on one socket */
+struct ddio_io {
+	unsigned int ndesc;		/* RX descriptors per queue */
+	unsigned int queues;		/* per port */
+	unsigned int ports;
+	unsigned int pkt_size;		/* bytes DMA-written per packet */
+	unsigned int desc_size;		/* bytes written back per descriptor */
+};
+
+/*
+ * Bytes that DMA writes allocate in the LLC when every descriptor holds a
+ * packet: the lines of the packets (headroom keeps them aligned) and of
+ * the descriptors. The buffers themselves are larger (e.g., 2 KB), but
+ * the lines that are not written do not compete for the DDIO ways.
+ */
+uint64_t ddio_io_footprint(const struct ddio_io *io);
+
+#endif /* DDIO_DDIO_H */
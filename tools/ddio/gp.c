@@ -0,0 +1,182 @@
+/*
+ * Gaussian-process regression and expected improvement, for the auto-tuner
+ *
+ * Copyright (c) 2020, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "gp.h"
+
+static const double lens[] = { 0.05, 0.1, 0.2, 0.3, 0.5, 0.8, 1.2, 2 };
+static const double noises[] = { 1e-4, 1e-3, 1e-2, 0.05, 0.2 };
+
+static double
+kernel(const struct gp *gp, const double *a, const double *b, double len)
+{
+	double d = 0, r;
+	unsigned int i;
+
+	for (i = 0; i < gp->dims; i++)
+		d += (a[i] - b[i]) * (a[i] - b[i]);
+	r = sqrt(5 * d) / len;
+	return (1 + r + r * r / 3) * exp(-r);
+}
+
+/* In place, lower triangle; -1 if not positive definite */
+static int
+cholesky(double *a, unsigned int n)
+{
+	unsigned int i, j, k;
+
+	for (j = 0; j < n; j++) {
+		double s = a[j * n + j];
+
+		for (k = 0; k < j; k++)
+			s -= a[j * n + k] * a[j * n + k];
+		if (s <= 0)
+			return -1;
+		a[j * n + j] = sqrt(s);
+		for (i = j + 1; i < n; i++) {
+			s = a[i * n + j];
+			for (k = 0; k < j; k++)
+				s -= a[i * n + k] * a[j * n + k];
+			a[i * n + j] = s / a[j * n + j];
+		}
+	}
+	return 0;
+}
+
+/* L z = b, then L^T x = z if both */
+static void
+solve(const double *l, unsigned int n, const double *b, double *x, int both)
+{
+	unsigned int i, k;
+
+	for (i = 0; i < n; i++) {
+		double s = b[i];
+
+		for (k = 0; k < i; k++)
+			s -= l[i * n + k] * x[k];
+		x[i] = s / l[i * n + i];
+	}
+	for (i = n; both && i-- > 0;) {
+		double s = x[i];
+
+		for (k = i + 1; k < n; k++)
+			s -= l[k * n + i] * x[k];
+		x[i] = s / l[i * n + i];
+	}
+}
+
+/* The Cholesky factor and alpha of len and noise; the log marginal likelihood */
+static double
+factor(struct gp *gp, const double *y, double len, double noise)
+{
+	unsigned int n = gp->n, i, j;
+	double lml = 0;
+
+	for (i = 0; i < n; i++)
+		for (j = 0; j <= i; j++)
+			gp->chol[i * n + j] = kernel(gp, gp->x[i], gp->x[j], len) + (i == j ? noise + 1e-9 : 0);
+	if (cholesky(gp->chol, n))
+		return -INFINITY;
+	solve(gp->chol, n, y, gp->alpha, 1);
+	for (i = 0; i < n; i++)
+		lml -= 0.5 * y[i] * gp->alpha[i] + log(gp->chol[i * n + i]);
+	return lml;
+}
+
+int
+gp_fit(struct gp *gp, const double (*x)[GP_MAX_DIMS], const double *y,
+       unsigned int n, unsigned int dims)
+{
+	double ys[GP_MAX_OBS], best = -INFINITY, var = 0, lml;
+	unsigned int i, a, b;
+
+	if (!n || n > GP_MAX_OBS || !dims || dims > GP_MAX_DIMS)
+		return -1;
+	gp_free(gp);
+	gp->dims = dims;
+	gp->n = n;
+	memcpy(gp->x, x, n * sizeof(gp->x[0]));
+	gp->chol = malloc((size_t)n * n * sizeof(*gp->chol));
+	gp->alpha = malloc(n * sizeof(*gp->alpha));
+	if (!gp->chol || !gp->alpha) {
+		perror("malloc");
+		gp_free(gp);
+		return -1;
+	}
+	gp->mean = 0;
+	for (i = 0; i < n; i++)
+		gp->mean += y[i] / n;
+	for (i = 0; i < n; i++)
+		var += (y[i] - gp->mean) * (y[i] - gp->mean) / n;
+	gp->sd = var > 0 ? sqrt(var) : 1;
+	for (i = 0; i < n; i++)
+		ys[i] = (y[i] - gp->mean) / gp->sd;
+
+	gp->len = lens[0];
+	gp->noise = noises[sizeof(noises) / sizeof(noises[0]) - 1];
+	for (a = 0; a < sizeof(lens) / sizeof(lens[0]); a++) {
+		for (b = 0; b < sizeof(noises) / sizeof(noises[0]); b++) {
+			lml = factor(gp, ys, lens[a], noises[b]);
+			if (lml > best) {
+				best = lml;
+				gp->len = lens[a];
+				gp->noise = noises[b];
+			}
+		}
+	}
+	if (factor(gp, ys, gp->len, gp->noise) == -INFINITY) {
+		gp_free(gp);
+		return -1;
+	}
+	return 0;
+}
+
+void
+gp_predict(const struct gp *gp, const double *x, double *mu, double *sd)
+{
+	double k[GP_MAX_OBS], v[GP_MAX_OBS], m = 0, var = 1;
+	unsigned int i;
+
+	for (i = 0; i < gp->n; i++) {
+		k[i] = kernel(gp, x, gp->x[i], gp->len);
+		m += k[i] * gp->alpha[i];
+	}
+	solve(gp->chol, gp->n, k, v, 0);
+	for (i = 0; i < gp->n; i++)
+		var -= v[i] * v[i];
+	*mu = gp->mean + m * gp->sd;
+	*sd = var > 1e-12 ? sqrt(var) * gp->sd : 1e-6 * gp->sd;
+}
+
+void
+gp_free(struct gp *gp)
+{
+	free(gp->chol);
+	free(gp->alpha);
+	gp->chol = NULL;
+	gp->alpha = NULL;
+}
+
+double
+gp_cdf(double z)
+{
+	return 0.5 * erfc(-z / M_SQRT2);
+}
+
+double
+gp_ei(double mu, double sd, double best)
+{
+	double z;
+
+	if (sd <= 0)
+		return mu > best ? mu - best : 0;
+	z = (mu - best) / sd;
+	return (mu - best) * gp_cdf(z) + sd * exp(-0.5 * z * z) / sqrt(2 * M_PI);
+}
@@ -0,0 +1,38 @@
+/*
+ * Gaussian-process regression and expected improvement, for the auto-tuner
+ *
+ * Copyright (c) 2020, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#ifndef DDIO_GP_H
+#define DDIO_GP_H
+
+#define GP_MAX_OBS	256
+#define GP_MAX_DIMS	8
+
+/*
+ * A Matern-5/2 kernel of one length scale over [0,1]^dims, on outputs
+ * standardized to zero mean and unit variance. The length scale and the
+ * noise are those of the highest marginal likelihood on a small grid.
+ */
+struct gp {
+	unsigned int dims, n;
+	double x[GP_MAX_OBS][GP_MAX_DIMS];
+	double mean, sd;		/* of the outputs */
+	double len, noise;		/* noise: variance, relative to the outputs */
+	double *chol;			/* n x n, lower */
+	double *alpha;			/* K^-1 y */
+};
+
+int  gp_fit(struct gp *gp, const double (*x)[GP_MAX_DIMS], const double *y,
+            unsigned int n, unsigned int dims);
+void gp_predict(const struct gp *gp, const double *x, double *mu, double *sd);
+void gp_free(struct gp *gp);
+
+/* Of a value above best, for a prediction of mean mu and deviation sd */
+double gp_ei(double mu, double sd, double best);
+
+/* Standard normal */
+double gp_cdf(double z);
+
+#endif /* DDIO_GP_H */
@@ -0,0 +1,221 @@
+/*
+ * Static versus dynamic RX burst and ring on the emulated NIC
+ *
+ * Copyright (c) 2020, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+// Compile command: gcc -O2 -pthread ddio-dynbench.c vnic.c hdr.c work.c pkt.c tsc.c -o ddio-dynbench
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include "vnic.h"
+
+static volatile sig_atomic_t stop;
+
+static void
+on_signal(int sig)
+{
+	(void)sig;
+	stop = 1;
+}
+
+/* "1,3,5-8" */
+static int
+parse_cpus(const char *arg, int *cpu, unsigned int max)
+{
+	char copy[1024], *tok, *save;
+	unsigned int n = 0;
+
+	snprintf(copy, sizeof(copy), "%s", arg);
+	for (tok = strtok_r(copy, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+		int lo, hi;
+
+		if (sscanf(tok, "%d-%d", &lo, &hi) != 2)
+			hi = lo = atoi(tok);
+		for (; lo <= hi; lo++) {
+			if (n == max) {
+				fprintf(stderr, "Too many cores in '%s'\n", arg);
+				return -1;
+			}
+			cpu[n++] = lo;
+		}
+	}
+	return n;
+}
+
+static void
+usage(const char *prog)
+{
+	printf("Usage: %s [options]\n", prog);
+	printf("\nOptions:\n");
+	printf("  -q queues   : Queues, one consumer core each (default: 1)\n");
+	printf("  -d desc     : RX descriptors per queue, the NDESC of FromDPDKDevice (default: 4096)\n");
+	printf("  -b burst    : RX burst (default: 32)\n");
+	printf("  -s size     : Packet size (default: 1024)\n");
+	printf("  -r gbps     : Offered load of all queues (default: as fast as possible)\n");
+	printf("  -R gbps     : TX rate of all queues, below -r for TX backpressure (default: as fast as possible)\n");
+	printf("  -D us       : Decision interval of the dynamic run (default: 100)\n");
+	printf("  -k kernel   : Processing kernel, as in ddio-vnic (default: none)\n");
+	printf("  -m mode     : alloc (regular stores, like DDIO) or nt (non-temporal stores, no DDIO)\n");
+	printf("  -C core     : Core of the NIC thread\n");
+	printf("  -c cores    : Cores of the consumers, e.g., 2-5 (default: not pinned)\n");
+	printf("  -t seconds  : Measurement time of every run (default: 5)\n");
+	printf("  -u seconds  : Warm-up time (default: 1)\n");
+	printf("  -o file     : Write results to file instead of stdout\n");
+	printf("\nExample:\n");
+	printf("  %s -q 4 -d 1024 -s 1500 -r 40 -R 25 -C 1 -c 2-5\n", prog);
+}
+
+/* The burst and ring of -b and -d, then the dynamic ones within them */
+static const struct {
+	const char *name;
+	int dynamic;
+} runs[] = {
+	{ "STATIC", 0 },
+	{ "DYNAMIC", 1 },
+};
+
+int main(int argc, char *argv[])
+{
+	struct vnic_config cfg;
+	struct vnic_stats st;
+	struct vnic v;
+	const char *outfile = NULL, *cpus = NULL;
+	unsigned int r;
+	double seconds = 5, warmup = 1, wire;
+	FILE *out = stdout;
+	int opt, n;
+
+	vnic_config_default(&cfg);
+	while ((opt = getopt(argc, argv, "q:d:b:s:r:R:D:k:m:C:c:t:u:o:h")) != -1) {
+		switch (opt) {
+		case 'q':
+			cfg.queues = strtoul(optarg, NULL, 0);
+			break;
+		case 'd':
+			cfg.ndesc = strtoul(optarg, NULL, 0);
+			break;
+		case 'b':
+			cfg.burst = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			cfg.pkt_size = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			cfg.rate_gbps = atof(optarg);
+			break;
+		case 'R':
+			cfg.tx_gbps = atof(optarg);
+			break;
+		case 'D':
+			cfg.dyn_us = strtoul(optarg, NULL, 0);
+			break;
+		case 'k':
+			if (work_parse(optarg, &cfg.work)) {
+				printf("Bad kernel %s!\n", optarg);
+				return 1;
+			}
+			break;
+		case 'm':
+			if (!strcmp(optarg, "alloc")) {
+				cfg.store = VNIC_ALLOC;
+			} else if (!strcmp(optarg, "nt")) {
+				cfg.store = VNIC_NT;
+			} else {
+				printf("Unknown mode %s!\n", optarg);
+				return 1;
+			}
+			break;
+		case 'C':
+			cfg.nic_cpu = atoi(optarg);
+			break;
+		case 'c':
+			cpus = optarg;
+			break;
+		case 't':
+			seconds = atof(optarg);
+			break;
+		case 'u':
+			warmup = atof(optarg);
+			break;
+		case 'o':
+			outfile = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+	if (!cfg.queues || cfg.queues > VNIC_MAX_QUEUES) {
+		printf("Bad number of queues %u!\n", cfg.queues);
+		return 1;
+	}
+	if (cpus) {
+		n = parse_cpus(cpus, cfg.cpu, VNIC_MAX_QUEUES);
+		if (n < 0)
+			return 1;
+		if ((unsigned int)n < cfg.queues) {
+			printf("%u queues need %u consumer cores!\n", cfg.queues, cfg.queues);
+			return 1;
+		}
+	}
+	cfg.yield = sysconf(_SC_NPROCESSORS_ONLN) <= cfg.queues;
+
+	if (outfile) {
+		out = fopen(outfile, "w");
+		if (!out) {
+			perror(outfile);
+			return 1;
+		}
+	}
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+	wire = (cfg.pkt_size + 20) * 8.0;
+	for (r = 0; r < sizeof(runs) / sizeof(runs[0]) && !stop; r++) {
+		const char *name = runs[r].name;
+
+		cfg.dynamic = runs[r].dynamic;
+		if (vnic_start(&v, &cfg)) {
+			if (out != stdout)
+				fclose(out);
+			return 1;
+		}
+		usleep(warmup * 1e6);
+		vnic_measure(&v);
+		for (n = 0; n < seconds * 10 && !stop; n++)
+			usleep(100000);
+		vnic_stop(&v, &st);
+
+		fprintf(out, "RESULT-%s-THROUGHPUT %f\n", name, st.sent * wire / st.seconds);
+		fprintf(out, "RESULT-%s-PPS %f\n", name, st.sent / st.seconds);
+		fprintf(out, "RESULT-%s-RX-DROPPED %" PRIu64 "\n", name, st.dropped);
+		fprintf(out, "RESULT-%s-TX-FULL %" PRIu64 "\n", name, st.txfull);
+		fprintf(out, "RESULT-%s-LATAVG %f\n", name, st.lat_avg);
+		fprintf(out, "RESULT-%s-LAT99 %f\n", name, hdr_percentile(st.lat, 99) / 1e3);
+		fprintf(out, "RESULT-%s-BUFFER-FOOTPRINT %" PRIu64 "\n", name, st.footprint);
+		if (v.perf) {
+			fprintf(out, "RESULT-%s-NIC-MISS-RATE %f\n", name,
+			        st.nic_llc_ref ? 100.0 * st.nic_llc_miss / st.nic_llc_ref : 0);
+			fprintf(out, "RESULT-%s-NIC-LLCMISSES-PER-PKT %f\n", name,
+			        st.offered ? (double)st.nic_llc_miss / st.offered : 0);
+			fprintf(out, "RESULT-%s-LLCMISSES-PER-PKT %f\n", name,
+			        st.processed ? (double)st.llc_miss / st.processed : 0);
+		}
+		if (cfg.dynamic) {
+			fprintf(out, "RESULT-%s-RING-AVG %f\n", name, st.dyn_ring);
+			fprintf(out, "RESULT-%s-BURST-AVG %f\n", name, st.dyn_burst);
+			fprintf(out, "RESULT-%s-SHRINKS %" PRIu64 "\n", name, st.dyn_shrinks);
+			fprintf(out, "RESULT-%s-GROWS %" PRIu64 "\n", name, st.dyn_grows);
+		}
+		vnic_free(&v);
+	}
+	if (out != stdout)
+		fclose(out);
+	return 0;
+}
@@ -0,0 +1,311 @@
+/*
+ * Packet generator with TSC-based pacing, for live rate sweeps
+ *
+ * Copyright (c) 2020, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+// Compile command: gcc -O2 -pthread ddio-gen.c gen.c traffic.c hdr.c port.c pkt.c tsc.c -o ddio-gen -lm
+// With AF_XDP:     gcc -O2 -pthread -DHAVE_XDP ddio-gen.c gen.c traffic.c hdr.c port.c pkt.c tsc.c -o ddio-gen -lm -lxdp -lbpf
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include "gen.h"
+#include "tsc.h"
+
+#define MAX_RATES	64
+
+struct result {
+	double seconds, txrate, throughput, pps, lat_avg;
+	struct hdr lat;			/* ns */
+};
+
+static volatile sig_atomic_t stop;
+
+static void
+on_signal(int sig)
+{
+	(void)sig;
+	stop = 1;
+}
+
+static int
+parse_mac(const char *arg, uint8_t *mac)
+{
+	unsigned int m[6], i;
+
+	if (sscanf(arg, "%x:%x:%x:%x:%x:%x", &m[0], &m[1], &m[2], &m[3], &m[4], &m[5]) != 6)
+		return -1;
+	for (i = 0; i < 6; i++)
+		mac[i] = m[i];
+	return 0;
+}
+
+static int
+read_mac(const char *ifname, uint8_t *mac)
+{
+	char path[256], line[64];
+	FILE *f;
+	int ret;
+
+	snprintf(path, sizeof(path), "/sys/class/net/%s/address", ifname);
+	f = fopen(path, "r");
+	if (!f)
+		return -1;
+	ret = fgets(line, sizeof(line), f) ? parse_mac(line, mac) : -1;
+	fclose(f);
+	return ret;
+}
+
+/* "1,3,5-8" */
+static int
+parse_cpus(const char *arg, int *cpu, unsigned int max)
+{
+	char copy[1024], *tok, *save;
+	unsigned int n = 0;
+
+	snprintf(copy, sizeof(copy), "%s", arg);
+	for (tok = strtok_r(copy, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+		int lo, hi;
+
+		if (sscanf(tok, "%d-%d", &lo, &hi) != 2)
+			hi = lo = atoi(tok);
+		for (; lo <= hi; lo++) {
+			if (n == max) {
+				fprintf(stderr, "Too many cores in '%s'\n", arg);
+				return -1;
+			}
+			cpu[n++] = lo;
+		}
+	}
+	return n;
+}
+
+static int
+run(const struct gen_config *cfg, const char *ifname, const struct port_config *pcfg,
+    double warmup, double seconds, struct result *r)
+{
+	static struct gen g;
+	struct gen_counters b, e;
+	uint64_t t0;
+	int i;
+
+	if (gen_start(&g, cfg, ifname, pcfg))
+		return -1;
+	usleep(warmup * 1e6);
+	gen_snapshot(&g, &b);
+	t0 = tsc_now();
+	gen_measure(&g, 1);
+	for (i = 0; i < seconds * 10 && !stop; i++)
+		usleep(100000);
+	gen_measure(&g, 0);
+	gen_snapshot(&g, &e);
+	r->seconds = tsc_to_ns(tsc_now() - t0) / 1e9;
+	gen_stop(&g);
+
+	e.sent -= b.sent;
+	e.received -= b.received;
+	e.sent_bytes -= b.sent_bytes;
+	e.received_bytes -= b.received_bytes;
+	e.lat_sum -= b.lat_sum;
+	/* Every frame also occupies 20 bytes of preamble and inter-frame gap */
+	r->txrate = (e.sent_bytes + 20 * e.sent) * 8.0 / r->seconds;
+	r->throughput = (e.received_bytes + 20 * e.received) * 8.0 / r->seconds;
+	r->pps = e.received / r->seconds;
+	r->lat_avg = e.received ? tsc_to_ns(e.lat_sum) / e.received / 1e3 : 0;
+	hdr_reset(&r->lat);
+	gen_histogram(&g, &r->lat);
+	gen_free(&g);
+	return 0;
+}
+
+static void
+usage(const char *prog)
+{
+	printf("Usage: %s [options]\n", prog);
+	printf("\nOptions:\n");
+	printf("  -i iface    : Interface (default: veth0)\n");
+	printf("  -x          : Use AF_XDP sockets (needs -DHAVE_XDP), AF_PACKET otherwise\n");
+	printf("  -f frames   : Frames per RX and TX ring (default: 4096)\n");
+	printf("  -D mac      : Destination MAC address, e.g., of the DUT (default: 02:00:00:00:00:02)\n");
+	printf("  -M mac      : Source MAC address (default: that of the interface)\n");
+	printf("  -g threads  : Threads, each with its own socket (GEN_THREADS, default: 4)\n");
+	printf("  -G cores    : Cores of the threads, e.g., 1-4\n");
+	printf("  -s size     : Packet size (GEN_PKT_SIZE, default: 1024)\n");
+	printf("  -F flows    : Flows (GEN_FLOWS, default: 4096)\n");
+	printf("  -L sizes    : Size mix instead of -s: imix or <size>[:<weight>],...\n");
+	printf("  -z flows    : Flow popularity: uniform, zipf[:<s>], or hh[:<%% flows>:<%% packets>]\n");
+	printf("                (default: uniform)\n");
+	printf("  -K flows/s  : Flows replaced by new ones per second (default: 0)\n");
+	printf("  -b burst    : Packets per transmit (default: 32)\n");
+	printf("  -r gbps     : Offered load of all threads; a comma-separated list is swept\n");
+	printf("                (default: as fast as possible)\n");
+	printf("  -P process  : Arrivals: constant, poisson, or onoff[:<on us>:<off us>] (default: constant)\n");
+	printf("  -t seconds  : Measurement time per rate (default: 5)\n");
+	printf("  -u seconds  : Warm-up time per rate (default: 1)\n");
+	printf("  -H file     : Save the latency histogram to file (see ddio-hdr), .<rate> appended in sweeps\n");
+	printf("  -o file     : Write results to file instead of stdout\n");
+	printf("\nExample:\n");
+	printf("  sudo %s -i ens1f0 -D 0c:42:a1:2b:3c:4d -g 8 -G 1-8 -s 1500 -r 100\n", prog);
+	printf("  sudo %s -i ens1f0 -D 0c:42:a1:2b:3c:4d -r 0.1,0.5,1,5,10,50 -P poisson > rates.csv\n", prog);
+}
+
+int main(int argc, char *argv[])
+{
+	struct gen_config cfg;
+	struct port_config pcfg;
+	struct result r;
+	const char *ifname = "veth0", *outfile = NULL, *src = NULL, *hdrfile = NULL;
+	double rates[MAX_RATES] = { 0 }, seconds = 5, warmup = 1;
+	char *tok, *save;
+	int opt, nrates = 1, i, ret = 0;
+	FILE *out = stdout;
+
+	gen_config_default(&cfg);
+	port_config_default(&pcfg);
+	while ((opt = getopt(argc, argv, "i:xf:D:M:g:G:s:F:L:z:K:b:r:P:t:u:H:o:h")) != -1) {
+		switch (opt) {
+		case 'i':
+			ifname = optarg;
+			break;
+		case 'x':
+			pcfg.xdp = 1;
+			break;
+		case 'f':
+			pcfg.frames = strtoul(optarg, NULL, 0);
+			break;
+		case 'D':
+			if (parse_mac(optarg, cfg.dst_mac)) {
+				printf("Bad MAC address %s!\n", optarg);
+				return 1;
+			}
+			break;
+		case 'M':
+			src = optarg;
+			break;
+		case 'g':
+			cfg.threads = strtoul(optarg, NULL, 0);
+			break;
+		case 'G':
+			if (parse_cpus(optarg, cfg.cpu, GEN_MAX_THREADS) < 0)
+				return 1;
+			break;
+		case 's':
+			cfg.pkt_size = strtoul(optarg, NULL, 0);
+			break;
+		case 'F':
+			cfg.traffic.flows = strtoul(optarg, NULL, 0);
+			break;
+		case 'L':
+			if (traffic_parse_sizes(optarg, &cfg.traffic)) {
+				printf("Bad size mix %s!\n", optarg);
+				return 1;
+			}
+			break;
+		case 'z':
+			if (traffic_parse_flows(optarg, &cfg.traffic)) {
+				printf("Bad flow popularity %s!\n", optarg);
+				return 1;
+			}
+			break;
+		case 'K':
+			cfg.traffic.churn = atof(optarg);
+			break;
+		case 'b':
+			cfg.burst = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			nrates = 0;
+			for (tok = strtok_r(optarg, ",", &save); tok && nrates < MAX_RATES;
+			     tok = strtok_r(NULL, ",", &save))
+				rates[nrates++] = atof(tok);
+			break;
+		case 'P':
+			if (gen_parse_process(optarg, &cfg)) {
+				printf("Bad arrival process %s!\n", optarg);
+				return 1;
+			}
+			break;
+		case 't':
+			seconds = atof(optarg);
+			break;
+		case 'u':
+			warmup = atof(optarg);
+			break;
+		case 'H':
+			hdrfile = optarg;
+			break;
+		case 'o':
+			outfile = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+	if (src ? parse_mac(src, cfg.src_mac) : read_mac(ifname, cfg.src_mac)) {
+		printf("Cannot get the source MAC address!\n");
+		return 1;
+	}
+	cfg.yield = sysconf(_SC_NPROCESSORS_ONLN) < cfg.threads;
+	tsc_hz();
+	if (hdr_init(&r.lat))
+		return 1;
+
+	if (outfile) {
+		out = fopen(outfile, "w");
+		if (!out) {
+			perror(outfile);
+			return 1;
+		}
+	}
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+	if (nrates > 1)
+		fprintf(out, "RATE,TXRATE,THROUGHPUT,PPS,LATAVG,LAT50,LAT99,LAT999,LAT9999,LATMAX\n");
+	for (i = 0; i < nrates && !stop && !ret; i++) {
+		cfg.rate_gbps = rates[i];
+		if (run(&cfg, ifname, &pcfg, warmup, seconds, &r)) {
+			ret = 1;
+			break;
+		}
+		if (hdrfile) {
+			char path[1024];
+			FILE *f;
+
+			if (nrates > 1)
+				snprintf(path, sizeof(path), "%s.%g", hdrfile, rates[i]);
+			else
+				snprintf(path, sizeof(path), "%s", hdrfile);
+			f = fopen(path, "w");
+			if (!f || hdr_save(&r.lat, f)) {
+				perror(path);
+				ret = 1;
+			}
+			if (f)
+				fclose(f);
+		}
+		if (nrates > 1) {
+			fprintf(out, "%g,%f,%f,%f,%f,%f,%f,%f,%f,%f\n", rates[i], r.txrate, r.throughput,
+			        r.pps, r.lat_avg, hdr_percentile(&r.lat, 50) / 1e3,
+			        hdr_percentile(&r.lat, 99) / 1e3, hdr_percentile(&r.lat, 99.9) / 1e3,
+			        hdr_percentile(&r.lat, 99.99) / 1e3, r.lat.max / 1e3);
+			fflush(out);
+			continue;
+		}
+		fprintf(out, "RESULT-TESTTIME %f\n", r.seconds);
+		fprintf(out, "RESULT-TXRATE %f\n", r.txrate);
+		fprintf(out, "RESULT-THROUGHPUT %f\n", r.throughput);
+		fprintf(out, "RESULT-PPS %f\n", r.pps);
+		fprintf(out, "RESULT-LATAVG %f\n", r.lat_avg);
+		hdr_write_results(&r.lat, out, 1e3);
+	}
+	if (out != stdout)
+		fclose(out);
+	hdr_free(&r.lat);
+	return ret;
+}
@@ -0,0 +1,121 @@
+/*
+ * Merges latency histograms of threads and runs, and prints percentiles or the CDF
+ *
+ * Copyright (c) 2020, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+// Compile command: gcc -O2 ddio-hdr.c hdr.c -o ddio-hdr
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "hdr.h"
+
+static void
+usage(const char *prog)
+{
+	printf("Usage: %s [options] file...\n", prog);
+	printf("\nOptions:\n");
+	printf("  -c file     : Write the CDF of all files to file (CSV, value in us)\n");
+	printf("  -m file     : Write the merged histogram to file\n");
+	printf("  -p pct      : Also print this percentile, e.g., 99.999\n");
+	printf("  -o file     : Write results to file instead of stdout\n");
+	printf("\nExample:\n");
+	printf("  %s -c cdf.csv run-*.hdr\n", prog);
+}
+
+static int
+write_file(const char *path, const struct hdr *h, int cdf)
+{
+	FILE *f = fopen(path, "w");
+	int ret = 0;
+
+	if (!f) {
+		perror(path);
+		return -1;
+	}
+	if (cdf)
+		hdr_write_cdf(h, f, 1e3);
+	else
+		ret = hdr_save(h, f);
+	if (fclose(f) || ret) {
+		perror(path);
+		return -1;
+	}
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *cdffile = NULL, *mergefile = NULL, *outfile = NULL;
+	double extra = -1;
+	struct hdr h;
+	FILE *out = stdout;
+	int opt, i, ret = 0;
+
+	while ((opt = getopt(argc, argv, "c:m:p:o:h")) != -1) {
+		switch (opt) {
+		case 'c':
+			cdffile = optarg;
+			break;
+		case 'm':
+			mergefile = optarg;
+			break;
+		case 'p':
+			extra = atof(optarg);
+			break;
+		case 'o':
+			outfile = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+	if (optind == argc) {
+		usage(argv[0]);
+		return 1;
+	}
+	if (hdr_init(&h))
+		return 1;
+	/* Same buckets everywhere: the merged histogram is exact */
+	for (i = optind; i < argc; i++) {
+		FILE *f = fopen(argv[i], "r");
+
+		if (!f) {
+			perror(argv[i]);
+			hdr_free(&h);
+			return 1;
+		}
+		if (hdr_load(&h, f)) {
+			printf("%s is not a histogram!\n", argv[i]);
+			fclose(f);
+			hdr_free(&h);
+			return 1;
+		}
+		fclose(f);
+	}
+
+	if (outfile) {
+		out = fopen(outfile, "w");
+		if (!out) {
+			perror(outfile);
+			hdr_free(&h);
+			return 1;
+		}
+	}
+	fprintf(out, "RESULT-COUNT %lu\n", h.total);
+	fprintf(out, "RESULT-LATAVG %f\n", hdr_mean(&h) / 1e3);
+	hdr_write_results(&h, out, 1e3);
+	if (extra >= 0)
+		fprintf(out, "RESULT-LAT%g %f\n", extra, hdr_percentile(&h, extra) / 1e3);
+	if (out != stdout)
+		fclose(out);
+	if (cdffile && write_file(cdffile, &h, 1))
+		ret = 1;
+	if (mergefile && write_file(mergefile, &h, 0))
+		ret = 1;
+	hdr_free(&h);
+	return ret;
+}
@@ -0,0 +1,461 @@
+/*
+ * Single-host testbed: generator and L2 forwarder over a veth pair
+ *
+ * Copyright (c) 2020, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+// Compile command: gcc -O2 -pthread ddio-loopback.c gen.c traffic.c hdr.c work.c port.c pkt.c tsc.c -o ddio-loopback -lm
+// With AF_XDP:     gcc -O2 -pthread -DHAVE_XDP ddio-loopback.c gen.c traffic.c hdr.c work.c port.c pkt.c tsc.c -o ddio-loopback -lm -lxdp -lbpf
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <sched.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "gen.h"
+#include "port.h"
+#include "pkt.h"
+#include "work.h"
+#include "tsc.h"
+
+#define MAX_FWD		32
+
+struct counters {
+	struct gen_counters gen;
+	uint64_t fwd_rx, fwd_tx;
+	uint64_t txfull;		/* TX ring full */
+};
+
+struct worker {
+	struct port port;
+	pthread_t thread;
+	int cpu;
+	struct counters cnt;
+	struct work work;
+	struct loopback *lb;
+} __attribute__((aligned(64)));
+
+struct loopback {
+	unsigned int burst;
+	struct work_config work;
+	int yield;
+	int stop;
+	struct gen gen;
+	struct worker fwd[MAX_FWD];
+	unsigned int nfwd;
+};
+
+static volatile sig_atomic_t stop;
+
+static void
+on_signal(int sig)
+{
+	(void)sig;
+	stop = 1;
+}
+
+static void
+pin(int cpu)
+{
+	cpu_set_t set;
+
+	if (cpu < 0)
+		return;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set))
+		fprintf(stderr, "Cannot pin a thread to core %d\n", cpu);
+}
+
+/* RXM: EtherMirror and WorkPackage, then back out of the same interface */
+static void *
+fwd_main(void *arg)
+{
+	struct worker *w = arg;
+	struct loopback *lb = w->lb;
+	struct port_pkt pkts[PORT_MAX_BURST];
+	unsigned int i, n, k, sent;
+
+	pin(w->cpu);
+	while (!__atomic_load_n(&lb->stop, __ATOMIC_RELAXED)) {
+		n = port_rx(&w->port, pkts, lb->burst);
+		if (!n) {
+			if (lb->yield)
+				sched_yield();
+			continue;
+		}
+		for (i = k = 0; i < n; i++) {
+			if (!pkt_is_test(pkts[i].data, pkts[i].len) || pkts[i].data[5] != 0x02)
+				continue;
+			pkt_swap_mac(pkts[i].data);
+			work_packet(&w->work, pkts[i].data, pkts[i].len);
+			pkts[k++] = pkts[i];
+		}
+		/* Blocks while the TX ring is full, like ToDPDKDevice(BLOCKING true) */
+		for (sent = 0; sent < k; ) {
+			sent += port_tx(&w->port, pkts + sent, k - sent);
+			if (sent == k)
+				break;
+			w->cnt.txfull++;
+			if (__atomic_load_n(&lb->stop, __ATOMIC_RELAXED))
+				break;
+			if (lb->yield)
+				sched_yield();
+		}
+		w->cnt.fwd_rx += k;
+		w->cnt.fwd_tx += sent;
+	}
+	return NULL;
+}
+
+static int
+setup_veth(const char *a, const char *b, unsigned int queues)
+{
+	char cmd[512];
+
+	snprintf(cmd, sizeof(cmd),
+	         "ip link show %s > /dev/null 2>&1 || ip link add %s numtxqueues %u numrxqueues %u "
+	         "type veth peer name %s numtxqueues %u numrxqueues %u", a, a, queues, queues, b,
+	         queues, queues);
+	if (system(cmd))
+		return -1;
+	snprintf(cmd, sizeof(cmd), "ip link set %s up && ip link set %s up", a, b);
+	return system(cmd) ? -1 : 0;
+}
+
+/* "1,3,5-8" */
+static int
+parse_cpus(const char *arg, int *cpu, unsigned int max)
+{
+	char copy[1024], *tok, *save;
+	unsigned int n = 0;
+
+	snprintf(copy, sizeof(copy), "%s", arg);
+	for (tok = strtok_r(copy, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+		int lo, hi;
+
+		if (sscanf(tok, "%d-%d", &lo, &hi) != 2)
+			hi = lo = atoi(tok);
+		for (; lo <= hi; lo++) {
+			if (n == max) {
+				fprintf(stderr, "Too many cores in '%s'\n", arg);
+				return -1;
+			}
+			cpu[n++] = lo;
+		}
+	}
+	return n;
+}
+
+static void
+snapshot(struct loopback *lb, struct counters *c)
+{
+	unsigned int i;
+
+	memset(c, 0, sizeof(*c));
+	gen_snapshot(&lb->gen, &c->gen);
+	for (i = 0; i < lb->nfwd; i++) {
+		c->fwd_rx += lb->fwd[i].cnt.fwd_rx;
+		c->fwd_tx += lb->fwd[i].cnt.fwd_tx;
+		c->txfull += lb->fwd[i].cnt.txfull;
+	}
+}
+
+static void
+usage(const char *prog)
+{
+	printf("Usage: %s [options]\n", prog);
+	printf("\nOptions:\n");
+	printf("  -i iface    : Interface of the generator (default: veth0)\n");
+	printf("  -I iface    : Interface of the forwarder, the peer of -i (default: veth1)\n");
+	printf("  -S          : Create the veth pair if it does not exist\n");
+	printf("  -x          : Use AF_XDP sockets (needs -DHAVE_XDP), AF_PACKET otherwise\n");
+	printf("  -f frames   : Frames per RX and TX ring (default: 4096)\n");
+	printf("\nGenerator (TXM):\n");
+	printf("  -g threads  : Generator threads (default: 1)\n");
+	printf("  -G cores    : Cores of the generator threads, e.g., 1\n");
+	printf("  -s size     : Packet size (default: 1024)\n");
+	printf("  -r gbps     : Offered load of all threads (default: as fast as possible)\n");
+	printf("  -P process  : Arrivals: constant, poisson, or onoff[:<on us>:<off us>] (default: constant)\n");
+	printf("  -F flows    : Flows (default: 4096)\n");
+	printf("  -L sizes    : Size mix instead of -s: imix or <size>[:<weight>],...\n");
+	printf("  -z flows    : Flow popularity: uniform, zipf[:<s>], or hh[:<%% flows>:<%% packets>]\n");
+	printf("                (default: uniform)\n");
+	printf("  -K flows/s  : Flows replaced by new ones per second (default: 0)\n");
+	printf("\nForwarder (RXM):\n");
+	printf("  -q threads  : Forwarder threads (NCORE), spread by flow hash (default: 1)\n");
+	printf("  -c cores    : Cores of the forwarder threads, e.g., 2-5\n");
+	printf("  -b burst    : RX and TX burst of both sides (default: 32)\n");
+	printf("  -w n_w      : Random calls per packet, like WorkPackage (default: 0)\n");
+	printf("  -k kernel   : Processing kernel instead: spin, csum, parse, hash, or random,\n");
+	printf("                with [,n=<ops>][,ws=<size>][,bytes=<bytes>][,wr=<%%>][,isa=<isa>]\n");
+	printf("\nRun:\n");
+	printf("  -t seconds  : Measurement time (default: 5)\n");
+	printf("  -u seconds  : Warm-up time (default: 1)\n");
+	printf("  -H file     : Save the latency histogram to file (see ddio-hdr)\n");
+	printf("  -o file     : Write results to file instead of stdout\n");
+	printf("\nExample:\n");
+	printf("  sudo %s -S -q 2 -s 64 -G 1 -c 2-3 -t 10\n", prog);
+	printf("  sudo %s -q 2 -g 2 -r 5 -P poisson -G 1,2 -c 3,4\n", prog);
+	printf("  sudo %s -q 4 -L imix -z zipf:1.2 -K 1000 -G 1 -c 2-5\n", prog);
+	printf("  sudo %s -q 4 -k hash,n=4,ws=64M -G 1 -c 2-5\n", prog);
+}
+
+int main(int argc, char *argv[])
+{
+	static struct loopback lb;
+	struct gen_config gcfg;
+	struct port_config pcfg;
+	struct counters b, e;
+	const char *gen_if = "veth0", *fwd_if = "veth1", *outfile = NULL, *cpus = NULL;
+	const char *hdrfile = NULL;
+	struct hdr lat = { 0 };
+	const char *gen_cpus = NULL;
+	double seconds = 5, warmup = 1, secs;
+	int opt, setup = 0, ret = 1, started = 0;
+	unsigned int i, nopen = 0, nthreads = 0;
+	uint64_t t0, fwd0[MAX_FWD], fwd_max = 0;
+	FILE *out = stdout;
+
+	port_config_default(&pcfg);
+	gen_config_default(&gcfg);
+	gcfg.threads = 1;
+	lb.burst = 32;
+	lb.nfwd = 1;
+	work_config_default(&lb.work);
+	while ((opt = getopt(argc, argv, "i:I:Sxf:g:G:s:r:P:F:L:z:K:q:c:b:w:k:t:u:H:o:h")) != -1) {
+		switch (opt) {
+		case 'i':
+			gen_if = optarg;
+			break;
+		case 'I':
+			fwd_if = optarg;
+			break;
+		case 'S':
+			setup = 1;
+			break;
+		case 'x':
+			pcfg.xdp = 1;
+			break;
+		case 'f':
+			pcfg.frames = strtoul(optarg, NULL, 0);
+			break;
+		case 'g':
+			gcfg.threads = strtoul(optarg, NULL, 0);
+			break;
+		case 'G':
+			gen_cpus = optarg;
+			break;
+		case 's':
+			gcfg.pkt_size = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			gcfg.rate_gbps = atof(optarg);
+			break;
+		case 'P':
+			if (gen_parse_process(optarg, &gcfg)) {
+				printf("Bad arrival process %s!\n", optarg);
+				return 1;
+			}
+			break;
+		case 'F':
+			gcfg.traffic.flows = strtoul(optarg, NULL, 0);
+			break;
+		case 'L':
+			if (traffic_parse_sizes(optarg, &gcfg.traffic)) {
+				printf("Bad size mix %s!\n", optarg);
+				return 1;
+			}
+			break;
+		case 'z':
+			if (traffic_parse_flows(optarg, &gcfg.traffic)) {
+				printf("Bad flow popularity %s!\n", optarg);
+				return 1;
+			}
+			break;
+		case 'K':
+			gcfg.traffic.churn = atof(optarg);
+			break;
+		case 'q':
+			lb.nfwd = strtoul(optarg, NULL, 0);
+			break;
+		case 'c':
+			cpus = optarg;
+			break;
+		case 'b':
+			lb.burst = strtoul(optarg, NULL, 0);
+			break;
+		case 'w':
+			work_config_default(&lb.work);
+			lb.work.n = strtoul(optarg, NULL, 0);
+			break;
+		case 'k':
+			if (work_parse(optarg, &lb.work)) {
+				printf("Bad kernel %s!\n", optarg);
+				return 1;
+			}
+			break;
+		case 't':
+			seconds = atof(optarg);
+			break;
+		case 'u':
+			warmup = atof(optarg);
+			break;
+		case 'o':
+			outfile = optarg;
+			break;
+		case 'H':
+			hdrfile = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+	gcfg.burst = lb.burst;
+	if (!lb.nfwd || lb.nfwd > MAX_FWD || !lb.burst || lb.burst > PORT_MAX_BURST) {
+		printf("Bad number of forwarder threads or burst!\n");
+		return 1;
+	}
+	if (setup && setup_veth(gen_if, fwd_if, lb.nfwd > gcfg.threads ? lb.nfwd : gcfg.threads)) {
+		printf("Cannot create the veth pair %s/%s!\n", gen_if, fwd_if);
+		return 1;
+	}
+	for (i = 0; i < MAX_FWD; i++)
+		lb.fwd[i].cpu = -1;
+	if (cpus) {
+		int cpu[MAX_FWD];
+		int n = parse_cpus(cpus, cpu, MAX_FWD);
+
+		if (n < 0)
+			return 1;
+		for (i = 0; i < (unsigned int)n; i++)
+			lb.fwd[i].cpu = cpu[i];
+	}
+	if (gen_cpus && parse_cpus(gen_cpus, gcfg.cpu, GEN_MAX_THREADS) < 0)
+		return 1;
+	tsc_hz();
+	lb.yield = sysconf(_SC_NPROCESSORS_ONLN) < lb.nfwd + gcfg.threads;
+	gcfg.yield = lb.yield;
+
+	/* Every forwarder thread has its own socket, in one fanout group (AF_PACKET) or queue (AF_XDP) */
+	if (gen_start(&lb.gen, &gcfg, gen_if, &pcfg))
+		return 1;
+	started = 1;
+	pcfg.fanout = lb.nfwd > 1 ? getpid() & 0xffff : -1;
+	for (i = 0; i < lb.nfwd; i++) {
+		pcfg.queue = i;
+		if (port_open(&lb.fwd[i].port, fwd_if, &pcfg))
+			goto stop;
+		nopen++;
+		if (work_init(&lb.fwd[i].work, &lb.work, i))
+			goto stop;
+	}
+	fprintf(stderr, "%s: %s, %s: %s\n", gen_if, port_kind_name(&lb.gen.t[0].port), fwd_if,
+	        port_kind_name(&lb.fwd[0].port));
+	if (lb.work.kernel != WORK_SPIN) {
+		char desc[128];
+
+		work_describe(&lb.fwd[0].work, desc, sizeof(desc));
+		fprintf(stderr, "Kernel: %s per forwarder\n", desc);
+	}
+
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+	for (i = 0; i < lb.nfwd; i++) {
+		lb.fwd[i].lb = &lb;
+		if (pthread_create(&lb.fwd[i].thread, NULL, fwd_main, &lb.fwd[i])) {
+			perror("pthread_create");
+			goto stop;
+		}
+		nthreads++;
+	}
+
+	usleep(warmup * 1e6);
+	snapshot(&lb, &b);
+	for (i = 0; i < lb.nfwd; i++)
+		fwd0[i] = lb.fwd[i].cnt.fwd_tx;
+	t0 = tsc_now();
+	gen_measure(&lb.gen, 1);
+	for (i = 0; i < seconds * 10 && !stop; i++)
+		usleep(100000);
+	gen_measure(&lb.gen, 0);
+	snapshot(&lb, &e);
+	for (i = 0; i < lb.nfwd; i++)
+		if (lb.fwd[i].cnt.fwd_tx - fwd0[i] > fwd_max)
+			fwd_max = lb.fwd[i].cnt.fwd_tx - fwd0[i];
+	secs = tsc_to_ns(tsc_now() - t0) / 1e9;
+	gen_stop(&lb.gen);
+	started = 0;
+	__atomic_store_n(&lb.stop, 1, __ATOMIC_RELAXED);
+	for (i = 0; i < lb.nfwd; i++)
+		pthread_join(lb.fwd[i].thread, NULL);
+
+	if (hdr_init(&lat))
+		goto close;
+	if (outfile) {
+		out = fopen(outfile, "w");
+		if (!out) {
+			perror(outfile);
+			goto close;
+		}
+	}
+	e.gen.sent -= b.gen.sent;
+	e.gen.received -= b.gen.received;
+	e.gen.sent_bytes -= b.gen.sent_bytes;
+	e.gen.received_bytes -= b.gen.received_bytes;
+	e.gen.lat_sum -= b.gen.lat_sum;
+	/* Every frame also occupies 20 bytes of preamble and inter-frame gap */
+	fprintf(out, "RESULT-TESTTIME %f\n", secs);
+	fprintf(out, "RESULT-TXRATE %f\n", (e.gen.sent_bytes + 20 * e.gen.sent) * 8.0 / secs);
+	fprintf(out, "RESULT-THROUGHPUT %f\n",
+	        (e.gen.received_bytes + 20 * e.gen.received) * 8.0 / secs);
+	fprintf(out, "RESULT-PPS %f\n", e.gen.received / secs);
+	fprintf(out, "RESULT-FWD-PPS %f\n", (e.fwd_tx - b.fwd_tx) / secs);
+	/* Busiest forwarder over the mean: 1 when the flow hash spreads the load evenly */
+	fprintf(out, "RESULT-FWD-IMBALANCE %f\n", e.fwd_tx > b.fwd_tx ?
+	        (double)fwd_max * lb.nfwd / (e.fwd_tx - b.fwd_tx) : 0);
+	fprintf(out, "RESULT-LOSS-RATE %f\n", e.gen.sent > e.gen.received ?
+	        100.0 * (e.gen.sent - e.gen.received) / e.gen.sent : 0);
+	fprintf(out, "RESULT-TX-FULL %" PRIu64 "\n", e.txfull - b.txfull);
+	fprintf(out, "RESULT-LATAVG %f\n", e.gen.received ?
+	        tsc_to_ns(e.gen.lat_sum) / e.gen.received / 1e3 : 0);
+	gen_histogram(&lb.gen, &lat);
+	hdr_write_results(&lat, out, 1e3);
+	fprintf(out, "RESULT-ZEROCOPY %d\n", lb.fwd[0].port.zerocopy);
+	if (out != stdout)
+		fclose(out);
+	ret = 0;
+	if (hdrfile) {
+		FILE *f = fopen(hdrfile, "w");
+
+		if (!f || hdr_save(&lat, f)) {
+			perror(hdrfile);
+			ret = 1;
+		}
+		if (f)
+			fclose(f);
+	}
+	goto close;
+
+stop:
+	/* Only the forwarders that were started */
+	__atomic_store_n(&lb.stop, 1, __ATOMIC_RELAXED);
+	for (i = 0; i < nthreads; i++)
+		pthread_join(lb.fwd[i].thread, NULL);
+close:
+	if (started)
+		gen_stop(&lb.gen);
+	gen_free(&lb.gen);
+	for (i = 0; i < nopen; i++) {
+		port_close(&lb.fwd[i].port);
+		work_free(&lb.fwd[i].work);
+	}
+	hdr_free(&lat);
+	return ret;
+}
@@ -0,0 +1,434 @@
+/*
+ * Writes pcap files of generated traffic and replays them with TSC pacing
+ *
+ * Copyright (c) 2020, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+// Compile command: gcc -O2 -pthread ddio-pcap.c pcap.c traffic.c port.c pkt.c tsc.c -o ddio-pcap -lm
+// With AF_XDP:     gcc -O2 -pthread -DHAVE_XDP ddio-pcap.c pcap.c traffic.c port.c pkt.c tsc.c -o ddio-pcap -lm -lxdp -lbpf
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <sched.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "pcap.h"
+#include "traffic.h"
+#include "port.h"
+#include "pkt.h"
+#include "tsc.h"
+
+#define MAX_PHASES	16
+
+struct options {
+	/* Writing (PGM) */
+	uint64_t total;			/* GEN_TOT */
+	unsigned int pkt_size;		/* GEN_PKT_SIZE */
+	struct traffic_config traffic;	/* GEN_FLOWS, GEN_BURST, and the profile */
+	/* Rate of the time stamps, in phases that repeat every period_ns */
+	double rate_gbps[MAX_PHASES];
+	double phase_ns[MAX_PHASES];
+	unsigned int nphases;
+	double period_ns;		/* 0: one phase, a constant rate */
+	int poisson;
+	uint8_t src_mac[6], dst_mac[6];
+	/* Replay */
+	const char *ifname;
+	struct port_config pcfg;
+	unsigned int loops;		/* GEN_REPLAY */
+	double speed;			/* 0: ignore the time stamps */
+	unsigned int burst;
+	int dry;
+	int cpu;
+};
+
+static volatile sig_atomic_t stop;
+
+static void
+on_signal(int sig)
+{
+	(void)sig;
+	stop = 1;
+}
+
+static int
+parse_mac(const char *arg, uint8_t *mac)
+{
+	unsigned int m[6], i;
+
+	if (sscanf(arg, "%x:%x:%x:%x:%x:%x", &m[0], &m[1], &m[2], &m[3], &m[4], &m[5]) != 6)
+		return -1;
+	for (i = 0; i < 6; i++)
+		mac[i] = m[i];
+	return 0;
+}
+
+static uint64_t
+xorshift(uint64_t *x)
+{
+	*x ^= *x << 13;
+	*x ^= *x >> 7;
+	*x ^= *x << 17;
+	return *x;
+}
+
+/* "<gbps>" or "<gbps>:<seconds>,<gbps>:<seconds>,..." */
+static int
+parse_rates(const char *arg, struct options *o)
+{
+	char copy[1024], *tok, *save;
+	unsigned int n = 0;
+
+	snprintf(copy, sizeof(copy), "%s", arg);
+	o->period_ns = 0;
+	for (tok = strtok_r(copy, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+		char *colon = strchr(tok, ':');
+
+		if (n == MAX_PHASES)
+			return -1;
+		o->rate_gbps[n] = atof(tok);
+		o->phase_ns[n] = colon ? atof(colon + 1) * 1e9 : 0;
+		if (o->rate_gbps[n] <= 0 || (n && o->phase_ns[n] <= 0) ||
+		    (!colon && strchr(arg, ',')))
+			return -1;
+		o->period_ns += o->phase_ns[n++];
+	}
+	o->nphases = n;
+	return n ? 0 : -1;
+}
+
+static double
+rate_at(const struct options *o, double ts)
+{
+	double t;
+	unsigned int i;
+
+	if (o->period_ns <= 0)
+		return o->rate_gbps[0];
+	t = fmod(ts, o->period_ns);
+	for (i = 0; i < o->nphases - 1 && t >= o->phase_ns[i]; i++)
+		t -= o->phase_ns[i];
+	return o->rate_gbps[i];
+}
+
+static int
+write_file(const char *path, const struct options *o, FILE *out)
+{
+	static uint8_t pkt[PCAP_SNAPLEN];
+	struct pcap_writer w;
+	struct traffic t;
+	struct traffic_stream st;
+	uint64_t i, rnd = 0x9e3779b97f4a7c15ull, t0;
+	double seconds, ts = 0;
+	int ret = 0;
+
+	if (o->pkt_size < PKT_MIN_SIZE || !o->nphases) {
+		printf("Bad generator configuration!\n");
+		return 1;
+	}
+	if (traffic_init(&t, &o->traffic, o->pkt_size))
+		return 1;
+	if (t.max_size > PCAP_SNAPLEN || traffic_stream_init(&st, &t, 0, rnd)) {
+		printf("Bad generator configuration!\n");
+		traffic_free(&t);
+		return 1;
+	}
+	if (pcap_writer_open(&w, path, pcap_format_of(path), PCAP_BUF_SIZE)) {
+		traffic_stream_free(&st);
+		traffic_free(&t);
+		return 1;
+	}
+	pkt_build_udp(pkt, t.max_size);
+	memcpy(pkt, o->dst_mac, 6);
+	memcpy(pkt + 6, o->src_mac, 6);
+
+	t0 = tsc_now();
+	for (i = 0; i < o->total && !stop && !ret; i++) {
+		unsigned int len = traffic_size(&t, &st);
+		/* Every frame also occupies 20 bytes of preamble and inter-frame gap */
+		double gap_ns = (len + 20) * 8 / rate_at(o, ts);
+
+		traffic_set(pkt, len, traffic_flow(&t, &st, ts));
+		pkt_set_u64(pkt, PKT_SEQ_OFFSET, i);
+		ret = pcap_write(&w, ts, pkt, len);
+		if (o->poisson)
+			ts -= log(((xorshift(&rnd) >> 11) + 1) * (1.0 / 9007199254740992.0)) * gap_ns;
+		else
+			ts += gap_ns;
+	}
+	if (pcap_writer_close(&w))
+		ret = -1;
+	seconds = tsc_to_ns(tsc_now() - t0) / 1e9;
+	traffic_stream_free(&st);
+	traffic_free(&t);
+	if (ret)
+		return 1;
+
+	fprintf(out, "RESULT-PACKETS %lu\n", w.packets);
+	fprintf(out, "RESULT-BYTES %lu\n", w.bytes);
+	fprintf(out, "RESULT-WRITE-RATE %f\n", w.bytes / seconds);
+	return 0;
+}
+
+static unsigned int
+send_all(struct port *p, const struct port_pkt *pkts, unsigned int n, uint64_t *txfull)
+{
+	unsigned int sent = 0;
+
+	while (sent < n && !stop) {
+		unsigned int k = port_tx(p, pkts + sent, n - sent);
+
+		if (!k)
+			(*txfull)++;
+		sent += k;
+	}
+	return sent;
+}
+
+static int
+replay_file(const char *path, const struct options *o, FILE *out)
+{
+	struct pcap_reader r;
+	struct pcap_view v;
+	struct port port;
+	struct port_pkt batch[PORT_MAX_BURST];
+	uint64_t packets = 0, wire_bytes = 0, late = 0, txfull = 0;
+	uint64_t t0, now, due, ts0 = 0, last_ts = 0, loop_ns = 0, nfile = 0;
+	double tick_per_ns = o->speed > 0 ? tsc_hz() / 1e9 / o->speed : 0, seconds;
+	unsigned int loop, n = 0;
+	int ret = 0;
+
+	if (!o->burst || o->burst > PORT_MAX_BURST) {
+		printf("Bad burst size!\n");
+		return 1;
+	}
+	if (pcap_reader_open(&r, path))
+		return 1;
+	if (!o->dry && port_open(&port, o->ifname, &o->pcfg)) {
+		pcap_reader_close(&r);
+		return 1;
+	}
+	if (o->cpu >= 0) {
+		cpu_set_t set;
+
+		CPU_ZERO(&set);
+		CPU_SET(o->cpu, &set);
+		if (sched_setaffinity(0, sizeof(set), &set))
+			fprintf(stderr, "Cannot pin to core %d\n", o->cpu);
+	}
+
+	t0 = now = tsc_now();
+	for (loop = 0; loop < o->loops && !stop && ret >= 0; loop++) {
+		pcap_rewind(&r);
+		while (!stop && (ret = pcap_next(&r, &v)) == 1) {
+			if (!packets)
+				ts0 = v.ts_ns;
+			if (!loop) {
+				last_ts = v.ts_ns;
+				nfile++;
+			}
+			/* Packets due now leave in one batch; the next one is awaited */
+			due = t0 + (v.ts_ns - ts0 + loop * loop_ns) * tick_per_ns;
+			if (due > now || n == o->burst) {
+				if (n && !o->dry)
+					send_all(&port, batch, n, &txfull);
+				n = 0;
+				now = tsc_now();
+				if (due > now) {
+					tsc_wait_until(due);
+					now = due;
+				}
+			}
+			if (o->speed > 0 && now > due)
+				late += now - due;
+			batch[n].data = (uint8_t *)v.data;
+			batch[n++].len = v.len;
+			packets++;
+			wire_bytes += v.wire_len + 20;
+		}
+		/* The next loop starts a mean gap after the last packet */
+		if (!loop && nfile > 1)
+			loop_ns = (last_ts - ts0) + (last_ts - ts0) / (nfile - 1);
+	}
+	if (n && !o->dry)
+		send_all(&port, batch, n, &txfull);
+	seconds = tsc_to_ns(tsc_now() - t0) / 1e9;
+	if (ret < 0)
+		printf("%s is truncated or corrupted, stopped after %lu packets\n", path, packets);
+
+	fprintf(out, "RESULT-TESTTIME %f\n", seconds);
+	fprintf(out, "RESULT-PACKETS %lu\n", packets);
+	fprintf(out, "RESULT-TXRATE %f\n", wire_bytes * 8 / seconds);
+	fprintf(out, "RESULT-PPS %f\n", packets / seconds);
+	fprintf(out, "RESULT-LATE-AVG %f\n", packets ? tsc_to_ns(late) / packets / 1e3 : 0);
+	fprintf(out, "RESULT-TX-FULL %lu\n", txfull);
+	if (!o->dry)
+		port_close(&port);
+	pcap_reader_close(&r);
+	return ret < 0;
+}
+
+static void
+usage(const char *prog)
+{
+	printf("Usage: %s [options] -w file | -R file\n", prog);
+	printf("\nOptions:\n");
+	printf("  -w file     : Write generated traffic to file (.pcapng for pcapng, pcap otherwise)\n");
+	printf("  -n packets  : Packets to write (GEN_TOT, default: 524288)\n");
+	printf("  -s size     : Packet size (GEN_PKT_SIZE, default: 1500)\n");
+	printf("  -F flows    : Flows (GEN_FLOWS, default: 4096)\n");
+	printf("  -B packets  : Consecutive packets of a flow (GEN_BURST, default: 128)\n");
+	printf("  -L sizes    : Size mix instead of -s: imix or <size>[:<weight>],...\n");
+	printf("  -z flows    : Flow popularity: uniform, zipf[:<s>], or hh[:<%% flows>:<%% packets>]\n");
+	printf("                (default: uniform)\n");
+	printf("  -K flows/s  : Flows replaced by new ones per second of the file (default: 0)\n");
+	printf("  -r gbps     : Rate of the time stamps, or phases of <gbps>:<seconds>,... that repeat\n");
+	printf("                (default: 100)\n");
+	printf("  -P process  : Arrivals: constant or poisson (default: constant)\n");
+	printf("  -D mac      : Destination MAC address (default: 02:00:00:00:00:02)\n");
+	printf("  -M mac      : Source MAC address (default: 02:00:00:00:00:01)\n");
+	printf("  -R file     : Replay file (pcap or pcapng)\n");
+	printf("  -i iface    : Interface to replay on (default: veth0)\n");
+	printf("  -d          : Dry run: pace the packets without sending them\n");
+	printf("  -x          : Use an AF_XDP socket (needs -DHAVE_XDP), AF_PACKET otherwise\n");
+	printf("  -f frames   : Frames of the TX ring (default: 4096)\n");
+	printf("  -l loops    : Times to replay the file (GEN_REPLAY, default: 1)\n");
+	printf("  -m speed    : Multiplier of the rate of the file, 0: as fast as possible (default: 1)\n");
+	printf("  -b burst    : Packets per transmit at most (default: 32)\n");
+	printf("  -C core     : Core to replay on\n");
+	printf("  -o file     : Write results to file instead of stdout\n");
+	printf("\nExample:\n");
+	printf("  %s -w 64.pcap -n 10000000 -s 64 -r 10\n", prog);
+	printf("  %s -w imix-zipf.pcap -L imix -z zipf:1.1 -K 10000\n", prog);
+	printf("  %s -w wave.pcap -s 1024 -r 2:0.1,10:0.1\n", prog);
+	printf("  sudo %s -R 64.pcap -i veth0 -l 100 -C 1\n", prog);
+}
+
+int main(int argc, char *argv[])
+{
+	static const uint8_t src[6] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 };
+	static const uint8_t dst[6] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x02 };
+	struct options o = {
+		.total = 524288, .pkt_size = 1500, .rate_gbps = { 100 }, .nphases = 1,
+		.ifname = "veth0", .loops = 1, .speed = 1, .burst = 32, .cpu = -1,
+	};
+	const char *wfile = NULL, *rfile = NULL, *outfile = NULL;
+	FILE *out = stdout;
+	int opt, ret;
+
+	traffic_config_default(&o.traffic);
+	o.traffic.flow_size = 128;
+	memcpy(o.src_mac, src, 6);
+	memcpy(o.dst_mac, dst, 6);
+	port_config_default(&o.pcfg);
+	while ((opt = getopt(argc, argv, "w:n:s:F:B:L:z:K:r:P:D:M:R:i:dxf:l:m:b:C:o:h")) != -1) {
+		switch (opt) {
+		case 'w':
+			wfile = optarg;
+			break;
+		case 'n':
+			o.total = strtoull(optarg, NULL, 0);
+			break;
+		case 's':
+			o.pkt_size = strtoul(optarg, NULL, 0);
+			break;
+		case 'F':
+			o.traffic.flows = strtoul(optarg, NULL, 0);
+			break;
+		case 'B':
+			o.traffic.flow_size = strtoul(optarg, NULL, 0);
+			break;
+		case 'L':
+			if (traffic_parse_sizes(optarg, &o.traffic)) {
+				printf("Bad size mix %s!\n", optarg);
+				return 1;
+			}
+			break;
+		case 'z':
+			if (traffic_parse_flows(optarg, &o.traffic)) {
+				printf("Bad flow popularity %s!\n", optarg);
+				return 1;
+			}
+			break;
+		case 'K':
+			o.traffic.churn = atof(optarg);
+			break;
+		case 'r':
+			if (parse_rates(optarg, &o)) {
+				printf("Bad rate %s!\n", optarg);
+				return 1;
+			}
+			break;
+		case 'P':
+			if (strcmp(optarg, "constant") && strcmp(optarg, "poisson")) {
+				printf("Bad arrival process %s!\n", optarg);
+				return 1;
+			}
+			o.poisson = !strcmp(optarg, "poisson");
+			break;
+		case 'D':
+		case 'M':
+			if (parse_mac(optarg, opt == 'D' ? o.dst_mac : o.src_mac)) {
+				printf("Bad MAC address %s!\n", optarg);
+				return 1;
+			}
+			break;
+		case 'R':
+			rfile = optarg;
+			break;
+		case 'i':
+			o.ifname = optarg;
+			break;
+		case 'd':
+			o.dry = 1;
+			break;
+		case 'x':
+			o.pcfg.xdp = 1;
+			break;
+		case 'f':
+			o.pcfg.frames = strtoul(optarg, NULL, 0);
+			break;
+		case 'l':
+			o.loops = strtoul(optarg, NULL, 0);
+			break;
+		case 'm':
+			o.speed = atof(optarg);
+			break;
+		case 'b':
+			o.burst = strtoul(optarg, NULL, 0);
+			break;
+		case 'C':
+			o.cpu = atoi(optarg);
+			break;
+		case 'o':
+			outfile = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+	if (!wfile == !rfile) {
+		usage(argv[0]);
+		return 1;
+	}
+	tsc_hz();
+
+	if (outfile) {
+		out = fopen(outfile, "w");
+		if (!out) {
+			perror(outfile);
+			return 1;
+		}
+	}
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+	ret = wfile ? write_file(wfile, &o, out) : replay_file(rfile, &o, out);
+	if (out != stdout)
+		fclose(out);
+	return ret;
+}
@@ -0,0 +1,272 @@
+/*
+ * L2 forwarding over an emulated NIC, with and without "DDIO"
+ *
+ * Copyright (c) 2020, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+// Compile command: gcc -O2 -pthread ddio-vnic.c vnic.c hdr.c work.c pkt.c tsc.c -o ddio-vnic
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include "vnic.h"
+
+static volatile sig_atomic_t stop;
+
+static void
+on_signal(int sig)
+{
+	(void)sig;
+	stop = 1;
+}
+
+/* "1,3,5-8" */
+static int
+parse_cpus(const char *arg, int *cpu, unsigned int max)
+{
+	char copy[1024], *tok, *save;
+	unsigned int n = 0;
+
+	snprintf(copy, sizeof(copy), "%s", arg);
+	for (tok = strtok_r(copy, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+		int lo, hi;
+
+		if (sscanf(tok, "%d-%d", &lo, &hi) != 2)
+			hi = lo = atoi(tok);
+		for (; lo <= hi; lo++) {
+			if (n == max) {
+				fprintf(stderr, "Too many cores in '%s'\n", arg);
+				return -1;
+			}
+			cpu[n++] = lo;
+		}
+	}
+	return n;
+}
+
+static void
+usage(const char *prog)
+{
+	printf("Usage: %s [options]\n", prog);
+	printf("\nOptions:\n");
+	printf("  -q queues   : Queues, one consumer core each (default: 1)\n");
+	printf("  -d desc     : RX descriptors per queue, the NDESC of FromDPDKDevice (default: 4096)\n");
+	printf("  -b burst    : RX burst (default: 32)\n");
+	printf("  -s size     : Packet size (default: 1024)\n");
+	printf("  -p pool     : Reuse of free buffers: lifo or fifo (default: lifo)\n");
+	printf("  -B kbytes   : Cache budget of the buffers in use per queue (default: no bound)\n");
+	printf("  -r gbps     : Offered load of all queues (default: as fast as possible)\n");
+	printf("  -R gbps     : TX rate of all queues, below -r for TX backpressure (default: as fast as possible)\n");
+	printf("  -D us       : Dynamic RX burst and ring, deciding every us microseconds (e.g., 100)\n");
+	printf("  -w n_w      : Random calls per packet, like WorkPackage (default: 0)\n");
+	printf("  -k kernel   : Processing kernel instead: spin, csum, parse, hash, or random,\n");
+	printf("                with [,n=<ops>][,ws=<size>][,bytes=<bytes>][,wr=<%%>][,isa=<isa>]\n");
+	printf("  -m mode     : alloc (regular stores, like DDIO) or nt (non-temporal stores, no DDIO)\n");
+	printf("  -C core     : Core of the NIC thread\n");
+	printf("  -c cores    : Cores of the consumers, e.g., 2-5 (default: not pinned)\n");
+	printf("  -t seconds  : Measurement time (default: 5)\n");
+	printf("  -u seconds  : Warm-up time (default: 1)\n");
+	printf("  -T          : Stamp every packet at every stage and decompose the latency\n");
+	printf("  -H file     : Save the latency histogram to file (see ddio-hdr)\n");
+	printf("  -o file     : Write results to file instead of stdout\n");
+	printf("\nExample:\n");
+	printf("  %s -q 4 -d 1024 -s 1500 -m alloc -C 1 -c 2-5 -t 10\n", prog);
+	printf("  %s -q 4 -d 1024 -s 1500 -m nt -C 1 -c 2-5 -t 10\n", prog);
+	printf("  %s -q 4 -d 1024 -s 1500 -m nt -r 40 -T -C 1 -c 2-5\n", prog);
+	printf("  %s -q 4 -d 1024 -s 1500 -k random,n=8,ws=8M -C 1 -c 2-5\n", prog);
+	printf("  %s -q 4 -d 1024 -s 1500 -r 40 -R 25 -D 100 -C 1 -c 2-5\n", prog);
+}
+
+int main(int argc, char *argv[])
+{
+	struct vnic_config cfg;
+	struct vnic_stats st;
+	struct vnic v;
+	const char *outfile = NULL, *cpus = NULL, *hdrfile = NULL;
+	double seconds = 5, warmup = 1, wire;
+	FILE *out = stdout;
+	int opt, n, ret = 0;
+
+	vnic_config_default(&cfg);
+	while ((opt = getopt(argc, argv, "q:d:b:s:p:B:r:R:D:w:k:m:C:c:t:u:TH:o:h")) != -1) {
+		switch (opt) {
+		case 'q':
+			cfg.queues = strtoul(optarg, NULL, 0);
+			break;
+		case 'd':
+			cfg.ndesc = strtoul(optarg, NULL, 0);
+			break;
+		case 'b':
+			cfg.burst = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			cfg.pkt_size = strtoul(optarg, NULL, 0);
+			break;
+		case 'p':
+			if (!strcmp(optarg, "lifo")) {
+				cfg.pool = VNIC_POOL_LIFO;
+			} else if (!strcmp(optarg, "fifo")) {
+				cfg.pool = VNIC_POOL_FIFO;
+			} else {
+				printf("Unknown pool %s!\n", optarg);
+				return 1;
+			}
+			break;
+		case 'B':
+			cfg.budget = atof(optarg) * 1024;
+			break;
+		case 'r':
+			cfg.rate_gbps = atof(optarg);
+			break;
+		case 'R':
+			cfg.tx_gbps = atof(optarg);
+			break;
+		case 'D':
+			cfg.dynamic = 1;
+			cfg.dyn_us = strtoul(optarg, NULL, 0);
+			break;
+		case 'w':
+			work_config_default(&cfg.work);
+			cfg.work.n = strtoul(optarg, NULL, 0);
+			break;
+		case 'k':
+			if (work_parse(optarg, &cfg.work)) {
+				printf("Bad kernel %s!\n", optarg);
+				return 1;
+			}
+			break;
+		case 'm':
+			if (!strcmp(optarg, "alloc")) {
+				cfg.store = VNIC_ALLOC;
+			} else if (!strcmp(optarg, "nt")) {
+				cfg.store = VNIC_NT;
+			} else {
+				printf("Unknown mode %s!\n", optarg);
+				return 1;
+			}
+			break;
+		case 'C':
+			cfg.nic_cpu = atoi(optarg);
+			break;
+		case 'c':
+			cpus = optarg;
+			break;
+		case 't':
+			seconds = atof(optarg);
+			break;
+		case 'u':
+			warmup = atof(optarg);
+			break;
+		case 'T':
+			cfg.stages = 1;
+			break;
+		case 'H':
+			hdrfile = optarg;
+			break;
+		case 'o':
+			outfile = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+	if (!cfg.queues || cfg.queues > VNIC_MAX_QUEUES) {
+		printf("Bad number of queues %u!\n", cfg.queues);
+		return 1;
+	}
+	if (cpus) {
+		n = parse_cpus(cpus, cfg.cpu, VNIC_MAX_QUEUES);
+		if (n < 0)
+			return 1;
+		if ((unsigned int)n < cfg.queues) {
+			printf("%u queues need %u consumer cores!\n", cfg.queues, cfg.queues);
+			return 1;
+		}
+	}
+	/* Polling threads that share cores would otherwise starve each other */
+	cfg.yield = sysconf(_SC_NPROCESSORS_ONLN) <= cfg.queues;
+
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+	if (vnic_start(&v, &cfg))
+		return 1;
+	if (!v.hugepages)
+		fprintf(stderr, "No huge pages reserved; using transparent huge pages\n");
+	if (cfg.work.kernel != WORK_SPIN) {
+		char desc[128];
+
+		work_describe(&v.q[0].work, desc, sizeof(desc));
+		fprintf(stderr, "Kernel: %s per core\n", desc);
+	}
+	usleep(warmup * 1e6);
+	vnic_measure(&v);
+	for (n = 0; n < seconds * 10 && !stop; n++)
+		usleep(100000);
+	vnic_stop(&v, &st);
+
+	if (outfile) {
+		out = fopen(outfile, "w");
+		if (!out) {
+			perror(outfile);
+			vnic_free(&v);
+			return 1;
+		}
+	}
+	/* Every frame also occupies 20 bytes of preamble and inter-frame gap */
+	wire = (cfg.pkt_size + 20) * 8.0;
+	fprintf(out, "RESULT-TESTTIME %f\n", st.seconds);
+	fprintf(out, "RESULT-TXRATE %f\n", st.offered * wire / st.seconds);
+	fprintf(out, "RESULT-THROUGHPUT %f\n", st.sent * wire / st.seconds);
+	fprintf(out, "RESULT-PPS %f\n", st.sent / st.seconds);
+	fprintf(out, "RESULT-RX-DROPPED %" PRIu64 "\n", st.dropped);
+	fprintf(out, "RESULT-RX-OUT-OF-BUFFER %" PRIu64 "\n", st.nobuf);
+	fprintf(out, "RESULT-TX-FULL %" PRIu64 "\n", st.txfull);
+	fprintf(out, "RESULT-LATAVG %f\n", st.lat_avg);
+	hdr_write_results(st.lat, out, 1e3);
+	/* The averages of the stages add up to RESULT-LATAVG */
+	for (n = 0; st.stage && n < VNIC_STAGES; n++) {
+		const char *name = vnic_stage_name(n);
+
+		fprintf(out, "RESULT-STAGE-%s-AVG %f\n", name, hdr_mean(&st.stage[n]) / 1e3);
+		fprintf(out, "RESULT-STAGE-%s-LAT50 %f\n", name, hdr_percentile(&st.stage[n], 50) / 1e3);
+		fprintf(out, "RESULT-STAGE-%s-LAT99 %f\n", name, hdr_percentile(&st.stage[n], 99) / 1e3);
+	}
+	if (v.perf) {
+		fprintf(out, "RESULT-LLCMISSES %" PRIu64 "\n", st.llc_miss);
+		fprintf(out, "RESULT-LLCREFERENCES %" PRIu64 "\n", st.llc_ref);
+		fprintf(out, "RESULT-LLCMISSES-PER-PKT %f\n",
+		        st.processed ? (double)st.llc_miss / st.processed : 0);
+		/* The NIC thread's misses are those of its writes, like ItoM misses */
+		fprintf(out, "RESULT-NIC-LLCMISSES %" PRIu64 "\n", st.nic_llc_miss);
+		fprintf(out, "RESULT-NIC-MISS-RATE %f\n",
+		        st.nic_llc_ref ? 100.0 * st.nic_llc_miss / st.nic_llc_ref : 0);
+	}
+	fprintf(out, "RESULT-BUFFER-FOOTPRINT %" PRIu64 "\n", st.footprint);
+	if (cfg.dynamic) {
+		fprintf(out, "RESULT-DYN-RING-AVG %f\n", st.dyn_ring);
+		fprintf(out, "RESULT-DYN-BURST-AVG %f\n", st.dyn_burst);
+		fprintf(out, "RESULT-DYN-SHRINKS %" PRIu64 "\n", st.dyn_shrinks);
+		fprintf(out, "RESULT-DYN-GROWS %" PRIu64 "\n", st.dyn_grows);
+	}
+	fprintf(out, "RESULT-HUGEPAGES %d\n", v.hugepages);
+	if (out != stdout)
+		fclose(out);
+	if (hdrfile) {
+		FILE *f = fopen(hdrfile, "w");
+
+		if (!f || hdr_save(st.lat, f)) {
+			perror(hdrfile);
+			ret = 1;
+		}
+		if (f)
+			fclose(f);
+	}
+	vnic_free(&v);
+	return ret;
+}
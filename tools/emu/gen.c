@@ -0,0 +1,338 @@
+/*
+ * Packet generator threads with TSC-based pacing
+ *
+ * Copyright (c) 2020, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include "gen.h"
+#include "pkt.h"
+#include "tsc.h"
+
+static inline uint64_t
+xorshift(uint64_t *x)
+{
+	*x ^= *x << 13;
+	*x ^= *x >> 7;
+	*x ^= *x << 17;
+	return *x;
+}
+
+/* Uniform in (0, 1] */
+static inline double
+uniform(uint64_t *x)
+{
+	return ((xorshift(x) >> 11) + 1) * (1.0 / 9007199254740992.0);
+}
+
+void
+gen_pacer_init(struct gen_pacer *p, enum gen_process process, double pps, double depth,
+               double on_us, double off_us, uint64_t seed)
+{
+	memset(p, 0, sizeof(*p));
+	p->process = process;
+	p->per_tick = pps / tsc_hz();
+	p->depth = depth;
+	p->rnd = seed | 1;
+	p->last = tsc_now();
+	p->next = p->last;
+	if (process == GEN_ONOFF) {
+		/* The mean rate is pps: the on periods are faster */
+		p->per_tick *= (on_us + off_us) / on_us;
+		p->on_ticks = ns_to_tsc(on_us * 1e3);
+		p->off_ticks = ns_to_tsc(off_us * 1e3);
+		p->on = 1;
+		p->phase_end = p->last + p->on_ticks;
+	}
+}
+
+unsigned int
+gen_pacer_due(struct gen_pacer *p, uint64_t now, unsigned int max)
+{
+	uint64_t t = p->last;
+
+	switch (p->process) {
+	case GEN_CONSTANT:
+		p->tokens += (now - t) * p->per_tick;
+		break;
+	case GEN_POISSON:
+		/* Arrivals missed by more than a bucket would be dropped anyway */
+		if (now - p->next > p->depth / p->per_tick)
+			p->next = now - p->depth / p->per_tick;
+		while (p->next <= now) {
+			p->tokens += 1;
+			p->next -= log(uniform(&p->rnd)) / p->per_tick;
+		}
+		break;
+	case GEN_ONOFF:
+		while (p->phase_end <= now) {
+			if (p->on)
+				p->tokens += (p->phase_end - t) * p->per_tick;
+			t = p->phase_end;
+			p->on = !p->on;
+			p->phase_end += p->on ? p->on_ticks : p->off_ticks;
+		}
+		if (p->on)
+			p->tokens += (now - t) * p->per_tick;
+		break;
+	}
+	p->last = now;
+	if (p->tokens > p->depth)
+		p->tokens = p->depth;
+	return p->tokens < max ? (unsigned int)p->tokens : max;
+}
+
+void
+gen_config_default(struct gen_config *cfg)
+{
+	static const uint8_t src[6] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 };
+	static const uint8_t dst[6] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x02 };
+	int i;
+
+	memset(cfg, 0, sizeof(*cfg));
+	cfg->threads = 4;
+	cfg->pkt_size = 1024;
+	cfg->burst = 32;
+	traffic_config_default(&cfg->traffic);
+	cfg->process = GEN_CONSTANT;
+	cfg->on_us = 100;
+	cfg->off_us = 100;
+	memcpy(cfg->src_mac, src, 6);
+	memcpy(cfg->dst_mac, dst, 6);
+	for (i = 0; i < GEN_MAX_THREADS; i++)
+		cfg->cpu[i] = -1;
+}
+
+/* "constant", "poisson", or "onoff[:<on us>:<off us>]" */
+int
+gen_parse_process(const char *arg, struct gen_config *cfg)
+{
+	if (!strcmp(arg, "constant")) {
+		cfg->process = GEN_CONSTANT;
+	} else if (!strcmp(arg, "poisson")) {
+		cfg->process = GEN_POISSON;
+	} else if (!strncmp(arg, "onoff", 5)) {
+		cfg->process = GEN_ONOFF;
+		if (arg[5] == ':' && sscanf(arg + 6, "%lf:%lf", &cfg->on_us, &cfg->off_us) != 2)
+			return -1;
+		if (cfg->on_us <= 0 || cfg->off_us < 0)
+			return -1;
+	} else {
+		return -1;
+	}
+	return 0;
+}
+
+static void
+pin(int cpu)
+{
+	cpu_set_t set;
+
+	if (cpu < 0)
+		return;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set))
+		fprintf(stderr, "Cannot pin a thread to core %d\n", cpu);
+}
+
+static void
+gen_receive(struct gen_thread *t, uint64_t now, int measuring)
+{
+	struct gen *g = t->g;
+	struct port_pkt in[PORT_MAX_BURST];
+	unsigned int i, n;
+
+	n = port_rx(&t->port, in, g->cfg.burst);
+	for (i = 0; i < n; i++) {
+		uint64_t lat;
+
+		/* Forwarded packets come back with the MAC addresses swapped */
+		if (!pkt_is_test(in[i].data, in[i].len) || memcmp(in[i].data, g->cfg.src_mac, 6))
+			continue;
+		lat = now - pkt_get_u64(in[i].data, PKT_TS_OFFSET);
+		t->cnt.received++;
+		t->cnt.received_bytes += in[i].len;
+		t->cnt.lat_sum += lat;
+		if (measuring)
+			hdr_record(&t->lat, tsc_to_ns(lat));
+	}
+}
+
+/* TXM: paced bursts of test packets, and the packets that come back */
+static void *
+gen_main(void *arg)
+{
+	struct gen_thread *t = arg;
+	struct gen *g = t->g;
+	const struct gen_config *cfg = &g->cfg;
+	struct port_pkt out[PORT_MAX_BURST];
+	uint8_t *bufs;
+	uint64_t seq = 0, bytes;
+	unsigned int i, due;
+
+	pin(cfg->cpu[t->id]);
+	bufs = aligned_alloc(64, (size_t)cfg->burst * PORT_FRAME_SIZE);
+	if (!bufs) {
+		perror("aligned_alloc");
+		return NULL;
+	}
+	for (i = 0; i < cfg->burst; i++) {
+		out[i].data = bufs + (size_t)i * PORT_FRAME_SIZE;
+		pkt_build_udp(out[i].data, g->traffic.max_size);
+		memcpy(out[i].data, cfg->dst_mac, 6);
+		memcpy(out[i].data + 6, cfg->src_mac, 6);
+	}
+	while (!__atomic_load_n(&g->stop, __ATOMIC_RELAXED)) {
+		uint64_t now = tsc_now();
+
+		gen_receive(t, now, __atomic_load_n(&g->measuring, __ATOMIC_RELAXED));
+		due = cfg->rate_gbps > 0 ? gen_pacer_due(&t->pacer, now, cfg->burst) : cfg->burst;
+		if (!due) {
+			if (cfg->yield)
+				sched_yield();
+			continue;
+		}
+		for (i = 0; i < due; i++) {
+			out[i].len = traffic_size(&g->traffic, &t->stream);
+			traffic_set(out[i].data, out[i].len,
+			            traffic_flow(&g->traffic, &t->stream, tsc_to_ns(now - g->start)));
+			pkt_set_u64(out[i].data, PKT_SEQ_OFFSET, seq + i);
+			pkt_set_u64(out[i].data, PKT_TS_OFFSET, now);
+		}
+		due = port_tx(&t->port, out, due);
+		if (cfg->rate_gbps > 0)
+			gen_pacer_take(&t->pacer, due);
+		for (i = 0, bytes = 0; i < due; i++)
+			bytes += out[i].len;
+		seq += due;
+		t->cnt.sent += due;
+		t->cnt.sent_bytes += bytes;
+	}
+	free(bufs);
+	return NULL;
+}
+
+int
+gen_start(struct gen *g, const struct gen_config *cfg, const char *ifname,
+          const struct port_config *pcfg)
+{
+	struct port_config pc = *pcfg;
+	double pps;
+	unsigned int i;
+
+	memset(g, 0, sizeof(*g));
+	g->cfg = *cfg;
+	if (!cfg->threads || cfg->threads > GEN_MAX_THREADS || !cfg->burst ||
+	    cfg->burst > PORT_MAX_BURST || cfg->pkt_size < PKT_MIN_SIZE) {
+		fprintf(stderr, "Bad generator configuration\n");
+		return -1;
+	}
+	if (traffic_init(&g->traffic, &cfg->traffic, cfg->pkt_size))
+		return -1;
+	if (g->traffic.max_size > PORT_FRAME_SIZE - 64) {
+		fprintf(stderr, "Bad generator configuration\n");
+		traffic_free(&g->traffic);
+		return -1;
+	}
+	/* Every frame also occupies 20 bytes of preamble and inter-frame gap */
+	pps = cfg->rate_gbps * 1e9 / ((g->traffic.mean_size + 20) * 8) / cfg->threads;
+	if (cfg->threads > 1 && pc.fanout < 0)
+		pc.fanout = (getpid() ^ 0x5a5a) & 0xffff;
+	for (i = 0; i < cfg->threads; i++) {
+		struct gen_thread *t = &g->t[i];
+
+		t->g = g;
+		t->id = i;
+		t->rnd = 0x9E3779B97F4A7C15ull * (i + 1);
+		if (hdr_init(&t->lat))
+			goto fail;
+		/* Uniform flows are split between the threads, as with FastUDPFlows */
+		if (traffic_stream_init(&t->stream, &g->traffic,
+		                        i * (cfg->traffic.flows / cfg->threads), t->rnd))
+			goto fail;
+		pc.queue = pcfg->queue + i;
+		if (port_open(&t->port, ifname, &pc))
+			goto fail;
+		t->opened = 1;
+		if (cfg->rate_gbps > 0)
+			gen_pacer_init(&t->pacer, cfg->process, pps, cfg->burst, cfg->on_us,
+			               cfg->off_us, t->rnd);
+	}
+	g->start = tsc_now();
+	for (i = 0; i < cfg->threads; i++) {
+		if (pthread_create(&g->t[i].thread, NULL, gen_main, &g->t[i])) {
+			perror("pthread_create");
+			g->cfg.threads = i;
+			gen_stop(g);
+			g->cfg.threads = cfg->threads;
+			goto fail;
+		}
+	}
+	return 0;
+fail:
+	gen_free(g);
+	return -1;
+}
+
+void
+gen_measure(struct gen *g, int on)
+{
+	__atomic_store_n(&g->measuring, on, __ATOMIC_RELAXED);
+}
+
+void
+gen_snapshot(const struct gen *g, struct gen_counters *c)
+{
+	unsigned int i;
+
+	memset(c, 0, sizeof(*c));
+	for (i = 0; i < g->cfg.threads; i++) {
+		c->sent += g->t[i].cnt.sent;
+		c->received += g->t[i].cnt.received;
+		c->sent_bytes += g->t[i].cnt.sent_bytes;
+		c->received_bytes += g->t[i].cnt.received_bytes;
+		c->lat_sum += g->t[i].cnt.lat_sum;
+	}
+}
+
+void
+gen_stop(struct gen *g)
+{
+	unsigned int i;
+
+	__atomic_store_n(&g->stop, 1, __ATOMIC_RELAXED);
+	for (i = 0; i < g->cfg.threads; i++)
+		pthread_join(g->t[i].thread, NULL);
+}
+
+void
+gen_histogram(const struct gen *g, struct hdr *h)
+{
+	unsigned int i;
+
+	for (i = 0; i < g->cfg.threads; i++)
+		hdr_merge(h, &g->t[i].lat);
+}
+
+void
+gen_free(struct gen *g)
+{
+	unsigned int i;
+
+	for (i = 0; i < GEN_MAX_THREADS; i++) {
+		if (g->t[i].opened)
+			port_close(&g->t[i].port);
+		hdr_free(&g->t[i].lat);
+		traffic_stream_free(&g->t[i].stream);
+		g->t[i].opened = 0;
+	}
+	traffic_free(&g->traffic);
+}
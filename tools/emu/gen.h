@@ -0,0 +1,122 @@
+/*
+ * Packet generator threads with TSC-based pacing
+ *
+ * Copyright (c) 2020, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#ifndef DDIO_GEN_H
+#define DDIO_GEN_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "hdr.h"
+#include "port.h"
+#include "traffic.h"
+
+#define GEN_MAX_THREADS		64
+
+enum gen_process {
+	GEN_CONSTANT,			/* evenly spaced packets */
+	GEN_POISSON,			/* exponential inter-arrival times */
+	GEN_ONOFF,			/* constant bursts at rate * (on + off) / on, then silence */
+};
+
+/*
+ * Token bucket of one thread. The arrival process adds tokens, up to
+ * `depth`, and every packet sent takes one, so a thread that falls behind
+ * sends at most a burst at once instead of its whole backlog.
+ */
+struct gen_pacer {
+	enum gen_process process;
+	double per_tick;		/* packets per TSC tick (while on) */
+	double tokens, depth;
+	uint64_t last;
+	double next;			/* GEN_POISSON: next arrival */
+	uint64_t on_ticks, off_ticks;	/* GEN_ONOFF */
+	uint64_t phase_end;
+	int on;
+	uint64_t rnd;
+};
+
+void gen_pacer_init(struct gen_pacer *p, enum gen_process process, double pps,
+                    double depth, double on_us, double off_us, uint64_t seed);
+
+/* Packets that may be sent at `now`, at most max; take them with gen_pacer_take() */
+unsigned int gen_pacer_due(struct gen_pacer *p, uint64_t now, unsigned int max);
+
+static inline void
+gen_pacer_take(struct gen_pacer *p, unsigned int n)
+{
+	p->tokens -= n;
+}
+
+struct gen_config {
+	unsigned int threads;		/* GEN_THREADS */
+	unsigned int pkt_size;		/* GEN_PKT_SIZE, unless traffic has a size mix */
+	unsigned int burst;		/* packets per transmit, and bucket depth */
+	struct traffic_config traffic;	/* sizes and flows */
+	double rate_gbps;		/* of all threads, 0: as fast as possible */
+	enum gen_process process;
+	double on_us, off_us;		/* GEN_ONOFF */
+	uint8_t src_mac[6], dst_mac[6];
+	int cpu[GEN_MAX_THREADS];	/* -1: not pinned */
+	int yield;			/* yield when idle (oversubscribed cores) */
+};
+
+struct gen_counters {
+	uint64_t sent;
+	uint64_t received;		/* test packets back with our MAC as destination */
+	uint64_t sent_bytes, received_bytes;	/* frames, without preamble and IFG */
+	uint64_t lat_sum;		/* TSC ticks */
+};
+
+struct gen;
+
+struct gen_thread {
+	struct gen *g;
+	unsigned int id;
+	struct port port;
+	int opened;
+	pthread_t thread;
+	struct gen_pacer pacer;
+	struct traffic_stream stream;
+	struct gen_counters cnt;
+	struct hdr lat;			/* ns, recorded while measuring */
+	uint64_t rnd;
+} __attribute__((aligned(64)));
+
+struct gen {
+	struct gen_config cfg;
+	struct traffic traffic;
+	uint64_t start;			/* TSC, for flow churn */
+	struct gen_thread t[GEN_MAX_THREADS];
+	int stop, measuring;
+};
+
+/*
+ * Defaults follow the experiments: 4 threads, 1024-byte packets over 4096
+ * uniform flows, in bursts of 32, as fast as possible.
+ */
+void gen_config_default(struct gen_config *cfg);
+
+/* Opens a socket per thread on ifname (see port_open()) and starts the threads */
+int  gen_start(struct gen *g, const struct gen_config *cfg, const char *ifname,
+               const struct port_config *pcfg);
+
+/* Latencies are only recorded while measuring */
+void gen_measure(struct gen *g, int on);
+
+/* Counters of all threads */
+void gen_snapshot(const struct gen *g, struct gen_counters *c);
+
+void gen_stop(struct gen *g);
+
+/* Adds the latencies of all threads, in ns, to h */
+void gen_histogram(const struct gen *g, struct hdr *h);
+
+void gen_free(struct gen *g);
+
+int  gen_parse_process(const char *arg, struct gen_config *cfg);
+
+#endif /* DDIO_GEN_H */
@@ -0,0 +1,166 @@
+/*
+ * High dynamic range (HDR) histograms of latencies
+ *
+ * Copyright (c) 2020, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "hdr.h"
+
+int
+hdr_init(struct hdr *h)
+{
+	h->counts = calloc(HDR_BUCKETS, sizeof(*h->counts));
+	if (!h->counts) {
+		perror("calloc");
+		return -1;
+	}
+	h->total = h->sum = h->max = 0;
+	h->min = UINT64_MAX;
+	return 0;
+}
+
+void
+hdr_free(struct hdr *h)
+{
+	free(h->counts);
+	h->counts = NULL;
+}
+
+void
+hdr_reset(struct hdr *h)
+{
+	memset(h->counts, 0, HDR_BUCKETS * sizeof(*h->counts));
+	h->total = h->sum = h->max = 0;
+	h->min = UINT64_MAX;
+}
+
+static inline unsigned int
+bucket_shift(unsigned int i)
+{
+	return i < 2 * HDR_HALF ? 0 : i / HDR_HALF - 1;
+}
+
+uint64_t
+hdr_lowest(unsigned int i)
+{
+	unsigned int shift = bucket_shift(i);
+
+	return (uint64_t)(i - shift * HDR_HALF) << shift;
+}
+
+uint64_t
+hdr_highest(unsigned int i)
+{
+	return hdr_lowest(i) + (1ull << bucket_shift(i)) - 1;
+}
+
+void
+hdr_merge(struct hdr *dst, const struct hdr *src)
+{
+	unsigned int i;
+
+	for (i = 0; i < HDR_BUCKETS; i++)
+		dst->counts[i] += __atomic_load_n(&src->counts[i], __ATOMIC_RELAXED);
+	dst->total += __atomic_load_n(&src->total, __ATOMIC_RELAXED);
+	dst->sum += __atomic_load_n(&src->sum, __ATOMIC_RELAXED);
+	if (src->min < dst->min)
+		dst->min = src->min;
+	if (src->max > dst->max)
+		dst->max = src->max;
+}
+
+uint64_t
+hdr_percentile(const struct hdr *h, double p)
+{
+	uint64_t rank, seen = 0;
+	unsigned int i;
+
+	if (!h->total)
+		return 0;
+	/* The smallest value with at least p% of the values at or below it */
+	rank = p / 100 * h->total + 0.5;
+	rank = rank < 1 ? 1 : rank > h->total ? h->total : rank;
+	for (i = 0; i < HDR_BUCKETS; i++) {
+		seen += h->counts[i];
+		if (seen >= rank)
+			return hdr_highest(i) < h->max ? hdr_highest(i) : h->max;
+	}
+	return h->max;
+}
+
+double
+hdr_mean(const struct hdr *h)
+{
+	return h->total ? (double)h->sum / h->total : 0;
+}
+
+void
+hdr_write_results(const struct hdr *h, FILE *f, double scale)
+{
+	fprintf(f, "RESULT-LAT50 %f\n", hdr_percentile(h, 50) / scale);
+	fprintf(f, "RESULT-LAT99 %f\n", hdr_percentile(h, 99) / scale);
+	fprintf(f, "RESULT-LAT999 %f\n", hdr_percentile(h, 99.9) / scale);
+	fprintf(f, "RESULT-LAT9999 %f\n", hdr_percentile(h, 99.99) / scale);
+	fprintf(f, "RESULT-LATMAX %f\n", h->max / scale);
+}
+
+void
+hdr_write_cdf(const struct hdr *h, FILE *f, double scale)
+{
+	uint64_t seen = 0;
+	unsigned int i;
+
+	fprintf(f, "value,count,fraction\n");
+	for (i = 0; i < HDR_BUCKETS; i++) {
+		if (!h->counts[i])
+			continue;
+		seen += h->counts[i];
+		fprintf(f, "%f,%" PRIu64 ",%.9f\n", hdr_highest(i) / scale, h->counts[i],
+		        (double)seen / h->total);
+	}
+}
+
+int
+hdr_save(const struct hdr *h, FILE *f)
+{
+	unsigned int i;
+
+	fprintf(f, "HDR %u %u\n", HDR_SUB_BITS, HDR_MAX_BITS);
+	fprintf(f, "%" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64 "\n", h->total, h->sum,
+	        h->total ? h->min : 0, h->max);
+	for (i = 0; i < HDR_BUCKETS; i++)
+		if (h->counts[i])
+			fprintf(f, "%u %" PRIu64 "\n", i, h->counts[i]);
+	return ferror(f) ? -1 : 0;
+}
+
+int
+hdr_load(struct hdr *h, FILE *f)
+{
+	uint64_t total, sum, min, max, count, n = 0;
+	unsigned int sub, bits, i;
+
+	if (fscanf(f, "HDR %u %u", &sub, &bits) != 2 || sub != HDR_SUB_BITS || bits != HDR_MAX_BITS)
+		return -1;
+	if (fscanf(f, "%" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64, &total, &sum, &min, &max) != 4)
+		return -1;
+	while (fscanf(f, "%u %" SCNu64, &i, &count) == 2) {
+		if (i >= HDR_BUCKETS)
+			return -1;
+		h->counts[i] += count;
+		n += count;
+	}
+	if (n != total)
+		return -1;
+	h->total += total;
+	h->sum += sum;
+	if (total && min < h->min)
+		h->min = min;
+	if (max > h->max)
+		h->max = max;
+	return 0;
+}
@@ -0,0 +1,85 @@
+/*
+ * High dynamic range (HDR) histograms of latencies
+ *
+ * Copyright (c) 2020, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#ifndef DDIO_HDR_H
+#define DDIO_HDR_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/*
+ * Log-linear buckets: values below 2^HDR_SUB_BITS have their own bucket,
+ * and every power of 2 above is split into 2^(HDR_SUB_BITS - 1) buckets, so
+ * a value is known within 1/128 (0.8%) up to 2^HDR_MAX_BITS (about 68 s in ns).
+ * All histograms have the same buckets and merge without loss.
+ */
+#define HDR_SUB_BITS		8
+#define HDR_MAX_BITS		36
+#define HDR_HALF		(1u << (HDR_SUB_BITS - 1))
+#define HDR_BUCKETS		((HDR_MAX_BITS - HDR_SUB_BITS + 2) * HDR_HALF)
+
+/* Written by one thread; others may read it at any time */
+struct hdr {
+	uint64_t *counts;
+	uint64_t total, sum;
+	uint64_t min, max;
+};
+
+int  hdr_init(struct hdr *h);
+void hdr_free(struct hdr *h);
+void hdr_reset(struct hdr *h);
+
+static inline unsigned int
+hdr_index(uint64_t v)
+{
+	unsigned int shift;
+
+	if (v < 2 * HDR_HALF)
+		return v;
+	if (v >> HDR_MAX_BITS)
+		v = (1ull << HDR_MAX_BITS) - 1;
+	shift = 63 - __builtin_clzll(v) - (HDR_SUB_BITS - 1);
+	return shift * HDR_HALF + (v >> shift);
+}
+
+/* A few ns: no locks, no atomic read-modify-writes, only relaxed stores */
+static inline void
+hdr_record(struct hdr *h, uint64_t v)
+{
+	uint64_t *c = &h->counts[hdr_index(v)];
+
+	__atomic_store_n(c, *c + 1, __ATOMIC_RELAXED);
+	__atomic_store_n(&h->total, h->total + 1, __ATOMIC_RELAXED);
+	__atomic_store_n(&h->sum, h->sum + v, __ATOMIC_RELAXED);
+	if (v < h->min)
+		__atomic_store_n(&h->min, v, __ATOMIC_RELAXED);
+	if (v > h->max)
+		__atomic_store_n(&h->max, v, __ATOMIC_RELAXED);
+}
+
+/* Lowest and highest values of bucket i */
+uint64_t hdr_lowest(unsigned int i);
+uint64_t hdr_highest(unsigned int i);
+
+/* Adds the counts of src to dst */
+void hdr_merge(struct hdr *dst, const struct hdr *src);
+
+/* Value at percentile p (0-100): the highest value of its bucket, at most the maximum */
+uint64_t hdr_percentile(const struct hdr *h, double p);
+double   hdr_mean(const struct hdr *h);
+
+/* RESULT-LAT50, LAT99, LAT999, LAT9999, and LATMAX, values divided by scale */
+void hdr_write_results(const struct hdr *h, FILE *f, double scale);
+
+/* "value,count,fraction" of every bucket in use, values divided by scale */
+void hdr_write_cdf(const struct hdr *h, FILE *f, double scale);
+
+/* Text file of the non-empty buckets, to merge the histograms of several runs */
+int  hdr_save(const struct hdr *h, FILE *f);
+/* Adds the histogram of the file to h */
+int  hdr_load(struct hdr *h, FILE *f);
+
+#endif /* DDIO_HDR_H */
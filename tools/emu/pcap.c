@@ -0,0 +1,383 @@
+/*
+ * pcap and pcapng files: buffered writer and mmap reader
+ *
+ * Copyright (c) 2020, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "pcap.h"
+
+#define MAGIC_US		0xa1b2c3d4
+#define MAGIC_NS		0xa1b23c4d
+#define LINKTYPE_ETHERNET	1
+
+#define NG_SHB			0x0a0d0d0a
+#define NG_IDB			1
+#define NG_SPB			3
+#define NG_EPB			6
+#define NG_BOM			0x1a2b3c4d
+#define NG_OPT_TSRESOL		9
+
+enum pcap_format
+pcap_format_of(const char *path)
+{
+	size_t n = strlen(path);
+
+	return n > 7 && !strcmp(path + n - 7, ".pcapng") ? PCAP_NG : PCAP_CLASSIC;
+}
+
+static int
+flush(struct pcap_writer *w)
+{
+	size_t done = 0;
+
+	while (done < w->len) {
+		ssize_t n = write(w->fd, w->buf + done, w->len - done);
+
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("write");
+			return -1;
+		}
+		done += n;
+	}
+	w->bytes += w->len;
+	w->len = 0;
+	return 0;
+}
+
+static inline uint8_t *
+reserve(struct pcap_writer *w, size_t n)
+{
+	uint8_t *p;
+
+	if (w->len + n > w->size && flush(w))
+		return NULL;
+	p = w->buf + w->len;
+	w->len += n;
+	return p;
+}
+
+static inline void
+put32(uint8_t *p, uint32_t x)
+{
+	memcpy(p, &x, 4);
+}
+
+static inline void
+put16(uint8_t *p, uint16_t x)
+{
+	memcpy(p, &x, 2);
+}
+
+int
+pcap_writer_open(struct pcap_writer *w, const char *path, enum pcap_format format,
+                 size_t buf_size)
+{
+	uint8_t *p;
+
+	memset(w, 0, sizeof(*w));
+	w->format = format;
+	/* A buffer always holds a whole record */
+	w->size = buf_size < 2 * PCAP_SNAPLEN ? 2 * PCAP_SNAPLEN : buf_size;
+	w->buf = malloc(w->size);
+	if (!w->buf)
+		return -1;
+	w->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (w->fd < 0) {
+		perror(path);
+		free(w->buf);
+		return -1;
+	}
+	posix_fadvise(w->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+	if (format == PCAP_CLASSIC) {
+		p = reserve(w, 24);
+		put32(p, MAGIC_NS);
+		put16(p + 4, 2);
+		put16(p + 6, 4);
+		put32(p + 8, 0);		/* thiszone */
+		put32(p + 12, 0);		/* sigfigs */
+		put32(p + 16, PCAP_SNAPLEN);
+		put32(p + 20, LINKTYPE_ETHERNET);
+		return 0;
+	}
+
+	p = reserve(w, 28);
+	put32(p, NG_SHB);
+	put32(p + 4, 28);
+	put32(p + 8, NG_BOM);
+	put16(p + 12, 1);
+	put16(p + 14, 0);
+	memset(p + 16, 0xff, 8);		/* section length: unknown */
+	put32(p + 24, 28);
+
+	p = reserve(w, 32);
+	put32(p, NG_IDB);
+	put32(p + 4, 32);
+	put16(p + 8, LINKTYPE_ETHERNET);
+	put16(p + 10, 0);
+	put32(p + 12, PCAP_SNAPLEN);
+	put16(p + 16, NG_OPT_TSRESOL);
+	put16(p + 18, 1);
+	put32(p + 20, 9);			/* ns, and padding */
+	put32(p + 24, 0);			/* opt_endofopt */
+	put32(p + 28, 32);
+	return 0;
+}
+
+int
+pcap_write(struct pcap_writer *w, uint64_t ts_ns, const uint8_t *data, uint32_t len)
+{
+	uint32_t cap = len < PCAP_SNAPLEN ? len : PCAP_SNAPLEN;
+	uint32_t pad = (4 - cap % 4) % 4;
+	uint8_t *p;
+
+	if (w->format == PCAP_CLASSIC) {
+		p = reserve(w, 16 + cap);
+		if (!p)
+			return -1;
+		put32(p, ts_ns / 1000000000);
+		put32(p + 4, ts_ns % 1000000000);
+		put32(p + 8, cap);
+		put32(p + 12, len);
+		memcpy(p + 16, data, cap);
+	} else {
+		p = reserve(w, 32 + cap + pad);
+		if (!p)
+			return -1;
+		put32(p, NG_EPB);
+		put32(p + 4, 32 + cap + pad);
+		put32(p + 8, 0);
+		put32(p + 12, ts_ns >> 32);
+		put32(p + 16, ts_ns);
+		put32(p + 20, cap);
+		put32(p + 24, len);
+		memcpy(p + 28, data, cap);
+		memset(p + 28 + cap, 0, pad);
+		put32(p + 28 + cap + pad, 32 + cap + pad);
+	}
+	w->packets++;
+	return 0;
+}
+
+int
+pcap_writer_close(struct pcap_writer *w)
+{
+	int ret = flush(w);
+
+	if (close(w->fd) && !ret) {
+		perror("close");
+		ret = -1;
+	}
+	free(w->buf);
+	return ret;
+}
+
+static inline uint32_t
+get32(const struct pcap_reader *r, size_t off)
+{
+	uint32_t x;
+
+	memcpy(&x, r->map + off, 4);
+	return r->swap ? __builtin_bswap32(x) : x;
+}
+
+static inline uint16_t
+get16(const struct pcap_reader *r, size_t off)
+{
+	uint16_t x;
+
+	memcpy(&x, r->map + off, 2);
+	return r->swap ? __builtin_bswap16(x) : x;
+}
+
+int
+pcap_reader_open(struct pcap_reader *r, const char *path)
+{
+	struct stat st;
+	uint32_t magic;
+	int fd;
+
+	memset(r, 0, sizeof(*r));
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		perror(path);
+		return -1;
+	}
+	if (fstat(fd, &st) || st.st_size < 24) {
+		printf("%s is not a pcap file!\n", path);
+		close(fd);
+		return -1;
+	}
+	r->size = st.st_size;
+	/* Populated up front, so that replay does not take page faults */
+	r->map = mmap(NULL, r->size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+	close(fd);
+	if (r->map == MAP_FAILED) {
+		perror("mmap");
+		return -1;
+	}
+	madvise((void *)r->map, r->size, MADV_SEQUENTIAL);
+
+	memcpy(&magic, r->map, 4);
+	switch (magic) {
+	case MAGIC_US:
+	case MAGIC_NS:
+		r->format = PCAP_CLASSIC;
+		break;
+	case __builtin_bswap32(MAGIC_US):
+	case __builtin_bswap32(MAGIC_NS):
+		r->format = PCAP_CLASSIC;
+		r->swap = 1;
+		break;
+	case NG_SHB:
+		/* The byte order is read from the SHB by pcap_next() */
+		r->format = PCAP_NG;
+		break;
+	default:
+		printf("%s is not a pcap file!\n", path);
+		pcap_reader_close(r);
+		return -1;
+	}
+	if (r->format == PCAP_CLASSIC) {
+		r->ts_mul = (magic == MAGIC_US || magic == __builtin_bswap32(MAGIC_US)) ? 1000 : 1;
+		if (get32(r, 20) != LINKTYPE_ETHERNET)
+			printf("Warning: %s is not an Ethernet capture\n", path);
+		r->first = 24;
+	}
+	r->off = r->first;
+	return 0;
+}
+
+/* Time stamp resolution of an IDB, in units per second */
+static uint64_t
+idb_resolution(const struct pcap_reader *r, size_t off, uint32_t len)
+{
+	size_t o = off + 16, end = off + len - 4;
+
+	while (o + 4 <= end) {
+		uint16_t code = get16(r, o), olen = get16(r, o + 2);
+
+		if (!code || o + 4 + olen > end)
+			break;
+		if (code == NG_OPT_TSRESOL && olen >= 1) {
+			uint8_t v = r->map[o + 4];
+			uint64_t res = 1;
+
+			if (v & 0x80)
+				return 1ull << (v & 0x7f);
+			while (v--)
+				res *= 10;
+			return res;
+		}
+		o += 4 + ((olen + 3) & ~3u);
+	}
+	return 1000000;
+}
+
+static int
+next_ng(struct pcap_reader *r, struct pcap_view *v)
+{
+	while (r->off + 12 <= r->size) {
+		size_t off = r->off;
+		uint32_t type, len, bom;
+
+		memcpy(&type, r->map + off, 4);
+		if (type == NG_SHB) {
+			memcpy(&bom, r->map + off + 8, 4);
+			if (bom != NG_BOM && bom != __builtin_bswap32(NG_BOM))
+				return -1;
+			r->swap = bom != NG_BOM;
+			r->nif = 0;
+		} else {
+			type = r->swap ? __builtin_bswap32(type) : type;
+		}
+		len = get32(r, off + 4);
+		if (len < 12 || len % 4 || len > r->size - off)
+			return -1;
+		r->off += len;
+
+		switch (type) {
+		case NG_IDB:
+			if (len < 20)
+				return -1;
+			if (r->nif < PCAP_MAX_IFACES)
+				r->if_res[r->nif] = idb_resolution(r, off, len);
+			r->nif++;
+			break;
+		case NG_EPB: {
+			uint32_t ifid, cap;
+			uint64_t ts, res;
+
+			if (len < 32)
+				return -1;
+			ifid = get32(r, off + 8);
+			cap = get32(r, off + 20);
+			if (cap > len - 32)
+				return -1;
+			res = ifid < r->nif && ifid < PCAP_MAX_IFACES ? r->if_res[ifid] : 1000000;
+			ts = (uint64_t)get32(r, off + 12) << 32 | get32(r, off + 16);
+			v->data = r->map + off + 28;
+			v->len = cap;
+			v->wire_len = get32(r, off + 24);
+			v->ts_ns = ts / res * 1000000000 + ts % res * 1000000000 / res;
+			return 1;
+		}
+		case NG_SPB:
+			if (len < 16)
+				return -1;
+			/* No time stamp: keep the previous one */
+			v->data = r->map + off + 12;
+			v->wire_len = get32(r, off + 8);
+			v->len = v->wire_len < len - 16 ? v->wire_len : len - 16;
+			return 1;
+		default:
+			break;
+		}
+	}
+	return r->off == r->size ? 0 : -1;
+}
+
+int
+pcap_next(struct pcap_reader *r, struct pcap_view *v)
+{
+	uint32_t cap;
+
+	if (r->format == PCAP_NG)
+		return next_ng(r, v);
+
+	if (r->off + 16 > r->size)
+		return r->off == r->size ? 0 : -1;
+	cap = get32(r, r->off + 8);
+	if (cap > r->size - r->off - 16)
+		return -1;
+	v->ts_ns = get32(r, r->off) * 1000000000ull + (uint64_t)get32(r, r->off + 4) * r->ts_mul;
+	v->len = cap;
+	v->wire_len = get32(r, r->off + 12);
+	v->data = r->map + r->off + 16;
+	r->off += 16 + cap;
+	return 1;
+}
+
+void
+pcap_rewind(struct pcap_reader *r)
+{
+	r->off = r->first;
+}
+
+void
+pcap_reader_close(struct pcap_reader *r)
+{
+	munmap((void *)r->map, r->size);
+}
@@ -0,0 +1,63 @@
+/*
+ * pcap and pcapng files: buffered writer and mmap reader
+ *
+ * Copyright (c) 2020, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#ifndef DDIO_PCAP_H
+#define DDIO_PCAP_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define PCAP_SNAPLEN		65535
+#define PCAP_BUF_SIZE		(4 << 20)	/* bytes buffered by the writer per write() */
+#define PCAP_MAX_IFACES		16		/* pcapng interfaces with their own time resolution */
+
+enum pcap_format {
+	PCAP_CLASSIC,			/* libpcap, ns time stamps */
+	PCAP_NG,			/* one SHB and IDB, then EPBs */
+};
+
+struct pcap_writer {
+	int fd;
+	enum pcap_format format;
+	uint8_t *buf;
+	size_t len, size;
+	uint64_t packets, bytes;	/* bytes written to the file */
+};
+
+/* A packet in the mapped file, valid until pcap_reader_close() */
+struct pcap_view {
+	const uint8_t *data;
+	uint32_t len;			/* captured */
+	uint32_t wire_len;
+	uint64_t ts_ns;
+};
+
+struct pcap_reader {
+	const uint8_t *map;
+	size_t size, off, first;	/* first: offset of the first packet */
+	enum pcap_format format;
+	int swap;			/* written with the other byte order */
+	uint32_t ts_mul;		/* classic: time stamp fraction to ns */
+	uint64_t if_res[PCAP_MAX_IFACES];	/* pcapng: units per second */
+	unsigned int nif;
+};
+
+/* The format follows the extension: .pcapng or pcap otherwise */
+enum pcap_format pcap_format_of(const char *path);
+
+int  pcap_writer_open(struct pcap_writer *w, const char *path, enum pcap_format format,
+                      size_t buf_size);
+/* Buffers the packet; the buffer goes to the file with a single write() when full */
+int  pcap_write(struct pcap_writer *w, uint64_t ts_ns, const uint8_t *data, uint32_t len);
+int  pcap_writer_close(struct pcap_writer *w);
+
+int  pcap_reader_open(struct pcap_reader *r, const char *path);
+/* 1 with the next packet, 0 at the end of the file, -1 if it is truncated or corrupted */
+int  pcap_next(struct pcap_reader *r, struct pcap_view *v);
+void pcap_rewind(struct pcap_reader *r);
+void pcap_reader_close(struct pcap_reader *r);
+
+#endif /* DDIO_PCAP_H */
@@ -0,0 +1,58 @@
+/*
+ * Test packets of the emulated testbed
+ *
+ * Copyright (c) 2020, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#include "pkt.h"
+
+void
+pkt_build_udp(uint8_t *p, unsigned int len)
+{
+	static const uint8_t hdr[42] = {
+		0x02, 0x00, 0x00, 0x00, 0x00, 0x02,		/* dst */
+		0x02, 0x00, 0x00, 0x00, 0x00, 0x01,		/* src */
+		0x08, 0x00,
+		0x45, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,	/* IPv4, length below */
+		0x40, 0x11, 0x00, 0x00,
+		10, 0, 0, 1,
+		10, 0, 0, 2,
+		PKT_UDP_PORT >> 8, PKT_UDP_PORT & 0xff,		/* UDP */
+		PKT_UDP_PORT >> 8, PKT_UDP_PORT & 0xff,
+		0x00, 0x00, 0x00, 0x00,
+	};
+	unsigned int i;
+
+	memcpy(p, hdr, sizeof(hdr));
+	p[16] = (len - 14) >> 8;
+	p[17] = (len - 14) & 0xff;
+	p[38] = (len - 34) >> 8;
+	p[39] = (len - 34) & 0xff;
+	for (i = sizeof(hdr); i < len; i++)
+		p[i] = i;
+	pkt_set_ip_csum(p);
+}
+
+/* CheckIPHeader drops packets with a wrong one */
+void
+pkt_set_ip_csum(uint8_t *p)
+{
+	uint32_t sum = 0;
+	unsigned int i;
+
+	p[24] = p[25] = 0;
+	for (i = 14; i < 34; i += 2)
+		sum += p[i] << 8 | p[i + 1];
+	while (sum >> 16)
+		sum = (sum & 0xffff) + (sum >> 16);
+	sum = ~sum & 0xffff;
+	p[24] = sum >> 8;
+	p[25] = sum & 0xff;
+}
+
+int
+pkt_is_test(const uint8_t *p, unsigned int len)
+{
+	return len >= PKT_MIN_SIZE && p[12] == 0x08 && p[13] == 0x00 && p[23] == 0x11 &&
+	       p[36] == (PKT_UDP_PORT >> 8) && p[37] == (PKT_UDP_PORT & 0xff);
+}
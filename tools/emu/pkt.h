@@ -0,0 +1,55 @@
+/*
+ * Test packets of the emulated testbed
+ *
+ * Copyright (c) 2020, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#ifndef DDIO_PKT_H
+#define DDIO_PKT_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define PKT_MIN_SIZE		64
+#define PKT_UDP_PORT		1234
+
+/* Where the sender stores the sequence number and TSC in the UDP payload */
+#define PKT_SEQ_OFFSET		42
+#define PKT_TS_OFFSET		50
+
+/* An Ethernet/IPv4/UDP frame of len bytes, like the flows of the generator */
+void pkt_build_udp(uint8_t *p, unsigned int len);
+
+/* Sets the IPv4 header checksum, e.g., after the length or the addresses change */
+void pkt_set_ip_csum(uint8_t *p);
+
+/* 1 if the frame is a test packet, i.e., UDP to PKT_UDP_PORT */
+int  pkt_is_test(const uint8_t *p, unsigned int len);
+
+/* EtherMirror */
+static inline void
+pkt_swap_mac(uint8_t *p)
+{
+	uint8_t mac[6];
+
+	memcpy(mac, p, 6);
+	memcpy(p, p + 6, 6);
+	memcpy(p + 6, mac, 6);
+}
+
+static inline void
+pkt_set_u64(uint8_t *p, unsigned int off, uint64_t x)
+{
+	memcpy(p + off, &x, sizeof(x));
+}
+
+static inline uint64_t
+pkt_get_u64(const uint8_t *p, unsigned int off)
+{
+	uint64_t x;
+
+	memcpy(&x, p + off, sizeof(x));
+	return x;
+}
+
+#endif /* DDIO_PKT_H */
@@ -0,0 +1,376 @@
+/*
+ * Packet I/O on a Linux interface: AF_XDP or AF_PACKET (TPACKET_V3) rings
+ *
+ * Copyright (c) 2020, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+
+#include "port.h"
+
+#define PACKET_BLOCK_SIZE	(1 << 16)	/* 32 frames */
+#define PACKET_TX_DATA		TPACKET_ALIGN(sizeof(struct tpacket3_hdr))
+
+void
+port_config_default(struct port_config *cfg)
+{
+	memset(cfg, 0, sizeof(*cfg));
+	cfg->frames = 4096;
+	cfg->fanout = -1;
+}
+
+const char *
+port_kind_name(const struct port *p)
+{
+	if (p->kind == PORT_XDP)
+		return p->zerocopy ? "AF_XDP (zero-copy)" : "AF_XDP (copy)";
+	return "AF_PACKET (TPACKET_V3)";
+}
+
+static inline struct tpacket_block_desc *
+packet_block(const struct port *p, unsigned int b)
+{
+	return (struct tpacket_block_desc *)(p->map + (size_t)b * p->block_size);
+}
+
+static int
+packet_open(struct port *p, const struct port_config *cfg)
+{
+	struct tpacket_req3 req;
+	struct sockaddr_ll sll;
+	int version = TPACKET_V3, one = 1;
+	size_t ring;
+
+	p->kind = PORT_PACKET;
+	p->fd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
+	if (p->fd < 0) {
+		perror("socket(AF_PACKET)");
+		return -1;
+	}
+	if (setsockopt(p->fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version))) {
+		perror("PACKET_VERSION");
+		return -1;
+	}
+
+	p->block_size = PACKET_BLOCK_SIZE;
+	p->nblocks = (size_t)cfg->frames * PORT_FRAME_SIZE / p->block_size;
+	memset(&req, 0, sizeof(req));
+	req.tp_block_size = p->block_size;
+	req.tp_block_nr = p->nblocks;
+	req.tp_frame_size = PORT_FRAME_SIZE;
+	req.tp_frame_nr = cfg->frames;
+	req.tp_retire_blk_tov = 1;		/* ms before a partial block is returned */
+	if (setsockopt(p->fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req))) {
+		perror("PACKET_RX_RING");
+		return -1;
+	}
+	req.tp_retire_blk_tov = 0;
+	if (setsockopt(p->fd, SOL_PACKET, PACKET_TX_RING, &req, sizeof(req))) {
+		perror("PACKET_TX_RING");
+		return -1;
+	}
+	/* Both are optional: the first skips the qdisc, the second our own TX on RX */
+	setsockopt(p->fd, SOL_PACKET, PACKET_QDISC_BYPASS, &one, sizeof(one));
+	setsockopt(p->fd, SOL_PACKET, PACKET_IGNORE_OUTGOING, &one, sizeof(one));
+
+	ring = (size_t)p->block_size * p->nblocks;
+	p->map_len = 2 * ring;
+	p->map = mmap(NULL, p->map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, p->fd, 0);
+	if (p->map == MAP_FAILED) {
+		perror("mmap");
+		p->map = NULL;
+		return -1;
+	}
+	p->tx = p->map + ring;
+
+	memset(&sll, 0, sizeof(sll));
+	sll.sll_family = AF_PACKET;
+	sll.sll_protocol = htons(ETH_P_ALL);
+	sll.sll_ifindex = p->ifindex;
+	if (bind(p->fd, (struct sockaddr *)&sll, sizeof(sll))) {
+		perror("bind");
+		return -1;
+	}
+	if (cfg->fanout >= 0) {
+		int arg = (cfg->fanout & 0xffff) | (PACKET_FANOUT_HASH << 16);
+
+		if (setsockopt(p->fd, SOL_PACKET, PACKET_FANOUT, &arg, sizeof(arg))) {
+			perror("PACKET_FANOUT");
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/* The packets of a block stay valid until the call after the one that returned the last of them */
+static unsigned int
+packet_rx(struct port *p, struct port_pkt *pkts, unsigned int n)
+{
+	struct tpacket_block_desc *bd = packet_block(p, p->block);
+	unsigned int i = 0;
+
+	if (!p->left) {
+		if (p->next_pkt) {
+			__atomic_store_n(&bd->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+			p->block = (p->block + 1) % p->nblocks;
+			p->next_pkt = NULL;
+			bd = packet_block(p, p->block);
+		}
+		if (!(__atomic_load_n(&bd->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER))
+			return 0;
+		p->left = bd->hdr.bh1.num_pkts;
+		p->next_pkt = (uint8_t *)bd + bd->hdr.bh1.offset_to_first_pkt;
+	}
+	for (; i < n && p->left; i++) {
+		struct tpacket3_hdr *h = (struct tpacket3_hdr *)p->next_pkt;
+
+		pkts[i].data = (uint8_t *)h + h->tp_mac;
+		pkts[i].len = h->tp_snaplen;
+		p->next_pkt += h->tp_next_offset;
+		p->left--;
+	}
+	return i;
+}
+
+static unsigned int
+packet_tx(struct port *p, const struct port_pkt *pkts, unsigned int n)
+{
+	unsigned int i;
+
+	for (i = 0; i < n; i++) {
+		struct tpacket3_hdr *h = (struct tpacket3_hdr *)(p->tx + (size_t)p->tx_cur * PORT_FRAME_SIZE);
+		unsigned int len = pkts[i].len;
+
+		if (__atomic_load_n(&h->tp_status, __ATOMIC_ACQUIRE) != TP_STATUS_AVAILABLE)
+			break;
+		if (len > PORT_FRAME_SIZE - PACKET_TX_DATA)
+			len = PORT_FRAME_SIZE - PACKET_TX_DATA;
+		memcpy((uint8_t *)h + PACKET_TX_DATA, pkts[i].data, len);
+		h->tp_len = len;
+		h->tp_next_offset = 0;
+		__atomic_store_n(&h->tp_status, TP_STATUS_SEND_REQUEST, __ATOMIC_RELEASE);
+		p->tx_cur = (p->tx_cur + 1) & (p->frames - 1);
+	}
+	if (i && sendto(p->fd, NULL, 0, MSG_DONTWAIT, NULL, 0) < 0 &&
+	    errno != EAGAIN && errno != ENOBUFS)
+		perror("sendto");
+	return i;
+}
+
+#ifdef HAVE_XDP
+/* The first half of the UMEM frames is for RX, the second half for TX */
+static int
+xdp_open(struct port *p, const char *ifname, const struct port_config *cfg)
+{
+	struct xsk_umem_config ucfg;
+	struct xsk_socket_config scfg;
+	size_t len = (size_t)2 * cfg->frames * PORT_FRAME_SIZE;
+	unsigned int i;
+	uint32_t idx;
+
+	p->kind = PORT_XDP;
+	p->area = mmap(NULL, len, PROT_READ | PROT_WRITE,
+	               MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+	if (p->area == MAP_FAILED) {
+		p->area = NULL;
+		return -1;
+	}
+	memset(&ucfg, 0, sizeof(ucfg));
+	ucfg.fill_size = cfg->frames;
+	ucfg.comp_size = cfg->frames;
+	ucfg.frame_size = PORT_FRAME_SIZE;
+	if (xsk_umem__create(&p->umem, p->area, len, &p->fq, &p->cq, &ucfg))
+		return -1;
+
+	memset(&scfg, 0, sizeof(scfg));
+	scfg.rx_size = cfg->frames;
+	scfg.tx_size = cfg->frames;
+	scfg.bind_flags = XDP_ZEROCOPY | XDP_USE_NEED_WAKEUP;
+	if (xsk_socket__create(&p->xsk, ifname, cfg->queue, p->umem, &p->rxq, &p->txq, &scfg)) {
+		/* veth and most drivers without zero-copy support */
+		scfg.bind_flags = XDP_COPY | XDP_USE_NEED_WAKEUP;
+		if (xsk_socket__create(&p->xsk, ifname, cfg->queue, p->umem, &p->rxq, &p->txq, &scfg))
+			return -1;
+	} else {
+		p->zerocopy = 1;
+	}
+	p->fd = xsk_socket__fd(p->xsk);
+
+	if (xsk_ring_prod__reserve(&p->fq, cfg->frames, &idx) != cfg->frames)
+		return -1;
+	for (i = 0; i < cfg->frames; i++)
+		*xsk_ring_prod__fill_addr(&p->fq, idx + i) = (uint64_t)i * PORT_FRAME_SIZE;
+	xsk_ring_prod__submit(&p->fq, cfg->frames);
+
+	p->free_frames = malloc(cfg->frames * sizeof(*p->free_frames));
+	if (!p->free_frames)
+		return -1;
+	for (i = 0; i < cfg->frames; i++)
+		p->free_frames[p->nfree++] = (uint64_t)(cfg->frames + i) * PORT_FRAME_SIZE;
+	return 0;
+}
+
+static void
+xdp_close(struct port *p)
+{
+	if (p->xsk)
+		xsk_socket__delete(p->xsk);
+	if (p->umem)
+		xsk_umem__delete(p->umem);
+	if (p->area)
+		munmap(p->area, (size_t)2 * p->frames * PORT_FRAME_SIZE);
+	free(p->free_frames);
+	p->xsk = NULL;
+	p->umem = NULL;
+	p->area = NULL;
+	p->free_frames = NULL;
+	p->fd = -1;
+}
+
+static unsigned int
+xdp_rx(struct port *p, struct port_pkt *pkts, unsigned int n)
+{
+	unsigned int i, got;
+	uint32_t idx;
+
+	/* The frames returned by the previous call go back to the fill ring */
+	if (p->rx_held) {
+		if (xsk_ring_prod__reserve(&p->fq, p->rx_held, &idx) == p->rx_held) {
+			for (i = 0; i < p->rx_held; i++) {
+				uint64_t addr = xsk_ring_cons__rx_desc(&p->rxq, p->rx_idx + i)->addr;
+
+				*xsk_ring_prod__fill_addr(&p->fq, idx + i) = xsk_umem__extract_addr(addr);
+			}
+			xsk_ring_prod__submit(&p->fq, p->rx_held);
+		}
+		xsk_ring_cons__release(&p->rxq, p->rx_held);
+		p->rx_held = 0;
+	}
+	if (xsk_ring_prod__needs_wakeup(&p->fq))
+		recvfrom(p->fd, NULL, 0, MSG_DONTWAIT, NULL, NULL);
+	got = xsk_ring_cons__peek(&p->rxq, n, &p->rx_idx);
+	for (i = 0; i < got; i++) {
+		const struct xdp_desc *d = xsk_ring_cons__rx_desc(&p->rxq, p->rx_idx + i);
+
+		pkts[i].data = xsk_umem__get_data(p->area, xsk_umem__add_offset_to_addr(d->addr));
+		pkts[i].len = d->len;
+	}
+	p->rx_held = got;
+	return got;
+}
+
+static unsigned int
+xdp_tx(struct port *p, const struct port_pkt *pkts, unsigned int n)
+{
+	unsigned int i, done;
+	uint32_t idx;
+
+	done = xsk_ring_cons__peek(&p->cq, p->frames, &idx);
+	for (i = 0; i < done; i++)
+		p->free_frames[p->nfree++] = *xsk_ring_cons__comp_addr(&p->cq, idx + i);
+	xsk_ring_cons__release(&p->cq, done);
+
+	if (n > p->nfree)
+		n = p->nfree;
+	if (!n || xsk_ring_prod__reserve(&p->txq, n, &idx) != n)
+		return 0;
+	for (i = 0; i < n; i++) {
+		struct xdp_desc *d = xsk_ring_prod__tx_desc(&p->txq, idx + i);
+		uint64_t addr = p->free_frames[--p->nfree];
+		unsigned int len = pkts[i].len < PORT_FRAME_SIZE ? pkts[i].len : PORT_FRAME_SIZE;
+
+		memcpy(xsk_umem__get_data(p->area, addr), pkts[i].data, len);
+		d->addr = addr;
+		d->len = len;
+	}
+	xsk_ring_prod__submit(&p->txq, n);
+	if (xsk_ring_prod__needs_wakeup(&p->txq))
+		sendto(p->fd, NULL, 0, MSG_DONTWAIT, NULL, 0);
+	return n;
+}
+#endif /* HAVE_XDP */
+
+int
+port_open(struct port *p, const char *ifname, const struct port_config *cfg)
+{
+	memset(p, 0, sizeof(*p));
+	p->fd = -1;
+	p->frames = cfg->frames;
+	if (cfg->frames < PACKET_BLOCK_SIZE / PORT_FRAME_SIZE || (cfg->frames & (cfg->frames - 1))) {
+		fprintf(stderr, "The rings need a power of 2 of at least %d frames\n",
+		        PACKET_BLOCK_SIZE / PORT_FRAME_SIZE);
+		return -1;
+	}
+	p->ifindex = if_nametoindex(ifname);
+	if (!p->ifindex) {
+		perror(ifname);
+		return -1;
+	}
+	if (cfg->xdp) {
+#ifdef HAVE_XDP
+		if (!xdp_open(p, ifname, cfg))
+			return 0;
+		fprintf(stderr, "%s: AF_XDP is not available, falling back to AF_PACKET\n", ifname);
+		xdp_close(p);
+		memset(p, 0, sizeof(*p));
+		p->fd = -1;
+		p->frames = cfg->frames;
+		p->ifindex = if_nametoindex(ifname);
+#else
+		fprintf(stderr, "Built without HAVE_XDP, falling back to AF_PACKET\n");
+#endif
+	}
+	if (packet_open(p, cfg)) {
+		port_close(p);
+		return -1;
+	}
+	return 0;
+}
+
+void
+port_close(struct port *p)
+{
+#ifdef HAVE_XDP
+	if (p->kind == PORT_XDP) {
+		xdp_close(p);
+		return;
+	}
+#endif
+	if (p->map)
+		munmap(p->map, p->map_len);
+	if (p->fd >= 0)
+		close(p->fd);
+	p->map = NULL;
+	p->fd = -1;
+}
+
+unsigned int
+port_rx(struct port *p, struct port_pkt *pkts, unsigned int n)
+{
+#ifdef HAVE_XDP
+	if (p->kind == PORT_XDP)
+		return xdp_rx(p, pkts, n);
+#endif
+	return packet_rx(p, pkts, n);
+}
+
+unsigned int
+port_tx(struct port *p, const struct port_pkt *pkts, unsigned int n)
+{
+#ifdef HAVE_XDP
+	if (p->kind == PORT_XDP)
+		return xdp_tx(p, pkts, n);
+#endif
+	return packet_tx(p, pkts, n);
+}
@@ -0,0 +1,81 @@
+/*
+ * Packet I/O on a Linux interface: AF_XDP or AF_PACKET (TPACKET_V3) rings
+ *
+ * Copyright (c) 2020, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#ifndef DDIO_PORT_H
+#define DDIO_PORT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef HAVE_XDP
+#include <xdp/xsk.h>
+#endif
+
+#define PORT_MAX_BURST		256
+#define PORT_FRAME_SIZE		2048
+
+enum port_kind {
+	PORT_PACKET,			/* AF_PACKET, TPACKET_V3 RX and TX rings */
+	PORT_XDP,			/* AF_XDP socket (HAVE_XDP) */
+};
+
+struct port_config {
+	unsigned int frames;		/* per ring (RX and TX), a power of 2 */
+	unsigned int queue;		/* AF_XDP: queue of the interface */
+	int fanout;			/* AF_PACKET: fanout group id, -1: none */
+	int xdp;			/* 1: try AF_XDP first */
+};
+
+/* A received packet, valid until the next port_rx() of its port */
+struct port_pkt {
+	uint8_t *data;
+	unsigned int len;
+};
+
+struct port {
+	enum port_kind kind;
+	int fd;
+	int ifindex;
+	int zerocopy;			/* AF_XDP bound in zero-copy mode */
+	unsigned int frames;
+
+	/* AF_PACKET */
+	uint8_t *map;
+	size_t map_len;
+	unsigned int block_size, nblocks, block;	/* RX */
+	unsigned int left;		/* packets not returned yet in the block */
+	uint8_t *next_pkt;
+	uint8_t *tx;
+	unsigned int tx_cur, tx_pending;
+
+#ifdef HAVE_XDP
+	struct xsk_umem *umem;
+	struct xsk_socket *xsk;
+	struct xsk_ring_prod fq, txq;
+	struct xsk_ring_cons cq, rxq;
+	void *area;
+	uint64_t *free_frames;		/* TX frames */
+	unsigned int nfree;
+	unsigned int rx_held;		/* descriptors to release at the next port_rx() */
+	uint32_t rx_idx;
+#endif
+};
+
+void port_config_default(struct port_config *cfg);
+
+/* Opens AF_XDP if configured and available, AF_PACKET otherwise */
+int  port_open(struct port *p, const char *ifname, const struct port_config *cfg);
+void port_close(struct port *p);
+
+/* Zero-copy views of up to n received packets */
+unsigned int port_rx(struct port *p, struct port_pkt *pkts, unsigned int n);
+
+/* Copies up to n packets to the TX ring and kicks it; returns how many were queued */
+unsigned int port_tx(struct port *p, const struct port_pkt *pkts, unsigned int n);
+
+const char *port_kind_name(const struct port *p);
+
+#endif /* DDIO_PORT_H */
@@ -0,0 +1,284 @@
+/*
+ * Traffic profiles: packet size mixes, flow popularity, and flow churn
+ *
+ * Copyright (c) 2020, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "traffic.h"
+#include "pkt.h"
+
+static inline uint64_t
+xorshift(uint64_t *x)
+{
+	*x ^= *x << 13;
+	*x ^= *x >> 7;
+	*x ^= *x << 17;
+	return *x;
+}
+
+static inline uint64_t
+splitmix(uint64_t x)
+{
+	x += 0x9e3779b97f4a7c15ull;
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+	return x ^ (x >> 31);
+}
+
+static void
+alias_free(struct traffic_alias *a)
+{
+	free(a->prob);
+	free(a->alias);
+	a->prob = NULL;
+	a->alias = NULL;
+}
+
+/* Vose's method: O(n) to build from unnormalized weights */
+static int
+alias_build(struct traffic_alias *a, const double *w, unsigned int n)
+{
+	uint32_t *small, *large;
+	unsigned int ns = 0, nl = 0, i;
+	double sum = 0, *p;
+
+	a->n = n;
+	a->prob = malloc(n * sizeof(*a->prob));
+	a->alias = malloc(n * sizeof(*a->alias));
+	p = malloc(n * sizeof(*p));
+	small = malloc(n * sizeof(*small));
+	large = malloc(n * sizeof(*large));
+	if (!a->prob || !a->alias || !p || !small || !large) {
+		perror("malloc");
+		alias_free(a);
+		free(p);
+		free(small);
+		free(large);
+		return -1;
+	}
+	for (i = 0; i < n; i++)
+		sum += w[i];
+	for (i = 0; i < n; i++) {
+		p[i] = w[i] * n / sum;
+		if (p[i] < 1)
+			small[ns++] = i;
+		else
+			large[nl++] = i;
+	}
+	while (ns && nl) {
+		uint32_t s = small[--ns], l = large[nl - 1];
+
+		a->prob[s] = p[s];
+		a->alias[s] = l;
+		p[l] -= 1 - p[s];
+		if (p[l] < 1) {
+			nl--;
+			small[ns++] = l;
+		}
+	}
+	/* What is left is 1 up to rounding */
+	while (nl) {
+		a->prob[large[--nl]] = 1;
+		a->alias[large[nl]] = large[nl];
+	}
+	while (ns) {
+		a->prob[small[--ns]] = 1;
+		a->alias[small[ns]] = small[ns];
+	}
+	free(p);
+	free(small);
+	free(large);
+	return 0;
+}
+
+static inline unsigned int
+alias_draw(const struct traffic_alias *a, uint64_t *rnd)
+{
+	double u = (xorshift(rnd) >> 11) * (1.0 / 9007199254740992.0) * a->n;
+	unsigned int i = u;
+
+	return u - i < a->prob[i] ? i : a->alias[i];
+}
+
+void
+traffic_config_default(struct traffic_config *cfg)
+{
+	memset(cfg, 0, sizeof(*cfg));
+	cfg->flows = 4096;
+	cfg->flow_size = 1;
+	cfg->popularity = TRAFFIC_UNIFORM;
+	cfg->zipf_s = 1;
+	cfg->hh_flows = 1;
+	cfg->hh_share = 90;
+}
+
+int
+traffic_parse_sizes(const char *arg, struct traffic_config *cfg)
+{
+	char copy[256], *tok, *save;
+	unsigned int n = 0;
+
+	snprintf(copy, sizeof(copy), "%s", strcmp(arg, "imix") ? arg : "64:7,576:4,1500:1");
+	for (tok = strtok_r(copy, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+		double w = 1;
+		unsigned int size;
+
+		if (n == TRAFFIC_MAX_SIZES || sscanf(tok, "%u:%lf", &size, &w) < 1 ||
+		    size < PKT_MIN_SIZE || w <= 0)
+			return -1;
+		cfg->size[n] = size;
+		cfg->weight[n++] = w;
+	}
+	cfg->nsizes = n;
+	return n ? 0 : -1;
+}
+
+int
+traffic_parse_flows(const char *arg, struct traffic_config *cfg)
+{
+	if (!strcmp(arg, "uniform")) {
+		cfg->popularity = TRAFFIC_UNIFORM;
+	} else if (!strncmp(arg, "zipf", 4)) {
+		cfg->popularity = TRAFFIC_ZIPF;
+		if (arg[4] == ':' && sscanf(arg + 5, "%lf", &cfg->zipf_s) != 1)
+			return -1;
+		if (cfg->zipf_s <= 0)
+			return -1;
+	} else if (!strncmp(arg, "hh", 2)) {
+		cfg->popularity = TRAFFIC_HEAVY;
+		if (arg[2] == ':' && sscanf(arg + 3, "%lf:%lf", &cfg->hh_flows, &cfg->hh_share) != 2)
+			return -1;
+		if (cfg->hh_flows <= 0 || cfg->hh_flows >= 100 || cfg->hh_share <= 0 ||
+		    cfg->hh_share >= 100)
+			return -1;
+	} else {
+		return -1;
+	}
+	return 0;
+}
+
+int
+traffic_init(struct traffic *t, const struct traffic_config *cfg, unsigned int pkt_size)
+{
+	unsigned int i, nh;
+	double *w, sum = 0;
+
+	memset(t, 0, sizeof(*t));
+	t->cfg = *cfg;
+	if (!cfg->flows || cfg->flows > TRAFFIC_MAX_FLOWS || !cfg->flow_size || cfg->churn < 0) {
+		fprintf(stderr, "Bad traffic profile\n");
+		return -1;
+	}
+	if (!t->cfg.nsizes) {
+		t->cfg.nsizes = 1;
+		t->cfg.size[0] = pkt_size;
+		t->cfg.weight[0] = 1;
+	}
+	for (i = 0; i < t->cfg.nsizes; i++) {
+		if (t->cfg.size[i] > t->max_size)
+			t->max_size = t->cfg.size[i];
+		t->mean_size += t->cfg.size[i] * t->cfg.weight[i];
+		sum += t->cfg.weight[i];
+	}
+	t->mean_size /= sum;
+	if (alias_build(&t->sizes, t->cfg.weight, t->cfg.nsizes))
+		return -1;
+	if (cfg->popularity == TRAFFIC_UNIFORM)
+		return 0;
+
+	w = malloc(cfg->flows * sizeof(*w));
+	if (!w) {
+		perror("malloc");
+		traffic_free(t);
+		return -1;
+	}
+	nh = cfg->flows * cfg->hh_flows / 100 + 0.5;
+	nh = nh < 1 ? 1 : nh;
+	for (i = 0; i < cfg->flows; i++) {
+		if (cfg->popularity == TRAFFIC_ZIPF)
+			w[i] = pow(i + 1, -cfg->zipf_s);
+		else if (nh >= cfg->flows)
+			w[i] = 1;
+		else
+			w[i] = i < nh ? cfg->hh_share / nh : (100 - cfg->hh_share) / (cfg->flows - nh);
+	}
+	i = alias_build(&t->flows, w, cfg->flows);
+	free(w);
+	if (i) {
+		traffic_free(t);
+		return -1;
+	}
+	return 0;
+}
+
+void
+traffic_free(struct traffic *t)
+{
+	alias_free(&t->sizes);
+	alias_free(&t->flows);
+}
+
+int
+traffic_stream_init(struct traffic_stream *s, const struct traffic *t, unsigned int first,
+                    uint64_t seed)
+{
+	unsigned int i;
+
+	memset(s, 0, sizeof(*s));
+	s->id = malloc(t->cfg.flows * sizeof(*s->id));
+	if (!s->id) {
+		perror("malloc");
+		return -1;
+	}
+	for (i = 0; i < t->cfg.flows; i++)
+		s->id[i] = i;
+	s->rank = (first + t->cfg.flows - 1) % t->cfg.flows;
+	s->rnd = splitmix(seed) | 1;
+	return 0;
+}
+
+void
+traffic_stream_free(struct traffic_stream *s)
+{
+	free(s->id);
+	s->id = NULL;
+}
+
+unsigned int
+traffic_size(const struct traffic *t, struct traffic_stream *s)
+{
+	if (t->cfg.nsizes == 1)
+		return t->cfg.size[0];
+	return t->cfg.size[alias_draw(&t->sizes, &s->rnd)];
+}
+
+uint32_t
+traffic_flow(const struct traffic *t, struct traffic_stream *s, double elapsed_ns)
+{
+	const struct traffic_config *cfg = &t->cfg;
+
+	if (cfg->churn > 0) {
+		uint64_t events = elapsed_ns * 1e-9 * cfg->churn;
+
+		/*
+		 * Every event is replayed, even by a stream that fell behind, so
+		 * the live flows depend only on the number of events
+		 */
+		for (; s->churned < events; s->churned++)
+			s->id[splitmix(s->churned) % cfg->flows] = cfg->flows + s->churned;
+	}
+	if (!s->left) {
+		if (cfg->popularity == TRAFFIC_UNIFORM)
+			s->rank = (s->rank + 1) % cfg->flows;
+		else
+			s->rank = alias_draw(&t->flows, &s->rnd);
+		s->left = cfg->flow_size;
+	}
+	s->left--;
+	return s->id[s->rank];
+}
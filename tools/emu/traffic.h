@@ -0,0 +1,105 @@
+/*
+ * Traffic profiles: packet size mixes, flow popularity, and flow churn
+ *
+ * Copyright (c) 2020, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#ifndef DDIO_TRAFFIC_H
+#define DDIO_TRAFFIC_H
+
+#include <stdint.h>
+
+#include "pkt.h"
+
+#define TRAFFIC_MAX_SIZES	16
+#define TRAFFIC_MAX_FLOWS	65536		/* live at once; ids of new flows go on */
+
+enum traffic_popularity {
+	TRAFFIC_UNIFORM,		/* flows in turn, as FastUDPFlows */
+	TRAFFIC_ZIPF,			/* flow of rank k with probability ~ 1 / k^s */
+	TRAFFIC_HEAVY,			/* a share of the flows gets a share of the packets */
+};
+
+struct traffic_config {
+	unsigned int nsizes;		/* 0: every packet has the size of the generator */
+	unsigned int size[TRAFFIC_MAX_SIZES];
+	double weight[TRAFFIC_MAX_SIZES];
+	unsigned int flows;		/* GEN_FLOWS */
+	unsigned int flow_size;		/* GEN_BURST: consecutive packets of a flow */
+	enum traffic_popularity popularity;
+	double zipf_s;
+	double hh_flows, hh_share;	/* TRAFFIC_HEAVY: % of the flows, % of the packets */
+	double churn;			/* flows replaced by new ones per second */
+};
+
+/* Walker's alias table, to draw from a discrete distribution in O(1) */
+struct traffic_alias {
+	unsigned int n;
+	double *prob;
+	uint32_t *alias;
+};
+
+/* Read-only once built, shared by all the streams of a generator */
+struct traffic {
+	struct traffic_config cfg;
+	struct traffic_alias sizes, flows;
+	unsigned int max_size;
+	double mean_size;
+};
+
+/* Per generator thread */
+struct traffic_stream {
+	uint32_t *id;			/* flow id of every rank */
+	uint64_t churned;		/* churn events applied */
+	unsigned int rank, left;	/* current flow, and its packets still to send */
+	uint64_t rnd;
+};
+
+/* One size, 4096 uniform flows, one packet per flow in turn, no churn */
+void traffic_config_default(struct traffic_config *cfg);
+
+/* "imix" (64:7,576:4,1500:1) or "<size>[:<weight>],..." */
+int  traffic_parse_sizes(const char *arg, struct traffic_config *cfg);
+
+/* "uniform", "zipf[:<s>]" (s = 1), or "hh[:<% flows>:<% packets>]" (1 and 90) */
+int  traffic_parse_flows(const char *arg, struct traffic_config *cfg);
+
+/* pkt_size is used when cfg has no size mix */
+int  traffic_init(struct traffic *t, const struct traffic_config *cfg, unsigned int pkt_size);
+void traffic_free(struct traffic *t);
+
+/* first: rank of the first flow; seed: of the random draws of sizes and flows */
+int  traffic_stream_init(struct traffic_stream *s, const struct traffic *t, unsigned int first,
+                         uint64_t seed);
+void traffic_stream_free(struct traffic_stream *s);
+
+unsigned int traffic_size(const struct traffic *t, struct traffic_stream *s);
+
+/*
+ * Flow id of the next packet, elapsed_ns after the start. Churn events are
+ * a function of time only, and a stream that fell behind replays the ones
+ * it missed, so all the streams have the same flows after the same events.
+ */
+uint32_t traffic_flow(const struct traffic *t, struct traffic_stream *s, double elapsed_ns);
+
+/*
+ * Sets the flow, the IPv4/UDP lengths, and the IPv4 checksum of a packet
+ * of pkt_build_udp(). The flow id is the UDP source port (low 16 bits)
+ * and the middle bytes of the source address, 10.x.y.1 (high 16 bits),
+ * so that new flows of churn do not reuse the ids of live ones.
+ */
+static inline void
+traffic_set(uint8_t *p, unsigned int len, uint32_t flow)
+{
+	p[16] = (len - 14) >> 8;
+	p[17] = (len - 14) & 0xff;
+	p[27] = flow >> 24;
+	p[28] = (flow >> 16) & 0xff;
+	p[34] = (flow >> 8) & 0xff;
+	p[35] = flow & 0xff;
+	p[38] = (len - 34) >> 8;
+	p[39] = (len - 34) & 0xff;
+	pkt_set_ip_csum(p);
+}
+
+#endif /* DDIO_TRAFFIC_H */
@@ -0,0 +1,41 @@
+/*
+ * Time stamp counter helpers
+ *
+ * Copyright (c) 2020, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#define _GNU_SOURCE
+#include <time.h>
+
+#include "tsc.h"
+
+static uint64_t
+mono_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/*
+ * The TSC is invariant on the processors of the testbed, so a single
+ * calibration over 50 ms is good to a few ppm.
+ */
+double
+tsc_hz(void)
+{
+	static double hz;
+	uint64_t t0, c0, t1, c1;
+
+	if (hz)
+		return hz;
+	t0 = mono_ns();
+	c0 = tsc_now();
+	do {
+		t1 = mono_ns();
+	} while (t1 - t0 < 50000000);
+	c1 = tsc_now();
+	hz = (c1 - c0) * 1e9 / (t1 - t0);
+	return hz;
+}
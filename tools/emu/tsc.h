@@ -0,0 +1,50 @@
+/*
+ * Time stamp counter helpers
+ *
+ * Copyright (c) 2020, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#ifndef DDIO_TSC_H
+#define DDIO_TSC_H
+
+#include <stdint.h>
+#include <x86intrin.h>
+
+static inline uint64_t
+tsc_now(void)
+{
+	return __rdtsc();
+}
+
+/* After all earlier loads have completed, e.g., to time a cache miss */
+static inline uint64_t
+tsc_now_fenced(void)
+{
+	_mm_lfence();
+	return __rdtsc();
+}
+
+/* Ticks per second, calibrated against CLOCK_MONOTONIC on the first call */
+double tsc_hz(void);
+
+static inline double
+tsc_to_ns(uint64_t ticks)
+{
+	return ticks * 1e9 / tsc_hz();
+}
+
+static inline uint64_t
+ns_to_tsc(double ns)
+{
+	return ns * tsc_hz() / 1e9;
+}
+
+/* Busy-waits until the TSC reaches t */
+static inline void
+tsc_wait_until(uint64_t t)
+{
+	while (tsc_now() < t)
+		_mm_pause();
+}
+
+#endif /* DDIO_TSC_H */
@@ -0,0 +1,695 @@
+/*
+ * Emulated NIC: a producer core that "DMA-writes" packets into RX rings
+ *
+ * Copyright (c) 2020, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <x86intrin.h>
+
+#include "vnic.h"
+#include "pkt.h"
+#include "tsc.h"
+
+#define HUGE_PAGE_SIZE	(2ul << 20)
+
+void
+vnic_config_default(struct vnic_config *cfg)
+{
+	int i;
+
+	memset(cfg, 0, sizeof(*cfg));
+	cfg->queues = 1;
+	cfg->ndesc = 4096;
+	cfg->burst = 32;
+	cfg->tx_free_thresh = 32;
+	cfg->pkt_size = 1024;
+	cfg->store = VNIC_ALLOC;
+	cfg->nic_cpu = -1;
+	cfg->dyn_us = 100;
+	for (i = 0; i < VNIC_MAX_QUEUES; i++)
+		cfg->cpu[i] = -1;
+}
+
+static void
+pin(int cpu)
+{
+	cpu_set_t set;
+
+	if (cpu < 0)
+		return;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set))
+		fprintf(stderr, "Cannot pin a thread to core %d\n", cpu);
+}
+
+/* Huge pages if the system has some reserved, transparent ones otherwise */
+static void *
+alloc_mem(size_t *len, int *huge)
+{
+	size_t hlen = (*len + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+	void *p;
+
+	p = mmap(NULL, hlen, PROT_READ | PROT_WRITE,
+	         MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1, 0);
+	if (p != MAP_FAILED) {
+		*len = hlen;
+		*huge = 1;
+		return p;
+	}
+	*huge = 0;
+	p = mmap(NULL, hlen, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED) {
+		perror("mmap");
+		return NULL;
+	}
+	madvise(p, hlen, MADV_HUGEPAGE);
+	memset(p, 0, hlen);
+	*len = hlen;
+	return p;
+}
+
+static inline uint8_t *
+buf_of(const struct vnic_queue *q, uint32_t buf)
+{
+	return q->bufs + (size_t)buf * VNIC_BUF_SIZE;
+}
+
+/* Non-temporal copy of whole lines; both buffers are 64-byte aligned */
+static void
+stream_copy(uint8_t *dst, const uint8_t *src, unsigned int len)
+{
+	unsigned int i;
+
+	for (i = 0; i < len; i += 16)
+		_mm_stream_si128((__m128i *)(dst + i), _mm_load_si128((const __m128i *)(src + i)));
+}
+
+static void
+nic_rx(struct vnic *v, struct vnic_queue *q, uint64_t now)
+{
+	struct vnic_desc *d = &q->rx[q->rx_tail & (v->cfg.ndesc - 1)];
+	unsigned int len = v->cfg.pkt_size;
+	uint8_t *pkt;
+
+	q->cnt.offered++;
+	if (__atomic_load_n(&d->status, __ATOMIC_ACQUIRE) != VNIC_DESC_NIC) {
+		q->cnt.dropped++;
+		return;
+	}
+	pkt = buf_of(q, d->buf);
+	pkt_set_u64(v->tmpl, PKT_SEQ_OFFSET, q->seq);
+	pkt_set_u64(v->tmpl, PKT_TS_OFFSET, now);
+	if (v->cfg.store == VNIC_ALLOC) {
+		memcpy(pkt, v->tmpl, len);
+		d->len = len;
+		__atomic_store_n(&d->status, VNIC_DESC_DONE, __ATOMIC_RELEASE);
+	} else {
+		stream_copy(pkt, v->tmpl, (len + 63) & ~63u);
+		d->len = len;
+		_mm_sfence();
+		__atomic_store_n(&d->status, VNIC_DESC_DONE, __ATOMIC_RELEASE);
+		_mm_clflush(d);
+	}
+	q->rx_tail++;
+	q->seq++;
+}
+
+/*
+ * The stamps of a core are published by the release of its TX descriptor.
+ * TSCs of different cores are only as close as they are synchronized.
+ */
+static void
+nic_stages(struct vnic *v, const struct vnic_meta *m, uint64_t rx, uint64_t tx)
+{
+	uint64_t t[VNIC_STAGES + 1] = { rx, m->poll, m->touch, m->work, m->enqueue, tx };
+	unsigned int s;
+
+	for (s = 0; s < VNIC_STAGES; s++)
+		hdr_record(&v->stage[s], t[s + 1] > t[s] ? tsc_to_ns(t[s + 1] - t[s]) : 0);
+}
+
+/* Reads the packets enqueued by the core, i.e., the DMA reads of TX */
+static void
+nic_tx(struct vnic *v, struct vnic_queue *q, uint64_t now)
+{
+	int measuring = __atomic_load_n(&v->measuring, __ATOMIC_RELAXED);
+	unsigned int n, i;
+
+	for (n = 0; n < v->cfg.burst; n++) {
+		struct vnic_desc *d = &q->tx[q->tx_head & (v->cfg.ndesc - 1)];
+		const uint8_t *pkt;
+		uint64_t ts, sum = 0;
+
+		if (__atomic_load_n(&d->status, __ATOMIC_ACQUIRE) != VNIC_DESC_READY)
+			break;
+		/* A slower TX link: the TX ring fills up and the core blocks */
+		if (v->tx_gap_tsc) {
+			if (now < v->tx_next)
+				break;
+			v->tx_next += v->tx_gap_tsc;
+			if (now - v->tx_next > 1024 * v->tx_gap_tsc)
+				v->tx_next = now;
+		}
+		pkt = buf_of(q, d->buf);
+		for (i = 0; i < d->len; i += 64)
+			sum += *(const volatile uint64_t *)(pkt + i);
+		ts = pkt_get_u64(pkt, PKT_TS_OFFSET);
+		q->cnt.lat_sum += now - ts;
+		if (measuring) {
+			hdr_record(&v->lat, tsc_to_ns(now - ts));
+			if (q->meta)
+				nic_stages(v, &q->meta[d->buf], ts, now);
+		}
+		q->cnt.sent++;
+		q->sink += sum;
+		__atomic_store_n(&d->status, VNIC_DESC_DONE, __ATOMIC_RELEASE);
+		q->tx_head++;
+	}
+}
+
+static void *
+nic_main(void *arg)
+{
+	struct vnic *v = arg;
+	unsigned int qi = 0, i;
+	double next = tsc_now();
+
+	pin(v->cfg.nic_cpu);
+	__atomic_store_n(&v->nic_tid, (int)syscall(SYS_gettid), __ATOMIC_RELEASE);
+	while (!__atomic_load_n(&v->stop, __ATOMIC_RELAXED)) {
+		uint64_t now = tsc_now();
+
+		for (i = 0; i < v->cfg.queues; i++)
+			nic_tx(v, &v->q[i], now);
+		if (v->gap_tsc) {
+			if (now < next) {
+				if (v->cfg.yield)
+					sched_yield();
+				continue;
+			}
+			next += v->gap_tsc;
+			/* The NIC itself was too slow: do not send a backlog at once */
+			if (now - next > 1024 * v->gap_tsc)
+				next = now;
+		}
+		nic_rx(v, &v->q[qi], now);
+		if (++qi == v->cfg.queues)
+			qi = 0;
+	}
+	return NULL;
+}
+
+/* Only the core of the queue uses its pool: no locks */
+static inline void
+pool_put(struct vnic *v, struct vnic_queue *q, uint32_t buf)
+{
+	if (v->cfg.pool == VNIC_POOL_FIFO) {
+		unsigned int i = q->pool_head + q->npool;
+
+		q->pool[i < q->nbufs ? i : i - q->nbufs] = buf;
+	} else {
+		q->pool[q->npool] = buf;
+	}
+	q->npool++;
+}
+
+static inline uint32_t
+pool_get(struct vnic *v, struct vnic_queue *q)
+{
+	uint32_t buf;
+
+	if (v->cfg.pool == VNIC_POOL_FIFO) {
+		buf = q->pool[q->pool_head];
+		if (++q->pool_head == q->nbufs)
+			q->pool_head = 0;
+	} else {
+		buf = q->pool[q->npool - 1];
+	}
+	q->npool--;
+	return buf;
+}
+
+static void
+core_clean_tx(struct vnic *v, struct vnic_queue *q)
+{
+	unsigned int n;
+
+	for (n = 0; n < v->cfg.tx_free_thresh && q->tx_clean != q->tx_tail; n++) {
+		struct vnic_desc *d = &q->tx[q->tx_clean & (v->cfg.ndesc - 1)];
+
+		if (__atomic_load_n(&d->status, __ATOMIC_ACQUIRE) != VNIC_DESC_DONE)
+			break;
+		pool_put(v, q, d->buf);
+		d->status = VNIC_DESC_NIC;
+		q->tx_clean++;
+	}
+}
+
+/*
+ * Gives buffers to the RX descriptors taken by the core, in order, while
+ * fewer than cap buffers are in use (posted, or not back from TX yet),
+ * and at most q->ring descriptors have one. The NIC drops the packets
+ * that find a descriptor without a buffer.
+ */
+static void
+core_refill(struct vnic *v, struct vnic_queue *q)
+{
+	while (q->rx_refill != q->rx_head) {
+		struct vnic_desc *d = &q->rx[q->rx_refill & (v->cfg.ndesc - 1)];
+
+		if (q->rx_refill + v->cfg.ndesc - q->rx_head >= q->ring)
+			break;
+		if (!q->npool || q->nbufs - q->npool >= q->cap) {
+			q->cnt.nobuf++;
+			break;
+		}
+		d->buf = pool_get(v, q);
+		__atomic_store_n(&d->status, VNIC_DESC_NIC, __ATOMIC_RELEASE);
+		q->rx_refill++;
+	}
+}
+
+static unsigned int
+core_rx(struct vnic *v, struct vnic_queue *q, uint32_t *bufs, uint16_t *lens)
+{
+	unsigned int n;
+
+	for (n = 0; n < q->burst; n++) {
+		struct vnic_desc *d = &q->rx[q->rx_head & (v->cfg.ndesc - 1)];
+
+		if (__atomic_load_n(&d->status, __ATOMIC_ACQUIRE) != VNIC_DESC_DONE)
+			break;
+		bufs[n] = d->buf;
+		lens[n] = d->len;
+		q->used[d->buf] = 1;
+		__atomic_store_n(&d->status, VNIC_DESC_EMPTY, __ATOMIC_RELAXED);
+		q->rx_head++;
+	}
+	core_refill(v, q);
+	return n;
+}
+
+/* Blocks while the TX ring is full, like ToDPDKDevice(BLOCKING true) */
+static int
+core_tx(struct vnic *v, struct vnic_queue *q, uint32_t buf, uint16_t len)
+{
+	struct vnic_desc *d;
+
+	while (q->tx_tail - q->tx_clean == v->cfg.ndesc) {
+		core_clean_tx(v, q);
+		if (q->tx_tail - q->tx_clean < v->cfg.ndesc)
+			break;
+		q->cnt.txfull++;
+		if (__atomic_load_n(&v->stop, __ATOMIC_RELAXED))
+			return -1;
+		if (v->cfg.yield)
+			sched_yield();
+	}
+	d = &q->tx[q->tx_tail & (v->cfg.ndesc - 1)];
+	if (q->meta)
+		q->meta[buf].enqueue = tsc_now();
+	d->buf = buf;
+	d->len = len;
+	__atomic_store_n(&d->status, VNIC_DESC_READY, __ATOMIC_RELEASE);
+	q->tx_tail++;
+	return 0;
+}
+
+/*
+ * The dynamic RX burst: multiplicative decrease on TX backpressure,
+ * increase when RX runs short of descriptors.
+ */
+static void
+core_adapt(struct vnic *v, struct vnic_queue *q, uint64_t now)
+{
+	uint64_t dropped = __atomic_load_n(&q->cnt.dropped, __ATOMIC_RELAXED);
+	unsigned int min_ring = v->cfg.burst;
+
+	if (q->cnt.txfull != q->dyn_txfull) {
+		q->ring = q->ring / 2 > min_ring ? q->ring / 2 : min_ring;
+		q->burst = q->burst / 2 > VNIC_DYN_MIN_BURST ? q->burst / 2 : VNIC_DYN_MIN_BURST;
+		if (q->burst > v->cfg.burst)
+			q->burst = v->cfg.burst;
+		q->cnt.dyn_shrinks++;
+	} else if ((dropped != q->dyn_dropped || 2 * q->dyn_full > q->dyn_polls) &&
+	           (q->ring < v->cfg.ndesc || q->burst < v->cfg.burst)) {
+		q->ring = q->ring + v->cfg.burst < v->cfg.ndesc ? q->ring + v->cfg.burst : v->cfg.ndesc;
+		q->burst = 2 * q->burst < v->cfg.burst ? 2 * q->burst : v->cfg.burst;
+		q->cnt.dyn_grows++;
+	}
+	q->cnt.dyn_epochs++;
+	q->cnt.dyn_ring_sum += q->ring;
+	q->cnt.dyn_burst_sum += q->burst;
+	q->dyn_txfull = q->cnt.txfull;
+	q->dyn_dropped = dropped;
+	q->dyn_polls = q->dyn_full = 0;
+	q->dyn_next = now + v->cfg.dyn_us * tsc_hz() / 1e6;
+}
+
+/* EtherMirror and WorkPackage of the RXM module; m may be NULL */
+static void
+l2fwd(struct vnic_queue *q, uint8_t *pkt, uint16_t len, struct vnic_meta *m)
+{
+	pkt_swap_mac(pkt);
+	if (m)
+		m->touch = tsc_now_fenced();
+	work_packet(&q->work, pkt, len);
+	if (m)
+		m->work = tsc_now();
+}
+
+static void *
+core_main(void *arg)
+{
+	struct vnic_queue *q = arg;
+	struct vnic *v = q->v;
+	uint32_t bufs[VNIC_MAX_BURST];
+	uint16_t lens[VNIC_MAX_BURST];
+	unsigned int n, i;
+
+	pin(v->cfg.cpu[q->id]);
+	__atomic_store_n(&q->tid, (int)syscall(SYS_gettid), __ATOMIC_RELEASE);
+	while (!__atomic_load_n(&v->stop, __ATOMIC_RELAXED)) {
+		/* Buffers come back from TX when the ring fills up or the RX ring needs them */
+		if (v->cfg.ndesc - (q->tx_tail - q->tx_clean) < v->cfg.tx_free_thresh ||
+		    q->rx_refill != q->rx_head) {
+			core_clean_tx(v, q);
+			core_refill(v, q);
+		}
+		n = core_rx(v, q, bufs, lens);
+		if (v->cfg.dynamic) {
+			uint64_t now = tsc_now();
+
+			q->dyn_polls++;
+			q->dyn_full += n == q->burst;
+			if (now >= q->dyn_next)
+				core_adapt(v, q, now);
+		}
+		if (!n) {
+			if (v->cfg.yield)
+				sched_yield();
+			continue;
+		}
+		if (q->meta) {
+			uint64_t now = tsc_now();
+
+			for (i = 0; i < n; i++) {
+				q->meta[bufs[i]].poll = now;
+				l2fwd(q, buf_of(q, bufs[i]), lens[i], &q->meta[bufs[i]]);
+			}
+		} else {
+			for (i = 0; i < n; i++)
+				l2fwd(q, buf_of(q, bufs[i]), lens[i], NULL);
+		}
+		for (i = 0; i < n; i++)
+			if (core_tx(v, q, bufs[i], lens[i]))
+				break;
+		q->cnt.processed += n;
+	}
+	return NULL;
+}
+
+static int
+perf_open(int tid, uint64_t config)
+{
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.config = config;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	return syscall(__NR_perf_event_open, &attr, tid, -1, -1, 0);
+}
+
+static void
+perf_read(struct vnic *v, const int *fd, uint64_t *x)
+{
+	int i;
+
+	for (i = 0; i < 2; i++)
+		if (!v->perf || read(fd[i], &x[i], sizeof(x[i])) != sizeof(x[i]))
+			x[i] = 0;
+}
+
+static int
+queue_init(struct vnic *v, struct vnic_queue *q, unsigned int id)
+{
+	const struct vnic_config *cfg = &v->cfg;
+	size_t ring = (cfg->ndesc * sizeof(struct vnic_desc) + 4095) & ~4095ul;
+	unsigned int nbufs = cfg->nbufs ? cfg->nbufs : 2 * cfg->ndesc + cfg->burst;
+	unsigned int i, posted;
+	int huge;
+	uint8_t *p;
+
+	q->v = v;
+	q->id = id;
+	q->mem_len = 2 * ring + (size_t)nbufs * VNIC_BUF_SIZE;
+	p = alloc_mem(&q->mem_len, &huge);
+	if (!p)
+		return -1;
+	q->mem = p;
+	if (!huge)
+		v->hugepages = 0;
+	q->rx = (struct vnic_desc *)p;
+	q->tx = (struct vnic_desc *)(p + ring);
+	q->bufs = p + 2 * ring;
+	q->pool = malloc(nbufs * sizeof(*q->pool));
+	q->used = calloc(nbufs, 1);
+	if (cfg->stages)
+		q->meta = aligned_alloc(64, (nbufs * sizeof(*q->meta) + 63) & ~63ul);
+	if (!q->pool || !q->used || (cfg->stages && !q->meta)) {
+		perror("malloc");
+		return -1;
+	}
+	if (work_init(&q->work, &cfg->work, id))
+		return -1;
+	q->nbufs = nbufs;
+	q->cap = cfg->budget ? cfg->budget / ((cfg->pkt_size + 63) & ~63u) : nbufs;
+	posted = cfg->ndesc < q->cap ? cfg->ndesc : q->cap;
+	posted = posted < nbufs ? posted : nbufs;
+
+	/* The first RX descriptors get a buffer, within the budget; the rest go to the pool */
+	for (i = 0; i < posted; i++)
+		q->rx[i].buf = i;
+	for (; i < cfg->ndesc; i++)
+		q->rx[i].status = VNIC_DESC_EMPTY;
+	for (i = nbufs; i > posted; i--)
+		pool_put(v, q, i - 1);
+	q->rx_head = cfg->ndesc;
+	q->rx_refill = posted;
+	q->burst = cfg->burst;
+	q->ring = cfg->ndesc;
+	return 0;
+}
+
+int
+vnic_start(struct vnic *v, const struct vnic_config *cfg)
+{
+	unsigned int i, j;
+
+	memset(v, 0, sizeof(*v));
+	v->cfg = *cfg;
+	v->nic_perf_fd[0] = v->nic_perf_fd[1] = -1;
+	if (!cfg->queues || cfg->queues > VNIC_MAX_QUEUES || !cfg->burst ||
+	    cfg->burst > VNIC_MAX_BURST || cfg->ndesc < cfg->burst ||
+	    (cfg->ndesc & (cfg->ndesc - 1)) || cfg->tx_free_thresh >= cfg->ndesc ||
+	    cfg->pkt_size < PKT_MIN_SIZE || cfg->pkt_size > VNIC_BUF_SIZE ||
+	    (cfg->nbufs && cfg->nbufs < 2 * cfg->burst)) {
+		fprintf(stderr, "Bad NIC configuration (the number of descriptors must be a power of 2)\n");
+		return -1;
+	}
+	if (cfg->budget && cfg->budget / ((cfg->pkt_size + 63) & ~63u) < 2 * cfg->burst) {
+		fprintf(stderr, "The buffer budget must hold at least two bursts\n");
+		return -1;
+	}
+	tsc_hz();
+	if (cfg->rate_gbps > 0)
+		v->gap_tsc = (cfg->pkt_size + 20) * 8 / cfg->rate_gbps * tsc_hz() / 1e9;
+	if (cfg->tx_gbps > 0)
+		v->tx_gap_tsc = (cfg->pkt_size + 20) * 8 / cfg->tx_gbps * tsc_hz() / 1e9;
+	v->tx_next = tsc_now();
+	v->hugepages = 1;
+	v->tmpl = aligned_alloc(64, VNIC_BUF_SIZE);
+	v->q = aligned_alloc(64, cfg->queues * sizeof(*v->q));
+	if (!v->tmpl || !v->q || hdr_init(&v->lat)) {
+		perror("malloc");
+		goto fail;
+	}
+	for (i = 0; cfg->stages && i < VNIC_STAGES; i++)
+		if (hdr_init(&v->stage[i]))
+			goto fail;
+	memset(v->q, 0, cfg->queues * sizeof(*v->q));
+	for (i = 0; i < cfg->queues; i++)
+		v->q[i].perf_fd[0] = v->q[i].perf_fd[1] = -1;
+	pkt_build_udp(v->tmpl, cfg->pkt_size);
+	for (i = 0; i < cfg->queues; i++)
+		if (queue_init(v, &v->q[i], i))
+			goto fail;
+
+	for (i = 0; i < cfg->queues; i++) {
+		if (pthread_create(&v->q[i].thread, NULL, core_main, &v->q[i])) {
+			perror("pthread_create");
+			goto stop;
+		}
+	}
+	if (pthread_create(&v->nic, NULL, nic_main, v)) {
+		perror("pthread_create");
+		goto stop;
+	}
+
+	/* The LLC counters of every consumer thread, and of the NIC thread */
+	v->perf = 1;
+	for (i = 0; i < cfg->queues; i++) {
+		struct vnic_queue *q = &v->q[i];
+		int tid;
+
+		while (!(tid = __atomic_load_n(&q->tid, __ATOMIC_ACQUIRE)))
+			sched_yield();
+		q->perf_fd[0] = perf_open(tid, PERF_COUNT_HW_CACHE_MISSES);
+		q->perf_fd[1] = perf_open(tid, PERF_COUNT_HW_CACHE_REFERENCES);
+		if (q->perf_fd[0] < 0 || q->perf_fd[1] < 0)
+			v->perf = 0;
+	}
+	while (!__atomic_load_n(&v->nic_tid, __ATOMIC_ACQUIRE))
+		sched_yield();
+	v->nic_perf_fd[0] = perf_open(v->nic_tid, PERF_COUNT_HW_CACHE_MISSES);
+	v->nic_perf_fd[1] = perf_open(v->nic_tid, PERF_COUNT_HW_CACHE_REFERENCES);
+	if (v->nic_perf_fd[0] < 0 || v->nic_perf_fd[1] < 0)
+		v->perf = 0;
+	if (!v->perf)
+		fprintf(stderr, "LLC counters are not available (perf_event_paranoid?)\n");
+	return 0;
+
+stop:
+	__atomic_store_n(&v->stop, 1, __ATOMIC_RELAXED);
+	for (j = 0; j < i; j++)
+		pthread_join(v->q[j].thread, NULL);
+	v->cfg.queues = 0;
+fail:
+	vnic_free(v);
+	return -1;
+}
+
+void
+vnic_measure(struct vnic *v)
+{
+	uint64_t x[2];
+	unsigned int i;
+
+	for (i = 0; i < v->cfg.queues; i++) {
+		v->q[i].base = v->q[i].cnt;
+		perf_read(v, v->q[i].perf_fd, x);
+		v->q[i].base.llc_miss = x[0];
+		v->q[i].base.llc_ref = x[1];
+		memset(v->q[i].used, 0, v->q[i].nbufs);
+	}
+	perf_read(v, v->nic_perf_fd, v->nic_base);
+	v->t_start = tsc_now();
+	__atomic_store_n(&v->measuring, 1, __ATOMIC_RELAXED);
+}
+
+void
+vnic_stop(struct vnic *v, struct vnic_stats *st)
+{
+	struct vnic_counters end[VNIC_MAX_QUEUES];
+	uint64_t lat_sum = 0, x[2], nic_end[2], epochs = 0;
+	unsigned int i, j;
+
+	memset(st, 0, sizeof(*st));
+	v->t_end = tsc_now();
+	__atomic_store_n(&v->measuring, 0, __ATOMIC_RELAXED);
+	for (i = 0; i < v->cfg.queues; i++) {
+		end[i] = v->q[i].cnt;
+		perf_read(v, v->q[i].perf_fd, x);
+		end[i].llc_miss = x[0];
+		end[i].llc_ref = x[1];
+	}
+	perf_read(v, v->nic_perf_fd, nic_end);
+	__atomic_store_n(&v->stop, 1, __ATOMIC_RELAXED);
+	pthread_join(v->nic, NULL);
+	for (i = 0; i < v->cfg.queues; i++)
+		pthread_join(v->q[i].thread, NULL);
+
+	st->seconds = tsc_to_ns(v->t_end - v->t_start) / 1e9;
+	for (i = 0; i < v->cfg.queues; i++) {
+		const struct vnic_counters *b = &v->q[i].base, *e = &end[i];
+
+		st->offered += e->offered - b->offered;
+		st->dropped += e->dropped - b->dropped;
+		st->sent += e->sent - b->sent;
+		st->processed += e->processed - b->processed;
+		st->nobuf += e->nobuf - b->nobuf;
+		st->txfull += e->txfull - b->txfull;
+		st->llc_miss += e->llc_miss - b->llc_miss;
+		st->llc_ref += e->llc_ref - b->llc_ref;
+		lat_sum += e->lat_sum - b->lat_sum;
+		epochs += e->dyn_epochs - b->dyn_epochs;
+		st->dyn_ring += e->dyn_ring_sum - b->dyn_ring_sum;
+		st->dyn_burst += e->dyn_burst_sum - b->dyn_burst_sum;
+		st->dyn_shrinks += e->dyn_shrinks - b->dyn_shrinks;
+		st->dyn_grows += e->dyn_grows - b->dyn_grows;
+		for (j = 0; j < v->q[i].nbufs; j++)
+			st->footprint += v->q[i].used[j];
+	}
+	st->footprint *= (v->cfg.pkt_size + 63) & ~63u;
+	if (epochs) {
+		st->dyn_ring /= epochs;
+		st->dyn_burst /= epochs;
+	}
+	st->nic_llc_miss = nic_end[0] - v->nic_base[0];
+	st->nic_llc_ref = nic_end[1] - v->nic_base[1];
+	if (st->sent)
+		st->lat_avg = tsc_to_ns(lat_sum) / st->sent / 1e3;
+	st->lat = &v->lat;
+	st->stage = v->cfg.stages ? v->stage : NULL;
+}
+
+void
+vnic_free(struct vnic *v)
+{
+	unsigned int i;
+	int k;
+
+	for (i = 0; v->q && i < v->cfg.queues; i++) {
+		for (k = 0; k < 2; k++)
+			if (v->q[i].perf_fd[k] >= 0)
+				close(v->q[i].perf_fd[k]);
+		if (v->q[i].mem)
+			munmap(v->q[i].mem, v->q[i].mem_len);
+		free(v->q[i].pool);
+		free(v->q[i].meta);
+		free(v->q[i].used);
+		work_free(&v->q[i].work);
+	}
+	free(v->q);
+	for (k = 0; k < 2; k++)
+		if (v->nic_perf_fd[k] >= 0)
+			close(v->nic_perf_fd[k]);
+	hdr_free(&v->lat);
+	for (k = 0; k < VNIC_STAGES; k++)
+		hdr_free(&v->stage[k]);
+	free(v->tmpl);
+	v->q = NULL;
+	v->tmpl = NULL;
+}
+
+const char *
+vnic_stage_name(enum vnic_stage s)
+{
+	static const char *name[VNIC_STAGES] = { "RX-RING", "TOUCH", "WORK", "TX-WAIT", "TX-RING" };
+
+	return s < VNIC_STAGES ? name[s] : "?";
+}
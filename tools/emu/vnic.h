@@ -0,0 +1,210 @@
+/*
+ * Emulated NIC: a producer core that "DMA-writes" packets into RX rings
+ *
+ * Copyright (c) 2020, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#ifndef DDIO_VNIC_H
+#define DDIO_VNIC_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "hdr.h"
+#include "work.h"
+
+#define VNIC_MAX_QUEUES		64
+#define VNIC_MAX_BURST		256
+#define VNIC_BUF_SIZE		2048		/* data room of a buffer */
+#define VNIC_DYN_MIN_BURST	4		/* of the dynamic RX burst */
+
+/*
+ * How the NIC core writes packets and RX descriptors. Regular stores
+ * allocate the lines in the cache hierarchy, as DDIO does. Non-temporal
+ * stores bypass it and invalidate any cached copy, and the descriptor is
+ * flushed after it is written, so that the consumer finds both in memory,
+ * as with DDIO disabled (Use_Allocating_Flow_Wr=0).
+ */
+enum vnic_store {
+	VNIC_ALLOC,
+	VNIC_NT,
+};
+
+/*
+ * Order in which a core reuses its free buffers. The RX ring itself is
+ * FIFO, so only the buffers beyond the posted ones make the difference:
+ * LIFO keeps reusing the same, recently used (cached) ones, FIFO cycles
+ * through all of them, like a mempool ring without a per-core cache.
+ */
+enum vnic_pool {
+	VNIC_POOL_LIFO,
+	VNIC_POOL_FIFO,
+};
+
+/* Status of a descriptor: who owns it */
+#define VNIC_DESC_NIC		0	/* RX: refilled, TX: free */
+#define VNIC_DESC_DONE		1	/* RX: packet written, TX: packet read by the NIC */
+#define VNIC_DESC_READY		2	/* TX: packet enqueued by the core */
+#define VNIC_DESC_EMPTY		3	/* RX: taken by the core, not refilled yet */
+
+struct vnic_desc {
+	uint32_t buf;			/* buffer index in the queue */
+	uint16_t len;
+	uint16_t status;
+	uint64_t reserved;		/* 16 bytes, like the descriptors of the experiments */
+};
+
+/*
+ * Stages of a packet when cfg.stages is set: the NIC's RX write and TX
+ * read, and the TSC stamps of the core in between, decompose the latency.
+ */
+enum vnic_stage {
+	VNIC_STAGE_RX_RING,		/* RX write to the poll that finds the packet */
+	VNIC_STAGE_TOUCH,		/* to the end of the first access to the payload */
+	VNIC_STAGE_WORK,		/* to the end of processing (WorkPackage) */
+	VNIC_STAGE_TX_WAIT,		/* to the TX enqueue: rest of the burst, full TX ring */
+	VNIC_STAGE_TX_RING,		/* to the TX read */
+	VNIC_STAGES,
+};
+
+/* Stamps of a buffer, like fields of the mbuf: written by the core only */
+struct vnic_meta {
+	uint64_t poll, touch, work, enqueue;
+};
+
+struct vnic_config {
+	unsigned int queues;		/* one consumer core per queue (NCORE) */
+	unsigned int ndesc;		/* RX and TX descriptors per queue */
+	unsigned int burst;		/* RX burst (NINBURST) */
+	unsigned int tx_free_thresh;	/* TX descriptors reclaimed at once */
+	unsigned int nbufs;		/* buffers per queue, 0: 2 * ndesc + burst */
+	enum vnic_pool pool;
+	size_t budget;			/* bytes of buffers in use per queue, 0: no bound */
+	unsigned int pkt_size;		/* frame size (GEN_PKT_SIZE) */
+	double rate_gbps;		/* offered load of all queues, 0: as fast as possible */
+	double tx_gbps;			/* TX rate of all queues, 0: as fast as possible */
+	enum vnic_store store;
+	struct work_config work;	/* per packet, like WorkPackage */
+	int nic_cpu;			/* core of the NIC thread, -1: not pinned */
+	int cpu[VNIC_MAX_QUEUES];	/* core of every consumer, -1: not pinned */
+	int yield;			/* yield when polling in vain (oversubscribed cores) */
+	int stages;			/* stamp every packet at every stage */
+	int dynamic;			/* shrink the RX burst and ring under TX backpressure */
+	unsigned int dyn_us;		/* between two decisions of the dynamic burst */
+};
+
+/* Counters of a queue, each written by one thread only */
+struct vnic_counters {
+	uint64_t offered;		/* NIC */
+	uint64_t dropped;		/* NIC: RX descriptor not refilled yet */
+	uint64_t sent;			/* NIC: read from the TX ring */
+	uint64_t lat_sum;		/* NIC: TSC ticks from RX write to TX read */
+	uint64_t processed;		/* core */
+	uint64_t nobuf;			/* core: RX refills stopped by the pool or the budget */
+	uint64_t txfull;		/* core: polls of a full TX ring */
+	uint64_t llc_miss;		/* perf, of the consumer thread */
+	uint64_t llc_ref;
+	uint64_t dyn_epochs;		/* core: decisions of the dynamic burst */
+	uint64_t dyn_ring_sum;		/* core: RX ring and burst in effect, summed */
+	uint64_t dyn_burst_sum;
+	uint64_t dyn_shrinks, dyn_grows;
+};
+
+struct vnic;
+
+struct vnic_queue {
+	struct vnic *v;
+	unsigned int id;
+	struct vnic_desc *rx, *tx;
+	uint8_t *bufs;
+	uint32_t *pool;			/* free buffers, owned by the core */
+	unsigned int pool_head;		/* FIFO: oldest free buffer */
+	unsigned int nbufs, cap;	/* buffers, and at most in use at once */
+	uint8_t *used;			/* buffers received since vnic_measure() */
+	struct vnic_meta *meta;		/* of every buffer, NULL without stages */
+	struct work work;		/* of the core */
+	unsigned int npool;
+	pthread_t thread;
+	int tid;
+	int perf_fd[2];			/* LLC misses and references, -1 if unavailable */
+
+	/* NIC */
+	uint64_t rx_tail, tx_head;
+	uint64_t seq;
+
+	/* Core */
+	uint64_t rx_head, rx_refill, tx_tail, tx_clean;
+	uint64_t sink;
+	unsigned int burst, ring;	/* RX burst, and RX descriptors with a buffer, at most */
+
+	/* Core: the dynamic burst, since its last decision */
+	uint64_t dyn_next;		/* TSC */
+	uint64_t dyn_txfull, dyn_dropped;
+	unsigned int dyn_polls, dyn_full;
+
+	struct vnic_counters cnt;
+	struct vnic_counters base;	/* at vnic_measure() */
+	void *mem;
+	size_t mem_len;
+} __attribute__((aligned(64)));
+
+struct vnic {
+	struct vnic_config cfg;
+	struct vnic_queue *q;
+	pthread_t nic;
+	int nic_tid;
+	int nic_perf_fd[2];		/* LLC misses and references of the NIC thread */
+	uint64_t nic_base[2];
+	uint8_t *tmpl;			/* packet written by the NIC */
+	double gap_tsc;			/* between two arrivals, 0: none */
+	double tx_gap_tsc;		/* between two TX reads, 0: none */
+	double tx_next;			/* TSC of the next TX read */
+	int hugepages;			/* 1 if the rings are in huge pages */
+	int perf;			/* 1 if the LLC counters are available */
+	int measuring, stop;
+	uint64_t t_start, t_end;	/* TSC */
+	struct hdr lat;			/* ns, recorded by the NIC while measuring */
+	struct hdr stage[VNIC_STAGES];	/* ns, likewise, with cfg.stages */
+};
+
+struct vnic_stats {
+	double seconds;
+	uint64_t offered, dropped, sent, processed, nobuf, txfull;
+	double lat_avg;			/* us */
+	const struct hdr *lat;		/* ns, valid until vnic_free() */
+	const struct hdr *stage;	/* VNIC_STAGES of them, NULL without stages */
+	uint64_t llc_miss, llc_ref;	/* of all consumers, 0 without perf */
+	uint64_t nic_llc_miss, nic_llc_ref;	/* of the NIC thread: its write misses */
+	uint64_t footprint;		/* bytes of the distinct buffers received */
+	double dyn_ring, dyn_burst;	/* averages of the dynamic burst, 0 without it */
+	uint64_t dyn_shrinks, dyn_grows;
+};
+
+/*
+ * Defaults follow the experiments: 1 queue, 4096 descriptors, bursts of
+ * 32, and 1024-byte packets as fast as possible with regular stores.
+ *
+ * With cfg.dynamic, every core halves its RX burst and the number of RX
+ * descriptors it keeps posted when it found the TX ring full since its
+ * last decision, and grows them back (twice the burst, one burst more of
+ * descriptors) when the NIC dropped packets or most polls returned a full
+ * burst, up to cfg.burst and cfg.ndesc, like the dynamic RX burst of the
+ * DMAdynamic branch of FastClick.
+ */
+void vnic_config_default(struct vnic_config *cfg);
+
+/* Allocates the rings and starts the NIC and consumer threads */
+int  vnic_start(struct vnic *v, const struct vnic_config *cfg);
+
+/* Starts counting (e.g., after a warm-up) */
+void vnic_measure(struct vnic *v);
+
+/* Stops the threads; the counters since vnic_measure() are then in st */
+void vnic_stop(struct vnic *v, struct vnic_stats *st);
+
+void vnic_free(struct vnic *v);
+
+/* "RX-RING", "TOUCH", "WORK", "TX-WAIT", and "TX-RING", as in the results */
+const char *vnic_stage_name(enum vnic_stage s);
+
+#endif /* DDIO_VNIC_H */
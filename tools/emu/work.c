@@ -0,0 +1,434 @@
+/*
+ * Per-packet processing kernels, in place of WorkPackage's busy loop
+ *
+ * Copyright (c) 2020, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <immintrin.h>
+
+#include "work.h"
+#include "pkt.h"
+
+#define HUGE_PAGE_SIZE	(2ul << 20)
+
+static inline uint64_t
+xorshift(uint64_t *x)
+{
+	*x ^= *x << 13;
+	*x ^= *x >> 7;
+	*x ^= *x << 17;
+	return *x;
+}
+
+static inline uint64_t
+mix(uint64_t x)
+{
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+	return x ^ (x >> 31);
+}
+
+/* IPv4 addresses and UDP ports, as RSS would hash them */
+static inline uint64_t
+flow_hash(const uint8_t *p)
+{
+	uint64_t a;
+	uint32_t b;
+
+	memcpy(&a, p + 26, sizeof(a));
+	memcpy(&b, p + 34, sizeof(b));
+	return mix(a ^ ((uint64_t)b << 17 | b >> 15));
+}
+
+/* Largest power of 2 at most x, at least 1 */
+static uint64_t
+pow2_floor(uint64_t x)
+{
+	return x < 2 ? 1 : 1ull << (63 - __builtin_clzll(x));
+}
+
+void
+work_config_default(struct work_config *cfg)
+{
+	memset(cfg, 0, sizeof(*cfg));
+	cfg->kernel = WORK_SPIN;
+	cfg->isa = WORK_ISA_AUTO;
+}
+
+static int
+parse_size(const char *arg, size_t *x)
+{
+	char *end;
+	double v = strtod(arg, &end);
+
+	switch (*end) {
+	case 'G': case 'g':
+		v *= 1024;
+		/* fall through */
+	case 'M': case 'm':
+		v *= 1024;
+		/* fall through */
+	case 'K': case 'k':
+		v *= 1024;
+		end++;
+		break;
+	}
+	if (*end || v < 0)
+		return -1;
+	*x = v;
+	return 0;
+}
+
+int
+work_parse(const char *arg, struct work_config *cfg)
+{
+	static const char *kernels[] = { "spin", "csum", "parse", "hash", "random" };
+	static const char *isas[] = { "auto", "scalar", "avx2", "avx512" };
+	char copy[256], *tok, *save;
+	unsigned int i;
+
+	work_config_default(cfg);
+	snprintf(copy, sizeof(copy), "%s", arg);
+	tok = strtok_r(copy, ",", &save);
+	for (i = 0; tok && i < sizeof(kernels) / sizeof(kernels[0]); i++)
+		if (!strcmp(tok, kernels[i]))
+			break;
+	if (!tok || i == sizeof(kernels) / sizeof(kernels[0]))
+		return -1;
+	cfg->kernel = i;
+	while ((tok = strtok_r(NULL, ",", &save))) {
+		if (!strncmp(tok, "n=", 2)) {
+			cfg->n = strtoul(tok + 2, NULL, 0);
+		} else if (!strncmp(tok, "ws=", 3)) {
+			if (parse_size(tok + 3, &cfg->ws))
+				return -1;
+		} else if (!strncmp(tok, "bytes=", 6)) {
+			cfg->bytes = strtoul(tok + 6, NULL, 0);
+		} else if (!strncmp(tok, "wr=", 3)) {
+			cfg->wr = strtoul(tok + 3, NULL, 0);
+			if (cfg->wr > 100)
+				return -1;
+		} else if (!strncmp(tok, "isa=", 4)) {
+			for (i = 0; i < sizeof(isas) / sizeof(isas[0]); i++)
+				if (!strcmp(tok + 4, isas[i]))
+					break;
+			if (i == sizeof(isas) / sizeof(isas[0]))
+				return -1;
+			cfg->isa = i;
+		} else {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * A rule is a mask and a value of w->hdr bytes each, and the header
+ * matches it if (header & mask) == value. All the rules are checked, like
+ * a linear ACL that counts the matches.
+ */
+static unsigned int
+match_scalar(const struct work *w, const uint8_t *p, unsigned int first)
+{
+	unsigned int i, j, r = first, matches = 0;
+	uint64_t h[WORK_MAX_HDR / 8];
+
+	memcpy(h, p, w->hdr);
+	for (i = 0; i < w->cfg.n; i++) {
+		const uint64_t *rule = (const uint64_t *)(w->mem + (size_t)r * 2 * w->hdr);
+		const uint64_t *value = rule + w->hdr / 8;
+		uint64_t diff = 0;
+
+		for (j = 0; j < w->hdr / 8; j++)
+			diff |= (h[j] & rule[j]) ^ value[j];
+		matches += !diff;
+		if (++r == w->nrules)
+			r = 0;
+	}
+	return matches;
+}
+
+__attribute__((target("avx2")))
+static unsigned int
+match_avx2(const struct work *w, const uint8_t *p, unsigned int first)
+{
+	unsigned int i, j, r = first, matches = 0, nv = w->hdr / 32;
+	__m256i h[WORK_MAX_HDR / 32];
+
+	for (j = 0; j < nv; j++)
+		h[j] = _mm256_loadu_si256((const __m256i *)(p + 32 * j));
+	for (i = 0; i < w->cfg.n; i++) {
+		const __m256i *rule = (const __m256i *)(w->mem + (size_t)r * 2 * w->hdr);
+		__m256i diff = _mm256_setzero_si256();
+
+		for (j = 0; j < nv; j++)
+			diff = _mm256_or_si256(diff, _mm256_xor_si256(_mm256_and_si256(h[j],
+			                       _mm256_load_si256(rule + j)), _mm256_load_si256(rule + nv + j)));
+		matches += _mm256_testz_si256(diff, diff);
+		if (++r == w->nrules)
+			r = 0;
+	}
+	return matches;
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static unsigned int
+match_avx512(const struct work *w, const uint8_t *p, unsigned int first)
+{
+	unsigned int i, j, r = first, matches = 0, nv = w->hdr / 64;
+	__m512i h[WORK_MAX_HDR / 64];
+
+	for (j = 0; j < nv; j++)
+		h[j] = _mm512_loadu_si512(p + 64 * j);
+	for (i = 0; i < w->cfg.n; i++) {
+		const __m512i *rule = (const __m512i *)(w->mem + (size_t)r * 2 * w->hdr);
+		__mmask8 diff = 0;
+
+		for (j = 0; j < nv; j++)
+			diff |= _mm512_cmpneq_epi64_mask(_mm512_and_si512(h[j], _mm512_load_si512(rule + j)),
+			                                 _mm512_load_si512(rule + nv + j));
+		matches += !diff;
+		if (++r == w->nrules)
+			r = 0;
+	}
+	return matches;
+}
+
+static int
+select_isa(struct work *w)
+{
+	int avx2 = __builtin_cpu_supports("avx2");
+	int avx512 = __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+
+	if (w->cfg.isa == WORK_ISA_AUTO)
+		w->cfg.isa = avx512 ? WORK_ISA_AVX512 : avx2 ? WORK_ISA_AVX2 : WORK_ISA_SCALAR;
+	if ((w->cfg.isa == WORK_ISA_AVX2 && !avx2) || (w->cfg.isa == WORK_ISA_AVX512 && !avx512)) {
+		fprintf(stderr, "The CPU does not have %s\n",
+		        w->cfg.isa == WORK_ISA_AVX2 ? "AVX2" : "AVX-512");
+		return -1;
+	}
+	w->match = w->cfg.isa == WORK_ISA_AVX512 ? match_avx512 :
+	           w->cfg.isa == WORK_ISA_AVX2 ? match_avx2 : match_scalar;
+	return 0;
+}
+
+/* Ethernet type, IP protocol, and UDP destination port; 1 rule in 16 matches */
+static void
+build_rules(struct work *w)
+{
+	unsigned int i;
+
+	for (i = 0; i < w->nrules; i++) {
+		uint8_t *mask = w->mem + (size_t)i * 2 * w->hdr, *value = mask + w->hdr;
+		uint16_t port = i % 16 ? xorshift(&w->rnd) : PKT_UDP_PORT;
+
+		memset(mask, 0, 2 * w->hdr);
+		mask[12] = mask[13] = mask[23] = mask[36] = mask[37] = 0xff;
+		value[12] = 0x08;
+		value[23] = 0x11;
+		value[36] = port >> 8;
+		value[37] = port & 0xff;
+		if (port == PKT_UDP_PORT && i % 16)
+			value[37] ^= 1;
+	}
+}
+
+/* In huge pages when large, so that the TLB does not add misses of its own */
+static int
+alloc_mem(struct work *w, size_t len)
+{
+	size_t align = len >= HUGE_PAGE_SIZE ? HUGE_PAGE_SIZE : 64;
+	void *p;
+
+	w->mem_len = (len + align - 1) & ~(align - 1);
+	if (posix_memalign(&p, align, w->mem_len)) {
+		perror("posix_memalign");
+		return -1;
+	}
+	if (align == HUGE_PAGE_SIZE)
+		madvise(p, w->mem_len, MADV_HUGEPAGE);
+	w->mem = p;
+	return 0;
+}
+
+int
+work_init(struct work *w, const struct work_config *cfg, uint64_t seed)
+{
+	size_t i;
+
+	memset(w, 0, sizeof(*w));
+	w->cfg = *cfg;
+	w->rnd = mix(seed + 0x9e3779b97f4a7c15ull) | 1;
+	switch (cfg->kernel) {
+	case WORK_SPIN:
+		return 0;
+	case WORK_CSUM:
+		if (!w->cfg.n)
+			w->cfg.n = 1;
+		return 0;
+	case WORK_PARSE:
+		w->hdr = cfg->bytes ? (cfg->bytes + 63) & ~63u : 64;
+		if (w->hdr > WORK_MAX_HDR) {
+			fprintf(stderr, "Parsing is limited to %u bytes of header\n", WORK_MAX_HDR);
+			return -1;
+		}
+		if (!w->cfg.ws)
+			w->cfg.ws = 16384;
+		w->nrules = w->cfg.ws / (2 * w->hdr);
+		w->nrules = w->nrules ? w->nrules : 1;
+		if (!w->cfg.n)
+			w->cfg.n = w->nrules;
+		if (select_isa(w) || alloc_mem(w, (size_t)w->nrules * 2 * w->hdr))
+			return -1;
+		build_rules(w);
+		return 0;
+	case WORK_HASH:
+	case WORK_RANDOM:
+		if (!w->cfg.ws)
+			w->cfg.ws = 1 << 20;
+		if (!w->cfg.n)
+			w->cfg.n = 1;
+		w->mask = pow2_floor(w->cfg.ws / 64) - 1;
+		if (alloc_mem(w, (w->mask + 1) * 64))
+			return -1;
+		/* Random signatures and values of the buckets, or random lines */
+		for (i = 0; i < w->mem_len / 8; i++)
+			((uint64_t *)w->mem)[i] = xorshift(&w->rnd);
+		return 0;
+	}
+	return -1;
+}
+
+void
+work_free(struct work *w)
+{
+	free(w->mem);
+	w->mem = NULL;
+}
+
+/* Ones' complement sum of 16-bit words, from sum */
+static uint16_t
+csum(const uint8_t *p, unsigned int len, uint16_t sum)
+{
+	uint64_t s = sum;
+	unsigned int i;
+
+	for (i = 0; i + 4 <= len; i += 4) {
+		uint32_t x;
+
+		memcpy(&x, p + i, sizeof(x));
+		s += x;
+	}
+	for (; i + 2 <= len; i += 2)
+		s += p[i] | p[i + 1] << 8;
+	if (i < len)
+		s += p[i];
+	while (s >> 16)
+		s = (s & 0xffff) + (s >> 16);
+	return s;
+}
+
+void
+work_packet(struct work *w, const uint8_t *p, unsigned int len)
+{
+	const struct work_config *cfg = &w->cfg;
+	uint8_t pad[WORK_MAX_HDR];
+	uint64_t x = w->sink | 1, h;
+	unsigned int i, end;
+	uint16_t sum = 0;
+
+	switch (cfg->kernel) {
+	case WORK_SPIN:
+		for (i = 0; i < cfg->n; i++)
+			xorshift(&x);
+		break;
+	case WORK_CSUM:
+		end = cfg->bytes && cfg->bytes < len ? cfg->bytes : len;
+		end = end > 14 ? end - 14 : 0;
+		for (i = 0; i < cfg->n; i++)
+			sum = csum(p + 14, end, sum);
+		x += sum;
+		break;
+	case WORK_PARSE:
+		if (len < w->hdr) {
+			memcpy(pad, p, len);
+			memset(pad + len, 0, w->hdr - len);
+			p = pad;
+		}
+		x += w->match(w, p, flow_hash(p) % w->nrules);
+		break;
+	case WORK_HASH:
+		h = flow_hash(p);
+		for (i = 0; i < cfg->n; i++, h += 0x9e3779b97f4a7c15ull) {
+			const uint32_t *b = (const uint32_t *)(w->mem + (h & w->mask) * 64);
+			uint32_t sig = h >> 32;
+			unsigned int j;
+
+			for (j = 0; j < 16; j += 2)
+				if (b[j] == sig)
+					x += b[j + 1];
+		}
+		break;
+	case WORK_RANDOM:
+		for (i = 0; i < cfg->n; i++) {
+			uint64_t r = xorshift(&w->rnd);
+			uint64_t *line = (uint64_t *)(w->mem + (r & w->mask) * 64);
+
+			if ((r >> 40) % 100 < cfg->wr)
+				(*line)++;
+			else
+				x += *line;
+		}
+		break;
+	}
+	w->sink = x;
+}
+
+static void
+size_str(size_t x, char *buf, size_t len)
+{
+	if (x >= 1 << 20 && !(x & ((1 << 20) - 1)))
+		snprintf(buf, len, "%zu MB", x >> 20);
+	else if (x >= 1 << 10 && !(x & ((1 << 10) - 1)))
+		snprintf(buf, len, "%zu KB", x >> 10);
+	else
+		snprintf(buf, len, "%zu B", x);
+}
+
+void
+work_describe(const struct work *w, char *buf, size_t len)
+{
+	static const char *isas[] = { "auto", "scalar", "avx2", "avx512" };
+	const struct work_config *cfg = &w->cfg;
+	char ws[32];
+
+	size_str(w->mem_len, ws, sizeof(ws));
+	switch (cfg->kernel) {
+	case WORK_SPIN:
+		snprintf(buf, len, "spin (%u random calls)", cfg->n);
+		break;
+	case WORK_CSUM:
+		if (cfg->bytes)
+			snprintf(buf, len, "csum (%u pass%s over %u bytes)", cfg->n,
+			         cfg->n > 1 ? "es" : "", cfg->bytes);
+		else
+			snprintf(buf, len, "csum (%u pass%s over the packet)", cfg->n, cfg->n > 1 ? "es" : "");
+		break;
+	case WORK_PARSE:
+		snprintf(buf, len, "parse (%s, %u rules of %u bytes in %s, %u per packet)",
+		         isas[cfg->isa], w->nrules, w->hdr, ws, cfg->n);
+		break;
+	case WORK_HASH:
+		snprintf(buf, len, "hash (%s table, %u lookups per packet)", ws, cfg->n);
+		break;
+	case WORK_RANDOM:
+		snprintf(buf, len, "random (%s array, %u accesses per packet, %u%% writes)", ws,
+		         cfg->n, cfg->wr);
+		break;
+	}
+}
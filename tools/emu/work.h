@@ -0,0 +1,74 @@
+/*
+ * Per-packet processing kernels, in place of WorkPackage's busy loop
+ *
+ * Copyright (c) 2020, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#ifndef DDIO_WORK_H
+#define DDIO_WORK_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define WORK_MAX_HDR		256		/* bytes of header matched by WORK_PARSE */
+
+enum work_kernel {
+	WORK_SPIN,			/* n random calls, like WorkPackage(W n) */
+	WORK_CSUM,			/* n passes of the Internet checksum over the IP packet */
+	WORK_PARSE,			/* the header against n rules of (mask, value) */
+	WORK_HASH,			/* n lookups of the flow in a hash table */
+	WORK_RANDOM,			/* n accesses to random lines of an array */
+};
+
+enum work_isa {
+	WORK_ISA_AUTO,			/* the widest the CPU has */
+	WORK_ISA_SCALAR,
+	WORK_ISA_AVX2,
+	WORK_ISA_AVX512,
+};
+
+/*
+ * Every kernel has the same three knobs: the bytes of the packet it reads,
+ * the size of its own data (per thread), and how many operations it does
+ * per packet. 0 selects the default of the kernel.
+ */
+struct work_config {
+	enum work_kernel kernel;
+	unsigned int n;			/* compute intensity */
+	size_t ws;			/* bytes: rules, hash table, or array */
+	unsigned int bytes;		/* of the frame, from its start, 0: all (csum, parse) */
+	unsigned int wr;		/* % of the accesses that write (random) */
+	enum work_isa isa;		/* of WORK_PARSE */
+};
+
+/* Per thread */
+struct work {
+	struct work_config cfg;
+	uint8_t *mem;
+	size_t mem_len;
+	uint64_t mask;			/* buckets or lines - 1, a power of 2 */
+	unsigned int nrules, hdr;	/* WORK_PARSE: rules, and bytes matched */
+	unsigned int (*match)(const struct work *w, const uint8_t *p, unsigned int first);
+	uint64_t rnd, sink;
+};
+
+/* WORK_SPIN, n = 0: forwarding only */
+void work_config_default(struct work_config *cfg);
+
+/*
+ * "<kernel>[,n=<n>][,ws=<bytes>[K|M|G]][,bytes=<bytes>][,wr=<%>][,isa=<isa>]",
+ * e.g., "hash,n=4,ws=64M" or "parse,ws=16K,isa=avx2"
+ */
+int  work_parse(const char *arg, struct work_config *cfg);
+
+/* Allocates and fills the data of the kernel; seed: of its random draws */
+int  work_init(struct work *w, const struct work_config *cfg, uint64_t seed);
+void work_free(struct work *w);
+
+/* Processes a frame of len bytes (only reads it) */
+void work_packet(struct work *w, const uint8_t *p, unsigned int len);
+
+/* e.g., "parse (avx512, 128 rules of 64 bytes, 128 per packet)" */
+void work_describe(const struct work *w, char *buf, size_t len);
+
+#endif /* DDIO_WORK_H */
@@ -0,0 +1,598 @@
+/*
+ * Calibrating the LLC and ring models against the sample results of the experiments
+ *
+ * Copyright (c) 2020, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+// Compile command: gcc -O2 -pthread ddio-calibrate.c ring.c llc.c slice.c -o ddio-calibrate -lm
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <math.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "llc.h"
+#include "ring.h"
+
+#define MAX_POINTS	512
+#define MAX_VALUES	32
+
+/*
+ * Metrics predicted by the model, named as in the results. Rates are
+ * compared in percentage points and PPS (in millions, as plotted) in
+ * percent of the measurement.
+ */
+enum metric {
+	M_ITOM,
+	M_PCIERDCUR,
+	M_PPS,
+	METRICS
+};
+
+static const char *metric_names[METRICS] = { "ItoM-HIT-RATE", "PCIeRdCur-HIT-RATE", "PPS" };
+
+enum var {
+	V_NCORE,
+	V_NDESC,
+	V_PKT_SIZE,
+	V_IOWAY,
+	V_NW,
+	V_NONE,
+	VARS
+};
+
+/*
+ * The experiments whose parameters the model covers: the swept variable
+ * is the first column of the CSVs, and the series variable the prefix of
+ * their names (e.g., 1024ItoM-HIT-RATE.csv). The offered load of every
+ * point is its measured TXRATE, which is also how the rates of pkt-rate
+ * are known. NDESC is per queue, as for FromDPDKDevice, except where the
+ * testie divides it among the cores (split). freq and splash depend on what the model does not have
+ * (uncore frequency and the application's own accesses).
+ */
+struct experiment {
+	const char *name;
+	const char *results;
+	enum var x, series;
+	double fixed[V_NONE];		/* NCORE, NDESC, GEN_PKT_SIZE, IOWAY, n_w */
+	int split;			/* NDESC is of all the cores */
+};
+
+static const struct experiment experiments[] = {
+	{ "ddio-tune", "ddiotune-results", V_IOWAY, V_NONE, { 1, 4096, 1024, 2, 0 }, 0 },
+	{ "pktsize-desc", "ddio-pktsize-desc-results", V_NDESC, V_PKT_SIZE, { 1, 4096, 1024, 2, 0 }, 0 },
+	{ "cores", "ddio-cores-results", V_NCORE, V_NONE, { 1, 256, 1500, 2, 0 }, 0 },
+	{ "cores-vs-ways", "ddio-cores-vs-ways-results", V_IOWAY, V_NCORE, { 1, 4096, 1500, 2, 0 }, 1 },
+	{ "process-time", "ddio-process-time-results", V_NW, V_NONE, { 2, 4096, 1500, 2, 0 }, 1 },
+	{ "pkt-rate", "ddio-pkt-rate-results", V_NONE, V_NONE, { 2, 4096, 1500, 2, 0 }, 0 },
+};
+
+#define NEXPERIMENTS	(int)(sizeof(experiments) / sizeof(experiments[0]))
+
+struct point {
+	const struct experiment *exp;
+	char series[16];
+	double x;
+	double var[V_NONE];
+	double rate_gbps;
+	double measured[METRICS];	/* NAN if not measured */
+};
+
+/* Unknown parameters of the model */
+struct params {
+	unsigned int slices;		/* sets the effective way size */
+	enum llc_policy policy;
+	double base_ns;
+	double call_ns;
+};
+
+struct calib {
+	struct point pt[MAX_POINTS];
+	int npoints;
+	struct params *grid;
+	int ngrid;
+	double *sim;			/* [ngrid][npoints][METRICS] */
+	double *score;			/* [ngrid] */
+	int use[METRICS];		/* metrics of the objective */
+	unsigned int ways, sets;
+	uint64_t packets;
+	int next;
+	pthread_mutex_t lock;
+};
+
+struct sweep {
+	double v[MAX_VALUES];
+	int n;
+};
+
+static int
+parse_list(const char *arg, struct sweep *s)
+{
+	char copy[1024], *tok, *save, *end;
+
+	s->n = 0;
+	snprintf(copy, sizeof(copy), "%s", arg);
+	for (tok = strtok_r(copy, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+		if (s->n == MAX_VALUES) {
+			fprintf(stderr, "Too many values in '%s'\n", arg);
+			return -1;
+		}
+		if (!strcmp(tok, "lru") || !strcmp(tok, "random")) {
+			s->v[s->n++] = strcmp(tok, "lru") ? LLC_RANDOM : LLC_LRU;
+			continue;
+		}
+		s->v[s->n++] = strtod(tok, &end);
+		if (end == tok) {
+			fprintf(stderr, "Bad value '%s'\n", tok);
+			return -1;
+		}
+	}
+	return s->n ? 0 : -1;
+}
+
+/* The mean of the runs on a CSV line; *x is the first column */
+static double
+mean_of(char *line, double *x)
+{
+	char *tok, *save, *end;
+	double sum = 0;
+	int n = -1;
+
+	for (tok = strtok_r(line, " \t\n", &save); tok; tok = strtok_r(NULL, " \t\n", &save)) {
+		double v = strtod(tok, &end);
+
+		if (end == tok)
+			break;
+		if (n < 0)
+			*x = v;
+		else
+			sum += v;
+		n++;
+	}
+	return n > 0 ? sum / n : NAN;
+}
+
+/* Matches "<digits><metric>.csv" and returns the digits in series */
+static int
+match_file(const char *name, const char *metric, char *series, size_t len)
+{
+	size_t n = strspn(name, "0123456789");
+
+	if (n >= len || strncmp(name + n, metric, strlen(metric)) ||
+	    strcmp(name + n + strlen(metric), ".csv"))
+		return 0;
+	memcpy(series, name, n);
+	series[n] = '\0';
+	return 1;
+}
+
+static struct point *
+find_point(struct calib *cal, const struct experiment *e, const char *series, double x)
+{
+	int i;
+
+	for (i = 0; i < cal->npoints; i++)
+		if (cal->pt[i].exp == e && !strcmp(cal->pt[i].series, series) && cal->pt[i].x == x)
+			return &cal->pt[i];
+	return NULL;
+}
+
+static struct point *
+new_point(struct calib *cal, const struct experiment *e, const char *series, double x)
+{
+	struct point *pt;
+	int m;
+
+	if (cal->npoints == MAX_POINTS)
+		return NULL;
+	pt = &cal->pt[cal->npoints++];
+	memset(pt, 0, sizeof(*pt));
+	pt->exp = e;
+	snprintf(pt->series, sizeof(pt->series), "%s", series);
+	pt->x = x;
+	memcpy(pt->var, e->fixed, sizeof(pt->var));
+	if (e->x != V_NONE)
+		pt->var[e->x] = x;
+	if (e->series != V_NONE && *series)
+		pt->var[e->series] = atof(series);
+	for (m = 0; m < METRICS; m++)
+		pt->measured[m] = NAN;
+	return pt;
+}
+
+/* TXRATE creates the points, and the other files add their measurements */
+static int
+load_experiment(struct calib *cal, const char *dir, const struct experiment *e)
+{
+	char path[1024], file[1300], line[4096], series[16];
+	struct dirent *de;
+	DIR *d;
+	int m, before = cal->npoints;
+
+	snprintf(path, sizeof(path), "%s/%s/sample-results/%s", dir, e->name, e->results);
+	d = opendir(path);
+	if (!d) {
+		perror(path);
+		return -1;
+	}
+	for (m = -1; m < METRICS; m++) {
+		rewinddir(d);
+		while ((de = readdir(d))) {
+			FILE *f;
+
+			if (!match_file(de->d_name, m < 0 ? "TXRATE" : metric_names[m], series,
+			                sizeof(series)))
+				continue;
+			snprintf(file, sizeof(file), "%s/%s", path, de->d_name);
+			f = fopen(file, "r");
+			if (!f) {
+				perror(file);
+				continue;
+			}
+			while (fgets(line, sizeof(line), f)) {
+				double x = 0, v = mean_of(line, &x);
+				struct point *pt;
+
+				if (isnan(v))
+					continue;
+				pt = find_point(cal, e, series, x);
+				if (m < 0 && !pt && (pt = new_point(cal, e, series, x)))
+					pt->rate_gbps = v;
+				else if (m >= 0 && pt)
+					pt->measured[m] = v;
+			}
+			fclose(f);
+		}
+	}
+	closedir(d);
+	fprintf(stderr, "%s: %d points\n", e->name, cal->npoints - before);
+	return 0;
+}
+
+static int
+emit_llc(void *arg, enum llc_op op, uint64_t addr, unsigned int size, unsigned int core,
+         uint64_t t_ns)
+{
+	(void)t_ns;
+	return llc_access_range(arg, op, addr, size, core);
+}
+
+static void
+warmup_done(void *arg)
+{
+	llc_reset_stats(arg);
+}
+
+static double
+rate(uint64_t part, uint64_t total)
+{
+	return total ? part * 100.0 / total : 0;
+}
+
+static int
+simulate(const struct calib *cal, const struct point *pt, const struct params *pr,
+         double *out)
+{
+	struct ring_config rcfg;
+	struct llc_config lcfg;
+	struct ring_stats st;
+	struct llc c;
+	struct ring_ops ops = { emit_llc, warmup_done, &c };
+	unsigned int ioway = pt->var[V_IOWAY];
+	const struct llc_stats *ls = &c.st;
+	double seconds;
+
+	ring_config_default(&rcfg);
+	rcfg.queues = pt->var[V_NCORE];
+	rcfg.ndesc = pt->var[V_NDESC];
+	if (pt->exp->split)
+		rcfg.ndesc /= rcfg.queues;
+	rcfg.pkt_size = pt->var[V_PKT_SIZE];
+	rcfg.rate_gbps = pt->rate_gbps;
+	rcfg.base_ns = pr->base_ns;
+	rcfg.proc_ns = pt->var[V_NW] * pr->call_ns;
+	rcfg.packets = cal->packets;
+	rcfg.warmup = cal->packets / 10;
+
+	llc_config_default(&lcfg);
+	lcfg.ways = cal->ways;
+	lcfg.sets = cal->sets;
+	lcfg.slices = pr->slices;
+	lcfg.policy = pr->policy;
+	if (!ioway || ioway > lcfg.ways)
+		return -1;
+	/* DDIOTune takes the ways from the top of the cache */
+	lcfg.io_mask = ((1u << ioway) - 1) << (lcfg.ways - ioway);
+
+	if (llc_init(&c, &lcfg))
+		return -1;
+	if (ring_run(&rcfg, &ops, &st)) {
+		llc_free(&c);
+		return -1;
+	}
+	seconds = (st.t_end_ns - st.t_start_ns) / 1e9;
+	out[M_ITOM] = rate(ls->hit[LLC_DMA_WR], ls->hit[LLC_DMA_WR] + ls->miss[LLC_DMA_WR]);
+	out[M_PCIERDCUR] = rate(ls->hit[LLC_DMA_RD], ls->hit[LLC_DMA_RD] + ls->miss[LLC_DMA_RD]);
+	out[M_PPS] = seconds > 0 ? st.processed / seconds / 1e6 : 0;
+	llc_free(&c);
+	return 0;
+}
+
+/* Error of a simulated value, in percentage points or percent (PPS) */
+static double
+error_of(int m, double sim, double meas)
+{
+	if (m == M_PPS)
+		return meas ? (sim - meas) * 100 / meas : 0;
+	return sim - meas;
+}
+
+/* RMSE of metric m over the points of experiment e (all if NULL) */
+static double
+rmse(const struct calib *cal, int g, const struct experiment *e, int m, double *mae, int *n)
+{
+	const double *sim = cal->sim + (size_t)g * cal->npoints * METRICS;
+	double sq = 0, abs_sum = 0;
+	int i, k = 0;
+
+	for (i = 0; i < cal->npoints; i++) {
+		double err;
+
+		if ((e && cal->pt[i].exp != e) || isnan(cal->pt[i].measured[m]) ||
+		    isnan(sim[i * METRICS + m]))
+			continue;
+		err = error_of(m, sim[i * METRICS + m], cal->pt[i].measured[m]);
+		sq += err * err;
+		abs_sum += fabs(err);
+		k++;
+	}
+	if (mae)
+		*mae = k ? abs_sum / k : 0;
+	if (n)
+		*n = k;
+	return k ? sqrt(sq / k) : 0;
+}
+
+static void *
+worker(void *arg)
+{
+	struct calib *cal = arg;
+
+	for (;;) {
+		double *sim, score = 0;
+		int g, i, m, used = 0;
+
+		pthread_mutex_lock(&cal->lock);
+		g = cal->next++;
+		pthread_mutex_unlock(&cal->lock);
+		if (g >= cal->ngrid)
+			break;
+
+		sim = cal->sim + (size_t)g * cal->npoints * METRICS;
+		for (i = 0; i < cal->npoints; i++) {
+			if (simulate(cal, &cal->pt[i], &cal->grid[g], sim + i * METRICS)) {
+				for (m = 0; m < METRICS; m++)
+					sim[i * METRICS + m] = NAN;
+			}
+		}
+		for (m = 0; m < METRICS; m++) {
+			if (cal->use[m]) {
+				score += rmse(cal, g, NULL, m, NULL, NULL);
+				used++;
+			}
+		}
+		cal->score[g] = used ? score / used : 0;
+		fprintf(stderr, "slices=%u policy=%s base_ns=%g call_ns=%g: error %f\n",
+		        cal->grid[g].slices, cal->grid[g].policy == LLC_LRU ? "lru" : "random",
+		        cal->grid[g].base_ns, cal->grid[g].call_ns, cal->score[g]);
+	}
+	return NULL;
+}
+
+static void
+usage(const char *prog)
+{
+	printf("Usage: %s [options]\n", prog);
+	printf("\nOptions:\n");
+	printf("  -E dir      : Experiments directory (default: ../../experiments)\n");
+	printf("  -x list     : Experiments (default: ddio-tune,pktsize-desc,cores,cores-vs-ways,process-time,pkt-rate)\n");
+	printf("  -m list     : Metrics of the objective (default: ItoM-HIT-RATE,PCIeRdCur-HIT-RATE)\n");
+	printf("\nParameters to fit (comma-separated lists are searched):\n");
+	printf("  -N slices   : Slices, i.e., way size in units of -S lines (default: 6,9,12,15,18)\n");
+	printf("  -p policy   : Replacement policy, lru and/or random (default: lru,random)\n");
+	printf("  -B ns       : Per-packet cost of the forwarding path (default: 30)\n");
+	printf("  -c ns       : Cost of one call of n_w (default: 5)\n");
+	printf("\nModel:\n");
+	printf("  -W ways     : Ways (default: 11)\n");
+	printf("  -S sets     : Sets per slice (default: 2048)\n");
+	printf("  -n packets  : Packets per simulated point (default: 200000)\n");
+	printf("  -j threads  : Parameter sets simulated in parallel (default: online CPUs)\n");
+	printf("\nOutput:\n");
+	printf("  -C file     : Write the measured and simulated value of every point (CSV)\n");
+	printf("  -o file     : Write results to file instead of stdout\n");
+	printf("\nExample:\n");
+	printf("  %s -x ddio-tune,pktsize-desc -N 9,12,15,18 -p lru,random -B 20,30,40\n", prog);
+}
+
+int main(int argc, char *argv[])
+{
+	static struct calib cal;
+	const char *dir = "../../experiments", *xlist = NULL, *mlist = NULL;
+	const char *outfile = NULL, *csvfile = NULL;
+	struct sweep sw_slices, sw_policy, sw_base, sw_call;
+	unsigned int nthreads = sysconf(_SC_NPROCESSORS_ONLN), t;
+	pthread_t *threads;
+	FILE *out = stdout;
+	int opt, i, j, k, l, m, best = 0, ret = 0;
+
+	parse_list("6,9,12,15,18", &sw_slices);
+	parse_list("lru,random", &sw_policy);
+	parse_list("30", &sw_base);
+	parse_list("5", &sw_call);
+	cal.ways = 11;
+	cal.sets = 2048;
+	cal.packets = 200000;
+
+	while ((opt = getopt(argc, argv, "E:x:m:N:p:B:c:W:S:n:j:C:o:h")) != -1) {
+		switch (opt) {
+		case 'E':
+			dir = optarg;
+			break;
+		case 'x':
+			xlist = optarg;
+			break;
+		case 'm':
+			mlist = optarg;
+			break;
+		case 'N':
+			ret = parse_list(optarg, &sw_slices);
+			break;
+		case 'p':
+			ret = parse_list(optarg, &sw_policy);
+			break;
+		case 'B':
+			ret = parse_list(optarg, &sw_base);
+			break;
+		case 'c':
+			ret = parse_list(optarg, &sw_call);
+			break;
+		case 'W':
+			cal.ways = strtoul(optarg, NULL, 0);
+			break;
+		case 'S':
+			cal.sets = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			cal.packets = strtoull(optarg, NULL, 0);
+			break;
+		case 'j':
+			nthreads = strtoul(optarg, NULL, 0);
+			break;
+		case 'C':
+			csvfile = optarg;
+			break;
+		case 'o':
+			outfile = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+		if (ret)
+			return 1;
+	}
+	if (!nthreads)
+		nthreads = 1;
+
+	for (m = 0; m < METRICS; m++)
+		cal.use[m] = mlist ? !!strstr(mlist, metric_names[m]) : m != M_PPS;
+	for (i = 0; i < NEXPERIMENTS; i++) {
+		if (xlist && !strstr(xlist, experiments[i].name))
+			continue;
+		if (load_experiment(&cal, dir, &experiments[i]))
+			return 1;
+	}
+	if (!cal.npoints) {
+		printf("No sample results found in %s!\n", dir);
+		return 1;
+	}
+
+	cal.ngrid = sw_slices.n * sw_policy.n * sw_base.n * sw_call.n;
+	cal.grid = calloc(cal.ngrid, sizeof(*cal.grid));
+	cal.score = calloc(cal.ngrid, sizeof(*cal.score));
+	cal.sim = calloc((size_t)cal.ngrid * cal.npoints * METRICS, sizeof(*cal.sim));
+	threads = calloc(nthreads, sizeof(*threads));
+	if (!cal.grid || !cal.score || !cal.sim || !threads) {
+		perror("calloc");
+		return 1;
+	}
+	cal.ngrid = 0;
+	for (i = 0; i < sw_slices.n; i++)
+		for (j = 0; j < sw_policy.n; j++)
+			for (k = 0; k < sw_base.n; k++)
+				for (l = 0; l < sw_call.n; l++) {
+					struct params *pr = &cal.grid[cal.ngrid++];
+
+					pr->slices = sw_slices.v[i];
+					pr->policy = sw_policy.v[j];
+					pr->base_ns = sw_base.v[k];
+					pr->call_ns = sw_call.v[l];
+				}
+	fprintf(stderr, "%d points x %d parameter sets on %u threads\n",
+	        cal.npoints, cal.ngrid, nthreads);
+
+	pthread_mutex_init(&cal.lock, NULL);
+	for (t = 0; t < nthreads; t++) {
+		if (pthread_create(&threads[t], NULL, worker, &cal)) {
+			perror("pthread_create");
+			return 1;
+		}
+	}
+	for (t = 0; t < nthreads; t++)
+		pthread_join(threads[t], NULL);
+
+	for (i = 1; i < cal.ngrid; i++)
+		if (cal.score[i] < cal.score[best])
+			best = i;
+
+	if (outfile) {
+		out = fopen(outfile, "w");
+		if (!out) {
+			perror(outfile);
+			return 1;
+		}
+	}
+	fprintf(out, "RESULT-BEST-SLICES %u\n", cal.grid[best].slices);
+	fprintf(out, "RESULT-BEST-WAY-SIZE %" PRIu64 "\n",
+	        (uint64_t)cal.grid[best].slices * cal.sets * LLC_LINE_SIZE);
+	fprintf(out, "RESULT-BEST-POLICY %s\n", cal.grid[best].policy == LLC_LRU ? "lru" : "random");
+	fprintf(out, "RESULT-BEST-BASE-NS %f\n", cal.grid[best].base_ns);
+	fprintf(out, "RESULT-BEST-CALL-NS %f\n", cal.grid[best].call_ns);
+	fprintf(out, "RESULT-BEST-ERROR %f\n", cal.score[best]);
+	for (m = 0; m < METRICS; m++) {
+		double mae;
+		int n;
+		double r = rmse(&cal, best, NULL, m, &mae, &n);
+
+		if (!n)
+			continue;
+		fprintf(out, "RESULT-%s-RMSE %f\n", metric_names[m], r);
+		fprintf(out, "RESULT-%s-MAE %f\n", metric_names[m], mae);
+		for (i = 0; i < NEXPERIMENTS; i++) {
+			r = rmse(&cal, best, &experiments[i], m, &mae, &n);
+			if (n)
+				fprintf(out, "RESULT-%s-%s-RMSE %f\n", experiments[i].name, metric_names[m], r);
+		}
+	}
+	if (out != stdout)
+		fclose(out);
+
+	if (csvfile) {
+		const double *sim = cal.sim + (size_t)best * cal.npoints * METRICS;
+		FILE *f = fopen(csvfile, "w");
+
+		if (!f) {
+			perror(csvfile);
+			return 1;
+		}
+		fprintf(f, "experiment,series,x,rate_gbps,metric,measured,simulated,error\n");
+		for (i = 0; i < cal.npoints; i++) {
+			const struct point *pt = &cal.pt[i];
+
+			for (m = 0; m < METRICS; m++) {
+				if (isnan(pt->measured[m]))
+					continue;
+				fprintf(f, "%s,%s,%g,%f,%s,%f,%f,%f\n", pt->exp->name, pt->series, pt->x,
+				        pt->rate_gbps, metric_names[m], pt->measured[m], sim[i * METRICS + m],
+				        error_of(m, sim[i * METRICS + m], pt->measured[m]));
+			}
+		}
+		fclose(f);
+	}
+	return 0;
+}
@@ -0,0 +1,374 @@
+/*
+ * Predicting DDIO hit rates and leaky DMA of L2 forwarding from a ring model
+ *
+ * Copyright (c) 2020, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+// Compile command: gcc -O2 -pthread -DHAVE_ZLIB ddio-ringsim.c ring.c llc.c slice.c trace.c -o ddio-ringsim -lz
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+
+#include "llc.h"
+#include "ring.h"
+#include "trace.h"
+
+#define MAX_VALUES	64
+
+/*
+ * Swept parameters, named after the variables of the experiments
+ */
+enum dim {
+	DIM_NCORE,
+	DIM_NDESC,
+	DIM_BURST,
+	DIM_PKT_SIZE,
+	DIM_RATE,
+	DIM_NW,
+	DIM_IOWAY,
+	DIMS
+};
+
+static const char *dim_names[DIMS] = {
+	"NCORE", "NDESC", "NINBURST", "GEN_PKT_SIZE", "RATE", "n_w", "IOWAY",
+};
+
+struct sweep {
+	double v[MAX_VALUES];
+	int n;
+};
+
+struct sim {
+	struct llc c;
+	FILE *trace;
+	struct trace_writer *writer;
+};
+
+static int
+parse_list(const char *arg, struct sweep *s)
+{
+	char copy[1024], *tok, *save, *end;
+
+	s->n = 0;
+	snprintf(copy, sizeof(copy), "%s", arg);
+	for (tok = strtok_r(copy, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+		if (s->n == MAX_VALUES) {
+			fprintf(stderr, "Too many values in '%s'\n", arg);
+			return -1;
+		}
+		s->v[s->n++] = strtod(tok, &end);
+		if (end == tok) {
+			fprintf(stderr, "Bad value '%s'\n", tok);
+			return -1;
+		}
+	}
+	return s->n ? 0 : -1;
+}
+
+static int
+emit_llc(void *arg, enum llc_op op, uint64_t addr, unsigned int size, unsigned int core,
+         uint64_t t_ns)
+{
+	struct sim *sim = arg;
+
+	(void)t_ns;
+	return llc_access_range(&sim->c, op, addr, size, core);
+}
+
+/* Text or binary traces, as read by ddio-sim */
+static int
+emit_trace(void *arg, enum llc_op op, uint64_t addr, unsigned int size, unsigned int core,
+           uint64_t t_ns)
+{
+	struct sim *sim = arg;
+	struct trace_rec rec = { t_ns, addr, size, core, op, 0 };
+
+	if (sim->writer)
+		trace_write(sim->writer, &rec);
+	else
+		trace_print_line(sim->trace, &rec);
+	return -1;
+}
+
+static void
+warmup_done(void *arg)
+{
+	struct sim *sim = arg;
+
+	llc_reset_stats(&sim->c);
+}
+
+static double
+rate(uint64_t part, uint64_t total)
+{
+	return total ? part * 100.0 / total : 0;
+}
+
+static void
+usage(const char *prog)
+{
+	printf("Usage: %s [options]\n", prog);
+	printf("\nWorkload (comma-separated lists are swept):\n");
+	printf("  -q cores    : Cores, one RX/TX queue each (NCORE, default: 1)\n");
+	printf("  -d ndesc    : RX/TX descriptors per queue (NDESC, default: 4096)\n");
+	printf("  -b burst    : RX/TX burst size (NINBURST, default: 32)\n");
+	printf("  -s bytes    : Packet size (GEN_PKT_SIZE, default: 1024)\n");
+	printf("  -r gbps     : Offered load in Gbps (default: 100)\n");
+	printf("  -w calls    : Random calls per packet (n_w of WorkPackage, default: 0)\n");
+	printf("  -c ns       : Cost of one call (default: 5)\n");
+	printf("  -B ns       : Per-packet cost of the forwarding path (default: 30)\n");
+	printf("  -M bytes    : mbuf size including header and headroom (default: 2304)\n");
+	printf("  -m mbufs    : Mempool size (default: 2 x queues x NDESC + 1024)\n");
+	printf("  -n packets  : Packets offered (default: 1000000)\n");
+	printf("  -u packets  : Warm-up packets not counted (default: 10%% of -n)\n");
+	printf("\nCache:\n");
+	printf("  -i mask     : IIO LLC WAYS (IOWAY, default: 0x600)\n");
+	printf("  -D          : Disable DDIO\n");
+	printf("  -e alloc    : CAT classes, e.g., \"llc:0=0x0C0;llc:1=0x600\"\n");
+	printf("  -a assoc    : CAT cores, e.g., \"llc:0=2;llc:1=0,1,3-17\"\n");
+	printf("  -S sets     : Sets per slice (default: 2048)\n");
+	printf("  -W ways     : Ways (default: 11)\n");
+	printf("  -N slices   : Slices (default: 18)\n");
+	printf("  -H hash     : Slice hash, a preset (xeon-2, xeon-4, xeon-8) or a table file\n");
+	printf("  -A topo     : Slice-aware mempool for a ring or mesh:<cols> topology (needs -H)\n");
+	printf("\nOutput:\n");
+	printf("  -T          : Write the trace for ddio-sim instead of simulating\n");
+	printf("                (binary if the output file ends with .dtr)\n");
+	printf("  -o file     : Write results to file instead of stdout\n");
+	printf("\nA single configuration prints NPF results; a sweep prints one CSV line per configuration.\n");
+	printf("\nExample:\n");
+	printf("  %s -d 256,512,1024,2048,4096 -s 64,256,1024,1500 -i 0x600,0x7FF -n 200000\n", prog);
+}
+
+int main(int argc, char *argv[])
+{
+	struct ring_config rcfg;
+	struct llc_config lcfg;
+	struct slice_hash hash;
+	struct slice_topo topo;
+	const char *topo_arg = NULL;
+	struct ring_stats st;
+	struct sweep sw[DIMS];
+	struct sim sim;
+	struct trace_writer writer;
+	struct ring_ops ops = { emit_llc, warmup_done, &sim };
+	const char *outfile = NULL;
+	int idx[DIMS] = { 0 };
+	int trace = 0, opt, d, nconf = 1, conf;
+	int64_t warmup = -1;
+	double call_ns = 5;
+	FILE *out = stdout;
+
+	ring_config_default(&rcfg);
+	llc_config_default(&lcfg);
+	for (d = 0; d < DIMS; d++)
+		sw[d].n = 1;
+	sw[DIM_NCORE].v[0] = rcfg.queues;
+	sw[DIM_NDESC].v[0] = rcfg.ndesc;
+	sw[DIM_BURST].v[0] = rcfg.burst;
+	sw[DIM_PKT_SIZE].v[0] = rcfg.pkt_size;
+	sw[DIM_RATE].v[0] = rcfg.rate_gbps;
+	sw[DIM_NW].v[0] = 0;
+	sw[DIM_IOWAY].v[0] = lcfg.io_mask;
+
+	while ((opt = getopt(argc, argv, "q:d:b:s:r:w:c:B:M:m:n:u:i:De:a:S:W:N:H:A:To:h")) != -1) {
+		int ret = 0;
+
+		switch (opt) {
+		case 'q':
+			ret = parse_list(optarg, &sw[DIM_NCORE]);
+			break;
+		case 'd':
+			ret = parse_list(optarg, &sw[DIM_NDESC]);
+			break;
+		case 'b':
+			ret = parse_list(optarg, &sw[DIM_BURST]);
+			break;
+		case 's':
+			ret = parse_list(optarg, &sw[DIM_PKT_SIZE]);
+			break;
+		case 'r':
+			ret = parse_list(optarg, &sw[DIM_RATE]);
+			break;
+		case 'w':
+			ret = parse_list(optarg, &sw[DIM_NW]);
+			break;
+		case 'i':
+			ret = parse_list(optarg, &sw[DIM_IOWAY]);
+			break;
+		case 'c':
+			call_ns = atof(optarg);
+			break;
+		case 'B':
+			rcfg.base_ns = atof(optarg);
+			break;
+		case 'M':
+			rcfg.mbuf_size = strtoul(optarg, NULL, 0);
+			break;
+		case 'm':
+			rcfg.nmbufs = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			rcfg.packets = strtoull(optarg, NULL, 0);
+			break;
+		case 'u':
+			warmup = strtoll(optarg, NULL, 0);
+			break;
+		case 'D':
+			lcfg.ddio = 0;
+			break;
+		case 'e':
+			ret = llc_parse_cos(&lcfg, optarg);
+			break;
+		case 'a':
+			ret = llc_parse_assoc(&lcfg, optarg);
+			break;
+		case 'S':
+			lcfg.sets = strtoul(optarg, NULL, 0);
+			break;
+		case 'W':
+			lcfg.ways = strtoul(optarg, NULL, 0);
+			break;
+		case 'N':
+			lcfg.slices = strtoul(optarg, NULL, 0);
+			break;
+		case 'H':
+			ret = slice_hash_get(optarg, &hash);
+			lcfg.slices = hash.slices;
+			lcfg.slice_fn = slice_llc_fn;
+			lcfg.slice_arg = &hash;
+			break;
+		case 'A':
+			topo_arg = optarg;
+			break;
+		case 'T':
+			trace = 1;
+			break;
+		case 'o':
+			outfile = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+		if (ret)
+			return 1;
+	}
+	rcfg.warmup = warmup >= 0 ? (uint64_t)warmup : rcfg.packets / 10;
+	if (topo_arg) {
+		if (!lcfg.slice_arg) {
+			printf("A slice-aware mempool needs a slice hash (-H)!\n");
+			return 1;
+		}
+		if (slice_topo_parse(topo_arg, hash.slices, &topo))
+			return 1;
+		rcfg.slice_hash = &hash;
+		rcfg.slice_topo = &topo;
+	}
+
+	for (d = 0; d < DIMS; d++)
+		nconf *= sw[d].n;
+	if (trace && nconf > 1) {
+		printf("A trace can only be written for a single configuration!\n");
+		return 1;
+	}
+
+	sim.writer = NULL;
+	if (trace && outfile && strlen(outfile) > 4 && !strcmp(outfile + strlen(outfile) - 4, ".dtr")) {
+		if (trace_writer_open(&writer, outfile, TRACE_DEFAULT_FLAGS, sysconf(_SC_NPROCESSORS_ONLN)))
+			return 1;
+		sim.writer = &writer;
+	} else if (outfile) {
+		out = fopen(outfile, "w");
+		if (!out) {
+			perror(outfile);
+			return 1;
+		}
+	}
+	if (trace) {
+		sim.trace = out;
+		ops.emit = emit_trace;
+		ops.warmup_done = NULL;
+	}
+	if (nconf > 1) {
+		for (d = 0; d < DIMS; d++)
+			fprintf(out, "%s,", dim_names[d]);
+		fprintf(out, "PPS,DROP-RATE,ItoM-HIT-RATE,PCIeRdCur-HIT-RATE,LEAKY-DMA-RATE,"
+		        "MEM-RD-BW,MEM-WR-BW\n");
+	}
+
+	for (conf = 0; conf < nconf; conf++) {
+		const struct llc_stats *ls = &sim.c.st;
+		double seconds;
+
+		rcfg.queues = sw[DIM_NCORE].v[idx[DIM_NCORE]];
+		rcfg.ndesc = sw[DIM_NDESC].v[idx[DIM_NDESC]];
+		rcfg.burst = sw[DIM_BURST].v[idx[DIM_BURST]];
+		rcfg.pkt_size = sw[DIM_PKT_SIZE].v[idx[DIM_PKT_SIZE]];
+		rcfg.rate_gbps = sw[DIM_RATE].v[idx[DIM_RATE]];
+		rcfg.proc_ns = sw[DIM_NW].v[idx[DIM_NW]] * call_ns;
+		lcfg.io_mask = sw[DIM_IOWAY].v[idx[DIM_IOWAY]];
+
+		if (!trace && llc_init(&sim.c, &lcfg))
+			return 1;
+		if (ring_run(&rcfg, &ops, &st))
+			return 1;
+		seconds = (st.t_end_ns - st.t_start_ns) / 1e9;
+
+		if (trace) {
+			/* Nothing else to report */
+		} else if (nconf == 1) {
+			fprintf(out, "RESULT-ItoM-HIT-SUM %" PRIu64 "\n", ls->hit[LLC_DMA_WR]);
+			fprintf(out, "RESULT-ItoM-MISS-SUM %" PRIu64 "\n", ls->miss[LLC_DMA_WR]);
+			fprintf(out, "RESULT-ItoM-HIT-RATE %f\n",
+			        rate(ls->hit[LLC_DMA_WR], ls->hit[LLC_DMA_WR] + ls->miss[LLC_DMA_WR]));
+			fprintf(out, "RESULT-PCIeRdCur-HIT-SUM %" PRIu64 "\n", ls->hit[LLC_DMA_RD]);
+			fprintf(out, "RESULT-PCIeRdCur-MISS-SUM %" PRIu64 "\n", ls->miss[LLC_DMA_RD]);
+			fprintf(out, "RESULT-PCIeRdCur-HIT-RATE %f\n",
+			        rate(ls->hit[LLC_DMA_RD], ls->hit[LLC_DMA_RD] + ls->miss[LLC_DMA_RD]));
+			fprintf(out, "RESULT-LEAKY-DMA-SUM %" PRIu64 "\n", st.leaky);
+			fprintf(out, "RESULT-LEAKY-DMA-RATE %f\n", rate(st.leaky, st.processed));
+			fprintf(out, "RESULT-DROPS %" PRIu64 "\n", st.dropped);
+			fprintf(out, "RESULT-PPS %f\n", seconds > 0 ? st.processed / seconds : 0);
+			fprintf(out, "RESULT-MEM-RD-BW %f\n",
+			        seconds > 0 ? ls->mem_rd * LLC_LINE_SIZE / seconds : 0);
+			fprintf(out, "RESULT-MEM-WR-BW %f\n",
+			        seconds > 0 ? ls->mem_wr * LLC_LINE_SIZE / seconds : 0);
+		} else {
+			for (d = 0; d < DIMS; d++) {
+				if (d == DIM_IOWAY)
+					fprintf(out, "0x%X,", (unsigned int)sw[d].v[idx[d]]);
+				else
+					fprintf(out, "%g,", sw[d].v[idx[d]]);
+			}
+			fprintf(out, "%.0f,%f,%f,%f,%f,%.0f,%.0f\n",
+			        seconds > 0 ? st.processed / seconds : 0,
+			        rate(st.dropped, st.offered),
+			        rate(ls->hit[LLC_DMA_WR], ls->hit[LLC_DMA_WR] + ls->miss[LLC_DMA_WR]),
+			        rate(ls->hit[LLC_DMA_RD], ls->hit[LLC_DMA_RD] + ls->miss[LLC_DMA_RD]),
+			        rate(st.leaky, st.processed),
+			        seconds > 0 ? ls->mem_rd * LLC_LINE_SIZE / seconds : 0,
+			        seconds > 0 ? ls->mem_wr * LLC_LINE_SIZE / seconds : 0);
+			fflush(out);
+		}
+		if (!trace)
+			llc_free(&sim.c);
+
+		/* Next configuration; the last dimension varies fastest */
+		for (d = DIMS - 1; d >= 0; d--) {
+			if (++idx[d] < sw[d].n)
+				break;
+			idx[d] = 0;
+		}
+	}
+
+	if (sim.writer && trace_writer_close(sim.writer))
+		return 1;
+	if (out != stdout)
+		fclose(out);
+	return 0;
+}
@@ -0,0 +1,286 @@
+/*
+ * Trace-driven LLC simulation of DDIO and CAT configurations
+ *
+ * Copyright (c) 2020, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+// Compile command: gcc -O2 -march=native -pthread -DHAVE_ZLIB ddio-sim.c llc.c slice.c shard.c trace.c -o ddio-sim -lz
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+
+#include "llc.h"
+#include "shard.h"
+#include "slice.h"
+#include "trace.h"
+
+static void
+print_pair(FILE *out, const char *name, uint64_t hit, uint64_t miss)
+{
+	fprintf(out, "RESULT-%s-HIT-SUM %" PRIu64 "\n", name, hit);
+	fprintf(out, "RESULT-%s-MISS-SUM %" PRIu64 "\n", name, miss);
+	if (hit + miss) {
+		fprintf(out, "RESULT-%s-HIT-RATE %f\n", name, hit * 100.0 / (hit + miss));
+		fprintf(out, "RESULT-%s-MISS-RATE %f\n", name, miss * 100.0 / (hit + miss));
+	}
+}
+
+static void
+print_results(FILE *out, const struct llc_stats *st, uint64_t io_occupancy)
+{
+	print_pair(out, "ItoM", st->hit[LLC_DMA_WR], st->miss[LLC_DMA_WR]);
+	print_pair(out, "PCIeRdCur", st->hit[LLC_DMA_RD], st->miss[LLC_DMA_RD]);
+	print_pair(out, "CORE-RD", st->hit[LLC_CORE_RD], st->miss[LLC_CORE_RD]);
+	print_pair(out, "CORE-WR", st->hit[LLC_CORE_WR], st->miss[LLC_CORE_WR]);
+	fprintf(out, "RESULT-LLC-EVICT-SUM %" PRIu64 "\n", st->evict);
+	fprintf(out, "RESULT-LLC-WRITEBACK-SUM %" PRIu64 "\n", st->writeback);
+	fprintf(out, "RESULT-IO-EVICT-SUM %" PRIu64 "\n", st->io_evict);
+	fprintf(out, "RESULT-MEM-RD-SUM %" PRIu64 "\n", st->mem_rd * LLC_LINE_SIZE);
+	fprintf(out, "RESULT-MEM-WR-SUM %" PRIu64 "\n", st->mem_wr * LLC_LINE_SIZE);
+	fprintf(out, "RESULT-IO-OCCUPANCY %" PRIu64 "\n", io_occupancy * LLC_LINE_SIZE);
+}
+
+static double
+rate(uint64_t part, uint64_t total)
+{
+	return total ? part * 100.0 / total : 0;
+}
+
+/* One line per configuration of a sweep */
+static void
+print_csv(FILE *out, uint32_t io_mask, const struct llc_stats *st, uint64_t io_occupancy)
+{
+	fprintf(out, "0x%X,%f,%f,%f,%f,%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 "\n", io_mask,
+	        rate(st->hit[LLC_DMA_WR], st->hit[LLC_DMA_WR] + st->miss[LLC_DMA_WR]),
+	        rate(st->hit[LLC_DMA_RD], st->hit[LLC_DMA_RD] + st->miss[LLC_DMA_RD]),
+	        rate(st->hit[LLC_CORE_RD], st->hit[LLC_CORE_RD] + st->miss[LLC_CORE_RD]),
+	        rate(st->hit[LLC_CORE_WR], st->hit[LLC_CORE_WR] + st->miss[LLC_CORE_WR]),
+	        st->io_evict, st->mem_rd * LLC_LINE_SIZE, st->mem_wr * LLC_LINE_SIZE,
+	        io_occupancy * LLC_LINE_SIZE);
+}
+
+/*
+ * Parses a list of IIO way masks ("0x600,0x7FF"), or of numbers of ways
+ * ("2-11", as IOWAY of the experiments) that are taken from the top of
+ * the cache, like DDIOTune does.
+ */
+static int
+parse_masks(const char *arg, int nways, unsigned int ways, uint32_t *mask, unsigned int *n)
+{
+	char copy[1024], *tok, *save;
+
+	snprintf(copy, sizeof(copy), "%s", arg);
+	for (tok = strtok_r(copy, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+		unsigned int lo, hi;
+
+		if (!nways) {
+			lo = hi = strtoul(tok, NULL, 16);
+		} else if (sscanf(tok, "%u-%u", &lo, &hi) != 2) {
+			hi = lo = strtoul(tok, NULL, 0);
+		}
+		for (; lo <= hi; lo++) {
+			if (*n == SHARD_MAX_CONFIGS) {
+				fprintf(stderr, "Too many configurations (max %d)\n", SHARD_MAX_CONFIGS);
+				return -1;
+			}
+			if (nways && (!lo || lo > ways)) {
+				fprintf(stderr, "Bad number of ways: %u\n", lo);
+				return -1;
+			}
+			mask[(*n)++] = nways ? ((1u << lo) - 1) << (ways - lo) : lo;
+		}
+	}
+	return *n ? 0 : -1;
+}
+
+static void
+usage(const char *prog)
+{
+	printf("Usage: %s [options] [trace]\n", prog);
+	printf("\nOptions:\n");
+	printf("  -s sets     : Sets per slice (default: 2048)\n");
+	printf("  -w ways     : Ways (default: 11)\n");
+	printf("  -n slices   : Slices (default: 18)\n");
+	printf("  -H hash     : Slice hash, a preset (xeon-2, xeon-4, xeon-8) or a table file\n");
+	printf("  -i masks    : IIO LLC WAYS, i.e., DDIO ways, comma-separated to sweep (default: 0x600)\n");
+	printf("  -I ways     : Number of DDIO ways to sweep instead, e.g., 2-11 (IOWAY)\n");
+	printf("  -d          : Disable DDIO (DMA goes to memory)\n");
+	printf("  -e alloc    : CAT classes, e.g., \"llc:0=0x0C0;llc:1=0x600\"\n");
+	printf("  -a assoc    : CAT cores, e.g., \"llc:0=2;llc:1=0,1,3-17\"\n");
+	printf("  -p policy   : Replacement policy: lru or random (default: lru)\n");
+	printf("  -W records  : Warm up the cache with the first records before counting\n");
+	printf("  -j threads  : Worker threads, each simulating a shard of the sets (default: 1)\n");
+	printf("  -o file     : Write results to file instead of stdout\n");
+	printf("\nThe trace is read from stdin if no file is given. Every line is\n");
+	printf("\"<op> <address> [<size>] [<core>]\" with op W (DMA write), R (DMA read),\n");
+	printf("r (core read), or w (core write). Binary traces (see ddio-trace) are mapped.\n");
+	printf("\nA single configuration prints NPF results; a sweep prints one CSV line per configuration.\n");
+	printf("\nExample:\n");
+	printf("  %s -i 0x7FF -e \"llc:1=0x600\" -a \"llc:1=0\" l2fwd.trace\n", prog);
+	printf("  %s -I 2-11 -j 16 l2fwd.trace\n", prog);
+}
+
+int main(int argc, char *argv[])
+{
+	struct llc_config cfg, cfgs[SHARD_MAX_CONFIGS];
+	struct slice_hash hash;
+	struct shard_sim sim;
+	struct llc_stats st;
+	struct trace_reader tr;
+	const char *outfile = NULL, *masks = NULL;
+	uint64_t records = 0, warmup = 0;
+	uint32_t mask[SHARD_MAX_CONFIGS];
+	unsigned int ncfg = 0, nthreads = 1, k;
+	char line[256];
+	FILE *in = stdin, *out = stdout;
+	int opt, nways = 0, binary = 0;
+
+	llc_config_default(&cfg);
+	while ((opt = getopt(argc, argv, "s:w:n:H:i:I:de:a:p:W:j:o:h")) != -1) {
+		switch (opt) {
+		case 's':
+			cfg.sets = strtoul(optarg, NULL, 0);
+			break;
+		case 'w':
+			cfg.ways = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			cfg.slices = strtoul(optarg, NULL, 0);
+			break;
+		case 'H':
+			if (slice_hash_get(optarg, &hash))
+				return 1;
+			cfg.slices = hash.slices;
+			cfg.slice_fn = slice_llc_fn;
+			cfg.slice_arg = &hash;
+			break;
+		case 'i':
+		case 'I':
+			masks = optarg;
+			nways = opt == 'I';
+			break;
+		case 'd':
+			cfg.ddio = 0;
+			break;
+		case 'e':
+			if (llc_parse_cos(&cfg, optarg))
+				return 1;
+			break;
+		case 'a':
+			if (llc_parse_assoc(&cfg, optarg))
+				return 1;
+			break;
+		case 'p':
+			cfg.policy = strcmp(optarg, "random") ? LLC_LRU : LLC_RANDOM;
+			break;
+		case 'W':
+			warmup = strtoull(optarg, NULL, 0);
+			break;
+		case 'j':
+			nthreads = strtoul(optarg, NULL, 0);
+			break;
+		case 'o':
+			outfile = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	if (masks) {
+		if (parse_masks(masks, nways, cfg.ways, mask, &ncfg))
+			return 1;
+	} else {
+		mask[ncfg++] = cfg.io_mask;
+	}
+	for (k = 0; k < ncfg; k++) {
+		cfgs[k] = cfg;
+		cfgs[k].io_mask = mask[k];
+	}
+
+	if (optind < argc && strcmp(argv[optind], "-")) {
+		binary = trace_is_binary(argv[optind]);
+		if (binary < 0)
+			return 1;
+		if (binary && trace_reader_open(&tr, argv[optind]))
+			return 1;
+		if (!binary) {
+			in = fopen(argv[optind], "r");
+			if (!in) {
+				perror(argv[optind]);
+				return 1;
+			}
+		}
+	}
+
+	if (shard_sim_init(&sim, cfgs, ncfg, nthreads))
+		return 1;
+	fprintf(stderr, "LLC: %u slices x %u sets x %u ways (%.2f MiB), DDIO %s, "
+	        "%u configuration(s), %u thread(s)\n",
+	        cfg.slices, cfg.sets, cfg.ways,
+	        (double)cfg.slices * cfg.sets * cfg.ways * LLC_LINE_SIZE / (1 << 20),
+	        cfg.ddio ? "on" : "off", ncfg, nthreads);
+
+	for (;;) {
+		struct trace_rec rec;
+		int ret;
+
+		if (binary) {
+			ret = trace_read(&tr, &rec);
+			if (!ret)
+				break;
+		} else {
+			if (!fgets(line, sizeof(line), in))
+				break;
+			ret = trace_parse_line(line, &rec);
+		}
+		if (ret < 0) {
+			if (binary)
+				fprintf(stderr, "Corrupted trace after %" PRIu64 " records\n", records);
+			else
+				fprintf(stderr, "Bad trace line: %s", line);
+			shard_sim_finish(&sim);
+			return 1;
+		}
+		if (!ret)
+			continue;
+		if (++records == warmup + 1 && warmup)
+			shard_sim_reset_stats(&sim);
+		shard_sim_access(&sim, rec.op, rec.addr, rec.size, rec.agent);
+	}
+	if (binary)
+		trace_reader_close(&tr);
+	else if (in != stdin)
+		fclose(in);
+	shard_sim_finish(&sim);
+	fprintf(stderr, "%" PRIu64 " records\n", records);
+
+	if (outfile) {
+		out = fopen(outfile, "w");
+		if (!out) {
+			perror(outfile);
+			return 1;
+		}
+	}
+	if (ncfg > 1)
+		fprintf(out, "IOWAY,ItoM-HIT-RATE,PCIeRdCur-HIT-RATE,CORE-RD-HIT-RATE,CORE-WR-HIT-RATE,"
+		        "IO-EVICT-SUM,MEM-RD-SUM,MEM-WR-SUM,IO-OCCUPANCY\n");
+	for (k = 0; k < ncfg; k++) {
+		uint32_t io_mask = shard_sim_llc(&sim, k)->cfg.io_mask;
+
+		shard_sim_stats(&sim, k, &st);
+		if (ncfg == 1)
+			print_results(out, &st, shard_sim_occupancy(&sim, k, io_mask));
+		else
+			print_csv(out, io_mask, &st, shard_sim_occupancy(&sim, k, io_mask));
+	}
+	if (out != stdout)
+		fclose(out);
+	shard_sim_free(&sim);
+	return 0;
+}
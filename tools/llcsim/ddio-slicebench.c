@@ -0,0 +1,287 @@
+/*
+ * Comparing slice-aware and slice-oblivious mbuf placement for L2 forwarding
+ *
+ * Copyright (c) 2020, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+// Compile command: gcc -O2 ddio-slicebench.c ring.c llc.c slice.c -o ddio-slicebench
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "llc.h"
+#include "ring.h"
+#include "slice.h"
+
+enum placement {
+	OBLIVIOUS,
+	AWARE,
+	PLACEMENTS
+};
+
+static const char *placement_names[PLACEMENTS] = { "OBLIVIOUS", "AWARE" };
+
+/*
+ * Latency of a core access: an LLC hit costs llc_ns plus hop_ns for every
+ * hop between the core and the slice of the line; a miss costs dram_ns.
+ * Accesses to the packet header, the line placed by the slice-aware
+ * mempool, are also counted separately.
+ */
+struct lat {
+	uint64_t lines;
+	uint64_t hits;
+	uint64_t hops;			/* of the hits */
+	double ns;
+};
+
+struct bench {
+	struct llc c;
+	const struct ring_config *rcfg;
+	const struct slice_hash *hash;
+	const struct slice_topo *topo;
+	double llc_ns, hop_ns, dram_ns;
+	struct lat all, hdr;
+};
+
+static void
+lat_add(struct lat *l, int hit, unsigned int hops, double ns)
+{
+	l->lines++;
+	l->hits += hit;
+	l->hops += hit ? hops : 0;
+	l->ns += ns;
+}
+
+static double
+lat_ns(const struct lat *l)
+{
+	return l->lines ? l->ns / l->lines : 0;
+}
+
+static double
+lat_hops(const struct lat *l)
+{
+	return l->hits ? (double)l->hops / l->hits : 0;
+}
+
+static int
+emit_latency(void *arg, enum llc_op op, uint64_t addr, unsigned int size, unsigned int core,
+             uint64_t t_ns)
+{
+	struct bench *b = arg;
+	uint64_t line, end;
+	int hits = 0;
+
+	(void)t_ns;
+	if (!size)
+		return 0;
+	end = (addr + size - 1) >> LLC_LINE_SHIFT;
+	for (line = addr >> LLC_LINE_SHIFT; line <= end; line++) {
+		uint64_t paddr = line << LLC_LINE_SHIFT;
+		int hit = llc_access(&b->c, op, paddr, core);
+		unsigned int d;
+		double ns;
+
+		hits += hit;
+		if (op != LLC_CORE_RD && op != LLC_CORE_WR)
+			continue;
+		d = slice_distance(b->topo, core, slice_of(b->hash, paddr));
+		ns = hit ? b->llc_ns + b->hop_ns * d : b->dram_ns;
+		lat_add(&b->all, hit, d, ns);
+		if (ring_is_pkt_hdr(b->rcfg, paddr))
+			lat_add(&b->hdr, hit, d, ns);
+	}
+	return hits;
+}
+
+static void
+warmup_done(void *arg)
+{
+	struct bench *b = arg;
+
+	llc_reset_stats(&b->c);
+	memset(&b->all, 0, sizeof(b->all));
+	memset(&b->hdr, 0, sizeof(b->hdr));
+}
+
+static double
+rate(uint64_t part, uint64_t total)
+{
+	return total ? part * 100.0 / total : 0;
+}
+
+static void
+usage(const char *prog)
+{
+	printf("Usage: %s [options]\n", prog);
+	printf("\nOptions:\n");
+	printf("  -H hash     : Slice hash, a preset (xeon-2, xeon-4, xeon-8) or a table file (default: xeon-8)\n");
+	printf("  -t topo     : Slice topology, ring or mesh:<cols> (default: ring)\n");
+	printf("  -S sets     : Sets per slice (default: 2048)\n");
+	printf("  -W ways     : Ways (default: 20)\n");
+	printf("  -i mask     : IIO LLC WAYS (default: 0xC0000)\n");
+	printf("  -q cores    : Cores, one RX/TX queue each (default: 1)\n");
+	printf("  -d ndesc    : RX/TX descriptors per queue (default: 1024)\n");
+	printf("  -b burst    : RX/TX burst size (default: 32)\n");
+	printf("  -s bytes    : Packet size (default: 64)\n");
+	printf("  -r gbps     : Offered load in Gbps (default: 100)\n");
+	printf("  -m mbufs    : Mempool size (default: 2 x slices x queues x NDESC)\n");
+	printf("  -n packets  : Packets offered (default: 1000000)\n");
+	printf("  -L ns       : LLC hit latency in the closest slice (default: 34)\n");
+	printf("  -P ns       : Extra latency per hop (default: 1.5)\n");
+	printf("  -M ns       : Memory latency (default: 80)\n");
+	printf("  -o file     : Write results to file instead of stdout\n");
+	printf("\nExample:\n");
+	printf("  %s -H xeon-8 -t ring -d 1024 -s 64\n", prog);
+}
+
+int main(int argc, char *argv[])
+{
+	struct ring_config rcfg;
+	struct llc_config lcfg;
+	struct slice_hash hash;
+	struct slice_topo topo;
+	struct ring_stats st[PLACEMENTS];
+	struct bench b[PLACEMENTS];
+	const char *hash_arg = "xeon-8", *topo_arg = "ring", *outfile = NULL;
+	double llc_ns = 34, hop_ns = 1.5, dram_ns = 80;
+	unsigned int ndesc = 1024;
+	FILE *out = stdout;
+	int opt, p;
+
+	ring_config_default(&rcfg);
+	rcfg.pkt_size = 64;
+	llc_config_default(&lcfg);
+	lcfg.ways = 20;
+	lcfg.io_mask = 0xC0000;
+
+	while ((opt = getopt(argc, argv, "H:t:S:W:i:q:d:b:s:r:m:n:L:P:M:o:h")) != -1) {
+		switch (opt) {
+		case 'H':
+			hash_arg = optarg;
+			break;
+		case 't':
+			topo_arg = optarg;
+			break;
+		case 'S':
+			lcfg.sets = strtoul(optarg, NULL, 0);
+			break;
+		case 'W':
+			lcfg.ways = strtoul(optarg, NULL, 0);
+			break;
+		case 'i':
+			lcfg.io_mask = strtoul(optarg, NULL, 0);
+			break;
+		case 'q':
+			rcfg.queues = strtoul(optarg, NULL, 0);
+			break;
+		case 'd':
+			ndesc = strtoul(optarg, NULL, 0);
+			break;
+		case 'b':
+			rcfg.burst = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			rcfg.pkt_size = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			rcfg.rate_gbps = strtod(optarg, NULL);
+			break;
+		case 'm':
+			rcfg.nmbufs = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			rcfg.packets = strtoull(optarg, NULL, 0);
+			break;
+		case 'L':
+			llc_ns = strtod(optarg, NULL);
+			break;
+		case 'P':
+			hop_ns = strtod(optarg, NULL);
+			break;
+		case 'M':
+			dram_ns = strtod(optarg, NULL);
+			break;
+		case 'o':
+			outfile = optarg;
+			break;
+		case 'h':
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	if (slice_hash_get(hash_arg, &hash))
+		return 1;
+	if (slice_topo_parse(topo_arg, hash.slices, &topo))
+		return 1;
+	if (!rcfg.queues || rcfg.queues > RING_MAX_QUEUES || !ndesc) {
+		printf("Bad number of cores or descriptors!\n");
+		return 1;
+	}
+	rcfg.ndesc = ndesc;
+	/* Leave enough mbufs in every slice for the rings */
+	if (!rcfg.nmbufs)
+		rcfg.nmbufs = 2 * hash.slices * rcfg.queues * ndesc;
+	rcfg.warmup = rcfg.packets / 10;
+	lcfg.slices = hash.slices;
+	lcfg.slice_fn = slice_llc_fn;
+	lcfg.slice_arg = &hash;
+
+	for (p = 0; p < PLACEMENTS; p++) {
+		struct ring_ops ops = { emit_latency, warmup_done, &b[p] };
+
+		memset(&b[p], 0, sizeof(b[p]));
+		b[p].rcfg = &rcfg;
+		b[p].hash = &hash;
+		b[p].topo = &topo;
+		b[p].llc_ns = llc_ns;
+		b[p].hop_ns = hop_ns;
+		b[p].dram_ns = dram_ns;
+		rcfg.slice_hash = p == AWARE ? &hash : NULL;
+		rcfg.slice_topo = p == AWARE ? &topo : NULL;
+		if (llc_init(&b[p].c, &lcfg))
+			return 1;
+		if (ring_run(&rcfg, &ops, &st[p]))
+			return 1;
+	}
+
+	if (outfile) {
+		out = fopen(outfile, "w");
+		if (!out) {
+			perror(outfile);
+			return 1;
+		}
+	}
+	for (p = 0; p < PLACEMENTS; p++) {
+		const struct llc_stats *ls = &b[p].c.st;
+		const char *name = placement_names[p];
+		double seconds = (st[p].t_end_ns - st[p].t_start_ns) / 1e9;
+
+		fprintf(out, "RESULT-%s-HDR-LATENCY %f\n", name, lat_ns(&b[p].hdr));
+		fprintf(out, "RESULT-%s-HDR-HOPS %f\n", name, lat_hops(&b[p].hdr));
+		fprintf(out, "RESULT-%s-LLC-LATENCY %f\n", name, lat_ns(&b[p].all));
+		fprintf(out, "RESULT-%s-HOPS %f\n", name, lat_hops(&b[p].all));
+		fprintf(out, "RESULT-%s-CORE-HIT-RATE %f\n", name,
+		        rate(b[p].all.hits, b[p].all.lines));
+		fprintf(out, "RESULT-%s-ItoM-HIT-RATE %f\n", name,
+		        rate(ls->hit[LLC_DMA_WR], ls->hit[LLC_DMA_WR] + ls->miss[LLC_DMA_WR]));
+		fprintf(out, "RESULT-%s-LEAKY-DMA-RATE %f\n", name, rate(st[p].leaky, st[p].processed));
+		fprintf(out, "RESULT-%s-PPS %f\n", name, seconds > 0 ? st[p].processed / seconds : 0);
+		llc_free(&b[p].c);
+	}
+	fprintf(out, "RESULT-AWARE-LOCAL-RATE %f\n",
+	        rate(st[AWARE].slice_local, st[AWARE].slice_local + st[AWARE].slice_remote));
+	fprintf(out, "RESULT-HDR-SPEEDUP %f\n", lat_ns(&b[AWARE].hdr) > 0 ?
+	        lat_ns(&b[OBLIVIOUS].hdr) / lat_ns(&b[AWARE].hdr) : 0);
+	fprintf(out, "RESULT-SPEEDUP %f\n", lat_ns(&b[AWARE].all) > 0 ?
+	        lat_ns(&b[OBLIVIOUS].all) / lat_ns(&b[AWARE].all) : 0);
+
+	if (out != stdout)
+		fclose(out);
+	return 0;
+}
@@ -0,0 +1,241 @@
+/*
+ * Converting, inspecting, and dumping binary memory-access traces
+ *
+ * Copyright (c) 2020, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+// Compile command: gcc -O2 -pthread -DHAVE_ZLIB ddio-trace.c trace.c -o ddio-trace -lz
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "trace.h"
+
+static double
+now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static int
+convert(const char *in_path, const char *out_path, uint32_t flags, unsigned int threads,
+        uint64_t ns_per_rec)
+{
+	struct trace_writer w;
+	struct trace_rec rec;
+	FILE *in = stdin;
+	char line[256];
+	uint64_t n = 0;
+	double t0 = now();
+	int ret;
+
+	if (in_path && strcmp(in_path, "-")) {
+		in = fopen(in_path, "r");
+		if (!in) {
+			perror(in_path);
+			return 1;
+		}
+	}
+	if (trace_writer_open(&w, out_path, flags, threads))
+		return 1;
+	while (fgets(line, sizeof(line), in)) {
+		ret = trace_parse_line(line, &rec);
+		if (ret < 0) {
+			fprintf(stderr, "Bad trace line: %s", line);
+			trace_writer_close(&w);
+			return 1;
+		}
+		if (!ret)
+			continue;
+		/* Text traces have no time; space the accesses evenly */
+		rec.t_ns = n++ * ns_per_rec;
+		if (trace_write(&w, &rec)) {
+			trace_writer_close(&w);
+			return 1;
+		}
+	}
+	if (in != stdin)
+		fclose(in);
+	if (trace_writer_close(&w))
+		return 1;
+	fprintf(stderr, "%" PRIu64 " records written in %.2f s\n", n, now() - t0);
+	return 0;
+}
+
+static int
+dump(const char *path, uint64_t from, int by_time, uint64_t count, int with_time)
+{
+	struct trace_reader r;
+	struct trace_rec rec;
+	uint64_t n = 0;
+	int ret;
+
+	if (trace_reader_open(&r, path))
+		return 1;
+	ret = by_time ? trace_seek_time(&r, from) : trace_seek(&r, from);
+	while (!ret && (!count || n < count) && (ret = trace_read(&r, &rec)) > 0) {
+		if (with_time)
+			printf("%" PRIu64 " ", rec.t_ns);
+		trace_print_line(stdout, &rec);
+		n++;
+		ret = 0;
+	}
+	trace_reader_close(&r);
+	if (ret < 0) {
+		fprintf(stderr, "Corrupted trace\n");
+		return 1;
+	}
+	return 0;
+}
+
+/* Reads the whole trace once and reports its layout and read speed */
+static int
+info(const char *path, FILE *out)
+{
+	struct trace_reader r;
+	struct trace_rec rec;
+	uint64_t ops[LLC_OPS] = { 0 }, n = 0, t_min = UINT64_MAX, t_max = 0;
+	double t0 = now(), secs;
+	int ret, i;
+
+	if (trace_reader_open(&r, path))
+		return 1;
+	while ((ret = trace_read(&r, &rec)) > 0) {
+		ops[rec.op]++;
+		if (rec.t_ns < t_min)
+			t_min = rec.t_ns;
+		if (rec.t_ns > t_max)
+			t_max = rec.t_ns;
+		n++;
+	}
+	secs = now() - t0;
+	if (ret < 0) {
+		fprintf(stderr, "Corrupted trace after %" PRIu64 " records\n", n);
+		trace_reader_close(&r);
+		return 1;
+	}
+	fprintf(out, "RESULT-RECORDS %" PRIu64 "\n", r.nrecords);
+	fprintf(out, "RESULT-BLOCKS %" PRIu64 "\n", r.nblocks);
+	fprintf(out, "RESULT-COMPRESSED %d\n", !!(r.flags & TRACE_ZLIB));
+	fprintf(out, "RESULT-BYTES %zu\n", r.len);
+	fprintf(out, "RESULT-BYTES-PER-RECORD %f\n", n ? (double)r.len / n : 0);
+	for (i = 0; i < LLC_OPS; i++) {
+		static const char *names[LLC_OPS] = { "ItoM", "PCIeRdCur", "CORE-RD", "CORE-WR" };
+
+		fprintf(out, "RESULT-%s-SUM %" PRIu64 "\n", names[i], ops[i]);
+	}
+	fprintf(out, "RESULT-DURATION-NS %" PRIu64 "\n", n ? t_max - t_min : 0);
+	fprintf(out, "RESULT-READ-RATE %f\n", secs > 0 ? n / secs : 0);
+	ret = n != r.nrecords;
+	if (ret)
+		fprintf(stderr, "%" PRIu64 " records decoded, %" PRIu64 " expected\n", n, r.nrecords);
+	trace_reader_close(&r);
+	return ret;
+}
+
+static void
+usage(const char *prog)
+{
+	printf("Usage: %s [options] <-c text | -d trace | -i trace>\n", prog);
+	printf("\nOptions:\n");
+	printf("  -c file     : Convert a text trace (- for stdin) to a binary trace (-o)\n");
+	printf("  -d file     : Dump a binary trace as text\n");
+	printf("  -i file     : Print the records, blocks, size, and read rate of a binary trace\n");
+	printf("  -o file     : Output file (binary trace with -c, results with -i)\n");
+	printf("  -z          : Compress the blocks with zlib\n");
+	printf("  -j threads  : Threads encoding and compressing blocks (default: 4)\n");
+	printf("  -n ns       : Time between the records of a text trace (default: 1)\n");
+	printf("  -s record   : Start the dump at this record\n");
+	printf("  -S ns       : Start the dump at this time\n");
+	printf("  -N records  : Stop the dump after this many records\n");
+	printf("  -t          : Print the time of every record in the dump\n");
+	printf("\nExample:\n");
+	printf("  %s -c l2fwd.trace -z -o l2fwd.dtr\n", prog);
+	printf("  %s -d l2fwd.dtr -S 1000000 -N 100 -t\n", prog);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *conv = NULL, *dumpf = NULL, *infof = NULL, *outfile = NULL;
+	uint64_t from = 0, count = 0, ns_per_rec = 1;
+	unsigned int threads = 4;
+	uint32_t flags = 0;
+	int opt, by_time = 0, with_time = 0, ret;
+	FILE *out = stdout;
+
+	while ((opt = getopt(argc, argv, "c:d:i:o:zj:n:s:S:N:th")) != -1) {
+		switch (opt) {
+		case 'c':
+			conv = optarg;
+			break;
+		case 'd':
+			dumpf = optarg;
+			break;
+		case 'i':
+			infof = optarg;
+			break;
+		case 'o':
+			outfile = optarg;
+			break;
+		case 'z':
+			flags |= TRACE_ZLIB;
+			break;
+		case 'j':
+			threads = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			ns_per_rec = strtoull(optarg, NULL, 0);
+			break;
+		case 's':
+			from = strtoull(optarg, NULL, 0);
+			by_time = 0;
+			break;
+		case 'S':
+			from = strtoull(optarg, NULL, 0);
+			by_time = 1;
+			break;
+		case 'N':
+			count = strtoull(optarg, NULL, 0);
+			break;
+		case 't':
+			with_time = 1;
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	if (conv) {
+		if (!outfile) {
+			printf("Converting needs an output file (-o)!\n");
+			return 1;
+		}
+		return convert(conv, outfile, flags, threads, ns_per_rec);
+	}
+	if (dumpf)
+		return dump(dumpf, from, by_time, count, with_time);
+	if (infof) {
+		if (outfile) {
+			out = fopen(outfile, "w");
+			if (!out) {
+				perror(outfile);
+				return 1;
+			}
+		}
+		ret = info(infof, out);
+		if (out != stdout)
+			fclose(out);
+		return ret;
+	}
+	usage(argv[0]);
+	return 1;
+}
@@ -0,0 +1,402 @@
+/*
+ * Set-associative LLC model with DDIO and CAT way partitioning
+ *
+ * Copyright (c) 2020, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#include "llc.h"
+
+void
+llc_config_default(struct llc_config *cfg)
+{
+	int i;
+
+	memset(cfg, 0, sizeof(*cfg));
+	cfg->sets = 2048;
+	cfg->ways = 11;
+	cfg->slices = 18;
+	cfg->io_mask = 0x600;
+	cfg->ddio = 1;
+	cfg->policy = LLC_LRU;
+	for (i = 0; i < LLC_MAX_COS; i++)
+		cfg->cos_mask[i] = (1u << cfg->ways) - 1;
+	cfg->seed = 1;
+}
+
+/*
+ * Folds the line address above the set index into a slice number.
+ * This is only a uniform spreading function, not the real hash.
+ */
+unsigned int
+llc_slice_fold(const struct llc *c, uint64_t line)
+{
+	uint64_t h = line >> c->set_shift;
+
+	h ^= h >> 17;
+	h *= 0xed5ad4bbull;
+	h ^= h >> 11;
+	return h % c->cfg.slices;
+}
+
+int
+llc_init(struct llc *c, const struct llc_config *cfg)
+{
+	return llc_init_shard(c, cfg, 0, 1);
+}
+
+int
+llc_init_shard(struct llc *c, const struct llc_config *cfg, unsigned int shard,
+               unsigned int nshards)
+{
+	uint32_t full;
+	size_t n;
+	int i;
+
+	memset(c, 0, sizeof(*c));
+	c->cfg = *cfg;
+	if (!nshards || shard >= nshards) {
+		fprintf(stderr, "Bad shard %u of %u\n", shard, nshards);
+		return -1;
+	}
+	c->shard = shard;
+	c->nshards = nshards;
+	if (!cfg->sets || (cfg->sets & (cfg->sets - 1))) {
+		fprintf(stderr, "The number of sets (%u) must be a power of two\n", cfg->sets);
+		return -1;
+	}
+	if (!cfg->ways || cfg->ways > LLC_MAX_WAYS || !cfg->slices) {
+		fprintf(stderr, "Bad geometry: %u ways, %u slices\n", cfg->ways, cfg->slices);
+		return -1;
+	}
+	full = cfg->ways == 32 ? ~0u : (1u << cfg->ways) - 1;
+	c->cfg.io_mask &= full;
+	if (cfg->ddio && !c->cfg.io_mask) {
+		fprintf(stderr, "The IIO way mask (0x%x) has no way of the cache\n", cfg->io_mask);
+		return -1;
+	}
+	for (i = 0; i < LLC_MAX_COS; i++) {
+		c->cfg.cos_mask[i] &= full;
+		if (!c->cfg.cos_mask[i])
+			c->cfg.cos_mask[i] = full;
+	}
+	if (!c->cfg.slice_fn)
+		c->cfg.slice_fn = llc_slice_fold;
+
+	while ((1u << c->set_shift) < cfg->sets)
+		c->set_shift++;
+	c->nsets = (cfg->sets * cfg->slices - shard + nshards - 1) / nshards;
+	n = (size_t)c->nsets * cfg->ways;
+	/* The tag compare may read up to 3 ways past the last set */
+	c->tag = calloc(n + 3, sizeof(*c->tag));
+	c->age = calloc(n, sizeof(*c->age));
+	c->valid = calloc(c->nsets, sizeof(*c->valid));
+	c->dirty = calloc(c->nsets, sizeof(*c->dirty));
+	c->io = calloc(c->nsets, sizeof(*c->io));
+	if (!c->tag || !c->age || !c->valid || !c->dirty || !c->io) {
+		perror("calloc");
+		llc_free(c);
+		return -1;
+	}
+	c->rng = (cfg->seed ? cfg->seed : 1) + shard;
+	return 0;
+}
+
+void
+llc_free(struct llc *c)
+{
+	free(c->tag);
+	free(c->age);
+	free(c->valid);
+	free(c->dirty);
+	free(c->io);
+	c->tag = c->age = NULL;
+	c->valid = c->dirty = c->io = NULL;
+}
+
+void
+llc_reset_stats(struct llc *c)
+{
+	memset(&c->st, 0, sizeof(c->st));
+}
+
+unsigned int
+llc_set_of(const struct llc *c, uint64_t line)
+{
+	return c->cfg.slice_fn(c, line) * c->cfg.sets + (line & (c->cfg.sets - 1));
+}
+
+/* Index of the set in this shard; the caller routes lines to their shard */
+static inline unsigned int
+set_of(const struct llc *c, uint64_t line)
+{
+	unsigned int set = llc_set_of(c, line);
+
+	return c->nshards > 1 ? set / c->nshards : set;
+}
+
+#ifdef __AVX2__
+/* Compares 4 tags per instruction; ways past the set are masked by valid */
+static inline int
+find_way(const struct llc *c, unsigned int set, uint64_t line)
+{
+	const uint64_t *tag = c->tag + (size_t)set * c->cfg.ways;
+	__m256i key = _mm256_set1_epi64x(line);
+	uint32_t match = 0;
+	unsigned int w;
+
+	for (w = 0; w < c->cfg.ways; w += 4) {
+		__m256i t = _mm256_loadu_si256((const __m256i *)(tag + w));
+		__m256i eq = _mm256_cmpeq_epi64(t, key);
+
+		match |= (uint32_t)_mm256_movemask_pd(_mm256_castsi256_pd(eq)) << w;
+	}
+	match &= c->valid[set];
+	return match ? __builtin_ctz(match) : -1;
+}
+#else
+static inline int
+find_way(const struct llc *c, unsigned int set, uint64_t line)
+{
+	const uint64_t *tag = c->tag + (size_t)set * c->cfg.ways;
+	uint32_t v = c->valid[set];
+
+	while (v) {
+		int w = __builtin_ctz(v);
+
+		if (tag[w] == line)
+			return w;
+		v &= v - 1;
+	}
+	return -1;
+}
+#endif
+
+static inline uint64_t
+xorshift64(uint64_t *s)
+{
+	*s ^= *s << 13;
+	*s ^= *s >> 7;
+	*s ^= *s << 17;
+	return *s;
+}
+
+/*
+ * Picks a way of `mask` to replace: an invalid way if there is one,
+ * otherwise the least-recently used (or a random) way.
+ */
+static int
+victim(struct llc *c, unsigned int set, uint32_t mask)
+{
+	const uint64_t *age = c->age + (size_t)set * c->cfg.ways;
+	uint32_t free_ways = mask & ~c->valid[set];
+	int w, best = -1;
+
+	if (free_ways)
+		return __builtin_ctz(free_ways);
+
+	if (c->cfg.policy == LLC_RANDOM) {
+		int k = xorshift64(&c->rng) % __builtin_popcount(mask);
+
+		while (k--)
+			mask &= mask - 1;
+		return __builtin_ctz(mask);
+	}
+
+	for (w = 0; mask; mask &= mask - 1) {
+		w = __builtin_ctz(mask);
+		if (best < 0 || age[w] < age[best])
+			best = w;
+	}
+	return best;
+}
+
+static void
+evict(struct llc *c, unsigned int set, int w)
+{
+	uint32_t bit = 1u << w;
+
+	if (!(c->valid[set] & bit))
+		return;
+	c->st.evict++;
+	if (c->dirty[set] & bit) {
+		c->st.writeback++;
+		c->st.mem_wr++;
+	}
+	if (c->io[set] & bit)
+		c->st.io_evict++;
+	c->valid[set] &= ~bit;
+	c->dirty[set] &= ~bit;
+	c->io[set] &= ~bit;
+}
+
+static int
+fill(struct llc *c, unsigned int set, uint64_t line, uint32_t mask)
+{
+	int w = victim(c, set, mask);
+
+	evict(c, set, w);
+	c->tag[(size_t)set * c->cfg.ways + w] = line;
+	c->valid[set] |= 1u << w;
+	return w;
+}
+
+/*
+ * DMA writes with DDIO update a cached line in place (write update) or
+ * allocate it in the IIO ways (write allocate). A full-line write does
+ * not read memory. Without DDIO, the line is invalidated and written to
+ * memory. DMA reads never allocate.
+ */
+int
+llc_access(struct llc *c, enum llc_op op, uint64_t addr, unsigned int core)
+{
+	uint64_t line = addr >> LLC_LINE_SHIFT;
+	unsigned int set = set_of(c, line);
+	int w = find_way(c, set, line);
+	int hit = w >= 0;
+	uint32_t bit;
+
+	if (hit)
+		c->st.hit[op]++;
+	else
+		c->st.miss[op]++;
+
+	switch (op) {
+	case LLC_DMA_WR:
+		if (!c->cfg.ddio) {
+			if (hit) {
+				bit = 1u << w;
+				c->valid[set] &= ~bit;
+				c->dirty[set] &= ~bit;
+				c->io[set] &= ~bit;
+			}
+			c->st.mem_wr++;
+			return hit;
+		}
+		if (!hit)
+			w = fill(c, set, line, c->cfg.io_mask);
+		bit = 1u << w;
+		c->dirty[set] |= bit;
+		c->io[set] |= bit;
+		break;
+	case LLC_DMA_RD:
+		if (!hit) {
+			c->st.mem_rd++;
+			return 0;
+		}
+		break;
+	case LLC_CORE_RD:
+	case LLC_CORE_WR:
+		if (!hit) {
+			c->st.mem_rd++;
+			w = fill(c, set, line, c->cfg.cos_mask[c->cfg.core_cos[core % LLC_MAX_CORES]]);
+		}
+		bit = 1u << w;
+		c->io[set] &= ~bit;
+		if (op == LLC_CORE_WR)
+			c->dirty[set] |= bit;
+		break;
+	default:
+		return hit;
+	}
+	c->age[(size_t)set * c->cfg.ways + w] = ++c->tick;
+	return hit;
+}
+
+unsigned int
+llc_access_range(struct llc *c, enum llc_op op, uint64_t addr, unsigned int size,
+                 unsigned int core)
+{
+	uint64_t a = addr & ~(uint64_t)(LLC_LINE_SIZE - 1);
+	uint64_t end = addr + (size ? size : 1);
+	unsigned int hits = 0;
+
+	for (; a < end; a += LLC_LINE_SIZE)
+		hits += llc_access(c, op, a, core);
+	return hits;
+}
+
+uint64_t
+llc_occupancy(const struct llc *c, uint32_t mask)
+{
+	uint64_t n = 0;
+	unsigned int s;
+
+	for (s = 0; s < c->nsets; s++)
+		n += __builtin_popcount(c->valid[s] & mask);
+	return n;
+}
+
+/*
+ * Both parsers accept the pqos syntax; the "@<domains>" part is ignored
+ * because the model has a single LLC.
+ */
+int
+llc_parse_cos(struct llc_config *cfg, const char *alloc)
+{
+	char copy[1024], *tok, *save;
+
+	snprintf(copy, sizeof(copy), "%s", alloc);
+	for (tok = strtok_r(copy, ";", &save); tok; tok = strtok_r(NULL, ";", &save)) {
+		char *colon = strchr(tok, ':'), *eq = strchr(tok, '=');
+		int cos;
+
+		if (!colon || !eq || colon > eq || strncmp(tok, "llc", 3))
+			continue;	/* e.g., mba */
+		cos = atoi(colon + 1);
+		if (cos < 0 || cos >= LLC_MAX_COS) {
+			fprintf(stderr, "Bad class of service in '%s'\n", tok);
+			return -1;
+		}
+		cfg->cos_mask[cos] = strtoul(eq + 1, NULL, 16);
+	}
+	return 0;
+}
+
+int
+llc_parse_assoc(struct llc_config *cfg, const char *assoc)
+{
+	char copy[1024], *tok, *save;
+
+	snprintf(copy, sizeof(copy), "%s", assoc);
+	for (tok = strtok_r(copy, ";", &save); tok; tok = strtok_r(NULL, ";", &save)) {
+		char *colon = strchr(tok, ':'), *eq = strchr(tok, '='), *p;
+		int cos;
+
+		if (!colon || !eq || colon > eq) {
+			fprintf(stderr, "Bad association '%s'\n", tok);
+			return -1;
+		}
+		cos = atoi(colon + 1);
+		if (cos < 0 || cos >= LLC_MAX_COS) {
+			fprintf(stderr, "Bad class of service in '%s'\n", tok);
+			return -1;
+		}
+		for (p = eq + 1; *p;) {
+			unsigned int lo, hi;
+			int n;
+
+			if (sscanf(p, "%u-%u%n", &lo, &hi, &n) != 2) {
+				if (sscanf(p, "%u%n", &lo, &n) != 1) {
+					fprintf(stderr, "Bad core list in '%s'\n", tok);
+					return -1;
+				}
+				hi = lo;
+			}
+			for (; lo <= hi && lo < LLC_MAX_CORES; lo++)
+				cfg->core_cos[lo] = cos;
+			p += n;
+			if (*p == ',')
+				p++;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,118 @@
+/*
+ * Set-associative LLC model with DDIO and CAT way partitioning
+ *
+ * Copyright (c) 2020, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#ifndef DDIO_LLC_H
+#define DDIO_LLC_H
+
+#include <stdint.h>
+
+#define LLC_LINE_SHIFT	6
+#define LLC_LINE_SIZE	(1 << LLC_LINE_SHIFT)
+#define LLC_MAX_WAYS	32
+#define LLC_MAX_COS	16
+#define LLC_MAX_CORES	256
+
+/*
+ * Accesses seen by the LLC. DMA writes and reads are the requests
+ * counted as ItoM and PCIeRdCur by the CHA.
+ */
+enum llc_op {
+	LLC_DMA_WR,
+	LLC_DMA_RD,
+	LLC_CORE_RD,
+	LLC_CORE_WR,
+	LLC_OPS
+};
+
+enum llc_policy {
+	LLC_LRU,
+	LLC_RANDOM,
+};
+
+struct llc;
+
+/* Maps a line address (addr >> LLC_LINE_SHIFT) to a slice */
+typedef unsigned int (*llc_slice_fn)(const struct llc *c, uint64_t line);
+
+struct llc_config {
+	unsigned int sets;		/* per slice, power of two */
+	unsigned int ways;
+	unsigned int slices;
+	uint32_t io_mask;		/* IIO LLC WAYS register (0xC8B) */
+	int ddio;			/* 0: DMA bypasses the LLC */
+	enum llc_policy policy;
+	uint32_t cos_mask[LLC_MAX_COS];	/* CAT capacity bitmasks */
+	uint8_t core_cos[LLC_MAX_CORES];
+	llc_slice_fn slice_fn;		/* NULL: llc_slice_fold */
+	const void *slice_arg;		/* e.g., the hash table of slice_fn */
+	uint64_t seed;			/* for LLC_RANDOM */
+};
+
+struct llc_stats {
+	uint64_t hit[LLC_OPS];
+	uint64_t miss[LLC_OPS];
+	uint64_t evict;			/* valid lines replaced */
+	uint64_t writeback;		/* dirty lines replaced */
+	uint64_t io_evict;		/* DMA-written lines replaced before a core access */
+	uint64_t mem_rd;		/* lines read from memory */
+	uint64_t mem_wr;		/* lines written to memory */
+};
+
+/*
+ * The tag store is kept as arrays (structure of arrays), so the tags of a
+ * set are contiguous and can be compared at once. Per-set state is kept as
+ * way bitmasks. A shard holds the sets whose index modulo nshards is shard.
+ */
+struct llc {
+	struct llc_config cfg;
+	unsigned int nsets;		/* sets * slices, or those of the shard */
+	unsigned int set_shift;		/* log2(sets) */
+	unsigned int shard, nshards;
+	uint64_t *tag;			/* [nsets * ways] line addresses */
+	uint64_t *age;			/* [nsets * ways] last-use stamps */
+	uint32_t *valid;		/* [nsets] */
+	uint32_t *dirty;		/* [nsets] */
+	uint32_t *io;			/* [nsets] written by DMA, not yet accessed by a core */
+	uint64_t tick;
+	uint64_t rng;
+	struct llc_stats st;
+};
+
+/*
+ * Defaults describe a Xeon Gold 6140 (Skylake-SP): 18 slices of 2048 sets
+ * and 11 ways (24.75 MiB), DDIO enabled with 2 ways (0x600), and LRU.
+ */
+void llc_config_default(struct llc_config *cfg);
+
+int  llc_init(struct llc *c, const struct llc_config *cfg);
+int  llc_init_shard(struct llc *c, const struct llc_config *cfg, unsigned int shard,
+                    unsigned int nshards);
+void llc_free(struct llc *c);
+void llc_reset_stats(struct llc *c);
+
+/* Returns 1 on a hit and 0 on a miss */
+int  llc_access(struct llc *c, enum llc_op op, uint64_t addr, unsigned int core);
+
+/* Accesses every line of [addr, addr + size); returns the number of hits */
+unsigned int llc_access_range(struct llc *c, enum llc_op op, uint64_t addr,
+                              unsigned int size, unsigned int core);
+
+/* Number of valid lines in the ways of `mask` */
+uint64_t llc_occupancy(const struct llc *c, uint32_t mask);
+
+unsigned int llc_slice_fold(const struct llc *c, uint64_t line);
+
+/* Set of a line in the whole cache (slice * sets + index) */
+unsigned int llc_set_of(const struct llc *c, uint64_t line);
+
+/*
+ * Parses pqos-style CAT settings into the configuration:
+ * "llc:0=0x0C0;llc:1=0x600" (classes) and "llc:0=2;llc:1=0,1,3-17" (cores).
+ */
+int  llc_parse_cos(struct llc_config *cfg, const char *alloc);
+int  llc_parse_assoc(struct llc_config *cfg, const char *assoc);
+
+#endif /* DDIO_LLC_H */
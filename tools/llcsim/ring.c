@@ -0,0 +1,367 @@
+/*
+ * NIC descriptor-ring and DMA traffic model of an L2 forwarding application
+ *
+ * Copyright (c) 2020, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ring.h"
+
+/* Address map of the model */
+#define MBUF_BASE	0x100000000ull
+#define RX_RING_BASE	0x40000000ull
+#define TX_RING_BASE	0x50000000ull
+#define RING_STRIDE	0x100000ull
+
+struct queue {
+	int32_t *rx;			/* mbuf of every RX slot, -1 if empty */
+	int32_t *tx;			/* mbuf of every TX slot in flight */
+	int32_t *batch;			/* mbufs of the current burst */
+	uint64_t nic;			/* next RX slot written by the NIC */
+	uint64_t core;			/* next RX slot read by the core */
+	uint64_t refill;		/* next RX slot to refill */
+	uint64_t tx_head, tx_tail;	/* next TX slot to fill / to free */
+	unsigned int in_burst, nbatch;
+	uint64_t offered, share;
+	double t_arrival, t_core;
+};
+
+struct model {
+	const struct ring_config *cfg;
+	const struct ring_ops *ops;
+	struct ring_stats *st;
+	struct queue q[RING_MAX_QUEUES];
+	int32_t *pool;			/* LIFO, like a mempool cache */
+	unsigned int npool;
+	struct slice_pool spool;	/* used instead with cfg->slice_hash */
+	unsigned int mbuf_stride;
+	double gap_ns;
+	int warm;
+};
+
+void
+ring_config_default(struct ring_config *cfg)
+{
+	memset(cfg, 0, sizeof(*cfg));
+	cfg->queues = 1;
+	cfg->ndesc = 4096;
+	cfg->desc_size = 16;
+	cfg->burst = 32;
+	cfg->tx_free_thresh = 32;
+	cfg->mbuf_size = 128 + 2176;		/* header + RTE_MBUF_DEFAULT_BUF_SIZE */
+	cfg->mbuf_hdr = 128;
+	cfg->headroom = 128;
+	cfg->pkt_size = 1024;
+	cfg->rate_gbps = 100;
+	cfg->base_ns = 30;
+	cfg->poll_ns = 20;
+	cfg->packets = 1000000;
+}
+
+static inline unsigned int
+mbuf_stride(const struct ring_config *cfg)
+{
+	return (cfg->mbuf_size + LLC_LINE_SIZE - 1) & ~(LLC_LINE_SIZE - 1);
+}
+
+static inline uint64_t
+mbuf_addr(const struct model *m, int32_t id)
+{
+	return MBUF_BASE + (uint64_t)id * m->mbuf_stride;
+}
+
+static inline uint64_t
+data_addr(const struct model *m, int32_t id)
+{
+	return mbuf_addr(m, id) + m->cfg->mbuf_hdr + m->cfg->headroom;
+}
+
+static inline uint64_t
+desc_addr(const struct model *m, uint64_t base, unsigned int q, uint64_t slot)
+{
+	return base + q * RING_STRIDE + (slot % m->cfg->ndesc) * m->cfg->desc_size;
+}
+
+static uint64_t
+hot_paddr(void *arg, unsigned int id)
+{
+	return data_addr(arg, id);
+}
+
+static int32_t
+pool_get(struct model *m, unsigned int qi)
+{
+	if (m->cfg->slice_hash) {
+		unsigned int home = slice_home(m->cfg->slice_topo, m->cfg->first_core + qi);
+
+		return slice_pool_get(&m->spool, home);
+	}
+	return m->npool ? m->pool[--m->npool] : -1;
+}
+
+static void
+pool_put(struct model *m, int32_t id)
+{
+	if (m->cfg->slice_hash)
+		slice_pool_put(&m->spool, id);
+	else
+		m->pool[m->npool++] = id;
+}
+
+static inline int
+emit(struct model *m, enum llc_op op, uint64_t addr, unsigned int size, unsigned int q,
+     double t)
+{
+	return m->ops->emit(m->ops->arg, op, addr, size, m->cfg->first_core + q, (uint64_t)t);
+}
+
+/*
+ * The NIC writes the packet and the descriptor, or drops the packet if
+ * the next descriptor has no buffer.
+ */
+static void
+nic_receive(struct model *m, unsigned int qi)
+{
+	struct queue *q = &m->q[qi];
+	uint64_t slot = q->nic % m->cfg->ndesc;
+	double t = q->t_arrival;
+
+	q->offered++;
+	m->st->offered++;
+	q->t_arrival += m->gap_ns;
+
+	if (q->nic - q->core >= m->cfg->ndesc || q->rx[slot] < 0) {
+		m->st->dropped++;
+		return;
+	}
+	emit(m, LLC_DMA_WR, data_addr(m, q->rx[slot]), m->cfg->pkt_size, qi, t);
+	emit(m, LLC_DMA_WR, desc_addr(m, RX_RING_BASE, qi, q->nic), m->cfg->desc_size, qi, t);
+	q->nic++;
+}
+
+/*
+ * Like rte_pktmbuf_free() after transmission: the mbuf header is written
+ * and the mbuf goes back to the top of the pool.
+ */
+static void
+tx_free(struct model *m, unsigned int qi, unsigned int n)
+{
+	struct queue *q = &m->q[qi];
+
+	while (n-- && q->tx_tail < q->tx_head) {
+		int32_t id = q->tx[q->tx_tail++ % m->cfg->ndesc];
+
+		emit(m, LLC_CORE_WR, mbuf_addr(m, id), LLC_LINE_SIZE, qi, q->t_core);
+		pool_put(m, id);
+	}
+}
+
+static void
+end_burst(struct model *m, unsigned int qi)
+{
+	const struct ring_config *cfg = m->cfg;
+	struct queue *q = &m->q[qi];
+	double t = q->t_core;
+	unsigned int i;
+
+	/* Refill the RX descriptors consumed so far */
+	while (q->refill < q->core) {
+		uint64_t slot = q->refill % cfg->ndesc;
+		int32_t id = pool_get(m, qi);
+
+		if (id < 0) {
+			m->st->nofill++;
+			break;
+		}
+		emit(m, LLC_CORE_WR, mbuf_addr(m, id), LLC_LINE_SIZE, qi, t);
+		emit(m, LLC_CORE_WR, desc_addr(m, RX_RING_BASE, qi, q->refill), cfg->desc_size, qi, t);
+		q->rx[slot] = id;
+		q->refill++;
+	}
+
+	/*
+	 * Reclaim sent mbufs when fewer than tx_free_thresh descriptors are free;
+	 * an empty ring is as free as it gets, even if tx_free_thresh + burst > ndesc
+	 */
+	while (cfg->ndesc - (q->tx_head - q->tx_tail) < cfg->tx_free_thresh + q->nbatch &&
+	       q->tx_tail < q->tx_head)
+		tx_free(m, qi, cfg->tx_free_thresh);
+
+	/* Enqueue the burst; the NIC then reads the descriptors and packets */
+	for (i = 0; i < q->nbatch; i++) {
+		emit(m, LLC_CORE_WR, desc_addr(m, TX_RING_BASE, qi, q->tx_head), cfg->desc_size, qi, t);
+		q->tx[q->tx_head++ % cfg->ndesc] = q->batch[i];
+	}
+	for (i = 0; i < q->nbatch; i++) {
+		uint64_t slot = q->tx_head - q->nbatch + i;
+
+		emit(m, LLC_DMA_RD, desc_addr(m, TX_RING_BASE, qi, slot), cfg->desc_size, qi, t);
+		emit(m, LLC_DMA_RD, data_addr(m, q->batch[i]), cfg->pkt_size, qi, t);
+	}
+	if (q->nbatch)
+		emit(m, LLC_DMA_WR, desc_addr(m, TX_RING_BASE, qi, q->tx_head - 1),
+		     cfg->desc_size, qi, t);
+	q->nbatch = 0;
+}
+
+/*
+ * One step of the core: poll, or process one packet of the current burst
+ * (descriptor, mbuf header, and MAC swap of the packet header).
+ */
+static void
+core_step(struct model *m, unsigned int qi)
+{
+	const struct ring_config *cfg = m->cfg;
+	struct queue *q = &m->q[qi];
+	uint64_t slot;
+	int32_t id;
+
+	if (!q->in_burst) {
+		uint64_t pending = q->nic - q->core;
+
+		if (!pending) {
+			q->t_core += cfg->poll_ns;
+			if (q->offered < q->share && q->t_core < q->t_arrival)
+				q->t_core = q->t_arrival;
+			return;
+		}
+		q->in_burst = pending < cfg->burst ? pending : cfg->burst;
+	}
+
+	slot = q->core % cfg->ndesc;
+	id = q->rx[slot];
+	q->rx[slot] = -1;
+	emit(m, LLC_CORE_RD, desc_addr(m, RX_RING_BASE, qi, q->core), cfg->desc_size, qi, q->t_core);
+	emit(m, LLC_CORE_WR, mbuf_addr(m, id), cfg->mbuf_hdr, qi, q->t_core);
+	if (!emit(m, LLC_CORE_WR, data_addr(m, id), LLC_LINE_SIZE, qi, q->t_core))
+		m->st->leaky++;
+	q->core++;
+	q->batch[q->nbatch++] = id;
+	q->t_core += cfg->base_ns + cfg->proc_ns;
+	if (++m->st->processed == cfg->warmup && !m->warm) {
+		m->warm = 1;
+		memset(m->st, 0, sizeof(*m->st));
+		m->spool.local = m->spool.remote = 0;
+		m->st->t_start_ns = q->t_core;
+		if (m->ops->warmup_done)
+			m->ops->warmup_done(m->ops->arg);
+	}
+
+	if (!--q->in_burst)
+		end_burst(m, qi);
+}
+
+static int
+queue_busy(const struct queue *q)
+{
+	return q->offered < q->share || q->in_burst || q->nic != q->core;
+}
+
+int
+ring_run(const struct ring_config *cfg, const struct ring_ops *ops, struct ring_stats *st)
+{
+	struct model m;
+	unsigned int nmbufs = cfg->nmbufs ? cfg->nmbufs : 2 * cfg->ndesc * cfg->queues + 1024;
+	unsigned int qi, i;
+	int ret = -1;
+
+	if (!cfg->queues || cfg->queues > RING_MAX_QUEUES || !cfg->ndesc || !cfg->burst ||
+	    !cfg->pkt_size || cfg->rate_gbps <= 0 || cfg->tx_free_thresh >= cfg->ndesc ||
+	    cfg->burst > cfg->ndesc) {
+		fprintf(stderr, "Bad ring configuration\n");
+		return -1;
+	}
+	if (nmbufs < cfg->ndesc * cfg->queues) {
+		fprintf(stderr, "The mempool (%u) cannot fill the RX rings\n", nmbufs);
+		return -1;
+	}
+
+	memset(&m, 0, sizeof(m));
+	memset(st, 0, sizeof(*st));
+	m.cfg = cfg;
+	m.ops = ops;
+	m.st = st;
+	m.mbuf_stride = mbuf_stride(cfg);
+	/* Every frame also occupies 20 bytes of preamble and inter-frame gap */
+	m.gap_ns = (cfg->pkt_size + 20) * 8 / (cfg->rate_gbps / cfg->queues);
+
+	if (cfg->slice_hash) {
+		if (!cfg->slice_topo || slice_pool_init(&m.spool, cfg->slice_hash, nmbufs, hot_paddr, &m))
+			goto out;
+	} else {
+		m.pool = malloc(nmbufs * sizeof(*m.pool));
+		if (!m.pool)
+			goto out;
+		for (i = 0; i < nmbufs; i++)
+			m.pool[i] = nmbufs - 1 - i;
+		m.npool = nmbufs;
+	}
+
+	for (qi = 0; qi < cfg->queues; qi++) {
+		struct queue *q = &m.q[qi];
+
+		q->rx = malloc(cfg->ndesc * sizeof(*q->rx));
+		q->tx = malloc(cfg->ndesc * sizeof(*q->tx));
+		q->batch = malloc(cfg->burst * sizeof(*q->batch));
+		if (!q->rx || !q->tx || !q->batch)
+			goto out;
+		for (i = 0; i < cfg->ndesc; i++)
+			q->rx[i] = pool_get(&m, qi);
+		q->share = cfg->packets / cfg->queues + (qi < cfg->packets % cfg->queues);
+		/* Spread the first arrivals of the queues over one gap */
+		q->t_arrival = m.gap_ns * qi / cfg->queues;
+	}
+
+	/* Discrete-event loop: always run the earliest NIC arrival or core step */
+	for (;;) {
+		int qa = -1, qc = -1;
+
+		for (qi = 0; qi < cfg->queues; qi++) {
+			const struct queue *q = &m.q[qi];
+
+			if (q->offered < q->share && (qa < 0 || q->t_arrival < m.q[qa].t_arrival))
+				qa = qi;
+			if (queue_busy(q) && (qc < 0 || q->t_core < m.q[qc].t_core))
+				qc = qi;
+		}
+		if (qc < 0)
+			break;
+		if (qa >= 0 && m.q[qa].t_arrival <= m.q[qc].t_core)
+			nic_receive(&m, qa);
+		else
+			core_step(&m, qc);
+	}
+
+	for (qi = 0; qi < cfg->queues; qi++)
+		if (m.q[qi].t_core > st->t_end_ns)
+			st->t_end_ns = m.q[qi].t_core;
+	st->slice_local = m.spool.local;
+	st->slice_remote = m.spool.remote;
+	ret = 0;
+out:
+	if (ret)
+		perror("malloc");
+	for (qi = 0; qi < cfg->queues; qi++) {
+		free(m.q[qi].rx);
+		free(m.q[qi].tx);
+		free(m.q[qi].batch);
+	}
+	free(m.pool);
+	slice_pool_free(&m.spool);
+	return ret;
+}
+
+int
+ring_is_pkt_hdr(const struct ring_config *cfg, uint64_t addr)
+{
+	uint64_t off;
+
+	if (addr < MBUF_BASE)
+		return 0;
+	off = (addr - MBUF_BASE) % mbuf_stride(cfg);
+	return off >> LLC_LINE_SHIFT == (cfg->mbuf_hdr + cfg->headroom) >> LLC_LINE_SHIFT;
+}
@@ -0,0 +1,82 @@
+/*
+ * NIC descriptor-ring and DMA traffic model of an L2 forwarding application
+ *
+ * Copyright (c) 2020, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#ifndef DDIO_RING_H
+#define DDIO_RING_H
+
+#include <stdint.h>
+
+#include "llc.h"
+#include "slice.h"
+
+#define RING_MAX_QUEUES	64
+
+/*
+ * Called for every access of the model in time order. Returns the number
+ * of lines that hit (or -1 if unknown, e.g., when only a trace is
+ * written); it is used to detect leaky DMA.
+ */
+typedef int (*ring_emit_fn)(void *arg, enum llc_op op, uint64_t addr,
+                            unsigned int size, unsigned int core, uint64_t t_ns);
+
+struct ring_ops {
+	ring_emit_fn emit;
+	void (*warmup_done)(void *arg);	/* optional, e.g., to reset the LLC stats */
+	void *arg;
+};
+
+struct ring_config {
+	unsigned int queues;		/* one core per queue (NCORE) */
+	unsigned int ndesc;		/* RX and TX descriptors per queue (NDESC / NCORE) */
+	unsigned int desc_size;		/* bytes per descriptor */
+	unsigned int burst;		/* RX/TX burst (NINBURST) */
+	unsigned int tx_free_thresh;	/* TX descriptors reclaimed at once */
+	unsigned int nmbufs;		/* mempool size, 0: 2 * ndesc * queues + 1024 */
+	unsigned int mbuf_size;		/* mbuf header + headroom + data room */
+	unsigned int mbuf_hdr;		/* struct rte_mbuf */
+	unsigned int headroom;
+	unsigned int pkt_size;		/* frame size (GEN_PKT_SIZE) */
+	double rate_gbps;		/* offered load of all queues (RATE) */
+	double base_ns;			/* per-packet cost of the forwarding path */
+	double proc_ns;			/* extra per-packet processing (n_w) */
+	double poll_ns;			/* cost of an empty poll */
+	uint64_t packets;		/* packets offered in total */
+	uint64_t warmup;		/* processed packets before counting */
+	unsigned int first_core;	/* core of queue 0 (threadoffset) */
+
+	/*
+	 * Slice-aware mempool: refills take mbufs whose packet header maps to
+	 * the closest slice of the core. NULL: one LIFO for all mbufs.
+	 */
+	const struct slice_hash *slice_hash;
+	const struct slice_topo *slice_topo;
+};
+
+struct ring_stats {
+	uint64_t offered;
+	uint64_t dropped;		/* no RX descriptor available */
+	uint64_t processed;
+	uint64_t leaky;			/* packet header missed when the core read it */
+	uint64_t nofill;		/* refills that found the mempool empty */
+	uint64_t slice_local;		/* slice-aware refills from the closest slice */
+	uint64_t slice_remote;
+	uint64_t t_start_ns;		/* end of the warm-up */
+	uint64_t t_end_ns;
+};
+
+/*
+ * Defaults follow the experiments: 1 queue, 4096 descriptors of 16 bytes,
+ * bursts of 32, 2 KB data room, 1024-byte packets at 100 Gbps.
+ */
+void ring_config_default(struct ring_config *cfg);
+
+int  ring_run(const struct ring_config *cfg, const struct ring_ops *ops,
+              struct ring_stats *st);
+
+/* 1 if addr is in the first line of the packet data of an mbuf */
+int  ring_is_pkt_hdr(const struct ring_config *cfg, uint64_t addr);
+
+#endif /* DDIO_RING_H */
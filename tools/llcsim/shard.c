@@ -0,0 +1,219 @@
+/*
+ * Parallel LLC simulation, sharded by set index
+ *
+ * Copyright (c) 2020, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+
+#include "shard.h"
+
+#define SHARD_QUEUE_SIZE	(1 << 16)	/* records per shard */
+#define SHARD_BATCH		64		/* records per publication */
+#define SHARD_RESET		LLC_OPS
+
+static void
+queue_publish(struct shard_queue *q)
+{
+	__atomic_store_n(&q->head, q->prod_head, __ATOMIC_RELEASE);
+}
+
+static void
+queue_push(struct shard_queue *q, uint64_t line, uint16_t op, uint16_t core)
+{
+	struct shard_rec *r;
+
+	while (q->prod_head - q->prod_tail > q->mask) {
+		q->prod_tail = __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+		if (q->prod_head - q->prod_tail > q->mask) {
+			queue_publish(q);
+			sched_yield();
+		}
+	}
+	r = &q->rec[q->prod_head++ & q->mask];
+	r->line = line;
+	r->op = op;
+	r->core = core;
+	if (!(q->prod_head % SHARD_BATCH))
+		queue_publish(q);
+}
+
+static void *
+worker(void *arg)
+{
+	struct shard *sh = arg;
+	struct shard_queue *q = &sh->q;
+	unsigned int ncfg = sh->sim->ncfg, k;
+	uint64_t tail = 0;
+
+	for (;;) {
+		uint64_t head = __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+
+		if (tail == head) {
+			if (__atomic_load_n(&sh->sim->done, __ATOMIC_ACQUIRE) &&
+			    tail == __atomic_load_n(&q->head, __ATOMIC_ACQUIRE))
+				break;
+			sched_yield();
+			continue;
+		}
+		for (; tail < head; tail++) {
+			const struct shard_rec *r = &q->rec[tail & q->mask];
+
+			if (r->op == SHARD_RESET) {
+				for (k = 0; k < ncfg; k++)
+					llc_reset_stats(&sh->c[k]);
+				continue;
+			}
+			for (k = 0; k < ncfg; k++)
+				llc_access(&sh->c[k], r->op, r->line << LLC_LINE_SHIFT, r->core);
+		}
+		__atomic_store_n(&q->tail, tail, __ATOMIC_RELEASE);
+	}
+	return NULL;
+}
+
+int
+shard_sim_init(struct shard_sim *s, const struct llc_config *cfg, unsigned int ncfg,
+               unsigned int nthreads)
+{
+	unsigned int t, k;
+
+	memset(s, 0, sizeof(*s));
+	if (!ncfg || ncfg > SHARD_MAX_CONFIGS || !nthreads || nthreads > SHARD_MAX_THREADS) {
+		fprintf(stderr, "Bad number of configurations (%u) or threads (%u)\n", ncfg, nthreads);
+		return -1;
+	}
+	s->ncfg = ncfg;
+	s->nthreads = nthreads;
+	s->shard = calloc(nthreads, sizeof(*s->shard));
+	if (!s->shard) {
+		perror("calloc");
+		return -1;
+	}
+	for (t = 0; t < nthreads; t++) {
+		struct shard *sh = &s->shard[t];
+
+		sh->sim = s;
+		sh->q.mask = SHARD_QUEUE_SIZE - 1;
+		sh->q.rec = malloc(SHARD_QUEUE_SIZE * sizeof(*sh->q.rec));
+		if (!sh->q.rec) {
+			perror("malloc");
+			goto fail;
+		}
+		for (k = 0; k < ncfg; k++)
+			if (llc_init_shard(&sh->c[k], &cfg[k], t, nthreads))
+				goto fail;
+	}
+	for (t = 0; t < nthreads; t++) {
+		if (pthread_create(&s->shard[t].thread, NULL, worker, &s->shard[t])) {
+			perror("pthread_create");
+			s->nthreads = t;
+			shard_sim_finish(s);
+			s->nthreads = nthreads;
+			goto fail;
+		}
+	}
+	return 0;
+fail:
+	shard_sim_free(s);
+	return -1;
+}
+
+void
+shard_sim_access(struct shard_sim *s, enum llc_op op, uint64_t addr, unsigned int size,
+                 unsigned int core)
+{
+	/* The set (and thus the shard) only depends on the geometry */
+	const struct llc *geo = &s->shard[0].c[0];
+	uint64_t line = addr >> LLC_LINE_SHIFT;
+	uint64_t end = (addr + (size ? size : 1) - 1) >> LLC_LINE_SHIFT;
+
+	for (; line <= end; line++) {
+		unsigned int t = s->nthreads > 1 ? llc_set_of(geo, line) % s->nthreads : 0;
+
+		queue_push(&s->shard[t].q, line, op, core);
+	}
+}
+
+/* Every shard resets its counters at the same position of the stream */
+void
+shard_sim_reset_stats(struct shard_sim *s)
+{
+	unsigned int t;
+
+	for (t = 0; t < s->nthreads; t++) {
+		queue_push(&s->shard[t].q, 0, SHARD_RESET, 0);
+		queue_publish(&s->shard[t].q);
+	}
+}
+
+void
+shard_sim_finish(struct shard_sim *s)
+{
+	unsigned int t;
+
+	for (t = 0; t < s->nthreads; t++)
+		queue_publish(&s->shard[t].q);
+	__atomic_store_n(&s->done, 1, __ATOMIC_RELEASE);
+	for (t = 0; t < s->nthreads; t++)
+		pthread_join(s->shard[t].thread, NULL);
+}
+
+/* Sums in shard order, so the result is the same for every run */
+void
+shard_sim_stats(const struct shard_sim *s, unsigned int k, struct llc_stats *st)
+{
+	unsigned int t, i;
+
+	memset(st, 0, sizeof(*st));
+	for (t = 0; t < s->nthreads; t++) {
+		const struct llc_stats *x = &s->shard[t].c[k].st;
+
+		for (i = 0; i < LLC_OPS; i++) {
+			st->hit[i] += x->hit[i];
+			st->miss[i] += x->miss[i];
+		}
+		st->evict += x->evict;
+		st->writeback += x->writeback;
+		st->io_evict += x->io_evict;
+		st->mem_rd += x->mem_rd;
+		st->mem_wr += x->mem_wr;
+	}
+}
+
+uint64_t
+shard_sim_occupancy(const struct shard_sim *s, unsigned int k, uint32_t mask)
+{
+	uint64_t n = 0;
+	unsigned int t;
+
+	for (t = 0; t < s->nthreads; t++)
+		n += llc_occupancy(&s->shard[t].c[k], mask);
+	return n;
+}
+
+const struct llc *
+shard_sim_llc(const struct shard_sim *s, unsigned int k)
+{
+	return &s->shard[0].c[k];
+}
+
+void
+shard_sim_free(struct shard_sim *s)
+{
+	unsigned int t, k;
+
+	if (!s->shard)
+		return;
+	for (t = 0; t < s->nthreads; t++) {
+		for (k = 0; k < s->ncfg; k++)
+			llc_free(&s->shard[t].c[k]);
+		free(s->shard[t].q.rec);
+	}
+	free(s->shard);
+	s->shard = NULL;
+}
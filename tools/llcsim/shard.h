@@ -0,0 +1,77 @@
+/*
+ * Parallel LLC simulation, sharded by set index
+ *
+ * Copyright (c) 2020, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#ifndef DDIO_SHARD_H
+#define DDIO_SHARD_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "llc.h"
+
+#define SHARD_MAX_THREADS	128
+#define SHARD_MAX_CONFIGS	32
+
+struct shard_rec {
+	uint64_t line;
+	uint16_t op;			/* enum llc_op, or SHARD_RESET */
+	uint16_t core;
+};
+
+/*
+ * Single-producer single-consumer queue. The producer publishes `head`
+ * once per batch and the consumer releases `tail` once per batch, so the
+ * shared indexes are touched rarely.
+ */
+struct shard_queue {
+	struct shard_rec *rec;
+	unsigned int mask;
+	uint64_t head __attribute__((aligned(64)));	/* shared, written by the producer */
+	uint64_t tail __attribute__((aligned(64)));	/* shared, written by the consumer */
+	uint64_t prod_head __attribute__((aligned(64)));	/* private to the producer */
+	uint64_t prod_tail;				/* last tail seen by the producer */
+};
+
+struct shard {
+	struct shard_queue q;
+	struct llc c[SHARD_MAX_CONFIGS];
+	pthread_t thread;
+	struct shard_sim *sim;
+};
+
+/*
+ * Every worker thread owns the sets of one shard and simulates them for
+ * all configurations, which must share the geometry and slice function
+ * (e.g., a sweep of the DDIO ways). Since the accesses to a set keep
+ * their order, the merged statistics do not depend on the number of
+ * threads, except with random replacement.
+ */
+struct shard_sim {
+	unsigned int nthreads;
+	unsigned int ncfg;
+	struct shard *shard;
+	int done;
+};
+
+int  shard_sim_init(struct shard_sim *s, const struct llc_config *cfg, unsigned int ncfg,
+                    unsigned int nthreads);
+
+/* Called by a single producer thread */
+void shard_sim_access(struct shard_sim *s, enum llc_op op, uint64_t addr, unsigned int size,
+                      unsigned int core);
+void shard_sim_reset_stats(struct shard_sim *s);
+
+/* Waits until all accesses are simulated and stops the workers */
+void shard_sim_finish(struct shard_sim *s);
+
+/* Statistics of configuration k, summed over the shards (after finish) */
+void shard_sim_stats(const struct shard_sim *s, unsigned int k, struct llc_stats *st);
+uint64_t shard_sim_occupancy(const struct shard_sim *s, unsigned int k, uint32_t mask);
+const struct llc *shard_sim_llc(const struct shard_sim *s, unsigned int k);
+
+void shard_sim_free(struct shard_sim *s);
+
+#endif /* DDIO_SHARD_H */
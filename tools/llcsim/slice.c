@@ -0,0 +1,245 @@
+/*
+ * LLC slice hash functions and slice-aware buffer placement
+ *
+ * Copyright (c) 2020, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "slice.h"
+
+/*
+ * Complex addressing of Xeon processors with 2, 4, and 8 slices (Sandy
+ * Bridge to Haswell), as reverse-engineered by Maurice et al. (RAID'15).
+ */
+#define O0	0x1B5F575440ull
+#define O1	0x2EB5FAA880ull
+#define O2	0x3CCCC93100ull
+
+static const struct slice_hash presets[] = {
+	{ "xeon-2", 2, 1, { O0 }, 0, { 0 } },
+	{ "xeon-4", 4, 2, { O0, O1 }, 0, { 0 } },
+	{ "xeon-8", 8, 3, { O0, O1, O2 }, 0, { 0 } },
+};
+
+const struct slice_hash *
+slice_hash_presets(int *n)
+{
+	*n = sizeof(presets) / sizeof(presets[0]);
+	return presets;
+}
+
+const struct slice_hash *
+slice_hash_find(const char *name)
+{
+	unsigned int i;
+
+	for (i = 0; i < sizeof(presets) / sizeof(presets[0]); i++)
+		if (!strcmp(presets[i].name, name))
+			return &presets[i];
+	return NULL;
+}
+
+/*
+ * A table file has one "slices <n>" line, up to 8 "mask <hex>" lines, and
+ * an optional "lut <s0> <s1> ..." line with 2^masks entries. '#' starts a
+ * comment.
+ */
+int
+slice_hash_load(const char *path, struct slice_hash *h)
+{
+	char line[4096];
+	FILE *f = fopen(path, "r");
+	unsigned int i;
+
+	if (!f) {
+		perror(path);
+		return -1;
+	}
+	memset(h, 0, sizeof(*h));
+	snprintf(h->name, sizeof(h->name), "%s", strrchr(path, '/') ? strrchr(path, '/') + 1 : path);
+	while (fgets(line, sizeof(line), f)) {
+		char *p = line, *end;
+
+		line[strcspn(line, "#\n")] = '\0';
+		if (!strncmp(line, "slices", 6)) {
+			h->slices = strtoul(line + 6, NULL, 0);
+		} else if (!strncmp(line, "mask", 4)) {
+			if (h->nmasks == SLICE_MAX_MASKS)
+				break;
+			h->mask[h->nmasks++] = strtoull(line + 4, NULL, 16);
+		} else if (!strncmp(line, "lut", 3)) {
+			for (p = line + 3; h->nlut < sizeof(h->lut); p = end) {
+				unsigned long v = strtoul(p, &end, 0);
+
+				if (end == p)
+					break;
+				h->lut[h->nlut++] = v;
+			}
+		}
+	}
+	fclose(f);
+
+	if (!h->slices || h->slices > SLICE_MAX_SLICES || !h->nmasks ||
+	    (h->nlut && h->nlut != 1u << h->nmasks) ||
+	    (!h->nlut && h->slices != 1u << h->nmasks)) {
+		fprintf(stderr, "%s: bad slice hash table\n", path);
+		return -1;
+	}
+	for (i = 0; i < h->nlut; i++) {
+		if (h->lut[i] >= h->slices) {
+			fprintf(stderr, "%s: slice %u out of range\n", path, h->lut[i]);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+int
+slice_hash_get(const char *name_or_path, struct slice_hash *h)
+{
+	const struct slice_hash *preset = slice_hash_find(name_or_path);
+
+	if (preset) {
+		*h = *preset;
+		return 0;
+	}
+	return slice_hash_load(name_or_path, h);
+}
+
+unsigned int
+slice_of(const struct slice_hash *h, uint64_t paddr)
+{
+	unsigned int i, idx = 0;
+
+	for (i = 0; i < h->nmasks; i++)
+		idx |= __builtin_parityll(paddr & h->mask[i]) << i;
+	return h->nlut ? h->lut[idx] : idx;
+}
+
+unsigned int
+slice_llc_fn(const struct llc *c, uint64_t line)
+{
+	return slice_of(c->cfg.slice_arg, line << LLC_LINE_SHIFT) % c->cfg.slices;
+}
+
+int
+slice_topo_parse(const char *arg, unsigned int slices, struct slice_topo *t)
+{
+	memset(t, 0, sizeof(*t));
+	t->slices = slices;
+	if (!strcmp(arg, "ring")) {
+		t->ring = 1;
+		return 0;
+	}
+	if (!strncmp(arg, "mesh:", 5) && (t->cols = strtoul(arg + 5, NULL, 0)) > 0)
+		return 0;
+	fprintf(stderr, "Bad topology '%s' (ring or mesh:<cols>)\n", arg);
+	return -1;
+}
+
+unsigned int
+slice_home(const struct slice_topo *t, unsigned int core)
+{
+	return core % t->slices;
+}
+
+unsigned int
+slice_distance(const struct slice_topo *t, unsigned int core, unsigned int slice)
+{
+	unsigned int a = slice_home(t, core), b = slice % t->slices;
+
+	if (t->ring) {
+		unsigned int d = a > b ? a - b : b - a;
+
+		return d < t->slices - d ? d : t->slices - d;
+	}
+	return abs((int)(a % t->cols) - (int)(b % t->cols)) +
+	       abs((int)(a / t->cols) - (int)(b / t->cols));
+}
+
+int
+slice_pool_init(struct slice_pool *p, const struct slice_hash *h, unsigned int n,
+                slice_paddr_fn paddr, void *arg)
+{
+	unsigned int i, s;
+
+	memset(p, 0, sizeof(*p));
+	if (h->slices > SLICE_MAX_SLICES)
+		return -1;
+	p->slices = h->slices;
+	p->n = n;
+	p->slice = malloc(n);
+	if (!p->slice)
+		goto fail;
+	for (i = 0; i < n; i++) {
+		p->slice[i] = slice_of(h, paddr(arg, i));
+		p->cap[p->slice[i]]++;
+	}
+	for (s = 0; s < p->slices; s++) {
+		p->stack[s] = malloc((p->cap[s] ? p->cap[s] : 1) * sizeof(int32_t));
+		if (!p->stack[s])
+			goto fail;
+	}
+	/* Lower ids end up on top, as in a freshly created mempool */
+	for (i = n; i-- > 0;)
+		p->stack[p->slice[i]][p->top[p->slice[i]]++] = i;
+	return 0;
+fail:
+	perror("malloc");
+	slice_pool_free(p);
+	return -1;
+}
+
+void
+slice_pool_free(struct slice_pool *p)
+{
+	unsigned int s;
+
+	for (s = 0; s < SLICE_MAX_SLICES; s++) {
+		free(p->stack[s]);
+		p->stack[s] = NULL;
+	}
+	free(p->slice);
+	p->slice = NULL;
+}
+
+int32_t
+slice_pool_get(struct slice_pool *p, unsigned int slice)
+{
+	unsigned int s, best = 0;
+
+	slice %= p->slices;
+	if (p->top[slice]) {
+		p->local++;
+		return p->stack[slice][--p->top[slice]];
+	}
+	for (s = 1; s < p->slices; s++)
+		if (p->top[s] > p->top[best])
+			best = s;
+	if (!p->top[best])
+		return -1;
+	p->remote++;
+	return p->stack[best][--p->top[best]];
+}
+
+void
+slice_pool_put(struct slice_pool *p, int32_t id)
+{
+	unsigned int s = p->slice[id];
+
+	p->stack[s][p->top[s]++] = id;
+}
+
+unsigned int
+slice_pool_avail(const struct slice_pool *p)
+{
+	unsigned int s, n = 0;
+
+	for (s = 0; s < p->slices; s++)
+		n += p->top[s];
+	return n;
+}
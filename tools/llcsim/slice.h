@@ -0,0 +1,80 @@
+/*
+ * LLC slice hash functions and slice-aware buffer placement
+ *
+ * Copyright (c) 2020, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#ifndef DDIO_SLICE_H
+#define DDIO_SLICE_H
+
+#include <stdint.h>
+
+#include "llc.h"
+
+#define SLICE_MAX_MASKS		8
+#define SLICE_MAX_SLICES	64
+
+/*
+ * Bit i of the hash is the parity of (physical address & mask[i]). The
+ * hash indexes `lut` to get the slice, which allows a non-power-of-two
+ * number of slices; without a lut, the hash is the slice.
+ */
+struct slice_hash {
+	char name[32];
+	unsigned int slices;
+	unsigned int nmasks;
+	uint64_t mask[SLICE_MAX_MASKS];
+	unsigned int nlut;
+	uint8_t lut[1 << SLICE_MAX_MASKS];
+};
+
+/*
+ * Core-to-slice distance: a bidirectional ring (up to Broadwell) or a
+ * mesh with `cols` columns (Skylake-SP). Core c sits next to slice
+ * c % slices, which is therefore its closest slice.
+ */
+struct slice_topo {
+	int ring;
+	unsigned int cols;
+	unsigned int slices;
+};
+
+const struct slice_hash *slice_hash_find(const char *name);
+const struct slice_hash *slice_hash_presets(int *n);
+int  slice_hash_load(const char *path, struct slice_hash *h);
+int  slice_hash_get(const char *name_or_path, struct slice_hash *h);
+unsigned int slice_of(const struct slice_hash *h, uint64_t paddr);
+
+/* Use as llc_config.slice_fn with llc_config.slice_arg pointing to the hash */
+unsigned int slice_llc_fn(const struct llc *c, uint64_t line);
+
+/* "ring" or "mesh:<cols>" */
+int  slice_topo_parse(const char *arg, unsigned int slices, struct slice_topo *t);
+unsigned int slice_home(const struct slice_topo *t, unsigned int core);
+unsigned int slice_distance(const struct slice_topo *t, unsigned int core, unsigned int slice);
+
+/*
+ * Buffer pool with one LIFO per slice. Every buffer belongs to the slice of
+ * its hot line (e.g., the packet header), given by `paddr`. A request for a
+ * slice without free buffers is served from the slice with the most.
+ */
+struct slice_pool {
+	unsigned int slices;
+	unsigned int n;
+	uint8_t *slice;			/* [n] slice of each buffer */
+	int32_t *stack[SLICE_MAX_SLICES];
+	unsigned int top[SLICE_MAX_SLICES];
+	unsigned int cap[SLICE_MAX_SLICES];
+	uint64_t local, remote;		/* requests served from the wanted slice or not */
+};
+
+typedef uint64_t (*slice_paddr_fn)(void *arg, unsigned int id);
+
+int  slice_pool_init(struct slice_pool *p, const struct slice_hash *h, unsigned int n,
+                     slice_paddr_fn paddr, void *arg);
+void slice_pool_free(struct slice_pool *p);
+int32_t slice_pool_get(struct slice_pool *p, unsigned int slice);
+void slice_pool_put(struct slice_pool *p, int32_t id);
+unsigned int slice_pool_avail(const struct slice_pool *p);
+
+#endif /* DDIO_SLICE_H */
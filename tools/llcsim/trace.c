@@ -0,0 +1,704 @@
+/*
+ * Binary memory-access traces: delta-encoded blocks with an index
+ *
+ * Copyright (c) 2020, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "trace.h"
+
+/* Integers are stored in host order, i.e., little endian on x86 */
+#define HDR_LEN		24
+#define BLK_HDR_LEN	16
+#define FOOTER_LEN	32
+#define MAX_REC_LEN	32		/* upper bound of an encoded record */
+
+#define CTL_OP		0x3
+#define CTL_SAME_AGENT	0x4
+#define CTL_LINE	0x8
+
+enum slot_state {
+	SLOT_FREE,
+	SLOT_FILLED,
+	SLOT_BUSY,
+	SLOT_DONE,
+};
+
+struct trace_block {
+	struct trace_rec *recs;
+	uint32_t n;
+	uint64_t first_record;
+	uint8_t *enc;			/* encoded records */
+	uint8_t *out;			/* compressed records */
+	uint32_t enc_len, out_len;
+	enum slot_state state;
+};
+
+static inline uint8_t *
+put_varint(uint8_t *p, uint64_t v)
+{
+	while (v >= 0x80) {
+		*p++ = v | 0x80;
+		v >>= 7;
+	}
+	*p++ = v;
+	return p;
+}
+
+static inline int
+get_varint(const uint8_t **pp, const uint8_t *end, uint64_t *v)
+{
+	const uint8_t *p = *pp;
+	unsigned int shift = 0;
+
+	*v = 0;
+	while (p < end && shift < 64) {
+		uint8_t b = *p++;
+
+		*v |= (uint64_t)(b & 0x7f) << shift;
+		if (!(b & 0x80)) {
+			*pp = p;
+			return 0;
+		}
+		shift += 7;
+	}
+	return -1;
+}
+
+static inline uint64_t
+zigzag(int64_t v)
+{
+	return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static inline int64_t
+unzigzag(uint64_t v)
+{
+	return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+static uint32_t
+encode_block(const struct trace_rec *recs, uint32_t n, uint8_t *out)
+{
+	struct trace_rec prev = { 0 };
+	uint8_t *p = out;
+	uint32_t i;
+
+	for (i = 0; i < n; i++) {
+		const struct trace_rec *r = &recs[i];
+		uint8_t ctl = r->op & CTL_OP;
+
+		if (i && r->agent == prev.agent)
+			ctl |= CTL_SAME_AGENT;
+		if (r->size == LLC_LINE_SIZE)
+			ctl |= CTL_LINE;
+		p = put_varint(p, zigzag((int64_t)(r->t_ns - prev.t_ns)));
+		*p++ = ctl;
+		if (!(ctl & CTL_SAME_AGENT))
+			p = put_varint(p, r->agent);
+		p = put_varint(p, zigzag((int64_t)(r->addr - prev.addr)));
+		if (!(ctl & CTL_LINE))
+			p = put_varint(p, r->size);
+		prev = *r;
+	}
+	return p - out;
+}
+
+static inline int
+decode_rec(const uint8_t **pp, const uint8_t *end, struct trace_rec *prev)
+{
+	uint64_t v;
+	uint8_t ctl;
+
+	if (get_varint(pp, end, &v) || *pp >= end)
+		return -1;
+	prev->t_ns += unzigzag(v);
+	ctl = *(*pp)++;
+	prev->op = ctl & CTL_OP;
+	if (!(ctl & CTL_SAME_AGENT)) {
+		if (get_varint(pp, end, &v))
+			return -1;
+		prev->agent = v;
+	}
+	if (get_varint(pp, end, &v))
+		return -1;
+	prev->addr += unzigzag(v);
+	if (ctl & CTL_LINE) {
+		prev->size = LLC_LINE_SIZE;
+	} else {
+		if (get_varint(pp, end, &v))
+			return -1;
+		prev->size = v;
+	}
+	return 0;
+}
+
+static const char op_chars[LLC_OPS] = { 'W', 'R', 'r', 'w' };
+
+int
+trace_parse_line(const char *line, struct trace_rec *rec)
+{
+	unsigned int size = LLC_LINE_SIZE, core = 0, i;
+	char c, a[32];
+
+	while (*line == ' ' || *line == '\t')
+		line++;
+	if (*line == '#' || *line == '\n' || *line == '\0')
+		return 0;
+	if (sscanf(line, "%c %31s %u %u", &c, a, &size, &core) < 2)
+		return -1;
+	for (i = 0; i < LLC_OPS && op_chars[i] != c; i++)
+		;
+	if (i == LLC_OPS)
+		return -1;
+	memset(rec, 0, sizeof(*rec));
+	rec->op = i;
+	rec->addr = strtoull(a, NULL, 0);
+	rec->size = size;
+	rec->agent = core;
+	return 1;
+}
+
+void
+trace_print_line(FILE *f, const struct trace_rec *rec)
+{
+	fprintf(f, "%c 0x%" PRIx64 " %u %u\n", op_chars[rec->op & CTL_OP], rec->addr, rec->size,
+	        rec->agent);
+}
+
+int
+trace_is_binary(const char *path)
+{
+	char magic[8];
+	int fd = open(path, O_RDONLY);
+	ssize_t n;
+
+	if (fd < 0) {
+		perror(path);
+		return -1;
+	}
+	n = read(fd, magic, sizeof(magic));
+	close(fd);
+	return n == sizeof(magic) && !memcmp(magic, TRACE_MAGIC, sizeof(magic));
+}
+
+/*
+ * Reader
+ */
+int
+trace_reader_open(struct trace_reader *r, const char *path)
+{
+	struct stat sb;
+	uint64_t footer[3], idx_off;
+	int fd;
+
+	memset(r, 0, sizeof(*r));
+	fd = open(path, O_RDONLY);
+	if (fd < 0 || fstat(fd, &sb)) {
+		perror(path);
+		if (fd >= 0)
+			close(fd);
+		return -1;
+	}
+	r->len = sb.st_size;
+	if (r->len < HDR_LEN + FOOTER_LEN) {
+		fprintf(stderr, "%s: not a trace\n", path);
+		close(fd);
+		return -1;
+	}
+	r->map = mmap(NULL, r->len, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+	close(fd);
+	if (r->map == MAP_FAILED) {
+		perror("mmap");
+		r->map = NULL;
+		return -1;
+	}
+	madvise((void *)r->map, r->len, MADV_SEQUENTIAL);
+
+	if (memcmp(r->map, TRACE_MAGIC, 8) ||
+	    memcmp(r->map + r->len - 8, TRACE_IDX_MAGIC, 8)) {
+		fprintf(stderr, "%s: not a trace, or not closed properly\n", path);
+		goto fail;
+	}
+	if (*(const uint32_t *)(r->map + 8) != TRACE_VERSION) {
+		fprintf(stderr, "%s: unsupported version %u\n", path, *(const uint32_t *)(r->map + 8));
+		goto fail;
+	}
+	r->flags = *(const uint32_t *)(r->map + 12);
+	r->block_records = *(const uint32_t *)(r->map + 16);
+	memcpy(footer, r->map + r->len - FOOTER_LEN, sizeof(footer));
+	r->nblocks = footer[0];
+	r->nrecords = footer[1];
+	idx_off = footer[2];
+	if (!r->block_records || idx_off > r->len - FOOTER_LEN ||
+	    r->nblocks > (r->len - FOOTER_LEN - idx_off) / sizeof(struct trace_index)) {
+		fprintf(stderr, "%s: corrupted index\n", path);
+		goto fail;
+	}
+	r->index = (const struct trace_index *)(r->map + idx_off);
+#ifndef HAVE_ZLIB
+	if (r->flags & TRACE_ZLIB) {
+		fprintf(stderr, "%s: compressed trace, rebuild with -DHAVE_ZLIB -lz\n", path);
+		goto fail;
+	}
+#endif
+	return 0;
+fail:
+	trace_reader_close(r);
+	return -1;
+}
+
+void
+trace_reader_close(struct trace_reader *r)
+{
+	if (r->map)
+		munmap((void *)r->map, r->len);
+	free(r->buf);
+	memset(r, 0, sizeof(*r));
+}
+
+/*
+ * Points *p and *end to the encoded records of block b, inflating them
+ * into *buf (of *buf_len bytes) if needed.
+ */
+static int
+block_data(const struct trace_reader *r, uint64_t b, uint8_t **buf, size_t *buf_len,
+           const uint8_t **p, const uint8_t **end, uint32_t *n)
+{
+	const struct trace_index *ix;
+	uint32_t hdr[4];
+
+	if (b >= r->nblocks)
+		return -1;
+	ix = &r->index[b];
+	if (ix->offset > r->len - FOOTER_LEN - BLK_HDR_LEN)
+		return -1;
+	memcpy(hdr, r->map + ix->offset, sizeof(hdr));
+	if (hdr[2] > r->len - FOOTER_LEN - BLK_HDR_LEN - ix->offset)
+		return -1;
+	*n = hdr[0];
+	*p = r->map + ix->offset + BLK_HDR_LEN;
+	if (hdr[2] == hdr[1]) {
+		*end = *p + hdr[1];
+		return 0;
+	}
+#ifdef HAVE_ZLIB
+	{
+		uLongf len = hdr[1];
+
+		if (*buf_len < hdr[1]) {
+			uint8_t *nb = realloc(*buf, hdr[1]);
+
+			if (!nb)
+				return -1;
+			*buf = nb;
+			*buf_len = hdr[1];
+		}
+		if (uncompress(*buf, &len, *p, hdr[2]) != Z_OK || len != hdr[1])
+			return -1;
+		*p = *buf;
+		*end = *buf + len;
+		return 0;
+	}
+#else
+	(void)buf;
+	(void)buf_len;
+	return -1;
+#endif
+}
+
+static int
+load_block(struct trace_reader *r, uint64_t b)
+{
+	if (block_data(r, b, &r->buf, &r->buf_len, &r->p, &r->end, &r->left)) {
+		fprintf(stderr, "Corrupted trace block %" PRIu64 "\n", b);
+		return -1;
+	}
+	memset(&r->prev, 0, sizeof(r->prev));
+	r->block = b + 1;
+	return 0;
+}
+
+int
+trace_read(struct trace_reader *r, struct trace_rec *rec)
+{
+	while (!r->left) {
+		if (r->block >= r->nblocks)
+			return 0;
+		if (load_block(r, r->block))
+			return -1;
+	}
+	if (decode_rec(&r->p, r->end, &r->prev))
+		return -1;
+	r->left--;
+	*rec = r->prev;
+	return 1;
+}
+
+int
+trace_seek(struct trace_reader *r, uint64_t record)
+{
+	uint64_t lo = 0, hi = r->nblocks, skip;
+
+	if (record >= r->nrecords) {
+		r->block = r->nblocks;
+		r->left = 0;
+		return 0;
+	}
+	while (hi - lo > 1) {
+		uint64_t mid = (lo + hi) / 2;
+
+		if (r->index[mid].first_record <= record)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	if (load_block(r, lo))
+		return -1;
+	for (skip = record - r->index[lo].first_record; skip; skip--, r->left--)
+		if (decode_rec(&r->p, r->end, &r->prev))
+			return -1;
+	return 0;
+}
+
+int
+trace_seek_time(struct trace_reader *r, uint64_t t_ns)
+{
+	uint64_t lo = 0, hi = r->nblocks;
+
+	if (!r->nblocks)
+		return 0;
+	while (hi - lo > 1) {
+		uint64_t mid = (lo + hi) / 2;
+
+		if (r->index[mid].first_t_ns < t_ns)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	if (load_block(r, lo))
+		return -1;
+	/* Skip the earlier records without consuming the first later one */
+	for (;;) {
+		const uint8_t *p = r->p;
+		struct trace_rec next = r->prev;
+
+		if (!r->left) {
+			if (r->block >= r->nblocks)
+				return 0;
+			if (load_block(r, r->block))
+				return -1;
+			continue;
+		}
+		if (decode_rec(&p, r->end, &next))
+			return -1;
+		if (next.t_ns >= t_ns)
+			return 0;
+		r->p = p;
+		r->prev = next;
+		r->left--;
+	}
+}
+
+/* Thread-safe: compressed blocks are inflated into a private buffer */
+int
+trace_read_block(struct trace_reader *r, uint64_t b, struct trace_rec *recs)
+{
+	struct trace_rec prev = { 0 };
+	const uint8_t *p, *end;
+	uint8_t *buf = NULL;
+	size_t buf_len = 0;
+	uint32_t n, i;
+
+	if (block_data(r, b, &buf, &buf_len, &p, &end, &n) || n > r->block_records) {
+		free(buf);
+		return -1;
+	}
+	for (i = 0; i < n; i++) {
+		if (decode_rec(&p, end, &prev)) {
+			free(buf);
+			return -1;
+		}
+		recs[i] = prev;
+	}
+	free(buf);
+	return n;
+}
+
+/*
+ * Writer
+ */
+static int
+write_all(int fd, const void *buf, size_t len)
+{
+	const uint8_t *p = buf;
+
+	while (len) {
+		ssize_t n = write(fd, p, len);
+
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("write");
+			return -1;
+		}
+		p += n;
+		len -= n;
+	}
+	return 0;
+}
+
+static void
+compress_block(uint32_t flags, struct trace_block *blk)
+{
+	blk->enc_len = encode_block(blk->recs, blk->n, blk->enc);
+	blk->out_len = blk->enc_len;
+#ifdef HAVE_ZLIB
+	if (flags & TRACE_ZLIB) {
+		uLongf len = compressBound(blk->enc_len);
+
+		/* Keep the block stored if compression does not help */
+		if (compress2(blk->out, &len, blk->enc, blk->enc_len, 1) == Z_OK &&
+		    len < blk->enc_len)
+			blk->out_len = len;
+	}
+#else
+	(void)flags;
+#endif
+}
+
+static int
+write_block(struct trace_writer *w, struct trace_block *blk)
+{
+	uint32_t hdr[4] = { blk->n, blk->enc_len, blk->out_len, 0 };
+	const uint8_t *data = blk->out_len < blk->enc_len ? blk->out : blk->enc;
+
+	if (w->written == w->index_cap) {
+		uint64_t cap = w->index_cap ? 2 * w->index_cap : 1024;
+		struct trace_index *ix = realloc(w->index, cap * sizeof(*ix));
+
+		if (!ix) {
+			perror("realloc");
+			return -1;
+		}
+		w->index = ix;
+		w->index_cap = cap;
+	}
+	w->index[w->written].offset = w->offset;
+	w->index[w->written].first_record = blk->first_record;
+	w->index[w->written].first_t_ns = blk->recs[0].t_ns;
+	if (write_all(w->fd, hdr, sizeof(hdr)) || write_all(w->fd, data, blk->out_len))
+		return -1;
+	w->offset += sizeof(hdr) + blk->out_len;
+	w->written++;
+	return 0;
+}
+
+static void *
+writer_worker(void *arg)
+{
+	struct trace_writer *w = arg;
+
+	pthread_mutex_lock(&w->lock);
+	for (;;) {
+		struct trace_block *blk = NULL;
+		unsigned int s;
+
+		for (s = 0; s < w->nslots && !blk; s++)
+			if (w->slot[s].state == SLOT_FILLED)
+				blk = &w->slot[s];
+		if (!blk) {
+			if (w->stop)
+				break;
+			pthread_cond_wait(&w->cond, &w->lock);
+			continue;
+		}
+		blk->state = SLOT_BUSY;
+		pthread_mutex_unlock(&w->lock);
+		compress_block(w->flags, blk);
+		pthread_mutex_lock(&w->lock);
+		blk->state = SLOT_DONE;
+		pthread_cond_broadcast(&w->cond);
+	}
+	pthread_mutex_unlock(&w->lock);
+	return NULL;
+}
+
+/* Writes block `seq` once a worker is done with it; called with the lock held */
+static int
+retire(struct trace_writer *w, uint64_t seq)
+{
+	struct trace_block *blk = &w->slot[seq % w->nslots];
+	int ret;
+
+	while (blk->state != SLOT_DONE)
+		pthread_cond_wait(&w->cond, &w->lock);
+	pthread_mutex_unlock(&w->lock);
+	ret = write_block(w, blk);
+	pthread_mutex_lock(&w->lock);
+	blk->state = SLOT_FREE;
+	blk->n = 0;
+	return ret;
+}
+
+/* Hands the block being filled over and moves to the next slot */
+static int
+submit(struct trace_writer *w)
+{
+	struct trace_block *blk = &w->slot[w->seq % w->nslots];
+	int ret = 0;
+
+	if (!w->nthreads) {
+		compress_block(w->flags, blk);
+		ret = write_block(w, blk);
+		blk->n = 0;
+		w->seq++;
+		return ret;
+	}
+	pthread_mutex_lock(&w->lock);
+	blk->state = SLOT_FILLED;
+	pthread_cond_broadcast(&w->cond);
+	w->seq++;
+	if (w->seq >= w->nslots && w->slot[w->seq % w->nslots].state != SLOT_FREE)
+		ret = retire(w, w->seq - w->nslots);
+	pthread_mutex_unlock(&w->lock);
+	return ret;
+}
+
+int
+trace_writer_open(struct trace_writer *w, const char *path, uint32_t flags,
+                  unsigned int nthreads)
+{
+	uint32_t hdr[4] = { TRACE_VERSION, flags, TRACE_BLOCK_RECORDS, 0 };
+	unsigned int s;
+
+	memset(w, 0, sizeof(*w));
+#ifndef HAVE_ZLIB
+	if (flags & TRACE_ZLIB) {
+		fprintf(stderr, "Compression needs zlib, rebuild with -DHAVE_ZLIB -lz\n");
+		return -1;
+	}
+#endif
+	if (nthreads > TRACE_MAX_THREADS)
+		nthreads = TRACE_MAX_THREADS;
+	w->flags = flags;
+	w->nslots = nthreads ? 2 * nthreads + 1 : 1;
+	w->slot = calloc(w->nslots, sizeof(*w->slot));
+	if (!w->slot) {
+		perror("calloc");
+		return -1;
+	}
+	for (s = 0; s < w->nslots; s++) {
+		struct trace_block *blk = &w->slot[s];
+		size_t enc_cap = (size_t)TRACE_BLOCK_RECORDS * MAX_REC_LEN;
+
+		blk->recs = malloc(TRACE_BLOCK_RECORDS * sizeof(*blk->recs));
+		blk->enc = malloc(enc_cap);
+#ifdef HAVE_ZLIB
+		blk->out = malloc(compressBound(enc_cap));
+#else
+		blk->out = malloc(1);
+#endif
+		if (!blk->recs || !blk->enc || !blk->out) {
+			perror("malloc");
+			goto fail;
+		}
+	}
+	w->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (w->fd < 0) {
+		perror(path);
+		goto fail;
+	}
+	if (write_all(w->fd, TRACE_MAGIC, 8) || write_all(w->fd, hdr, sizeof(hdr)))
+		goto fail;
+	w->offset = HDR_LEN;
+
+	pthread_mutex_init(&w->lock, NULL);
+	pthread_cond_init(&w->cond, NULL);
+	for (; w->nthreads < nthreads; w->nthreads++) {
+		if (pthread_create(&w->thread[w->nthreads], NULL, writer_worker, w)) {
+			perror("pthread_create");
+			break;
+		}
+	}
+	return 0;
+fail:
+	if (w->fd > 0)
+		close(w->fd);
+	for (s = 0; s < w->nslots; s++) {
+		free(w->slot[s].recs);
+		free(w->slot[s].enc);
+		free(w->slot[s].out);
+	}
+	free(w->slot);
+	return -1;
+}
+
+int
+trace_write(struct trace_writer *w, const struct trace_rec *rec)
+{
+	struct trace_block *blk = &w->slot[w->seq % w->nslots];
+
+	if (!blk->n)
+		blk->first_record = w->records;
+	blk->recs[blk->n++] = *rec;
+	w->records++;
+	if (blk->n == TRACE_BLOCK_RECORDS && submit(w))
+		w->error = 1;
+	return w->error ? -1 : 0;
+}
+
+int
+trace_writer_close(struct trace_writer *w)
+{
+	uint64_t footer[3], seq;
+	unsigned int s;
+	int ret = w->error ? -1 : 0;
+
+	if (w->slot[w->seq % w->nslots].n && submit(w))
+		ret = -1;
+	if (w->nthreads) {
+		pthread_mutex_lock(&w->lock);
+		for (seq = w->written; seq < w->seq; seq++)
+			if (retire(w, seq))
+				ret = -1;
+		w->stop = 1;
+		pthread_cond_broadcast(&w->cond);
+		pthread_mutex_unlock(&w->lock);
+		for (s = 0; s < w->nthreads; s++)
+			pthread_join(w->thread[s], NULL);
+	}
+
+	footer[0] = w->written;
+	footer[1] = w->records;
+	footer[2] = w->offset;
+	if (write_all(w->fd, w->index, w->written * sizeof(*w->index)) ||
+	    write_all(w->fd, footer, sizeof(footer)) || write_all(w->fd, TRACE_IDX_MAGIC, 8))
+		ret = -1;
+	if (close(w->fd))
+		ret = -1;
+
+	pthread_mutex_destroy(&w->lock);
+	pthread_cond_destroy(&w->cond);
+	for (s = 0; s < w->nslots; s++) {
+		free(w->slot[s].recs);
+		free(w->slot[s].enc);
+		free(w->slot[s].out);
+	}
+	free(w->slot);
+	free(w->index);
+	return ret;
+}
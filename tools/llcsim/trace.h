@@ -0,0 +1,136 @@
+/*
+ * Binary memory-access traces: delta-encoded blocks with an index
+ *
+ * Copyright (c) 2020, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#ifndef DDIO_TRACE_H
+#define DDIO_TRACE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#include "llc.h"
+
+/*
+ * File layout (all integers little endian):
+ *
+ *   header   "DDIOTRC1", u32 version, u32 flags, u32 block records, u32 0
+ *   block*   u32 records, u32 encoded bytes, u32 stored bytes, u32 0,
+ *            stored bytes of (zlib-compressed, with TRACE_ZLIB) records
+ *   index    one struct trace_index per block
+ *   footer   u64 blocks, u64 records, u64 index offset, "DDIOIDX1"
+ *
+ * Every block is decoded on its own: the deltas of its first record are
+ * relative to zero. A record is the time delta, a control byte (op, same
+ * agent, one-line size), the agent if it changed, the address delta, and
+ * the size if it is not one line, as varints (deltas are zigzag-encoded,
+ * since the accesses of several queues interleave). A sequential access
+ * thus takes about 4 bytes.
+ */
+#define TRACE_MAGIC		"DDIOTRC1"
+#define TRACE_IDX_MAGIC		"DDIOIDX1"
+#define TRACE_VERSION		1
+#define TRACE_ZLIB		0x1
+#ifdef HAVE_ZLIB
+#define TRACE_DEFAULT_FLAGS	TRACE_ZLIB
+#else
+#define TRACE_DEFAULT_FLAGS	0
+#endif
+#define TRACE_BLOCK_RECORDS	65536
+#define TRACE_MAX_THREADS	64
+
+/* The agent is the core of core accesses, and the core (or IIO stack) of the queue for DMA */
+struct trace_rec {
+	uint64_t t_ns;
+	uint64_t addr;
+	uint32_t size;
+	uint16_t agent;
+	uint8_t op;			/* enum llc_op */
+	uint8_t pad;
+};
+
+struct trace_index {
+	uint64_t offset;		/* of the block header */
+	uint64_t first_record;
+	uint64_t first_t_ns;
+};
+
+/*
+ * Text traces have one "<op> <address> [<size>] [<core>]" line per access,
+ * where <op> is W (DMA write, ItoM), R (DMA read, PCIeRdCur), r (core
+ * read), or w (core write). Addresses are hexadecimal or decimal, the size
+ * defaults to one line and the core to 0. Empty lines and lines starting
+ * with '#' are ignored (0 is returned); bad lines return -1.
+ */
+int  trace_parse_line(const char *line, struct trace_rec *rec);
+void trace_print_line(FILE *f, const struct trace_rec *rec);
+
+/* 1 if the file starts with TRACE_MAGIC, 0 if not, -1 on error */
+int  trace_is_binary(const char *path);
+
+/*
+ * The reader maps the whole file. Uncompressed blocks are decoded in
+ * place; compressed blocks are inflated into a buffer of the reader.
+ */
+struct trace_reader {
+	const uint8_t *map;
+	size_t len;
+	uint32_t flags;
+	uint32_t block_records;
+	uint64_t nblocks, nrecords;
+	const struct trace_index *index;
+	uint64_t block;			/* next block to decode */
+	const uint8_t *p, *end;		/* records left in the current block */
+	uint32_t left;
+	struct trace_rec prev;
+	uint8_t *buf;			/* inflated block */
+	size_t buf_len;
+};
+
+int  trace_reader_open(struct trace_reader *r, const char *path);
+void trace_reader_close(struct trace_reader *r);
+
+/* Returns 1 with the next record, 0 at the end, or -1 on a corrupted file */
+int  trace_read(struct trace_reader *r, struct trace_rec *rec);
+
+/* Continue from the block holding `record` or the first access at or after `t_ns` */
+int  trace_seek(struct trace_reader *r, uint64_t record);
+int  trace_seek_time(struct trace_reader *r, uint64_t t_ns);
+
+/* Decodes block `b` into recs (of at least block_records entries); returns the count or -1 */
+int  trace_read_block(struct trace_reader *r, uint64_t b, struct trace_rec *recs);
+
+/*
+ * The writer hands full blocks to worker threads that encode and compress
+ * them, while blocks are written in order. With 0 threads, blocks are
+ * encoded by the caller.
+ */
+struct trace_block;
+
+struct trace_writer {
+	int fd;
+	uint32_t flags;
+	unsigned int nthreads;
+	pthread_t thread[TRACE_MAX_THREADS];
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct trace_block *slot;	/* 2 * nthreads + 1 blocks in flight */
+	unsigned int nslots;
+	uint64_t seq;			/* block being filled */
+	uint64_t written;		/* blocks written to the file */
+	uint64_t records;
+	uint64_t offset;
+	struct trace_index *index;
+	uint64_t index_cap;
+	int stop, error;
+};
+
+int  trace_writer_open(struct trace_writer *w, const char *path, uint32_t flags,
+                       unsigned int nthreads);
+int  trace_write(struct trace_writer *w, const struct trace_rec *rec);
+int  trace_writer_close(struct trace_writer *w);
+
+#endif /* DDIO_TRACE_H */
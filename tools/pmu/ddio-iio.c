@@ -0,0 +1,284 @@
+/*
+ * Per-IIO-stack and per-device PCIe bandwidth and DDIO hit/miss
+ *
+ * Copyright (c) 2020, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+// Compile command: gcc -O2 ddio-iio.c iio.c pmu.c -o ddio-iio -lm
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include "pmu.h"
+#include "iio.h"
+
+#define MAX_DEVS	16
+
+static volatile sig_atomic_t stop;
+
+static void
+on_signal(int sig)
+{
+	(void)sig;
+	stop = 1;
+}
+
+/*
+ * Inbound write/read events of one stack (port < 0) or one root port
+ */
+struct iio_meter {
+	int stack;
+	int port;
+	int wr, rd;		/* event indexes */
+	char name[32];
+};
+
+static int
+add_meter(struct pmu_sched *s, const struct iio_stack *st, int stack, int port,
+          struct iio_meter *m)
+{
+	char spec[PMU_SPEC_LEN], ev[PMU_NAME_LEN];
+	int ch_mask = port < 0 ? (1 << IIO_MAX_PORTS) - 1 : 1 << port;
+
+	m->stack = stack;
+	m->port = port;
+	if (port < 0)
+		snprintf(m->name, sizeof(m->name), "IIO%d", st[stack].box);
+	else
+		snprintf(m->name, sizeof(m->name), "IIO%d-P%d", st[stack].box, port);
+
+	snprintf(spec, sizeof(spec), "%s,ch_mask=0x%x", IIO_IB_WRITE, ch_mask);
+	snprintf(ev, sizeof(ev), "%s-IB-WR", m->name);
+	m->wr = pmu_sched_add_box(s, ev, "uncore_iio", -1, st[stack].box, spec, IIO_BYTES_PER_COUNT);
+
+	snprintf(spec, sizeof(spec), "%s,ch_mask=0x%x", IIO_IB_READ, ch_mask);
+	snprintf(ev, sizeof(ev), "%s-IB-RD", m->name);
+	m->rd = pmu_sched_add_box(s, ev, "uncore_iio", -1, st[stack].box, spec, IIO_BYTES_PER_COUNT);
+
+	return m->wr < 0 || m->rd < 0 ? -1 : 0;
+}
+
+static double
+estimate(const struct pmu_sched *s, int i)
+{
+	double est, err;
+
+	if (i < 0)
+		return 0;
+	pmu_sched_estimate(s, i, &est, &err);
+	return est;
+}
+
+static void
+usage(const char *prog)
+{
+	printf("Usage: %s [options]\n", prog);
+	printf("\nOptions:\n");
+	printf("  -d [label=]bdf : Device to attribute (repeatable, e.g., nic=0000:17:00.0)\n");
+	printf("  -s socket      : CPU socket to measure (default: 0)\n");
+	printf("  -i ms          : Rotation interval in milliseconds (default: 10)\n");
+	printf("  -t seconds     : Measurement duration (default: until SIGINT/SIGTERM)\n");
+	printf("  -c counters    : General-purpose counters per box (default: 4)\n");
+	printf("  -r path        : sysfs event_source directory (default: %s)\n", PMU_SYSFS_ROOT);
+	printf("  -p path        : sysfs PCI devices directory (default: %s)\n", IIO_PCI_ROOT);
+	printf("  -o file        : Write results to file instead of stdout\n");
+	printf("  -m             : Use the mock backend (no hardware access)\n");
+	printf("\nExample:\n");
+	printf("  %s -d nic=0000:17:00.0 -d nvme=0000:5e:00.0 -o test.log\n", prog);
+}
+
+int main(int argc, char *argv[])
+{
+	struct pmu_sched sched;
+	struct pmu_backend *be;
+	struct iio_stack st[IIO_MAX_STACKS];
+	struct iio_dev dev[MAX_DEVS];
+	struct iio_meter stacks[IIO_MAX_STACKS], ports[MAX_DEVS];
+	int dev_meter[MAX_DEVS];
+	const char *pmu_root = NULL, *pci_root = IIO_PCI_ROOT, *outfile = NULL;
+	const char *args[MAX_DEVS];
+	int ndev = 0, nstacks, nports = 0, socket = 0, counters = 4, mock = 0, opt, i, j;
+	unsigned int interval_ms = 10;
+	double duration = 0, seconds, total_wr = 0, total_rd = 0;
+	double itom_hit, itom_miss, rd_hit, rd_miss;
+	FILE *out = stdout;
+
+	while ((opt = getopt(argc, argv, "d:s:i:t:c:r:p:o:mh")) != -1) {
+		switch (opt) {
+		case 'd':
+			if (ndev < MAX_DEVS)
+				args[ndev++] = optarg;
+			break;
+		case 's':
+			socket = atoi(optarg);
+			break;
+		case 'i':
+			interval_ms = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			duration = atof(optarg);
+			break;
+		case 'c':
+			counters = atoi(optarg);
+			break;
+		case 'r':
+			pmu_root = optarg;
+			break;
+		case 'p':
+			pci_root = optarg;
+			break;
+		case 'o':
+			outfile = optarg;
+			break;
+		case 'm':
+			mock = 1;
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	be = mock ? pmu_mock_backend(getpid()) : pmu_perf_backend(pmu_root);
+	if (!be) {
+		printf("Could not create the %s backend!\n", mock ? "mock" : "perf");
+		return 1;
+	}
+
+	nstacks = iio_stacks(pmu_root ? pmu_root : PMU_SYSFS_ROOT, socket, st, IIO_MAX_STACKS);
+	if (nstacks <= 0) {
+		printf("No IIO stacks found for socket %d!\n", socket);
+		return 1;
+	}
+
+	for (i = 0; i < ndev; i++) {
+		const char *eq = strchr(args[i], '=');
+		const char *bdf = eq ? eq + 1 : args[i];
+		char *c;
+
+		if (iio_resolve(pci_root, bdf, st, nstacks, &dev[i]))
+			return 1;
+		if (eq)
+			snprintf(dev[i].label, sizeof(dev[i].label), "%.*s", (int)(eq - args[i]), args[i]);
+		else
+			snprintf(dev[i].label, sizeof(dev[i].label), "%s", bdf);
+		/* NPF result names cannot contain ':' */
+		for (c = dev[i].label; *c; c++)
+			if (*c == ':')
+				*c = '-';
+	}
+
+	pmu_sched_init(&sched, be, socket, counters, interval_ms);
+
+	/* Whole-stack totals give the socket-wide inbound traffic */
+	for (i = 0; i < nstacks; i++)
+		if (add_meter(&sched, st, i, -1, &stacks[i]))
+			return 1;
+
+	/* One meter per root port used by the devices */
+	for (i = 0; i < ndev; i++) {
+		dev_meter[i] = -1;
+		if (dev[i].port < 0)
+			continue;
+		for (j = 0; j < nports; j++)
+			if (ports[j].stack == dev[i].stack && ports[j].port == dev[i].port)
+				dev_meter[i] = j;
+		if (dev_meter[i] < 0) {
+			if (add_meter(&sched, st, dev[i].stack, dev[i].port, &ports[nports]))
+				return 1;
+			dev_meter[i] = nports++;
+		}
+	}
+
+	if (pmu_sched_add_preset(&sched, "ItoM-HIT") < 0 ||
+	    pmu_sched_add_preset(&sched, "ItoM-MISS") < 0 ||
+	    pmu_sched_add_preset(&sched, "PCIeRdCur-HIT") < 0 ||
+	    pmu_sched_add_preset(&sched, "PCIeRdCur-MISS") < 0)
+		return 1;
+
+	pmu_sched_build(&sched);
+	fprintf(stderr, "%d IIO stacks, %d events in %d groups (%s backend)\n",
+	        nstacks, sched.nev, sched.ngroups, be->name);
+	for (i = 0; i < ndev; i++) {
+		fprintf(stderr, "  %s: %04x:%02x:%02x.%x -> root port %02x:%02x.%x, uncore_iio_%d",
+		        dev[i].label, dev[i].domain, dev[i].bus, dev[i].dev, dev[i].fn,
+		        dev[i].rp_bus, dev[i].rp_dev, dev[i].rp_fn, st[dev[i].stack].box);
+		if (dev[i].port >= 0)
+			fprintf(stderr, " port %d\n", dev[i].port);
+		else
+			fprintf(stderr, " (whole stack)\n");
+	}
+
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+
+	if (pmu_sched_run(&sched, duration, &stop)) {
+		printf("Could not start the counters!\n");
+		return 1;
+	}
+	seconds = sched.t_total / 1e9;
+
+	if (outfile) {
+		out = fopen(outfile, "w");
+		if (!out) {
+			perror(outfile);
+			return 1;
+		}
+	}
+
+	for (i = 0; i < nstacks; i++) {
+		double wr = estimate(&sched, stacks[i].wr), rd = estimate(&sched, stacks[i].rd);
+
+		total_wr += wr;
+		total_rd += rd;
+		fprintf(out, "RESULT-%s-IB-WR-BW %f\n", stacks[i].name, seconds ? wr / seconds : 0);
+		fprintf(out, "RESULT-%s-IB-RD-BW %f\n", stacks[i].name, seconds ? rd / seconds : 0);
+	}
+	for (i = 0; i < nports; i++) {
+		double wr = estimate(&sched, ports[i].wr), rd = estimate(&sched, ports[i].rd);
+
+		fprintf(out, "RESULT-%s-IB-WR-BW %f\n", ports[i].name, seconds ? wr / seconds : 0);
+		fprintf(out, "RESULT-%s-IB-RD-BW %f\n", ports[i].name, seconds ? rd / seconds : 0);
+	}
+
+	itom_hit = estimate(&sched, pmu_sched_find(&sched, "ItoM-HIT"));
+	itom_miss = estimate(&sched, pmu_sched_find(&sched, "ItoM-MISS"));
+	rd_hit = estimate(&sched, pmu_sched_find(&sched, "PCIeRdCur-HIT"));
+	rd_miss = estimate(&sched, pmu_sched_find(&sched, "PCIeRdCur-MISS"));
+
+	/*
+	 * Skylake-SP CHAs cannot filter TOR inserts by stack, so the socket-wide
+	 * hit/miss counts are apportioned by each device's share of the inbound
+	 * writes (ItoM) and reads (PCIeRdCur) of the socket.
+	 */
+	for (i = 0; i < ndev; i++) {
+		const struct iio_meter *m = dev_meter[i] >= 0 ? &ports[dev_meter[i]] : &stacks[dev[i].stack];
+		double wr = estimate(&sched, m->wr), rd = estimate(&sched, m->rd);
+		double wshare = total_wr > 0 ? wr / total_wr : 0;
+		double rshare = total_rd > 0 ? rd / total_rd : 0;
+		const char *l = dev[i].label;
+
+		fprintf(out, "RESULT-%s-IB-WR-BW %f\n", l, seconds ? wr / seconds : 0);
+		fprintf(out, "RESULT-%s-IB-RD-BW %f\n", l, seconds ? rd / seconds : 0);
+		fprintf(out, "RESULT-%s-ItoM-HIT-SUM %.0f\n", l, itom_hit * wshare);
+		fprintf(out, "RESULT-%s-ItoM-MISS-SUM %.0f\n", l, itom_miss * wshare);
+		fprintf(out, "RESULT-%s-PCIeRdCur-HIT-SUM %.0f\n", l, rd_hit * rshare);
+		fprintf(out, "RESULT-%s-PCIeRdCur-MISS-SUM %.0f\n", l, rd_miss * rshare);
+	}
+
+	fprintf(out, "RESULT-ItoM-HIT-SUM %.0f\n", itom_hit);
+	fprintf(out, "RESULT-ItoM-MISS-SUM %.0f\n", itom_miss);
+	fprintf(out, "RESULT-PCIeRdCur-HIT-SUM %.0f\n", rd_hit);
+	fprintf(out, "RESULT-PCIeRdCur-MISS-SUM %.0f\n", rd_miss);
+	pmu_sched_print_rates(&sched, out);
+
+	if (out != stdout)
+		fclose(out);
+	pmu_sched_close(&sched);
+	be->destroy(be);
+	return 0;
+}
@@ -0,0 +1,179 @@
+/*
+ * Memory-controller (IMC) read/write bandwidth per channel and socket
+ *
+ * Copyright (c) 2020, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+// Compile command: gcc -O2 ddio-imc.c pmu.c -o ddio-imc -lm
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include "pmu.h"
+
+#define MAX_SOCKETS	8
+
+static volatile sig_atomic_t stop;
+
+static void
+on_signal(int sig)
+{
+	(void)sig;
+	stop = 1;
+}
+
+static double
+estimate(const struct pmu_sched *s, int i)
+{
+	double est, err;
+
+	pmu_sched_estimate(s, i, &est, &err);
+	return est;
+}
+
+static void
+usage(const char *prog)
+{
+	printf("Usage: %s [options]\n", prog);
+	printf("\nOptions:\n");
+	printf("  -s sockets  : Comma-separated list of sockets (default: 0)\n");
+	printf("  -i ms       : Sampling interval in milliseconds (default: 10)\n");
+	printf("  -t seconds  : Measurement duration (default: until SIGINT/SIGTERM)\n");
+	printf("  -r path     : sysfs event_source directory (default: %s)\n", PMU_SYSFS_ROOT);
+	printf("  -o file     : Write results to file instead of stdout\n");
+	printf("  -m          : Use the mock backend (no hardware access)\n");
+	printf("\nExample:\n");
+	printf("  %s -s 0 -o imc.log\n", prog);
+}
+
+int main(int argc, char *argv[])
+{
+	struct pmu_sched sched;
+	struct pmu_backend *be;
+	const struct pmu_preset *rd = pmu_preset_find("MEM-RD");
+	const struct pmu_preset *wr = pmu_preset_find("MEM-WR");
+	const char *sysfs_root = NULL, *outfile = NULL, *socket_list = "0";
+	int sockets[MAX_SOCKETS], nsockets = 0, nch, mock = 0, opt, s, c;
+	int ev_rd[MAX_SOCKETS][PMU_MAX_BOXES], ev_wr[MAX_SOCKETS][PMU_MAX_BOXES];
+	unsigned int interval_ms = 10;
+	double duration = 0, seconds, tot_rd = 0, tot_wr = 0;
+	char copy[128], *tok, *save;
+	FILE *out = stdout;
+
+	while ((opt = getopt(argc, argv, "s:i:t:r:o:mh")) != -1) {
+		switch (opt) {
+		case 's':
+			socket_list = optarg;
+			break;
+		case 'i':
+			interval_ms = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			duration = atof(optarg);
+			break;
+		case 'r':
+			sysfs_root = optarg;
+			break;
+		case 'o':
+			outfile = optarg;
+			break;
+		case 'm':
+			mock = 1;
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	snprintf(copy, sizeof(copy), "%s", socket_list);
+	for (tok = strtok_r(copy, ",", &save); tok && nsockets < MAX_SOCKETS;
+	     tok = strtok_r(NULL, ",", &save))
+		sockets[nsockets++] = atoi(tok);
+
+	be = mock ? pmu_mock_backend(getpid()) : pmu_perf_backend(sysfs_root);
+	if (!be) {
+		printf("Could not create the %s backend!\n", mock ? "mock" : "perf");
+		return 1;
+	}
+
+	/* Every uncore_imc box is one DRAM channel */
+	nch = be->nboxes(be, "uncore_imc");
+	if (nch <= 0) {
+		printf("No IMC channels found!\n");
+		return 1;
+	}
+	if (nch * 2 * nsockets > PMU_MAX_EVENTS) {
+		printf("Too many channels (%d) for %d sockets!\n", nch, nsockets);
+		return 1;
+	}
+
+	pmu_sched_init(&sched, be, sockets[0], 4, interval_ms);
+	for (s = 0; s < nsockets; s++) {
+		for (c = 0; c < nch; c++) {
+			char name[PMU_NAME_LEN];
+
+			snprintf(name, sizeof(name), "MEM-RD-S%d-CH%d", sockets[s], c);
+			ev_rd[s][c] = pmu_sched_add_box(&sched, name, rd->pmu, sockets[s], c,
+			                                rd->spec, rd->scale);
+			snprintf(name, sizeof(name), "MEM-WR-S%d-CH%d", sockets[s], c);
+			ev_wr[s][c] = pmu_sched_add_box(&sched, name, wr->pmu, sockets[s], c,
+			                                wr->spec, wr->scale);
+			if (ev_rd[s][c] < 0 || ev_wr[s][c] < 0)
+				return 1;
+		}
+	}
+	pmu_sched_build(&sched);
+	fprintf(stderr, "%d sockets x %d channels, %d groups (%s backend)\n",
+	        nsockets, nch, sched.ngroups, be->name);
+
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+
+	if (pmu_sched_run(&sched, duration, &stop)) {
+		printf("Could not start the counters!\n");
+		return 1;
+	}
+	seconds = sched.t_total / 1e9;
+	if (seconds <= 0)
+		seconds = 1;
+
+	if (outfile) {
+		out = fopen(outfile, "w");
+		if (!out) {
+			perror(outfile);
+			return 1;
+		}
+	}
+
+	for (s = 0; s < nsockets; s++) {
+		double s_rd = 0, s_wr = 0;
+
+		for (c = 0; c < nch; c++) {
+			double r = estimate(&sched, ev_rd[s][c]), w = estimate(&sched, ev_wr[s][c]);
+
+			s_rd += r;
+			s_wr += w;
+			fprintf(out, "RESULT-MEM-RD-BW-S%d-CH%d %f\n", sockets[s], c, r / seconds);
+			fprintf(out, "RESULT-MEM-WR-BW-S%d-CH%d %f\n", sockets[s], c, w / seconds);
+		}
+		fprintf(out, "RESULT-MEM-RD-BW-S%d %f\n", sockets[s], s_rd / seconds);
+		fprintf(out, "RESULT-MEM-WR-BW-S%d %f\n", sockets[s], s_wr / seconds);
+		tot_rd += s_rd;
+		tot_wr += s_wr;
+	}
+	fprintf(out, "RESULT-MEM-RD-SUM %.0f\n", tot_rd);
+	fprintf(out, "RESULT-MEM-WR-SUM %.0f\n", tot_wr);
+	fprintf(out, "RESULT-MEM-RD-BW %f\n", tot_rd / seconds);
+	fprintf(out, "RESULT-MEM-WR-BW %f\n", tot_wr / seconds);
+
+	if (out != stdout)
+		fclose(out);
+	pmu_sched_close(&sched);
+	be->destroy(be);
+	return 0;
+}
@@ -0,0 +1,190 @@
+/*
+ * Measuring more uncore events than available counters
+ *
+ * Copyright (c) 2020, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+// Compile command: gcc -O2 ddio-pmu.c pmu.c -o ddio-pmu -lm
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include "pmu.h"
+
+static volatile sig_atomic_t stop;
+
+static void
+on_signal(int sig)
+{
+	(void)sig;
+	stop = 1;
+}
+
+/*
+ * -e accepts a preset (ItoM-HIT), a preset family (ItoM -> ItoM-HIT and ItoM-MISS)
+ * or a raw event written as name:pmu:spec, e.g.,
+ * "MyEvent:uncore_cha:event=0x35,umask=0x14,filter_opc0=0x21e"
+ */
+static int
+add_event(struct pmu_sched *s, const char *arg)
+{
+	const struct pmu_preset *p;
+	char name[PMU_NAME_LEN], pmu[PMU_NAME_LEN];
+	size_t len = strlen(arg);
+	int found = 0;
+	const char *c1, *c2;
+
+	if (pmu_preset_find(arg))
+		return pmu_sched_add_preset(s, arg) < 0 ? -1 : 0;
+
+	c1 = strchr(arg, ':');
+	c2 = c1 ? strchr(c1 + 1, ':') : NULL;
+	if (c2) {
+		snprintf(name, sizeof(name), "%.*s", (int)(c1 - arg), arg);
+		snprintf(pmu, sizeof(pmu), "%.*s", (int)(c2 - c1 - 1), c1 + 1);
+		return pmu_sched_add(s, name, pmu, c2 + 1, 1) < 0 ? -1 : 0;
+	}
+
+	for (p = pmu_presets(); p->name; p++) {
+		if (!strncmp(p->name, arg, len) && p->name[len] == '-') {
+			if (pmu_sched_add_preset(s, p->name) < 0)
+				return -1;
+			found = 1;
+		}
+	}
+	if (!found) {
+		fprintf(stderr, "Unknown event '%s' (try -l)\n", arg);
+		return -1;
+	}
+	return 0;
+}
+
+static void
+usage(const char *prog)
+{
+	printf("Usage: %s [options]\n", prog);
+	printf("\nOptions:\n");
+	printf("  -e event    : Event to measure (repeatable, default: all presets)\n");
+	printf("  -s socket   : CPU socket to measure (default: 0)\n");
+	printf("  -i ms       : Rotation interval in milliseconds (default: 10)\n");
+	printf("  -t seconds  : Measurement duration (default: until SIGINT/SIGTERM)\n");
+	printf("  -c counters : General-purpose counters per box (default: 4)\n");
+	printf("  -r path     : sysfs event_source directory (default: %s)\n", PMU_SYSFS_ROOT);
+	printf("  -o file     : Write results to file instead of stdout\n");
+	printf("  -m          : Use the mock backend (no hardware access)\n");
+	printf("  -l          : List predefined events\n");
+	printf("\nExample:\n");
+	printf("  %s -e ItoM -e PCIeRdCur -e RFO -e WiL -e PCIeItoM -e MEM -i 5 -o test.log\n", prog);
+}
+
+int main(int argc, char *argv[])
+{
+	struct pmu_sched sched;
+	struct pmu_backend *be;
+	const char *sysfs_root = NULL, *outfile = NULL;
+	const char *events[PMU_MAX_EVENTS];
+	int nevents = 0, socket = 0, counters = 4, mock = 0, opt, i;
+	unsigned int interval_ms = 10;
+	double duration = 0;
+	FILE *out = stdout;
+
+	while ((opt = getopt(argc, argv, "e:s:i:t:c:r:o:mlh")) != -1) {
+		switch (opt) {
+		case 'e':
+			if (nevents < PMU_MAX_EVENTS)
+				events[nevents++] = optarg;
+			break;
+		case 's':
+			socket = atoi(optarg);
+			break;
+		case 'i':
+			interval_ms = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			duration = atof(optarg);
+			break;
+		case 'c':
+			counters = atoi(optarg);
+			break;
+		case 'r':
+			sysfs_root = optarg;
+			break;
+		case 'o':
+			outfile = optarg;
+			break;
+		case 'm':
+			mock = 1;
+			break;
+		case 'l':
+			for (const struct pmu_preset *p = pmu_presets(); p->name; p++)
+				printf("%-16s %-12s %s\n", p->name, p->pmu, p->spec);
+			return 0;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	be = mock ? pmu_mock_backend(getpid()) : pmu_perf_backend(sysfs_root);
+	if (!be) {
+		printf("Could not create the %s backend!\n", mock ? "mock" : "perf");
+		return 1;
+	}
+
+	pmu_sched_init(&sched, be, socket, counters, interval_ms);
+	if (!nevents) {
+		for (const struct pmu_preset *p = pmu_presets(); p->name; p++)
+			if (pmu_sched_add_preset(&sched, p->name) < 0)
+				return 1;
+	}
+	for (i = 0; i < nevents; i++)
+		if (add_event(&sched, events[i]))
+			return 1;
+
+	pmu_sched_build(&sched);
+	fprintf(stderr, "%d events in %d groups, %u ms per group (%s backend)\n",
+	        sched.nev, sched.ngroups, sched.interval_ms, be->name);
+	for (i = 0; i < sched.nev; i++)
+		fprintf(stderr, "  group %d: %s (%s)\n", sched.ev[i].group,
+		        sched.ev[i].name, sched.ev[i].pmu);
+
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+
+	if (pmu_sched_run(&sched, duration, &stop)) {
+		printf("Could not start the counters!\n");
+		return 1;
+	}
+
+	if (outfile) {
+		out = fopen(outfile, "w");
+		if (!out) {
+			perror(outfile);
+			return 1;
+		}
+	}
+
+	for (i = 0; i < sched.nev; i++) {
+		const struct pmu_event *e = &sched.ev[i];
+		double est, err;
+
+		pmu_sched_estimate(&sched, i, &est, &err);
+		fprintf(out, "RESULT-%s-SUM %.0f\n", e->name, est);
+		fprintf(out, "RESULT-%s-ERR %f\n", e->name, est > 0 ? err * 100 / est : 0);
+		fprintf(stderr, "%-16s %16.0f +- %5.2f%% (scheduled %5.1f%% of %.3fs, %u slices)\n",
+		        e->name, est, est > 0 ? err * 100 / est : 0,
+		        sched.t_total ? e->running * 100.0 / sched.t_total : 0,
+		        sched.t_total / 1e9, e->nslices);
+	}
+	pmu_sched_print_rates(&sched, out);
+
+	if (out != stdout)
+		fclose(out);
+	pmu_sched_close(&sched);
+	be->destroy(be);
+	return 0;
+}
@@ -0,0 +1,174 @@
+/*
+ * Mapping PCIe devices to IIO stacks and root ports
+ *
+ * Copyright (c) 2020, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <dirent.h>
+
+#include "iio.h"
+
+/*
+ * Default root buses of uncore_iio_0..3 on Skylake-SP
+ * (CSTACK/DMI, PCIe0, PCIe1, PCIe2). uncore_iio_4/5 are the MCP stacks.
+ */
+static const int skx_root_bus[2][IIO_MAX_STACKS] = {
+	{ 0x00, 0x17, 0x3a, 0x5d, -1, -1, -1, -1 },
+	{ 0x80, 0x85, 0xae, 0xd7, -1, -1, -1, -1 },
+};
+
+int
+iio_stacks(const char *pmu_root, int socket, struct iio_stack *st, int max)
+{
+	char path[512], buf[64];
+	int box, n = 0, from_sysfs = 0;
+
+	for (box = 0; box < IIO_MAX_STACKS && n < max; box++) {
+		unsigned int domain, bus;
+		FILE *f;
+
+		snprintf(path, sizeof(path), "%s/uncore_iio_%d/die%d", pmu_root, box, socket);
+		f = fopen(path, "r");
+		if (!f)
+			continue;
+		if (fgets(buf, sizeof(buf), f) && sscanf(buf, "%x:%x", &domain, &bus) == 2) {
+			st[n].box = box;
+			st[n].domain = domain;
+			st[n].root_bus = bus;
+			n++;
+			from_sysfs = 1;
+		}
+		fclose(f);
+	}
+	if (from_sysfs)
+		return n;
+
+	if (socket < 0 || socket > 1)
+		return 0;
+	for (box = 0; box < IIO_MAX_STACKS && n < max; box++) {
+		if (skx_root_bus[socket][box] < 0)
+			continue;
+		st[n].box = box;
+		st[n].domain = 0;
+		st[n].root_bus = skx_root_bus[socket][box];
+		n++;
+	}
+	return n;
+}
+
+static int
+parse_bdf(const char *bdf, int *domain, int *bus, int *dev, int *fn)
+{
+	unsigned int d, b, s, f;
+
+	if (sscanf(bdf, "%x:%x:%x.%x", &d, &b, &s, &f) == 4) {
+		*domain = d;
+	} else if (sscanf(bdf, "%x:%x.%x", &b, &s, &f) == 3) {
+		*domain = 0;
+	} else {
+		return -1;
+	}
+	*bus = b;
+	*dev = s;
+	*fn = f;
+	return 0;
+}
+
+/*
+ * Returns 1 and the bus window if the entry is a PCI-to-PCI bridge.
+ * Only the first 64 bytes of the config space are needed, which sysfs
+ * exposes without privileges.
+ */
+static int
+read_bridge(const char *pci_root, const char *name, int *secondary, int *subordinate)
+{
+	char path[512];
+	uint8_t cfg[64];
+	FILE *f;
+
+	snprintf(path, sizeof(path), "%s/%s/config", pci_root, name);
+	f = fopen(path, "rb");
+	if (!f)
+		return 0;
+	if (fread(cfg, 1, sizeof(cfg), f) != sizeof(cfg)) {
+		fclose(f);
+		return 0;
+	}
+	fclose(f);
+	if ((cfg[0x0e] & 0x7f) != 1)
+		return 0;
+	*secondary = cfg[0x19];
+	*subordinate = cfg[0x1a];
+	return 1;
+}
+
+/*
+ * Among the bridges whose bus window covers the device, the one with the
+ * lowest bus number is the root port. find_ddio_device() in change-ddio.c
+ * also requires the subordinate bus to be the device's, so behind a switch
+ * it may stop at a port of the switch instead.
+ */
+int
+iio_resolve(const char *pci_root, const char *bdf, const struct iio_stack *st,
+            int nstacks, struct iio_dev *d)
+{
+	struct dirent *de;
+	DIR *dir;
+	int i, lowest = 0x100;
+
+	memset(d, 0, sizeof(*d));
+	if (parse_bdf(bdf, &d->domain, &d->bus, &d->dev, &d->fn)) {
+		fprintf(stderr, "Bad PCIe address '%s'\n", bdf);
+		return -1;
+	}
+	d->rp_bus = d->bus;
+	d->rp_dev = d->dev;
+	d->rp_fn = d->fn;
+	d->stack = -1;
+	d->port = -1;
+
+	dir = opendir(pci_root);
+	if (!dir) {
+		perror(pci_root);
+		return -1;
+	}
+	while ((de = readdir(dir))) {
+		int domain, bus, dev, fn, sec, sub;
+
+		if (parse_bdf(de->d_name, &domain, &bus, &dev, &fn))
+			continue;
+		if (domain != d->domain || bus >= d->bus)
+			continue;
+		if (!read_bridge(pci_root, de->d_name, &sec, &sub))
+			continue;
+		if (sec <= d->bus && sub >= d->bus && bus < lowest) {
+			lowest = bus;
+			d->rp_bus = bus;
+			d->rp_dev = dev;
+			d->rp_fn = fn;
+		}
+	}
+	closedir(dir);
+
+	for (i = 0; i < nstacks; i++) {
+		if (st[i].domain == d->domain && st[i].root_bus == d->rp_bus) {
+			d->stack = i;
+			break;
+		}
+	}
+	/* Root ports A-D of a stack are devices 0-3 on its root bus */
+	if (lowest < 0x100 && d->rp_dev < IIO_MAX_PORTS)
+		d->port = d->rp_dev;
+
+	if (d->stack < 0) {
+		fprintf(stderr, "%s: root bus %02x is not an IIO stack of this socket\n",
+		        bdf, d->rp_bus);
+		return -1;
+	}
+	return 0;
+}
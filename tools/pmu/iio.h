@@ -0,0 +1,50 @@
+/*
+ * Mapping PCIe devices to IIO stacks and root ports
+ *
+ * Copyright (c) 2020, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#ifndef DDIO_IIO_H
+#define DDIO_IIO_H
+
+#define IIO_MAX_STACKS	8
+#define IIO_MAX_PORTS	4
+#define IIO_PCI_ROOT	"/sys/bus/pci/devices"
+
+/*
+ * DATA_REQ_OF_CPU counts inbound (device -> CPU) data in 4-byte units.
+ * ch_mask selects the root port(s) of the stack, fc_mask all flow classes.
+ */
+#define IIO_IB_WRITE	"event=0x83,umask=0x01,fc_mask=0x07"
+#define IIO_IB_READ	"event=0x83,umask=0x04,fc_mask=0x07"
+#define IIO_BYTES_PER_COUNT	4
+
+struct iio_stack {
+	int box;		/* uncore_iio_<box> */
+	int domain;
+	int root_bus;
+};
+
+struct iio_dev {
+	char label[32];
+	int domain, bus, dev, fn;
+	/* Root port: the lowest bridge whose bus window covers the device */
+	int rp_bus, rp_dev, rp_fn;
+	int stack;		/* index in the stack table, -1 if unknown */
+	int port;		/* ch_mask bit, -1 for the whole stack */
+};
+
+/*
+ * Fill the stack table of a socket. Uses <pmu_root>/uncore_iio_<n>/die<socket>
+ * when the kernel exposes it, otherwise the default Skylake-SP bus layout.
+ */
+int iio_stacks(const char *pmu_root, int socket, struct iio_stack *st, int max);
+
+/*
+ * Resolve the root port of a device ("[dddd:]bb:dd.f") from the bridge windows
+ * in <pci_root>/<bdf>/config and attach it to one of the stacks.
+ */
+int iio_resolve(const char *pci_root, const char *bdf, const struct iio_stack *st,
+                int nstacks, struct iio_dev *d);
+
+#endif /* DDIO_IIO_H */
@@ -0,0 +1,940 @@
+/*
+ * Uncore PMU access and counter multiplexing
+ *
+ * Copyright (c) 2020, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "pmu.h"
+
+uint64_t
+pmu_now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/*
+ * Event encoding
+ *
+ * The kernel describes every field of an uncore event in
+ * <sysfs>/<pmu>_<box>/format/<field>, e.g., "config1:41-50".
+ * The table below is the Skylake-SP layout and is only used when
+ * the format files are not available.
+ */
+
+struct pmu_format {
+	const char *field;
+	const char *layout;
+};
+
+static const struct pmu_format skx_formats[] = {
+	{ "event",		"config:0-7" },
+	{ "umask",		"config:8-15" },
+	{ "edge",		"config:18" },
+	{ "tid_en",		"config:19" },
+	{ "inv",		"config:23" },
+	{ "thresh",		"config:24-31" },
+	{ "thresh8",		"config:24-31" },
+	{ "ch_mask",		"config:36-43" },
+	{ "fc_mask",		"config:44-46" },
+	{ "filter_tid",		"config1:0-8" },
+	{ "filter_state",	"config1:17-26" },
+	{ "filter_rem",		"config1:32" },
+	{ "filter_loc",		"config1:33" },
+	{ "filter_all_op",	"config1:35" },
+	{ "filter_nm",		"config1:36" },
+	{ "filter_not_nm",	"config1:37" },
+	{ "filter_opc0",	"config1:41-50" },
+	{ "filter_nc",		"config1:62" },
+	{ "filter_isoc",	"config1:63" },
+	{ NULL, NULL }
+};
+
+static int
+read_sysfs_line(const char *path, char *buf, size_t len)
+{
+	FILE *f = fopen(path, "r");
+	if (!f)
+		return -1;
+	if (!fgets(buf, len, f)) {
+		fclose(f);
+		return -1;
+	}
+	fclose(f);
+	buf[strcspn(buf, "\n")] = '\0';
+	return 0;
+}
+
+static const char *
+lookup_format(const char *sysfs_root, const char *pmu, const char *field,
+              char *buf, size_t len)
+{
+	char path[512];
+	int i;
+
+	if (sysfs_root) {
+		snprintf(path, sizeof(path), "%s/%s_0/format/%s", sysfs_root, pmu, field);
+		if (!read_sysfs_line(path, buf, len))
+			return buf;
+		snprintf(path, sizeof(path), "%s/%s/format/%s", sysfs_root, pmu, field);
+		if (!read_sysfs_line(path, buf, len))
+			return buf;
+	}
+	for (i = 0; skx_formats[i].field; i++)
+		if (!strcmp(skx_formats[i].field, field))
+			return skx_formats[i].layout;
+	return NULL;
+}
+
+/*
+ * Scatter value into the bit ranges of a layout such as "config:0-7,32-35".
+ */
+static int
+apply_format(const char *layout, uint64_t value, struct pmu_config *cfg)
+{
+	uint64_t *word;
+	const char *p;
+	int lo, hi, n;
+
+	if (!strncmp(layout, "config1:", 8)) {
+		word = &cfg->config1;
+		p = layout + 8;
+	} else if (!strncmp(layout, "config2:", 8)) {
+		word = &cfg->config2;
+		p = layout + 8;
+	} else if (!strncmp(layout, "config:", 7)) {
+		word = &cfg->config;
+		p = layout + 7;
+	} else {
+		return -1;
+	}
+
+	while (*p) {
+		if (sscanf(p, "%d-%d%n", &lo, &hi, &n) == 2) {
+			p += n;
+		} else if (sscanf(p, "%d%n", &lo, &n) == 1) {
+			hi = lo;
+			p += n;
+		} else {
+			return -1;
+		}
+		if (lo < 0 || hi > 63 || hi < lo)
+			return -1;
+		int width = hi - lo + 1;
+		uint64_t mask = width == 64 ? ~0ull : ((1ull << width) - 1);
+		*word |= (value & mask) << lo;
+		value = width == 64 ? 0 : value >> width;
+		if (*p == ',')
+			p++;
+	}
+	return 0;
+}
+
+int
+pmu_encode(const char *sysfs_root, const char *pmu, const char *spec,
+           struct pmu_config *cfg)
+{
+	char copy[PMU_SPEC_LEN], buf[128];
+	char *tok, *save;
+
+	memset(cfg, 0, sizeof(*cfg));
+	snprintf(copy, sizeof(copy), "%s", spec);
+
+	for (tok = strtok_r(copy, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+		char *eq = strchr(tok, '=');
+		uint64_t value = 1;
+		const char *layout;
+
+		if (eq) {
+			*eq = '\0';
+			value = strtoull(eq + 1, NULL, 0);
+		}
+		layout = lookup_format(sysfs_root, pmu, tok, buf, sizeof(buf));
+		if (!layout) {
+			fprintf(stderr, "Unknown field '%s' for %s\n", tok, pmu);
+			return -1;
+		}
+		if (apply_format(layout, value, cfg)) {
+			fprintf(stderr, "Bad format '%s' for %s/%s\n", layout, pmu, tok);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Predefined events (Skylake-SP)
+ *
+ * TOR_INSERTS (0x35) with umask IO_HIT (0x14) / IO_MISS (0x24) counts the
+ * requests coming from the IIO, filtered by the opcode in filter_opc0.
+ * These are the same opcodes pcm-pcie uses on this generation.
+ * CAS_COUNT (0x04) counts 64-byte DRAM transfers per channel.
+ */
+
+#define TOR_IO(umask, opc) \
+	"event=0x35,umask=" umask ",filter_opc0=" opc \
+	",filter_loc=1,filter_rem=1,filter_nm=1,filter_not_nm=1"
+
+static const struct pmu_preset presets[] = {
+	{ "PCIeRdCur-HIT",	"uncore_cha", TOR_IO("0x14", "0x21e"), 1 },
+	{ "PCIeRdCur-MISS",	"uncore_cha", TOR_IO("0x24", "0x21e"), 1 },
+	{ "ItoM-HIT",		"uncore_cha", TOR_IO("0x14", "0x248"), 1 },
+	{ "ItoM-MISS",		"uncore_cha", TOR_IO("0x24", "0x248"), 1 },
+	{ "RFO-HIT",		"uncore_cha", TOR_IO("0x14", "0x200"), 1 },
+	{ "RFO-MISS",		"uncore_cha", TOR_IO("0x24", "0x200"), 1 },
+	{ "WiL-HIT",		"uncore_cha", TOR_IO("0x14", "0x20f"), 1 },
+	{ "WiL-MISS",		"uncore_cha", TOR_IO("0x24", "0x20f"), 1 },
+	/* ItoMCacheNear: partial-line inbound writes */
+	{ "PCIeItoM-HIT",	"uncore_cha", TOR_IO("0x14", "0x26d"), 1 },
+	{ "PCIeItoM-MISS",	"uncore_cha", TOR_IO("0x24", "0x26d"), 1 },
+	{ "MEM-RD",		"uncore_imc", "event=0x04,umask=0x03", 64 },
+	{ "MEM-WR",		"uncore_imc", "event=0x04,umask=0x0c", 64 },
+	{ NULL, NULL, NULL, 0 }
+};
+
+const struct pmu_preset *
+pmu_presets(void)
+{
+	return presets;
+}
+
+const struct pmu_preset *
+pmu_preset_find(const char *name)
+{
+	int i;
+	for (i = 0; presets[i].name; i++)
+		if (!strcmp(presets[i].name, name))
+			return &presets[i];
+	return NULL;
+}
+
+/*
+ * perf_event_open(2) backend
+ */
+
+#define PERF_MAX_HANDLES	(PMU_MAX_EVENTS * PMU_MAX_BOXES)
+
+struct perf_priv {
+	int fd[PERF_MAX_HANDLES];
+	int n;
+};
+
+static int
+perf_nboxes(struct pmu_backend *be, const char *pmu)
+{
+	char path[512], buf[64];
+	int n;
+
+	for (n = 0; n < PMU_MAX_BOXES; n++) {
+		snprintf(path, sizeof(path), "%s/%s_%d/type", be->sysfs_root, pmu, n);
+		if (read_sysfs_line(path, buf, sizeof(buf)))
+			break;
+	}
+	if (n == 0) {
+		snprintf(path, sizeof(path), "%s/%s/type", be->sysfs_root, pmu);
+		if (!read_sysfs_line(path, buf, sizeof(buf)))
+			n = 1;
+	}
+	return n;
+}
+
+/*
+ * Uncore PMUs expose one CPU per socket in their cpumask, in socket order.
+ */
+static int
+perf_socket_cpu(const char *dir, int socket)
+{
+	char path[600], buf[256];
+	char *p = buf;
+	int idx = 0;
+
+	snprintf(path, sizeof(path), "%s/cpumask", dir);
+	if (read_sysfs_line(path, buf, sizeof(buf)))
+		return socket ? -1 : 0;
+
+	while (*p) {
+		int lo, hi, n;
+		if (sscanf(p, "%d-%d%n", &lo, &hi, &n) != 2) {
+			if (sscanf(p, "%d%n", &lo, &n) != 1)
+				break;
+			hi = lo;
+		}
+		if (socket - idx <= hi - lo)
+			return lo + (socket - idx);
+		idx += hi - lo + 1;
+		p += n;
+		if (*p == ',')
+			p++;
+	}
+	return -1;
+}
+
+static int
+perf_open(struct pmu_backend *be, const char *pmu, int box, int socket,
+          const struct pmu_config *cfg)
+{
+	struct perf_priv *pp = be->priv;
+	struct perf_event_attr attr;
+	char dir[512], path[600], buf[64];
+	int cpu, fd;
+
+	if (pp->n == PERF_MAX_HANDLES)
+		return -1;
+
+	snprintf(dir, sizeof(dir), "%s/%s_%d", be->sysfs_root, pmu, box);
+	snprintf(path, sizeof(path), "%s/type", dir);
+	if (read_sysfs_line(path, buf, sizeof(buf))) {
+		snprintf(dir, sizeof(dir), "%s/%s", be->sysfs_root, pmu);
+		snprintf(path, sizeof(path), "%s/type", dir);
+		if (read_sysfs_line(path, buf, sizeof(buf)))
+			return -1;
+	}
+
+	cpu = perf_socket_cpu(dir, socket);
+	if (cpu < 0)
+		return -1;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = strtoul(buf, NULL, 0);
+	attr.config = cfg->config;
+	attr.config1 = cfg->config1;
+	attr.config2 = cfg->config2;
+	attr.disabled = 1;
+	attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+	fd = syscall(__NR_perf_event_open, &attr, -1, cpu, -1, 0);
+	if (fd < 0) {
+		perror("perf_event_open");
+		return -1;
+	}
+	pp->fd[pp->n] = fd;
+	return pp->n++;
+}
+
+static int
+perf_enable(struct pmu_backend *be, int h)
+{
+	struct perf_priv *pp = be->priv;
+	return ioctl(pp->fd[h], PERF_EVENT_IOC_ENABLE, 0);
+}
+
+static int
+perf_disable(struct pmu_backend *be, int h)
+{
+	struct perf_priv *pp = be->priv;
+	return ioctl(pp->fd[h], PERF_EVENT_IOC_DISABLE, 0);
+}
+
+static int
+perf_read(struct pmu_backend *be, int h, struct pmu_reading *r)
+{
+	struct perf_priv *pp = be->priv;
+	uint64_t buf[3];
+
+	if (read(pp->fd[h], buf, sizeof(buf)) != sizeof(buf))
+		return -1;
+	r->value = buf[0];
+	r->time_enabled = buf[1];
+	r->time_running = buf[2];
+	return 0;
+}
+
+static void
+perf_close(struct pmu_backend *be, int h)
+{
+	struct perf_priv *pp = be->priv;
+	if (pp->fd[h] >= 0)
+		close(pp->fd[h]);
+	pp->fd[h] = -1;
+}
+
+static void
+perf_destroy(struct pmu_backend *be)
+{
+	free(be->priv);
+	free(be);
+}
+
+struct pmu_backend *
+pmu_perf_backend(const char *sysfs_root)
+{
+	struct pmu_backend *be = calloc(1, sizeof(*be));
+	struct perf_priv *pp = calloc(1, sizeof(*pp));
+
+	if (!be || !pp) {
+		free(be);
+		free(pp);
+		return NULL;
+	}
+	be->name = "perf";
+	be->nboxes = perf_nboxes;
+	be->open = perf_open;
+	be->enable = perf_enable;
+	be->disable = perf_disable;
+	be->read = perf_read;
+	be->close = perf_close;
+	be->destroy = perf_destroy;
+	be->sysfs_root = sysfs_root ? sysfs_root : PMU_SYSFS_ROOT;
+	be->priv = pp;
+	return be;
+}
+
+/*
+ * Mock backend
+ *
+ * Every handle counts at a pseudo-random base rate that is modulated
+ * by a slow sine wave, so that multiplexed estimates carry a real
+ * (and checkable) error. No hardware or privileges are needed.
+ */
+
+struct mock_counter {
+	double base;		/* events per ns */
+	double period;		/* ns */
+	double value;
+	uint64_t running;
+	uint64_t since;
+	int enabled;
+};
+
+struct mock_priv {
+	struct mock_counter c[PERF_MAX_HANDLES];
+	int n;
+	unsigned int seed;
+	uint64_t t0;
+};
+
+static uint64_t
+mix64(uint64_t x)
+{
+	x ^= x >> 33;
+	x *= 0xff51afd7ed558ccdull;
+	x ^= x >> 33;
+	x *= 0xc4ceb9fe1a85ec53ull;
+	x ^= x >> 33;
+	return x;
+}
+
+static int
+mock_nboxes(struct pmu_backend *be, const char *pmu)
+{
+	(void)be;
+	if (!strcmp(pmu, "uncore_cha"))
+		return 18;
+	if (!strcmp(pmu, "uncore_iio") || !strcmp(pmu, "uncore_imc"))
+		return 6;
+	return 1;
+}
+
+static int
+mock_open(struct pmu_backend *be, const char *pmu, int box, int socket,
+          const struct pmu_config *cfg)
+{
+	struct mock_priv *mp = be->priv;
+	struct mock_counter *c;
+	uint64_t h;
+	const char *p;
+
+	if (mp->n == PERF_MAX_HANDLES)
+		return -1;
+
+	h = mix64(cfg->config ^ mix64(cfg->config1) ^ ((uint64_t)box << 48) ^
+	          ((uint64_t)socket << 56) ^ mp->seed);
+	for (p = pmu; *p; p++)
+		h = mix64(h ^ (uint8_t)*p);
+
+	c = &mp->c[mp->n];
+	memset(c, 0, sizeof(*c));
+	/* 1M..100M events/s per box */
+	c->base = 1e-3 * pow(100.0, (double)(h & 0xffff) / 0xffff);
+	c->period = 2e8 + (double)((h >> 16) & 0xffff) * 1e4;
+	return mp->n++;
+}
+
+/* Integral of base * (1 + 0.3 sin(2 pi t / period)) over [a, b] */
+static double
+mock_integral(const struct mock_counter *c, double a, double b)
+{
+	double w = 2 * M_PI / c->period;
+	return c->base * ((b - a) + 0.3 / w * (cos(w * a) - cos(w * b)));
+}
+
+static void
+mock_sync(struct mock_priv *mp, struct mock_counter *c, uint64_t now)
+{
+	if (c->enabled) {
+		c->value += mock_integral(c, c->since - mp->t0, now - mp->t0);
+		c->running += now - c->since;
+		c->since = now;
+	}
+}
+
+static int
+mock_enable(struct pmu_backend *be, int h)
+{
+	struct mock_priv *mp = be->priv;
+	struct mock_counter *c = &mp->c[h];
+
+	if (!c->enabled) {
+		c->enabled = 1;
+		c->since = pmu_now_ns();
+	}
+	return 0;
+}
+
+static int
+mock_disable(struct pmu_backend *be, int h)
+{
+	struct mock_priv *mp = be->priv;
+	struct mock_counter *c = &mp->c[h];
+
+	mock_sync(mp, c, pmu_now_ns());
+	c->enabled = 0;
+	return 0;
+}
+
+static int
+mock_read(struct pmu_backend *be, int h, struct pmu_reading *r)
+{
+	struct mock_priv *mp = be->priv;
+	struct mock_counter *c = &mp->c[h];
+
+	mock_sync(mp, c, pmu_now_ns());
+	r->value = (uint64_t)c->value;
+	r->time_enabled = c->running;
+	r->time_running = c->running;
+	return 0;
+}
+
+static void
+mock_close(struct pmu_backend *be, int h)
+{
+	(void)be;
+	(void)h;
+}
+
+static void
+mock_destroy(struct pmu_backend *be)
+{
+	free(be->priv);
+	free(be);
+}
+
+struct pmu_backend *
+pmu_mock_backend(unsigned int seed)
+{
+	struct pmu_backend *be = calloc(1, sizeof(*be));
+	struct mock_priv *mp = calloc(1, sizeof(*mp));
+
+	if (!be || !mp) {
+		free(be);
+		free(mp);
+		return NULL;
+	}
+	mp->seed = seed;
+	mp->t0 = pmu_now_ns();
+	be->name = "mock";
+	be->nboxes = mock_nboxes;
+	be->open = mock_open;
+	be->enable = mock_enable;
+	be->disable = mock_disable;
+	be->read = mock_read;
+	be->close = mock_close;
+	be->destroy = mock_destroy;
+	be->sysfs_root = NULL;
+	be->priv = mp;
+	return be;
+}
+
+/*
+ * Scheduler
+ *
+ * Events are packed into groups, separately for every PMU type, so that
+ * a group never uses more than `counters` counters per box and never
+ * mixes two different filter (config1) values. In slice k, every type
+ * enables its group k mod (its number of groups), and slices last
+ * interval_ms; each event's count is extrapolated to the whole run
+ * with the ratio of wall time to the time it was actually scheduled.
+ */
+
+void
+pmu_sched_init(struct pmu_sched *s, struct pmu_backend *be, int socket,
+               int counters, unsigned int interval_ms)
+{
+	memset(s, 0, sizeof(*s));
+	s->be = be;
+	s->socket = socket;
+	s->counters = counters > 0 ? counters : 4;
+	s->interval_ms = interval_ms > 0 ? interval_ms : 10;
+}
+
+int
+pmu_sched_add(struct pmu_sched *s, const char *name, const char *pmu,
+              const char *spec, double scale)
+{
+	return pmu_sched_add_box(s, name, pmu, -1, -1, spec, scale);
+}
+
+int
+pmu_sched_add_box(struct pmu_sched *s, const char *name, const char *pmu,
+                  int socket, int box, const char *spec, double scale)
+{
+	struct pmu_event *e;
+
+	if (s->nev == PMU_MAX_EVENTS) {
+		fprintf(stderr, "Too many events (max %d)\n", PMU_MAX_EVENTS);
+		return -1;
+	}
+	e = &s->ev[s->nev];
+	memset(e, 0, sizeof(*e));
+	snprintf(e->name, sizeof(e->name), "%s", name);
+	snprintf(e->pmu, sizeof(e->pmu), "%s", pmu);
+	e->scale = scale > 0 ? scale : 1;
+	e->group = -1;
+	e->box = box;
+	e->socket = socket;
+	if (pmu_encode(s->be->sysfs_root, pmu, spec, &e->cfg))
+		return -1;
+	return s->nev++;
+}
+
+int
+pmu_sched_add_preset(struct pmu_sched *s, const char *name)
+{
+	const struct pmu_preset *p = pmu_preset_find(name);
+
+	if (!p) {
+		fprintf(stderr, "Unknown event '%s'\n", name);
+		return -1;
+	}
+	return pmu_sched_add(s, p->name, p->pmu, p->spec, p->scale);
+}
+
+static int
+group_fits(const struct pmu_sched *s, int g, const struct pmu_event *e)
+{
+	int i, used = 0;
+
+	for (i = 0; i < s->nev; i++) {
+		const struct pmu_event *o = &s->ev[i];
+		if (o->group != g || strcmp(o->pmu, e->pmu))
+			continue;
+		/* Events pinned to different boxes use different counters */
+		if (o->box >= 0 && e->box >= 0 && o->box != e->box)
+			continue;
+		if (o->socket >= 0 && e->socket >= 0 && o->socket != e->socket)
+			continue;
+		if (o->cfg.config1 && e->cfg.config1 && o->cfg.config1 != e->cfg.config1)
+			return 0;
+		used++;
+	}
+	return used < s->counters;
+}
+
+static int
+gcd(int a, int b)
+{
+	while (b) {
+		int t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+int
+pmu_sched_build(struct pmu_sched *s)
+{
+	int i, j, g;
+
+	s->ngroups = 0;
+	s->period = 1;
+	for (i = 0; i < s->nev; i++)
+		s->ev[i].group = -1;
+
+	for (i = 0; i < s->nev; i++) {
+		struct pmu_event *e = &s->ev[i];
+
+		for (g = 0; !group_fits(s, g, e); g++)
+			;
+		e->group = g;
+		if (g + 1 > s->ngroups)
+			s->ngroups = g + 1;
+	}
+	for (i = 0; i < s->nev; i++) {
+		struct pmu_event *e = &s->ev[i];
+
+		e->ngroups = 0;
+		for (j = 0; j < s->nev; j++)
+			if (!strcmp(s->ev[j].pmu, e->pmu) && s->ev[j].group >= e->ngroups)
+				e->ngroups = s->ev[j].group + 1;
+		s->period = s->period / gcd(s->period, e->ngroups) * e->ngroups;
+	}
+	return s->ngroups;
+}
+
+static int
+scheduled(const struct pmu_event *e, int slice)
+{
+	return e->group == slice % e->ngroups;
+}
+
+static int
+event_set(struct pmu_sched *s, struct pmu_event *e, int enable)
+{
+	int b, ret = 0;
+
+	for (b = 0; b < e->nboxes; b++)
+		ret |= enable ? s->be->enable(s->be, e->h[b])
+		              : s->be->disable(s->be, e->h[b]);
+	return ret;
+}
+
+/*
+ * Account the slice that just ended for an event scheduled in it.
+ * Perf's own time_enabled/time_running ratio is applied per box, in
+ * case the kernel multiplexed the counters on top of us.
+ */
+static void
+event_collect(struct pmu_sched *s, struct pmu_event *e, uint64_t now)
+{
+	uint64_t slice_ns = now - e->t_on;
+	double sum = 0;
+	int b;
+
+	for (b = 0; b < e->nboxes; b++) {
+		struct pmu_reading r;
+		uint64_t dv;
+
+		if (s->be->read(s->be, e->h[b], &r))
+			continue;
+		dv = r.value - e->last[b];
+		e->last[b] = r.value;
+		if (r.time_running && r.time_running < r.time_enabled)
+			sum += (double)dv * r.time_enabled / r.time_running;
+		else
+			sum += dv;
+	}
+	e->count += (uint64_t)sum;
+	e->running += slice_ns;
+	e->t_on = now;
+	if (slice_ns) {
+		double rate = sum / slice_ns;
+		e->rate_sum += rate;
+		e->rate_sum2 += rate * rate;
+		e->nslices++;
+	}
+}
+
+int
+pmu_sched_start(struct pmu_sched *s)
+{
+	int i, b;
+
+	if (!s->period)
+		pmu_sched_build(s);
+
+	for (i = 0; i < s->nev; i++) {
+		struct pmu_event *e = &s->ev[i];
+
+		e->nboxes = s->be->nboxes(s->be, e->pmu);
+		if (e->nboxes <= 0 || e->box >= e->nboxes) {
+			fprintf(stderr, "No %s boxes found\n", e->pmu);
+			return -1;
+		}
+		if (e->box >= 0)
+			e->nboxes = 1;
+		for (b = 0; b < e->nboxes; b++) {
+			int box = e->box >= 0 ? e->box : b;
+
+			e->h[b] = s->be->open(s->be, e->pmu, box,
+			                      e->socket >= 0 ? e->socket : s->socket, &e->cfg);
+			if (e->h[b] < 0) {
+				fprintf(stderr, "Could not open %s on %s_%d\n", e->name, e->pmu, box);
+				e->nboxes = b;
+				return -1;
+			}
+		}
+	}
+
+	s->cur = 0;
+	s->t_start = pmu_now_ns();
+	for (i = 0; i < s->nev; i++) {
+		struct pmu_event *e = &s->ev[i];
+
+		if (!scheduled(e, s->cur))
+			continue;
+		e->t_on = s->t_start;
+		if (event_set(s, e, 1))
+			return -1;
+	}
+	return 0;
+}
+
+int
+pmu_sched_rotate(struct pmu_sched *s)
+{
+	int i, next = (s->cur + 1) % s->period, ret = 0;
+	uint64_t now;
+
+	/* An event that stays scheduled is never disabled, so it has no gap */
+	for (i = 0; i < s->nev; i++)
+		if (scheduled(&s->ev[i], s->cur) && !scheduled(&s->ev[i], next))
+			event_set(s, &s->ev[i], 0);
+	now = pmu_now_ns();
+	for (i = 0; i < s->nev; i++)
+		if (scheduled(&s->ev[i], s->cur))
+			event_collect(s, &s->ev[i], now);
+	s->t_total = now - s->t_start;
+
+	for (i = 0; i < s->nev; i++) {
+		struct pmu_event *e = &s->ev[i];
+
+		if (!scheduled(e, next) || scheduled(e, s->cur))
+			continue;
+		ret |= event_set(s, e, 1);
+		e->t_on = pmu_now_ns();
+	}
+	s->cur = next;
+	return ret;
+}
+
+int
+pmu_sched_stop(struct pmu_sched *s)
+{
+	uint64_t now;
+	int i;
+
+	for (i = 0; i < s->nev; i++)
+		if (scheduled(&s->ev[i], s->cur))
+			event_set(s, &s->ev[i], 0);
+	now = pmu_now_ns();
+	for (i = 0; i < s->nev; i++)
+		if (scheduled(&s->ev[i], s->cur))
+			event_collect(s, &s->ev[i], now);
+	s->t_total = now - s->t_start;
+	return 0;
+}
+
+int
+pmu_sched_run(struct pmu_sched *s, double duration, volatile sig_atomic_t *stop)
+{
+	struct timespec next;
+
+	if (pmu_sched_start(s))
+		return -1;
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	while (!*stop) {
+		next.tv_nsec += (long)s->interval_ms * 1000000L;
+		while (next.tv_nsec >= 1000000000L) {
+			next.tv_nsec -= 1000000000L;
+			next.tv_sec++;
+		}
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+		if (*stop)
+			break;
+		pmu_sched_rotate(s);
+		if (duration > 0 && s->t_total >= duration * 1e9)
+			break;
+	}
+	return pmu_sched_stop(s);
+}
+
+void
+pmu_sched_close(struct pmu_sched *s)
+{
+	int i, b;
+
+	for (i = 0; i < s->nev; i++)
+		for (b = 0; b < s->ev[i].nboxes; b++)
+			s->be->close(s->be, s->ev[i].h[b]);
+}
+
+/*
+ * The unobserved part of the run is estimated from the mean per-slice
+ * rate, so its standard error is the standard error of that mean times
+ * the unobserved time (finite population correction included).
+ */
+void
+pmu_sched_estimate(const struct pmu_sched *s, int i, double *estimate,
+                   double *error)
+{
+	const struct pmu_event *e = &s->ev[i];
+	double total = s->t_total, f, var, n;
+
+	*estimate = 0;
+	*error = 0;
+	if (!e->running || !total)
+		return;
+
+	f = (double)e->running / total;
+	*estimate = e->count / f * e->scale;
+	if (f >= 1)
+		return;
+
+	n = e->nslices;
+	if (n < 2) {
+		*error = *estimate;
+		return;
+	}
+	var = (e->rate_sum2 - e->rate_sum * e->rate_sum / n) / (n - 1);
+	if (var < 0)
+		var = 0;
+	*error = total * sqrt(var / n) * sqrt(1 - f) * e->scale;
+}
+
+int
+pmu_sched_find(const struct pmu_sched *s, const char *name)
+{
+	int i;
+	for (i = 0; i < s->nev; i++)
+		if (!strcmp(s->ev[i].name, name))
+			return i;
+	return -1;
+}
+
+/*
+ * Print RESULT-<X>-HIT-RATE/MISS-RATE for every <X>-HIT/<X>-MISS pair.
+ */
+void
+pmu_sched_print_rates(const struct pmu_sched *s, FILE *out)
+{
+	int i, j;
+
+	for (i = 0; i < s->nev; i++) {
+		const char *name = s->ev[i].name;
+		size_t len = strlen(name);
+		char miss[PMU_NAME_LEN + 8];
+		double hit, miss_v, err;
+
+		if (len < 4 || strcmp(name + len - 4, "-HIT"))
+			continue;
+		snprintf(miss, sizeof(miss), "%.*s-MISS", (int)(len - 4), name);
+		j = pmu_sched_find(s, miss);
+		if (j < 0)
+			continue;
+
+		pmu_sched_estimate(s, i, &hit, &err);
+		pmu_sched_estimate(s, j, &miss_v, &err);
+		if (hit + miss_v <= 0)
+			continue;
+		fprintf(out, "RESULT-%.*s-HIT-RATE %f\n", (int)(len - 4), name,
+		        hit * 100 / (hit + miss_v));
+		fprintf(out, "RESULT-%.*s-MISS-RATE %f\n", (int)(len - 4), name,
+		        miss_v * 100 / (hit + miss_v));
+	}
+}
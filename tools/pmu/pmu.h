@@ -0,0 +1,157 @@
+/*
+ * Uncore PMU access and counter multiplexing
+ *
+ * Copyright (c) 2020, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#ifndef DDIO_PMU_H
+#define DDIO_PMU_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <signal.h>
+
+#define PMU_MAX_EVENTS	64
+#define PMU_MAX_BOXES	64
+#define PMU_MAX_GROUPS	PMU_MAX_EVENTS
+#define PMU_NAME_LEN	64
+#define PMU_SPEC_LEN	256
+
+#define PMU_SYSFS_ROOT	"/sys/bus/event_source/devices"
+
+/*
+ * Raw encoding of an event, i.e., what ends up in perf_event_attr.
+ * config1 holds the CHA filter (e.g., the TOR opcode), which is a
+ * per-box resource on Skylake-SP: two events can only share a box if
+ * their config1 values are equal.
+ */
+struct pmu_config {
+	uint64_t config;
+	uint64_t config1;
+	uint64_t config2;
+};
+
+struct pmu_reading {
+	uint64_t value;
+	uint64_t time_enabled;	/* ns */
+	uint64_t time_running;	/* ns */
+};
+
+/*
+ * Backend: the thing that actually programs the counters.
+ * Handles are small non-negative integers owned by the backend.
+ */
+struct pmu_backend {
+	const char *name;
+	int  (*nboxes)(struct pmu_backend *be, const char *pmu);
+	int  (*open)(struct pmu_backend *be, const char *pmu, int box, int socket,
+	             const struct pmu_config *cfg);
+	int  (*enable)(struct pmu_backend *be, int h);
+	int  (*disable)(struct pmu_backend *be, int h);
+	int  (*read)(struct pmu_backend *be, int h, struct pmu_reading *r);
+	void (*close)(struct pmu_backend *be, int h);
+	void (*destroy)(struct pmu_backend *be);
+	const char *sysfs_root;
+	void *priv;
+};
+
+struct pmu_backend *pmu_perf_backend(const char *sysfs_root);
+struct pmu_backend *pmu_mock_backend(unsigned int seed);
+
+/*
+ * Encode a perf-style event string (e.g., "event=0x35,umask=0x14,filter_opc0=0x248")
+ * using the format files of the given PMU. Falls back to the Skylake-SP
+ * layout when the format directory does not exist (e.g., with the mock backend).
+ */
+int pmu_encode(const char *sysfs_root, const char *pmu, const char *spec,
+               struct pmu_config *cfg);
+
+/*
+ * Predefined DDIO-related events (see pmu.c). Returns NULL if unknown.
+ */
+struct pmu_preset {
+	const char *name;
+	const char *pmu;
+	const char *spec;
+	double scale;		/* e.g., 64 for CAS counts -> bytes */
+};
+
+const struct pmu_preset *pmu_preset_find(const char *name);
+const struct pmu_preset *pmu_presets(void);
+
+/*
+ * A single logical event, opened on every box of its PMU type
+ * (or on one box/socket only, see pmu_sched_add_box()).
+ */
+struct pmu_event {
+	char name[PMU_NAME_LEN];
+	char pmu[PMU_NAME_LEN];
+	struct pmu_config cfg;
+	double scale;
+	int group;		/* among the groups of its PMU type */
+	int ngroups;		/* of its PMU type */
+	int box;		/* -1: summed over every box of the PMU */
+	int socket;		/* -1: the socket of the scheduler */
+
+	int nboxes;
+	int h[PMU_MAX_BOXES];
+	uint64_t last[PMU_MAX_BOXES];
+	uint64_t t_on;		/* start of the current slice */
+
+	/* Accumulated over the slices in which the event was scheduled */
+	uint64_t count;
+	uint64_t running;	/* ns */
+	unsigned int nslices;
+	double rate_sum;	/* sum of per-slice rates (events/ns) */
+	double rate_sum2;
+};
+
+/*
+ * Round-robin scheduler rotating event groups over the counters of each box.
+ * Every PMU type has groups of its own, so a type whose events fit in one
+ * group counts all the time, whatever the other types need.
+ */
+struct pmu_sched {
+	struct pmu_backend *be;
+	int socket;
+	int counters;		/* general-purpose counters per box */
+	unsigned int interval_ms;
+
+	struct pmu_event ev[PMU_MAX_EVENTS];
+	int nev;
+	int ngroups;		/* of the PMU type with the most */
+	int period;		/* slices until every type is back at its group 0 */
+	int cur;		/* slice, modulo period */
+
+	uint64_t t_start;
+	uint64_t t_total;	/* ns since pmu_sched_start() */
+};
+
+void pmu_sched_init(struct pmu_sched *s, struct pmu_backend *be, int socket,
+                    int counters, unsigned int interval_ms);
+int  pmu_sched_add(struct pmu_sched *s, const char *name, const char *pmu,
+                   const char *spec, double scale);
+int  pmu_sched_add_box(struct pmu_sched *s, const char *name, const char *pmu,
+                       int socket, int box, const char *spec, double scale);
+int  pmu_sched_add_preset(struct pmu_sched *s, const char *name);
+int  pmu_sched_build(struct pmu_sched *s);
+int  pmu_sched_start(struct pmu_sched *s);
+int  pmu_sched_rotate(struct pmu_sched *s);
+int  pmu_sched_stop(struct pmu_sched *s);
+/* Start, rotate every interval until duration (0: forever) or *stop, then stop */
+int  pmu_sched_run(struct pmu_sched *s, double duration,
+                   volatile sig_atomic_t *stop);
+void pmu_sched_close(struct pmu_sched *s);
+
+/*
+ * Scaled estimate of an event over the whole run and its standard error,
+ * both in events (multiplied by the event's scale).
+ */
+void pmu_sched_estimate(const struct pmu_sched *s, int i, double *estimate,
+                        double *error);
+int  pmu_sched_find(const struct pmu_sched *s, const char *name);
+void pmu_sched_print_rates(const struct pmu_sched *s, FILE *out);
+
+uint64_t pmu_now_ns(void);
+
+#endif /* DDIO_PMU_H */
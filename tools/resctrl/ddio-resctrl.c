@@ -0,0 +1,268 @@
+/*
+ * Configuring CAT/MBA through resctrl with pqos-compatible arguments
+ *
+ * Copyright (c) 2020, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+// Compile command: gcc -O2 ddio-resctrl.c resctrl.c -o ddio-resctrl
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "resctrl.h"
+
+#define MAX_COS	16
+
+/*
+ * Parse a domain list such as "0", "0,1" or "0-1" into a bitmask.
+ * An empty list means every domain of the current schemata.
+ */
+static int
+parse_domains(const char *s, const char *end, uint32_t *mask)
+{
+	*mask = 0;
+	while (s < end) {
+		unsigned int lo, hi;
+		int n;
+
+		if (sscanf(s, "%u-%u%n", &lo, &hi, &n) != 2) {
+			if (sscanf(s, "%u%n", &lo, &n) != 1)
+				return -1;
+			hi = lo;
+		}
+		if (hi >= 32 || lo > hi)
+			return -1;
+		for (; lo <= hi; lo++)
+			*mask |= 1u << lo;
+		s += n;
+		if (*s == ',')
+			s++;
+	}
+	return 0;
+}
+
+/*
+ * -e "llc@0:0=0x0C0;mba@0:0=40;mba@0:1=40;llc@0:1=0x600"
+ * i.e., <llc|mba>[@<domains>]:<cos>=<value>
+ */
+static int
+allocate(struct resctrl *rc, const char *arg)
+{
+	struct resctrl_schema want[MAX_COS];
+	struct resctrl_schema def;
+	char copy[1024], *tok, *save, name[RESCTRL_NAME_LEN];
+	int used[MAX_COS] = { 0 };
+	int cos, changed = 0, ret;
+
+	for (cos = 0; cos < MAX_COS; cos++)
+		resctrl_schema_init(&want[cos]);
+	if (resctrl_schema_read(rc, NULL, &def))
+		return -1;
+
+	snprintf(copy, sizeof(copy), "%s", arg);
+	for (tok = strtok_r(copy, ";", &save); tok; tok = strtok_r(NULL, ";", &save)) {
+		char *colon = strchr(tok, ':'), *eq = strchr(tok, '='), *at = strchr(tok, '@');
+		uint32_t domains = 0;
+		uint64_t value;
+		int is_llc, d;
+
+		while (*tok == ' ')
+			tok++;
+		if (!colon || !eq || colon > eq) {
+			fprintf(stderr, "Bad allocation '%s'\n", tok);
+			return -1;
+		}
+		is_llc = !strncmp(tok, "llc", 3) || !strncmp(tok, "l3", 2);
+		if (!is_llc && strncmp(tok, "mba", 3)) {
+			fprintf(stderr, "Unsupported resource in '%s'\n", tok);
+			return -1;
+		}
+		if (at && at < colon) {
+			if (parse_domains(at + 1, colon, &domains)) {
+				fprintf(stderr, "Bad domain list in '%s'\n", tok);
+				return -1;
+			}
+		} else {
+			for (d = 0; d < (is_llc ? def.nl3 : def.nmb); d++)
+				domains |= 1u << (is_llc ? def.l3_id[d] : def.mb_id[d]);
+		}
+		cos = atoi(colon + 1);
+		if (cos < 0 || cos >= MAX_COS) {
+			fprintf(stderr, "Bad class of service in '%s'\n", tok);
+			return -1;
+		}
+		value = strtoull(eq + 1, NULL, is_llc ? 16 : 10);
+
+		for (d = 0; d < 32; d++) {
+			if (!(domains >> d & 1))
+				continue;
+			if (is_llc)
+				resctrl_schema_set_l3(&want[cos], d, value);
+			else
+				resctrl_schema_set_mb(&want[cos], d, value);
+		}
+		used[cos] = 1;
+	}
+
+	for (cos = 0; cos < MAX_COS; cos++) {
+		if (!used[cos])
+			continue;
+		resctrl_cos_name(cos, name, sizeof(name));
+		if (resctrl_group_create(rc, name))
+			return -1;
+		ret = resctrl_schema_apply(rc, name, &want[cos], cos ? NULL : &def);
+		if (ret < 0)
+			return -1;
+		changed += ret;
+	}
+	return changed;
+}
+
+/*
+ * -a "llc:0=2;llc:1=0,1,3-17" (cores) or "pid:1=1234,5678" (tasks)
+ */
+static int
+associate(struct resctrl *rc, const char *arg)
+{
+	char copy[1024], *tok, *save, name[RESCTRL_NAME_LEN];
+
+	snprintf(copy, sizeof(copy), "%s", arg);
+	for (tok = strtok_r(copy, ";", &save); tok; tok = strtok_r(NULL, ";", &save)) {
+		char *colon = strchr(tok, ':'), *eq = strchr(tok, '=');
+		int cos;
+
+		while (*tok == ' ')
+			tok++;
+		if (!colon || !eq || colon > eq) {
+			fprintf(stderr, "Bad association '%s'\n", tok);
+			return -1;
+		}
+		cos = atoi(colon + 1);
+		resctrl_cos_name(cos, name, sizeof(name));
+		if (resctrl_group_create(rc, name))
+			return -1;
+
+		if (!strncmp(tok, "pid", 3)) {
+			char *pid, *psave;
+			for (pid = strtok_r(eq + 1, ",", &psave); pid; pid = strtok_r(NULL, ",", &psave))
+				if (resctrl_assign_task(rc, name, atoi(pid)))
+					return -1;
+		} else if (!strncmp(tok, "llc", 3) || !strncmp(tok, "core", 4)) {
+			if (resctrl_assign_cpus(rc, name, eq + 1))
+				return -1;
+		} else {
+			fprintf(stderr, "Unsupported association '%s'\n", tok);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static int
+show(struct resctrl *rc)
+{
+	char names[RESCTRL_MAX_GROUPS + 1][RESCTRL_NAME_LEN];
+	int i, j, n;
+
+	n = resctrl_group_list(rc, names + 1, RESCTRL_MAX_GROUPS);
+	if (n < 0)
+		return -1;
+	names[0][0] = '\0';
+	for (i = 0; i <= n; i++) {
+		struct resctrl_schema s;
+
+		if (resctrl_schema_read(rc, names[i], &s))
+			return -1;
+		printf("%s:", i ? names[i] : "default");
+		for (j = 0; j < s.nl3; j++)
+			printf(" L3@%d=0x%" PRIx64, s.l3_id[j], s.l3[j]);
+		for (j = 0; j < s.nmb; j++)
+			printf(" MB@%d=%" PRIu64, s.mb_id[j], s.mb[j]);
+		printf("\n");
+	}
+	return 0;
+}
+
+static void
+usage(const char *prog)
+{
+	printf("Usage: %s [options]\n", prog);
+	printf("\nOptions:\n");
+	printf("  -R          : Reset (remove all groups, full cache and bandwidth)\n");
+	printf("  -e alloc    : Set allocations, e.g., \"llc@0:1=0x600;mba@0:1=40\"\n");
+	printf("  -a assoc    : Associate cores/tasks, e.g., \"llc:1=0,1,3-17;pid:1=1234\"\n");
+	printf("                (cores are added to the COS, like pqos -a)\n");
+	printf("  -s          : Show the groups and their allocations\n");
+	printf("  -r path     : resctrl root (default: %s)\n", RESCTRL_ROOT);
+	printf("\nClass of service 0 is the default group and class <n> is group COS<n>.\n");
+	printf("Only the domains whose value changes are written.\n");
+	printf("\nExample:\n");
+	printf("  %s -e \"llc@0:0=0x0C0;mba@0:0=40;mba@0:1=40;llc@0:1=0x600\" -a \"llc:0=2;llc:1=0,1,3-17\"\n", prog);
+}
+
+int main(int argc, char *argv[])
+{
+	struct resctrl rc;
+	const char *root = NULL, *alloc = NULL, *assoc = NULL;
+	int reset = 0, do_show = 0, opt, changed = 0;
+	struct timespec t0, t1;
+
+	while ((opt = getopt(argc, argv, "Re:a:sr:h")) != -1) {
+		switch (opt) {
+		case 'R':
+			reset = 1;
+			break;
+		case 'e':
+			alloc = optarg;
+			break;
+		case 'a':
+			assoc = optarg;
+			break;
+		case 's':
+			do_show = 1;
+			break;
+		case 'r':
+			root = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+	if (!reset && !alloc && !assoc && !do_show) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (!root && access(RESCTRL_ROOT "/schemata", F_OK) && resctrl_mount(RESCTRL_ROOT))
+		return 1;
+	if (resctrl_open(&rc, root))
+		return 1;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	if (reset && resctrl_reset(&rc)) {
+		printf("Reset failed!\n");
+		return 1;
+	}
+	if (alloc && (changed = allocate(&rc, alloc)) < 0) {
+		printf("Allocation failed!\n");
+		return 1;
+	}
+	if (assoc && associate(&rc, assoc)) {
+		printf("Association failed!\n");
+		return 1;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	if (alloc || reset)
+		printf("%u domain(s) written in %.1f us\n", rc.writes,
+		       (t1.tv_sec - t0.tv_sec) * 1e6 + (t1.tv_nsec - t0.tv_nsec) / 1e3);
+	if (do_show && show(&rc))
+		return 1;
+	return 0;
+}
@@ -0,0 +1,416 @@
+/*
+ * Sampling per-group LLC occupancy and memory bandwidth via resctrl
+ *
+ * Copyright (c) 2020, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+// Compile command: gcc -O2 ddio-resmon.c resctrl.c -o ddio-resmon -lm
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <math.h>
+#include <sched.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "resctrl.h"
+
+#define MAX_GROUPS	16
+#define RING_MAGIC	"RMON"
+#define RING_VERSION	1
+
+/*
+ * The ring keeps the last `cap` records, one per (sample, group, domain).
+ * With -w it is written as a header, the group names and the records in
+ * chronological order.
+ */
+struct ring_header {
+	char magic[4];
+	uint32_t version;
+	uint32_t ngroups;
+	uint32_t interval_us;
+	uint64_t count;
+};
+
+struct ring_record {
+	uint64_t t_ns;			/* since the first sample */
+	uint16_t group;
+	uint16_t domain;
+	uint32_t valid;			/* bit e set if v[e] was read */
+	uint64_t v[RESCTRL_MON_EVENTS];
+};
+
+struct ring {
+	struct ring_record *rec;
+	uint64_t cap;
+	uint64_t head;			/* records written so far */
+};
+
+/*
+ * Summary of one group, summed over its domains
+ */
+struct group_stats {
+	char label[RESCTRL_NAME_LEN];
+	struct resctrl_mon mon;
+	uint64_t n;
+	double occ_sum, occ_sum2, occ_min, occ_max;
+	int have_prev[RESCTRL_MON_EVENTS];
+	uint64_t first[RESCTRL_MON_EVENTS], prev[RESCTRL_MON_EVENTS];
+	uint64_t t_first[RESCTRL_MON_EVENTS], t_prev[RESCTRL_MON_EVENTS];
+	/* Bytes and time before the last reset of the counter */
+	uint64_t bytes[RESCTRL_MON_EVENTS], t_span[RESCTRL_MON_EVENTS];
+	double bw_max[RESCTRL_MON_EVENTS];
+};
+
+static volatile sig_atomic_t stop;
+
+static void
+on_signal(int sig)
+{
+	(void)sig;
+	stop = 1;
+}
+
+static uint64_t
+now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void
+ring_push(struct ring *r, const struct ring_record *rec)
+{
+	r->rec[r->head % r->cap] = *rec;
+	r->head++;
+}
+
+static int
+ring_save(const struct ring *r, const char *path, struct group_stats *g, int ngroups,
+          unsigned int interval_ms)
+{
+	struct ring_header h = { RING_MAGIC, RING_VERSION, ngroups, interval_ms * 1000, 0 };
+	uint64_t i, first = r->head > r->cap ? r->head - r->cap : 0;
+	FILE *f = fopen(path, "wb");
+	int j;
+
+	if (!f) {
+		perror(path);
+		return -1;
+	}
+	h.count = r->head - first;
+	fwrite(&h, sizeof(h), 1, f);
+	for (j = 0; j < ngroups; j++)
+		fwrite(g[j].label, RESCTRL_NAME_LEN, 1, f);
+	for (i = first; i < r->head; i++)
+		fwrite(&r->rec[i % r->cap], sizeof(struct ring_record), 1, f);
+	return fclose(f);
+}
+
+static void
+print_record(FILE *out, const struct ring_record *rec, const char *label)
+{
+	int e;
+
+	fprintf(out, "%.6f,%s,%u", rec->t_ns / 1e9, label, rec->domain);
+	for (e = 0; e < RESCTRL_MON_EVENTS; e++) {
+		if (rec->valid >> e & 1)
+			fprintf(out, ",%" PRIu64, rec->v[e]);
+		else
+			fprintf(out, ",");
+	}
+	fprintf(out, "\n");
+}
+
+static void
+print_series_header(FILE *out)
+{
+	int e;
+
+	fprintf(out, "time,group,domain");
+	for (e = 0; e < RESCTRL_MON_EVENTS; e++)
+		fprintf(out, ",%s", resctrl_mon_event_names[e]);
+	fprintf(out, "\n");
+}
+
+/*
+ * Print a ring written with -w as CSV
+ */
+static int
+ring_print(const char *path, FILE *out)
+{
+	char labels[MAX_GROUPS][RESCTRL_NAME_LEN];
+	struct ring_header h;
+	struct ring_record rec;
+	FILE *f = fopen(path, "rb");
+	uint64_t i;
+
+	if (!f) {
+		perror(path);
+		return -1;
+	}
+	if (fread(&h, sizeof(h), 1, f) != 1 || memcmp(h.magic, RING_MAGIC, 4) ||
+	    h.version != RING_VERSION || h.ngroups > MAX_GROUPS ||
+	    fread(labels, RESCTRL_NAME_LEN, h.ngroups, f) != h.ngroups) {
+		fprintf(stderr, "%s: not a ddio-resmon ring\n", path);
+		fclose(f);
+		return -1;
+	}
+	print_series_header(out);
+	for (i = 0; i < h.count && fread(&rec, sizeof(rec), 1, f) == 1; i++)
+		print_record(out, &rec, rec.group < h.ngroups ? labels[rec.group] : "?");
+	fclose(f);
+	return 0;
+}
+
+static void
+sample(struct group_stats *g, int gi, struct ring *r, uint64_t t)
+{
+	uint64_t sum[RESCTRL_MON_EVENTS] = { 0 };
+	int valid[RESCTRL_MON_EVENTS] = { 0 };
+	int d, e;
+
+	for (d = 0; d < g->mon.ndomains; d++) {
+		struct ring_record rec = { t, gi, g->mon.domain[d], 0, { 0 } };
+
+		for (e = 0; e < RESCTRL_MON_EVENTS; e++) {
+			if (resctrl_mon_read(&g->mon, d, e, &rec.v[e]))
+				continue;
+			rec.valid |= 1u << e;
+			sum[e] += rec.v[e];
+			valid[e]++;
+		}
+		ring_push(r, &rec);
+	}
+
+	/* Only samples where every domain was read are summarized */
+	if (valid[RESCTRL_LLC_OCCUPANCY] == g->mon.ndomains) {
+		double occ = sum[RESCTRL_LLC_OCCUPANCY];
+
+		if (!g->n || occ < g->occ_min)
+			g->occ_min = occ;
+		if (!g->n || occ > g->occ_max)
+			g->occ_max = occ;
+		g->occ_sum += occ;
+		g->occ_sum2 += occ * occ;
+		g->n++;
+	}
+	for (e = RESCTRL_MBM_TOTAL; e < RESCTRL_MON_EVENTS; e++) {
+		if (valid[e] != g->mon.ndomains)
+			continue;
+		if (g->have_prev[e] && sum[e] < g->prev[e]) {
+			/* The counter was reset (e.g., the RMID was reused): restart the baseline */
+			fprintf(stderr, "%s: %s counter went back, restarting from it\n", g->label,
+			        e == RESCTRL_MBM_TOTAL ? "MBT" : "MBL");
+			g->bytes[e] += g->prev[e] - g->first[e];
+			g->t_span[e] += g->t_prev[e] - g->t_first[e];
+			g->have_prev[e] = 0;
+		}
+		if (!g->have_prev[e]) {
+			g->first[e] = sum[e];
+			g->t_first[e] = t;
+			g->have_prev[e] = 1;
+		} else if (t > g->t_prev[e]) {
+			double bw = (sum[e] - g->prev[e]) / ((t - g->t_prev[e]) / 1e9);
+
+			if (bw > g->bw_max[e])
+				g->bw_max[e] = bw;
+		}
+		g->prev[e] = sum[e];
+		g->t_prev[e] = t;
+	}
+}
+
+static void
+usage(const char *prog)
+{
+	printf("Usage: %s [options]\n", prog);
+	printf("\nOptions:\n");
+	printf("  -g groups   : Comma-separated list of groups (default: all, COS0 is the default group)\n");
+	printf("  -i ms       : Sampling interval in milliseconds (default: 100)\n");
+	printf("  -t seconds  : Measurement duration (default: until SIGINT/SIGTERM)\n");
+	printf("  -n records  : Ring capacity in records (default: 65536)\n");
+	printf("  -c cpu      : Pin the sampler to this CPU\n");
+	printf("  -w file     : Write the ring (binary) to file\n");
+	printf("  -p file     : Print a ring written with -w as CSV and exit\n");
+	printf("  -T          : Print the time series (CSV) before the results\n");
+	printf("  -r path     : resctrl root (default: %s)\n", RESCTRL_ROOT);
+	printf("  -o file     : Write results to file instead of stdout\n");
+	printf("\nExample:\n");
+	printf("  %s -c 35 -i 100 -w resmon.bin -o test.log\n", prog);
+}
+
+int main(int argc, char *argv[])
+{
+	struct resctrl rc;
+	struct ring ring = { NULL, 65536, 0 };
+	static struct group_stats g[MAX_GROUPS];
+	char names[RESCTRL_MAX_GROUPS][RESCTRL_NAME_LEN];
+	const char *root = NULL, *outfile = NULL, *ringfile = NULL, *group_list = NULL;
+	int ngroups = 0, series = 0, cpu = -1, opt, i, e, n;
+	unsigned int interval_ms = 100;
+	double duration = 0;
+	uint64_t t0, next;
+	FILE *out = stdout;
+
+	while ((opt = getopt(argc, argv, "g:i:t:n:c:w:p:Tr:o:h")) != -1) {
+		switch (opt) {
+		case 'g':
+			group_list = optarg;
+			break;
+		case 'i':
+			interval_ms = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			duration = atof(optarg);
+			break;
+		case 'n':
+			ring.cap = strtoull(optarg, NULL, 0);
+			break;
+		case 'c':
+			cpu = atoi(optarg);
+			break;
+		case 'w':
+			ringfile = optarg;
+			break;
+		case 'p':
+			return ring_print(optarg, stdout) ? 1 : 0;
+		case 'T':
+			series = 1;
+			break;
+		case 'r':
+			root = optarg;
+			break;
+		case 'o':
+			outfile = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+	if (!interval_ms || !ring.cap) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (cpu >= 0) {
+		cpu_set_t set;
+
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		if (sched_setaffinity(0, sizeof(set), &set))
+			perror("sched_setaffinity");
+	}
+
+	if (resctrl_open(&rc, root))
+		return 1;
+
+	/* The default group is labelled COS0, as in pqos */
+	if (group_list) {
+		char copy[1024], *tok, *save;
+
+		snprintf(copy, sizeof(copy), "%s", group_list);
+		for (tok = strtok_r(copy, ",", &save); tok && ngroups < MAX_GROUPS;
+		     tok = strtok_r(NULL, ",", &save))
+			snprintf(g[ngroups++].label, RESCTRL_NAME_LEN, "%.*s", RESCTRL_NAME_LEN - 1, tok);
+	} else {
+		n = resctrl_group_list(&rc, names, RESCTRL_MAX_GROUPS);
+		if (n < 0)
+			return 1;
+		snprintf(g[ngroups++].label, RESCTRL_NAME_LEN, "COS0");
+		for (i = 0; i < n && ngroups < MAX_GROUPS; i++)
+			snprintf(g[ngroups++].label, RESCTRL_NAME_LEN, "%.*s", RESCTRL_NAME_LEN - 1, names[i]);
+	}
+	for (i = 0; i < ngroups; i++) {
+		const char *group = strcmp(g[i].label, "COS0") && strcmp(g[i].label, "default") ?
+		                    g[i].label : NULL;
+
+		if (resctrl_mon_open(&rc, group, &g[i].mon))
+			return 1;
+	}
+
+	ring.rec = calloc(ring.cap, sizeof(struct ring_record));
+	if (!ring.rec) {
+		perror("calloc");
+		return 1;
+	}
+
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+
+	t0 = now_ns();
+	next = t0;
+	while (!stop) {
+		uint64_t t = now_ns();
+		struct timespec ts;
+
+		for (i = 0; i < ngroups; i++)
+			sample(&g[i], i, &ring, t - t0);
+		if (duration > 0 && t - t0 >= duration * 1e9)
+			break;
+
+		next += interval_ms * 1000000ull;
+		ts.tv_sec = next / 1000000000ull;
+		ts.tv_nsec = next % 1000000000ull;
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+	}
+
+	if (ringfile && ring_save(&ring, ringfile, g, ngroups, interval_ms))
+		return 1;
+
+	if (outfile) {
+		out = fopen(outfile, "w");
+		if (!out) {
+			perror(outfile);
+			return 1;
+		}
+	}
+
+	if (series) {
+		uint64_t r, first = ring.head > ring.cap ? ring.head - ring.cap : 0;
+
+		print_series_header(out);
+		for (r = first; r < ring.head; r++)
+			print_record(out, &ring.rec[r % ring.cap], g[ring.rec[r % ring.cap].group].label);
+	}
+
+	for (i = 0; i < ngroups; i++) {
+		const char *l = g[i].label;
+
+		if (g[i].n) {
+			double avg = g[i].occ_sum / g[i].n;
+			double var = g[i].occ_sum2 / g[i].n - avg * avg;
+
+			fprintf(out, "RESULT-%s-LLCOCCUPANCY-AVG %f\n", l, avg);
+			fprintf(out, "RESULT-%s-LLCOCCUPANCY-MIN %.0f\n", l, g[i].occ_min);
+			fprintf(out, "RESULT-%s-LLCOCCUPANCY-MAX %.0f\n", l, g[i].occ_max);
+			fprintf(out, "RESULT-%s-LLCOCCUPANCY-STD %f\n", l, var > 0 ? sqrt(var) : 0);
+		}
+		for (e = RESCTRL_MBM_TOTAL; e < RESCTRL_MON_EVENTS; e++) {
+			const char *ev = e == RESCTRL_MBM_TOTAL ? "MBT" : "MBL";
+			double dt = (g[i].t_span[e] + g[i].t_prev[e] - g[i].t_first[e]) / 1e9;
+
+			if (!g[i].have_prev[e] || dt <= 0)
+				continue;
+			fprintf(out, "RESULT-%s-%s-BW %f\n", l, ev,
+			        (g[i].bytes[e] + g[i].prev[e] - g[i].first[e]) / dt);
+			fprintf(out, "RESULT-%s-%s-BW-MAX %f\n", l, ev, g[i].bw_max[e]);
+		}
+	}
+	fprintf(stderr, "%" PRIu64 " records sampled (%" PRIu64 " kept)\n", ring.head,
+	        ring.head < ring.cap ? ring.head : ring.cap);
+
+	if (out != stdout)
+		fclose(out);
+	for (i = 0; i < ngroups; i++)
+		resctrl_mon_close(&g[i].mon);
+	free(ring.rec);
+	return 0;
+}
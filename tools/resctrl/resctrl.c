@@ -0,0 +1,621 @@
+/*
+ * Cache Allocation (CAT) and Memory Bandwidth Allocation (MBA) via resctrl
+ *
+ * Copyright (c) 2020, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+#include <sys/mount.h>
+
+#include "resctrl.h"
+
+#define RDTGROUP_SUPER_MAGIC	0x7655821
+
+static int
+is_default(const char *group)
+{
+	return !group || !group[0] || !strcmp(group, ".");
+}
+
+static void
+group_path(const struct resctrl *rc, const char *group, const char *file,
+           char *buf, size_t len)
+{
+	if (is_default(group))
+		snprintf(buf, len, "%s/%s", rc->root, file ? file : "");
+	else
+		snprintf(buf, len, "%s/%s/%s", rc->root, group, file ? file : "");
+}
+
+static int
+read_file(const char *path, char *buf, size_t len)
+{
+	ssize_t n;
+	int fd = open(path, O_RDONLY);
+
+	if (fd < 0)
+		return -1;
+	n = read(fd, buf, len - 1);
+	close(fd);
+	if (n < 0)
+		return -1;
+	buf[n] = '\0';
+	return 0;
+}
+
+/*
+ * resctrl reports the reason of a rejected write in info/last_cmd_status
+ */
+static void
+print_status(const struct resctrl *rc, const char *what)
+{
+	char path[RESCTRL_PATH_LEN], buf[256];
+
+	snprintf(path, sizeof(path), "%s/info/last_cmd_status", rc->root);
+	if (!read_file(path, buf, sizeof(buf))) {
+		buf[strcspn(buf, "\n")] = '\0';
+		fprintf(stderr, "%s: %s\n", what, buf);
+	} else {
+		fprintf(stderr, "%s: %s\n", what, strerror(errno));
+	}
+}
+
+static int
+write_file(const struct resctrl *rc, const char *path, const char *buf)
+{
+	int flags = O_WRONLY | O_TRUNC | (rc->is_resctrlfs ? 0 : O_CREAT);
+	size_t len = strlen(buf);
+	int fd = open(path, flags, 0644);
+
+	if (fd < 0) {
+		perror(path);
+		return -1;
+	}
+	if (write(fd, buf, len) != (ssize_t)len) {
+		print_status(rc, path);
+		close(fd);
+		return -1;
+	}
+	close(fd);
+	return 0;
+}
+
+int
+resctrl_mount(const char *root)
+{
+	if (mount("resctrl", root, "resctrl", 0, NULL) && errno != EBUSY) {
+		perror("mount resctrl");
+		return -1;
+	}
+	return 0;
+}
+
+int
+resctrl_open(struct resctrl *rc, const char *root)
+{
+	char path[RESCTRL_PATH_LEN], buf[64];
+	struct statfs sfs;
+	struct stat st;
+
+	memset(rc, 0, sizeof(*rc));
+	snprintf(rc->root, sizeof(rc->root), "%s", root ? root : RESCTRL_ROOT);
+
+	if (stat(rc->root, &st) || !S_ISDIR(st.st_mode)) {
+		fprintf(stderr, "%s is not a directory\n", rc->root);
+		return -1;
+	}
+	if (!statfs(rc->root, &sfs) && sfs.f_type == RDTGROUP_SUPER_MAGIC)
+		rc->is_resctrlfs = 1;
+
+	snprintf(path, sizeof(path), "%s/info/L3/cbm_mask", rc->root);
+	if (!read_file(path, buf, sizeof(buf)))
+		rc->cbm_mask = strtoull(buf, NULL, 16);
+	return 0;
+}
+
+void
+resctrl_cos_name(unsigned int cos, char *name, size_t len)
+{
+	if (cos == 0)
+		snprintf(name, len, "%s", "");
+	else
+		snprintf(name, len, "COS%u", cos);
+}
+
+int
+resctrl_group_create(struct resctrl *rc, const char *group)
+{
+	char path[RESCTRL_PATH_LEN];
+
+	if (is_default(group))
+		return 0;
+	group_path(rc, group, NULL, path, sizeof(path));
+	if (mkdir(path, 0755) && errno != EEXIST) {
+		perror(path);
+		return -1;
+	}
+	return 0;
+}
+
+int
+resctrl_group_remove(struct resctrl *rc, const char *group)
+{
+	char path[RESCTRL_PATH_LEN], file[RESCTRL_PATH_LEN + 256];
+	struct dirent *de;
+	DIR *dir;
+
+	if (is_default(group))
+		return 0;
+	group_path(rc, group, NULL, path, sizeof(path));
+	if (!rmdir(path) || errno == ENOENT)
+		return 0;
+
+	/* A plain directory tree keeps the files we wrote; drop them first */
+	if (errno != ENOTEMPTY || rc->is_resctrlfs) {
+		perror(path);
+		return -1;
+	}
+	dir = opendir(path);
+	if (!dir)
+		return -1;
+	while ((de = readdir(dir))) {
+		if (de->d_type != DT_REG)
+			continue;
+		snprintf(file, sizeof(file), "%s/%s", path, de->d_name);
+		unlink(file);
+	}
+	closedir(dir);
+	if (rmdir(path)) {
+		perror(path);
+		return -1;
+	}
+	return 0;
+}
+
+int
+resctrl_group_list(struct resctrl *rc, char names[][RESCTRL_NAME_LEN], int max)
+{
+	struct dirent *de;
+	DIR *dir = opendir(rc->root);
+	int n = 0;
+
+	if (!dir) {
+		perror(rc->root);
+		return -1;
+	}
+	while ((de = readdir(dir)) && n < max) {
+		if (de->d_type != DT_DIR || de->d_name[0] == '.')
+			continue;
+		if (!strcmp(de->d_name, "info") || !strcmp(de->d_name, "mon_groups") ||
+		    !strcmp(de->d_name, "mon_data"))
+			continue;
+		snprintf(names[n++], RESCTRL_NAME_LEN, "%.*s", RESCTRL_NAME_LEN - 1, de->d_name);
+	}
+	closedir(dir);
+	return n;
+}
+
+void
+resctrl_schema_init(struct resctrl_schema *s)
+{
+	memset(s, 0, sizeof(*s));
+}
+
+static int
+set_domain(int *n, int *ids, uint64_t *vals, int domain, uint64_t value)
+{
+	int i;
+
+	for (i = 0; i < *n; i++) {
+		if (ids[i] == domain) {
+			vals[i] = value;
+			return 0;
+		}
+	}
+	if (*n == RESCTRL_MAX_DOMAINS)
+		return -1;
+	ids[*n] = domain;
+	vals[*n] = value;
+	(*n)++;
+	return 0;
+}
+
+int
+resctrl_schema_set_l3(struct resctrl_schema *s, int domain, uint64_t mask)
+{
+	return set_domain(&s->nl3, s->l3_id, s->l3, domain, mask);
+}
+
+int
+resctrl_schema_set_mb(struct resctrl_schema *s, int domain, uint64_t value)
+{
+	return set_domain(&s->nmb, s->mb_id, s->mb, domain, value);
+}
+
+/*
+ * Schemata lines look like "    L3:0=7ff;1=7ff" and "    MB:0=100;1=100".
+ * Other resources (e.g., L3CODE/L3DATA with CDP) are ignored.
+ */
+int
+resctrl_schema_parse(const char *text, struct resctrl_schema *s)
+{
+	const char *line = text;
+
+	resctrl_schema_init(s);
+	while (line && *line) {
+		const char *end = strchr(line, '\n');
+		const char *p = line;
+		int is_l3, is_mb;
+
+		while (*p == ' ' || *p == '\t')
+			p++;
+		is_l3 = !strncmp(p, "L3:", 3);
+		is_mb = !strncmp(p, "MB:", 3);
+		if (is_l3 || is_mb) {
+			p += 3;
+			while (*p && *p != '\n') {
+				unsigned int id;
+				char *next;
+				uint64_t v;
+
+				if (sscanf(p, "%u=", &id) != 1)
+					return -1;
+				p = strchr(p, '=') + 1;
+				v = strtoull(p, &next, is_l3 ? 16 : 10);
+				if (next == p)
+					return -1;
+				if (is_l3)
+					resctrl_schema_set_l3(s, id, v);
+				else
+					resctrl_schema_set_mb(s, id, v);
+				p = next;
+				while (*p == ';' || *p == ' ')
+					p++;
+			}
+		}
+		line = end ? end + 1 : NULL;
+	}
+	return 0;
+}
+
+int
+resctrl_schema_read(struct resctrl *rc, const char *group, struct resctrl_schema *s)
+{
+	char path[RESCTRL_PATH_LEN], buf[4096];
+
+	group_path(rc, group, "schemata", path, sizeof(path));
+	if (read_file(path, buf, sizeof(buf))) {
+		/* A freshly created group of a plain directory tree has no file yet */
+		if (!rc->is_resctrlfs && errno == ENOENT) {
+			resctrl_schema_init(s);
+			return 0;
+		}
+		perror(path);
+		return -1;
+	}
+	return resctrl_schema_parse(buf, s);
+}
+
+static int
+lookup(int n, const int *ids, const uint64_t *vals, int domain, uint64_t *value)
+{
+	int i;
+
+	for (i = 0; i < n; i++) {
+		if (ids[i] == domain) {
+			*value = vals[i];
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Append "<res>:<id>=<val>;..." for the domains that changed.
+ */
+static int
+diff_line(char *buf, size_t len, const char *res, const char *fmt,
+          int n, const int *ids, const uint64_t *vals,
+          int cn, const int *cids, const uint64_t *cvals)
+{
+	size_t off = strlen(buf);
+	int i, changed = 0;
+
+	for (i = 0; i < n; i++) {
+		uint64_t old;
+
+		if (vals[i] == RESCTRL_UNSET)
+			continue;
+		if (lookup(cn, cids, cvals, ids[i], &old) && old == vals[i])
+			continue;
+		off += snprintf(buf + off, len - off, changed ? ";" : "%s:", res);
+		off += snprintf(buf + off, len - off, "%d=", ids[i]);
+		off += snprintf(buf + off, len - off, fmt, vals[i]);
+		changed++;
+	}
+	if (changed)
+		snprintf(buf + off, len - off, "\n");
+	return changed;
+}
+
+int
+resctrl_schema_apply(struct resctrl *rc, const char *group,
+                     const struct resctrl_schema *want,
+                     const struct resctrl_schema *cur)
+{
+	struct resctrl_schema now;
+	char path[RESCTRL_PATH_LEN], buf[1024] = "";
+	int changed;
+
+	if (!cur) {
+		if (resctrl_schema_read(rc, group, &now))
+			return -1;
+		cur = &now;
+	}
+
+	changed = diff_line(buf, sizeof(buf), "L3", "%" PRIx64, want->nl3, want->l3_id,
+	                    want->l3, cur->nl3, cur->l3_id, cur->l3);
+	changed += diff_line(buf, sizeof(buf), "MB", "%" PRIu64, want->nmb, want->mb_id,
+	                     want->mb, cur->nmb, cur->mb_id, cur->mb);
+	if (!changed)
+		return 0;
+
+	/*
+	 * resctrlfs keeps the domains a write leaves out, a plain file does
+	 * not: write all of them, the current ones with the changes.
+	 */
+	if (!rc->is_resctrlfs) {
+		struct resctrl_schema all = *cur;
+		int i;
+
+		for (i = 0; i < want->nl3; i++)
+			if (want->l3[i] != RESCTRL_UNSET)
+				resctrl_schema_set_l3(&all, want->l3_id[i], want->l3[i]);
+		for (i = 0; i < want->nmb; i++)
+			if (want->mb[i] != RESCTRL_UNSET)
+				resctrl_schema_set_mb(&all, want->mb_id[i], want->mb[i]);
+		buf[0] = '\0';
+		diff_line(buf, sizeof(buf), "L3", "%" PRIx64, all.nl3, all.l3_id, all.l3, 0, NULL, NULL);
+		diff_line(buf, sizeof(buf), "MB", "%" PRIu64, all.nmb, all.mb_id, all.mb, 0, NULL, NULL);
+	}
+
+	group_path(rc, group, "schemata", path, sizeof(path));
+	if (write_file(rc, path, buf))
+		return -1;
+	rc->writes += changed;
+	return changed;
+}
+
+/*
+ * CPU lists ("0,1,3-17") as bitmaps
+ */
+#define MAX_CPUS	1024
+
+static int
+cpulist_parse(const char *list, uint64_t *bits)
+{
+	const char *p = list;
+
+	memset(bits, 0, MAX_CPUS / 8);
+	while (*p && *p != '\n') {
+		unsigned int lo, hi;
+		int n;
+
+		if (sscanf(p, "%u-%u%n", &lo, &hi, &n) != 2) {
+			if (sscanf(p, "%u%n", &lo, &n) != 1)
+				return -1;
+			hi = lo;
+		}
+		if (hi >= MAX_CPUS || lo > hi)
+			return -1;
+		for (; lo <= hi; lo++)
+			bits[lo / 64] |= 1ull << (lo % 64);
+		p += n;
+		if (*p == ',')
+			p++;
+	}
+	return 0;
+}
+
+static void
+cpulist_format(const uint64_t *bits, char *buf, size_t len)
+{
+	size_t off = 0;
+	int cpu, start = -1;
+
+	buf[0] = '\0';
+	for (cpu = 0; cpu <= MAX_CPUS; cpu++) {
+		int set = cpu < MAX_CPUS && (bits[cpu / 64] >> (cpu % 64) & 1);
+
+		if (set && start < 0)
+			start = cpu;
+		if (!set && start >= 0) {
+			off += snprintf(buf + off, len - off, off ? ",%d" : "%d", start);
+			if (cpu - 1 > start)
+				off += snprintf(buf + off, len - off, "-%d", cpu - 1);
+			start = -1;
+		}
+		if (off >= len)
+			break;
+	}
+}
+
+/*
+ * On resctrlfs, CPUs leave their group when they are written to another
+ * one; a plain tree needs them dropped from the other lists by hand.
+ */
+static int
+drop_cpus(struct resctrl *rc, const char *group, const uint64_t *cpus)
+{
+	char names[RESCTRL_MAX_GROUPS + 1][RESCTRL_NAME_LEN], path[RESCTRL_PATH_LEN], buf[4096];
+	uint64_t cur[MAX_CPUS / 64];
+	int i, j, n, changed;
+
+	n = resctrl_group_list(rc, names, RESCTRL_MAX_GROUPS);
+	if (n < 0)
+		return -1;
+	names[n++][0] = '\0';		/* the default group */
+	for (i = 0; i < n; i++) {
+		if (is_default(names[i]) ? is_default(group) : !is_default(group) && !strcmp(names[i], group))
+			continue;
+		group_path(rc, names[i], "cpus_list", path, sizeof(path));
+		if (read_file(path, buf, sizeof(buf)) || cpulist_parse(buf, cur))
+			continue;
+		for (j = changed = 0; j < MAX_CPUS / 64; j++) {
+			changed |= (cur[j] & cpus[j]) != 0;
+			cur[j] &= ~cpus[j];
+		}
+		if (!changed)
+			continue;
+		cpulist_format(cur, buf, sizeof(buf) - 1);
+		strcat(buf, "\n");
+		if (write_file(rc, path, buf))
+			return -1;
+	}
+	return 0;
+}
+
+/*
+ * Like pqos -a, the CPUs are added to the group: the ones it has stay.
+ * (CPUs cannot be dropped from the default group directly anyway; they
+ * leave it when they are written to another group.)
+ */
+int
+resctrl_assign_cpus(struct resctrl *rc, const char *group, const char *cpulist)
+{
+	char path[RESCTRL_PATH_LEN], buf[4096];
+	uint64_t add[MAX_CPUS / 64], want[MAX_CPUS / 64], cur[MAX_CPUS / 64];
+	int i;
+
+	if (cpulist_parse(cpulist, add)) {
+		fprintf(stderr, "Bad CPU list '%s'\n", cpulist);
+		return -1;
+	}
+	memcpy(want, add, sizeof(want));
+	group_path(rc, group, "cpus_list", path, sizeof(path));
+	if (!read_file(path, buf, sizeof(buf)) && !cpulist_parse(buf, cur)) {
+		for (i = 0; i < MAX_CPUS / 64; i++)
+			want[i] |= cur[i];
+	}
+	cpulist_format(want, buf, sizeof(buf) - 1);
+	strcat(buf, "\n");
+	if (write_file(rc, path, buf))
+		return -1;
+	return rc->is_resctrlfs ? 0 : drop_cpus(rc, group, add);
+}
+
+int
+resctrl_assign_task(struct resctrl *rc, const char *group, pid_t pid)
+{
+	char path[RESCTRL_PATH_LEN], buf[32];
+
+	group_path(rc, group, "tasks", path, sizeof(path));
+	snprintf(buf, sizeof(buf), "%d\n", (int)pid);
+	return write_file(rc, path, buf);
+}
+
+int
+resctrl_reset(struct resctrl *rc)
+{
+	char names[RESCTRL_MAX_GROUPS][RESCTRL_NAME_LEN];
+	struct resctrl_schema cur, want;
+	int i, n;
+
+	n = resctrl_group_list(rc, names, RESCTRL_MAX_GROUPS);
+	if (n < 0)
+		return -1;
+	for (i = 0; i < n; i++)
+		if (resctrl_group_remove(rc, names[i]))
+			return -1;
+
+	if (resctrl_schema_read(rc, NULL, &cur))
+		return -1;
+	resctrl_schema_init(&want);
+	for (i = 0; i < cur.nl3 && rc->cbm_mask; i++)
+		resctrl_schema_set_l3(&want, cur.l3_id[i], rc->cbm_mask);
+	for (i = 0; i < cur.nmb; i++)
+		resctrl_schema_set_mb(&want, cur.mb_id[i], 100);
+	return resctrl_schema_apply(rc, NULL, &want, &cur) < 0 ? -1 : 0;
+}
+
+const char *resctrl_mon_event_names[RESCTRL_MON_EVENTS] = {
+	"llc_occupancy", "mbm_total_bytes", "mbm_local_bytes",
+};
+
+int
+resctrl_mon_open(struct resctrl *rc, const char *group, struct resctrl_mon *m)
+{
+	char path[RESCTRL_PATH_LEN], file[RESCTRL_PATH_LEN + 320];
+	struct dirent *de;
+	DIR *dir;
+	int e;
+
+	memset(m, 0, sizeof(*m));
+	group_path(rc, group, "mon_data", path, sizeof(path));
+	dir = opendir(path);
+	if (!dir) {
+		perror(path);
+		return -1;
+	}
+	while ((de = readdir(dir)) && m->ndomains < RESCTRL_MAX_DOMAINS) {
+		int id;
+
+		if (sscanf(de->d_name, "mon_L3_%d", &id) != 1)
+			continue;
+		m->domain[m->ndomains] = id;
+		for (e = 0; e < RESCTRL_MON_EVENTS; e++) {
+			snprintf(file, sizeof(file), "%s/%s/%s", path, de->d_name,
+			         resctrl_mon_event_names[e]);
+			m->fd[m->ndomains][e] = open(file, O_RDONLY);
+		}
+		m->ndomains++;
+	}
+	closedir(dir);
+	if (!m->ndomains) {
+		fprintf(stderr, "%s: no monitoring domains\n", path);
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Returns -1 if the event is not supported or the kernel reports
+ * "Unavailable" (e.g., the RMID was recycled) or "Error".
+ */
+int
+resctrl_mon_read(const struct resctrl_mon *m, int d, int ev, uint64_t *value)
+{
+	char buf[32], *end;
+	ssize_t n;
+
+	if (m->fd[d][ev] < 0)
+		return -1;
+	n = pread(m->fd[d][ev], buf, sizeof(buf) - 1, 0);
+	if (n <= 0)
+		return -1;
+	buf[n] = '\0';
+	*value = strtoull(buf, &end, 10);
+	return end == buf ? -1 : 0;
+}
+
+void
+resctrl_mon_close(struct resctrl_mon *m)
+{
+	int d, e;
+
+	for (d = 0; d < m->ndomains; d++)
+		for (e = 0; e < RESCTRL_MON_EVENTS; e++)
+			if (m->fd[d][e] >= 0)
+				close(m->fd[d][e]);
+	m->ndomains = 0;
+}
@@ -0,0 +1,102 @@
+/*
+ * Cache Allocation (CAT) and Memory Bandwidth Allocation (MBA) via resctrl
+ *
+ * Copyright (c) 2020, Alireza Farshin, KTH Royal Institute of Technology - All Rights Reserved
+ */
+
+#ifndef DDIO_RESCTRL_H
+#define DDIO_RESCTRL_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#define RESCTRL_ROOT		"/sys/fs/resctrl"
+#define RESCTRL_MAX_DOMAINS	16
+#define RESCTRL_MAX_GROUPS	64
+#define RESCTRL_NAME_LEN	64
+#define RESCTRL_PATH_LEN	512
+
+/*
+ * Allocation of one group (i.e., one class of service).
+ * A value of RESCTRL_UNSET means "do not touch this domain".
+ */
+#define RESCTRL_UNSET		(~0ull)
+
+struct resctrl_schema {
+	int nl3;
+	int l3_id[RESCTRL_MAX_DOMAINS];
+	uint64_t l3[RESCTRL_MAX_DOMAINS];	/* capacity bitmask */
+	int nmb;
+	int mb_id[RESCTRL_MAX_DOMAINS];
+	uint64_t mb[RESCTRL_MAX_DOMAINS];	/* percent (or MBps with mba_MBps) */
+};
+
+struct resctrl {
+	char root[RESCTRL_PATH_LEN / 2];
+	int is_resctrlfs;	/* 0 for a plain directory tree (e.g., tests) */
+	uint64_t cbm_mask;	/* info/L3/cbm_mask, 0 if unknown */
+	unsigned int writes;	/* schemata lines written so far */
+};
+
+/*
+ * Group names: NULL, "" or "." is the default (root) group.
+ * resctrl_cos_name() maps a pqos class of service to a group: COS0 is the
+ * default group and COS<n> is a group named "COS<n>".
+ */
+int  resctrl_open(struct resctrl *rc, const char *root);
+int  resctrl_mount(const char *root);
+void resctrl_cos_name(unsigned int cos, char *name, size_t len);
+
+int  resctrl_group_create(struct resctrl *rc, const char *group);
+int  resctrl_group_remove(struct resctrl *rc, const char *group);
+int  resctrl_group_list(struct resctrl *rc, char names[][RESCTRL_NAME_LEN], int max);
+
+void resctrl_schema_init(struct resctrl_schema *s);
+int  resctrl_schema_parse(const char *text, struct resctrl_schema *s);
+int  resctrl_schema_read(struct resctrl *rc, const char *group, struct resctrl_schema *s);
+int  resctrl_schema_set_l3(struct resctrl_schema *s, int domain, uint64_t mask);
+int  resctrl_schema_set_mb(struct resctrl_schema *s, int domain, uint64_t value);
+
+/*
+ * Write only the domains of `want` that differ from `cur` (which is read
+ * from the group when NULL). Returns the number of domains written.
+ */
+int  resctrl_schema_apply(struct resctrl *rc, const char *group,
+                          const struct resctrl_schema *want,
+                          const struct resctrl_schema *cur);
+
+/* Adds the CPUs to the group, like pqos -a; they leave their previous group */
+int  resctrl_assign_cpus(struct resctrl *rc, const char *group, const char *cpulist);
+int  resctrl_assign_task(struct resctrl *rc, const char *group, pid_t pid);
+
+/*
+ * Monitoring (CMT/MBM) events of a group, read from
+ * mon_data/mon_L3_<domain>/<event>. The files are kept open so that
+ * a sample costs one pread() per file.
+ */
+enum resctrl_mon_event {
+	RESCTRL_LLC_OCCUPANCY,	/* bytes */
+	RESCTRL_MBM_TOTAL,	/* bytes, monotonic */
+	RESCTRL_MBM_LOCAL,	/* bytes, monotonic */
+	RESCTRL_MON_EVENTS
+};
+
+struct resctrl_mon {
+	int ndomains;
+	int domain[RESCTRL_MAX_DOMAINS];
+	int fd[RESCTRL_MAX_DOMAINS][RESCTRL_MON_EVENTS];	/* -1 if not supported */
+};
+
+extern const char *resctrl_mon_event_names[RESCTRL_MON_EVENTS];
+
+int  resctrl_mon_open(struct resctrl *rc, const char *group, struct resctrl_mon *m);
+int  resctrl_mon_read(const struct resctrl_mon *m, int d, int ev, uint64_t *value);
+void resctrl_mon_close(struct resctrl_mon *m);
+
+/*
+ * Same as `pqos -R`: remove every group and give the default group
+ * the full cache and memory bandwidth.
+ */
+int  resctrl_reset(struct resctrl *rc);
+
+#endif /* DDIO_RESCTRL_H */